@@ -4,10 +4,18 @@
 #include "Actors/CalloutsManager.h"
 
 #include "EngineUtils.h"
+#include "Actors/GameManager.h"
+#include "Actors/WfActorPool.h"
 #include "Actors/WfPropertyActor.h"
+#include "Actors/WfVoxManager.h"
+#include "Kismet/GameplayStatics.h"
 #include "Lib/WfCalloutData.h"
+#include "Lib/WfIncidentJournal.h"
+#include "Lib/WfSimTimings.h"
 #include "Logging/StructuredLog.h"
+#include "Misc/Paths.h"
 #include "Statics/WfGameModeBase.h"
+#include "Vehicles/WfFireApparatusBase.h"
 
 
 ACalloutsManager* ACalloutsManager::Instance = nullptr;
@@ -26,6 +34,16 @@ void ACalloutsManager::BeginPlay()
 		Instance = this;
 
 		//GetWorldTimerManager().SetTimer(CalloutTimerHandle, this, &ACalloutsManager::GenerateCallout, 300.0f, true);
+
+		if (HasAuthority())
+		{
+			if (!Lifecycle.IsCompiled())
+				BuildLifecycle();
+			FWfIncidentJournal::Get().Start(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Journal"),
+				FString::Printf(TEXT("Incidents-%s.wfj"), *FDateTime::UtcNow().ToString(TEXT("%Y%m%d-%H%M%S")))));
+			GetWorldTimerManager().SetTimer(IncidentTimerHandle,
+				this, &ACalloutsManager::UpdateIncidents, IncidentUpdateSeconds, true);
+		}
 	}
 	else
 	{
@@ -36,6 +54,8 @@ void ACalloutsManager::BeginPlay()
 void ACalloutsManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
+	if (Instance == this && HasAuthority())
+		FWfIncidentJournal::Get().Stop();
 	if (Instance)
 	{
 		Instance = nullptr;
@@ -120,7 +140,7 @@ void ACalloutsManager::Server_ForceCallout_Implementation(const FName& CalloutTy
 }
 
 /**
- * \brief Creates a new callout, spawning the actor and all necessary actors/data to do so.
+ * \brief Creates a new callout as an incident record, and pre-alerts it. The actor is spawned by the lifecycle.
  * Preform all logic before calling parent/super. This completes all logic in creating the callout.
  * \param CalloutType The Data Table Row Name of the callout to be created. It has been validated by this point.
  * \param CalloutData Data for callout creation. Can be passed in with custom data. Will be modified during execution.
@@ -128,24 +148,17 @@ void ACalloutsManager::Server_ForceCallout_Implementation(const FName& CalloutTy
  */
 void ACalloutsManager::CreateCallout(const FName& CalloutType, FCalloutData& CalloutData)
 {
+	WF_SCOPE_CYCLE(STAT_WfCalloutGeneration, TEXT("CalloutGeneration"));
 	if (!HasAuthority())
 	{
-		CalloutData.CallLogging.Add("Cannot Execute on Client - Must Run on Server.");
+		FWfIncidentJournal::Get().Record(FWfIncidentJournal::ServerJournalId, EWfJournalEvent::CalloutRejected, FName(TEXT("NotAuthority")));
 		return;
 	}
 
-	// Try to spawn the callout actor at the same location as the call itself, just for organization.
-	FTransform SpawnTransform(FVector(0.0f));
-	if (IsValid(CalloutData.PropertyActor))
-	{
-		SpawnTransform.SetLocation(CalloutData.PropertyActor->GetActorLocation());
-		SpawnTransform.SetRotation(CalloutData.PropertyActor->GetActorQuat());
-	}
-
 	const AWfGameModeBase* GameMode = Cast<AWfGameModeBase>(GetWorld()->GetAuthGameMode());
 	if (!IsValid(GameMode))
 	{
-		CalloutData.CallLogging.Add("Invalid GameMode");
+		FWfIncidentJournal::Get().Record(FWfIncidentJournal::ServerJournalId, EWfJournalEvent::CalloutRejected, FName(TEXT("InvalidGameMode")));
 		UE_LOGFMT(LogCallouts, Display, "ACalloutsManager({NetMode}): Failed to Generate Callout - Invalid GameMode"
 			, HasAuthority() ? "SRV" : "CLI");
 		return;
@@ -154,7 +167,7 @@ void ACalloutsManager::CreateCallout(const FName& CalloutType, FCalloutData& Cal
 	UDataTable* dt = GameMode->CalloutsTable;
 	if (!IsValid(dt))
 	{
-		CalloutData.CallLogging.Add("Invalid DataTable");
+		FWfIncidentJournal::Get().Record(FWfIncidentJournal::ServerJournalId, EWfJournalEvent::CalloutRejected, FName(TEXT("InvalidDataTable")));
 		UE_LOGFMT(LogCallouts, Display, "ACalloutsManager({NetMode}): Failed to Generate Callout - Callout Data Table was NOT SET in GameMode!"
 			, HasAuthority() ? "SRV" : "CLI");
 		return;
@@ -164,20 +177,334 @@ void ACalloutsManager::CreateCallout(const FName& CalloutType, FCalloutData& Cal
 	FCallouts* CalloutRowData = dt->FindRow<FCallouts>(CalloutType, ContextString);
 	if (CalloutRowData == nullptr)
 	{
-		CalloutData.CallLogging.Add("Invalid DataTable");
+		FWfIncidentJournal::Get().Record(FWfIncidentJournal::ServerJournalId, EWfJournalEvent::CalloutRejected, FName(TEXT("RowNotFound")));
 		UE_LOGFMT(LogCallouts, Display, "ACalloutsManager({NetMode}): Callout Row '{RowName}' NOT FOUND in Callouts Data Table!"
 			, HasAuthority() ? "SRV" : "CLI", CalloutType);
 		return;
 	}
 
-	AWfCalloutActor* CalloutActor = GetWorld()->SpawnActorDeferred<AWfCalloutActor>
-		(CalloutData.CalloutActor, SpawnTransform, this, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	// The incident starts as a record; its actor is only spawned once it is needed
+	AWfPropertyActor* PropertyActor = CalloutData.PropertyActor;
+	if (!IsValid(PropertyActor))
+	{
+		TArray<AActor*> AllProperties;
+		UGameplayStatics::GetAllActorsOfClass(GetWorld(), AWfPropertyActor::StaticClass(), AllProperties);
+		if (!AllProperties.IsEmpty())
+			PropertyActor = Cast<AWfPropertyActor>(AllProperties[FMath::RandRange(0, AllProperties.Num() - 1)]);
+	}
+	if (!IsValid(PropertyActor))
+	{
+		FWfIncidentJournal::Get().Record(FWfIncidentJournal::ServerJournalId, EWfJournalEvent::CalloutRejected, FName(TEXT("NoPropertyActor")));
+		UE_LOGFMT(LogCallouts, Error, "ACalloutsManager({NetMode}): Failed to Generate Callout - No PropertyActor (Location) Found"
+			, HasAuthority() ? "SRV" : "CLI");
+		return;
+	}
+
+	if (!Lifecycle.IsCompiled())
+		BuildLifecycle();
+
+	const AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	const FDateTime GameDateTime = IsValid(GameManager) ? GameManager->GetSimulatedDateTime() : FDateTime::UtcNow();
+
+	const FWfIncidentHandle Handle = Incidents.Acquire();
+	FWfIncidentRecord& Record  = *Incidents.Get(Handle);
+	Record.IncidentNumber      = NextIncidentNumber++;
+	Record.CalloutType         = CalloutType;
+	Record.PropertyActor       = PropertyActor;
+	Record.Location            = PropertyActor->GetActorLocation();
+	Record.CalloutActorClass   = CalloutData.CalloutActor.Get() ? CalloutData.CalloutActor.Get() : AWfCalloutActor::StaticClass();
+	Record.ResolutionDeadline  = GameDateTime + FTimespan(CalloutRowData->DeadlineDays, CalloutRowData->DeadlineHours, CalloutRowData->DeadlineMinutes, 0);
+	Record.StateEnteredSeconds = GetWorld()->GetTimeSeconds();
+	Record.JournalId           = FWfIncidentJournal::Get().OpenIncident(Record.IncidentNumber);
+	IncidentLookup.Add(Record.IncidentNumber, Handle);
+	FWfIncidentJournal::Get().Record(Record.JournalId, EWfJournalEvent::IncidentCreated, CalloutType, PropertyActor->GetFName());
+
+	CalloutData.PropertyActor = PropertyActor;
+	TriggerIncidentAt(Handle.Index, EWfIncidentEvent::Alert);
+	WF_COUNT(STAT_WfNumCallouts, TEXT("CalloutsGenerated"), 1);
+}
+
+void ACalloutsManager::DispatchIncident(const int IncidentNumber)
+{
+	TriggerIncident(IncidentNumber, EWfIncidentEvent::Dispatch);
+}
+
+EWfIncidentState ACalloutsManager::GetIncidentState(const int IncidentNumber) const
+{
+	const FWfIncidentHandle* Handle = IncidentLookup.Find(IncidentNumber);
+	const FWfIncidentRecord* Record = Handle ? Incidents.Get(*Handle) : nullptr;
+	return Record ? Record->State : EWfIncidentState::Closed;
+}
+
+TArray<int> ACalloutsManager::GetActiveIncidents() const
+{
+	TArray<int> IncidentNumbers;
+	IncidentLookup.GenerateKeyArray(IncidentNumbers);
+	IncidentNumbers.Sort();
+	return IncidentNumbers;
+}
+
+AWfCalloutActor* ACalloutsManager::GetIncidentActor(const int IncidentNumber) const
+{
+	const FWfIncidentHandle* Handle = IncidentLookup.Find(IncidentNumber);
+	const FWfIncidentRecord* Record = Handle ? Incidents.Get(*Handle) : nullptr;
+	return Record ? Record->CalloutActor.Get() : nullptr;
+}
+
+bool ACalloutsManager::TriggerIncident(const int IncidentNumber, const EWfIncidentEvent Event)
+{
+	if (!HasAuthority())
+		return false;
+
+	const FWfIncidentHandle* Handle = IncidentLookup.Find(IncidentNumber);
+	return Handle && Incidents.Get(*Handle) && TriggerIncidentAt(Handle->Index, Event);
+}
+
+bool ACalloutsManager::TriggerIncidentAt(const int32 Index, const EWfIncidentEvent Event)
+{
+	const FWfIncidentHandle Handle = Incidents.GetHandle(Index);
+	FWfIncidentRecord* Record = Incidents.Get(Handle);
+	if (Record == nullptr)
+		return false;
+
+	// The state is written before any hook runs. The hooks reach Blueprint, which can start another
+	// incident and grow the pool, so the record is looked up again rather than trusted afterwards.
+	const int32 IncidentNumber = Record->IncidentNumber;
+	const int32 JournalId = Record->JournalId;
+	if (!Lifecycle.Fire(Index, Record->State, Event))
+		return false;
+
+	// Finished incidents give their slot back once the hooks are done with them
+	Record = Incidents.Get(Handle);
+	if (Record != nullptr && (Record->State == EWfIncidentState::Closed || Record->State == EWfIncidentState::Expired))
+	{
+		FWfIncidentJournal::Get().CloseIncident(JournalId);
+		IncidentLookup.Remove(IncidentNumber);
+		Incidents.Release(Handle);
+	}
+	return true;
+}
+
+/**
+ * \brief The incident lifecycle. Everything that happens on a state change is registered here,
+ *  so this is the one place to read to know what an incident does next.
+ */
+void ACalloutsManager::BuildLifecycle()
+{
+	using EState = EWfIncidentState;
+	using EEvent = EWfIncidentEvent;
+
+	Lifecycle.AddTransition(EState::Pending,    EEvent::Alert,    EState::PreAlert);
+	Lifecycle.AddTransition(EState::PreAlert,   EEvent::Dispatch, EState::Dispatched);
+	Lifecycle.AddTransition(EState::Dispatched, EEvent::Respond,  EState::EnRoute);
+	Lifecycle.AddTransition(EState::Dispatched, EEvent::Arrive,   EState::OnScene);
+	Lifecycle.AddTransition(EState::EnRoute,    EEvent::Arrive,   EState::OnScene);
+	Lifecycle.AddTransition(EState::Dispatched, EEvent::Control,  EState::Controlled);
+	Lifecycle.AddTransition(EState::EnRoute,    EEvent::Control,  EState::Controlled);
+	Lifecycle.AddTransition(EState::OnScene,    EEvent::Control,  EState::Controlled);
+	Lifecycle.AddTransition(EState::Controlled, EEvent::Close,    EState::Closed);
+	for (const EState Open : {EState::Pending, EState::PreAlert, EState::Dispatched, EState::EnRoute, EState::OnScene})
+	{
+		Lifecycle.AddTransition(Open, EEvent::Expire, EState::Expired);
+	}
+
+	Lifecycle.AddAnyTransitionHook([this](const int32 Index, const EState From, const EState To)
+	{
+		FWfIncidentRecord* Record = Incidents.Get(Incidents.GetHandle(Index));
+		Record->StateEnteredSeconds = GetWorld()->GetTimeSeconds();
+		FWfIncidentJournal::Get().Record(Record->JournalId, EWfJournalEvent::StateChanged, static_cast<int32>(From), static_cast<int32>(To));
+		if (OnIncidentStateChanged.IsBound())
+			OnIncidentStateChanged.Broadcast(Record->IncidentNumber, To);
+	});
+
+	Lifecycle.AddEnterHook(EState::PreAlert, [this](const int32 Index, const EState, const EState)
+	{
+		const FWfIncidentRecord* Record = Incidents.Get(Incidents.GetHandle(Index));
+		SpeakPreAlert(*Record);
+		if (IsPlayerNearby(Record->Location, AttachRadius))
+			AttachCalloutActor(Index);
+	});
+
+	Lifecycle.AddEnterHook(EState::Dispatched, [this](const int32 Index, const EState, const EState)
+	{
+		if (AttachCalloutActor(Index))
+			Incidents.Get(Incidents.GetHandle(Index))->CalloutActor->DispatchCallout();
+	});
+
+	Lifecycle.AddEnterHook(EState::Closed, [this](const int32 Index, const EState, const EState)
+	{
+		if (AWfCalloutActor* CalloutActor = Incidents.Get(Incidents.GetHandle(Index))->CalloutActor.Get())
+			CalloutActor->CloseCallout();
+	});
+
+	Lifecycle.AddEnterHook(EState::Expired, [this](const int32 Index, const EState, const EState)
+	{
+		if (AWfCalloutActor* CalloutActor = Incidents.Get(Incidents.GetHandle(Index))->CalloutActor.Get())
+		{
+			Multicast_CalloutExpired(CalloutActor->GetCalloutData());
+			CalloutActor->ExpireCallout();
+		}
+	});
+
+	Lifecycle.Compile();
+}
+
+/**
+ * \brief Decides every incident's next event first, then fires them, so no hook runs while the pool is being walked.
+ */
+void ACalloutsManager::UpdateIncidents()
+{
+	WF_SCOPE_SIM_TIMING(TEXT("Incidents"));
+	const AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!IsValid(GameManager))
+		return;
+
+	const FDateTime GameDateTime = GameManager->GetSimulatedDateTime();
+	const double WorldSeconds = GetWorld()->GetTimeSeconds();
+	const float ArriveRadiusSquared = FMath::Square(ArriveRadius);
+
+	PendingEvents.Reset();
+	PendingAttachments.Reset();
+	Incidents.ForEachActive([&](const int32 Index, FWfIncidentRecord& Record)
+	{
+		const double SecondsInState = WorldSeconds - Record.StateEnteredSeconds;
+		const AWfCalloutActor* CalloutActor = Record.CalloutActor.Get();
+
+		if (Record.State != EWfIncidentState::Controlled && GameDateTime > Record.ResolutionDeadline)
+		{
+			PendingEvents.Emplace(Index, EWfIncidentEvent::Expire);
+			return;
+		}
+
+		switch (Record.State)
+		{
+		case EWfIncidentState::PreAlert:
+			if (SecondsInState >= SecondsToRespond)
+				PendingEvents.Emplace(Index, EWfIncidentEvent::Dispatch);
+			else if (CalloutActor == nullptr && IsPlayerNearby(Record.Location, AttachRadius))
+				PendingAttachments.Add(Index);
+			break;
+
+		case EWfIncidentState::Dispatched:
+		case EWfIncidentState::EnRoute:
+		case EWfIncidentState::OnScene:
+		{
+			if (CalloutActor == nullptr)
+				break;
+			if (CalloutActor->IsIncidentControlled())
+			{
+				PendingEvents.Emplace(Index, EWfIncidentEvent::Control);
+				break;
+			}
+			if (Record.State == EWfIncidentState::OnScene)
+				break;
+
+			const FIncidentAssignments Assignments = GameManager->GetIncidentAssignments(CalloutActor);
+			bool bArrived = false;
+			for (const AWfFireApparatusBase* FireApparatus : Assignments.FireApparatuses)
+			{
+				bArrived |= IsValid(FireApparatus)
+					&& FVector::DistSquared(FireApparatus->GetActorLocation(), Record.Location) <= ArriveRadiusSquared;
+			}
+			if (bArrived)
+				PendingEvents.Emplace(Index, EWfIncidentEvent::Arrive);
+			else if (Record.State == EWfIncidentState::Dispatched && !Assignments.FireApparatuses.IsEmpty())
+				PendingEvents.Emplace(Index, EWfIncidentEvent::Respond);
+			break;
+		}
+
+		case EWfIncidentState::Controlled:
+			if (SecondsInState >= SecondsToClose)
+				PendingEvents.Emplace(Index, EWfIncidentEvent::Close);
+			break;
+
+		default:
+			break;
+		}
+	});
+	FWfIncidentJournal::Get().Flush();
+
+	for (const TPair<int32, EWfIncidentEvent>& Pending : PendingEvents)
+		TriggerIncidentAt(Pending.Key, Pending.Value);
+
+	// A player wandered close to a pre-alert, so it gets its actor without changing state
+	for (const int32 Index : PendingAttachments)
+		AttachCalloutActor(Index);
+}
+
+bool ACalloutsManager::AttachCalloutActor(const int32 Index)
+{
+	FWfIncidentRecord* Record = Incidents.Get(Incidents.GetHandle(Index));
+	if (Record == nullptr)
+		return false;
+	if (Record->CalloutActor.IsValid())
+		return true;
+
+	FCallouts CalloutRow = GetCalloutDataRow(Record->CalloutType);
+	AWfPropertyActor* PropertyActor = Record->PropertyActor.Get();
+	if (!IsValid(PropertyActor))
+		return false;
+
+	AWfActorPool* ActorPool = AWfActorPool::GetInstance(this);
+	if (!IsValid(ActorPool))
+		return false;
+
+	// Place the callout actor at the same location as the call itself, just for organization.
+	const FTransform SpawnTransform(PropertyActor->GetActorQuat(), PropertyActor->GetActorLocation());
+	const TSubclassOf<AWfCalloutActor> CalloutClass = Record->CalloutActorClass ? Record->CalloutActorClass : AWfCalloutActor::StaticClass();
+	AWfCalloutActor* CalloutActor = ActorPool->Acquire<AWfCalloutActor>(CalloutClass, SpawnTransform, this);
+	if (!IsValid(CalloutActor))
+		return false;
+
+	const AWfGameModeBase* GameMode = Cast<AWfGameModeBase>(GetWorld()->GetAuthGameMode());
+	CalloutActor->SetCalloutRow(IsValid(GameMode) ? GameMode->CalloutsTable : nullptr, Record->CalloutType);
+	CalloutActor->SetIncidentNumber(Record->IncidentNumber);
+	CalloutActor->SetJournalId(Record->JournalId);
+	FWfIncidentJournal::Get().Record(Record->JournalId, EWfJournalEvent::ActorAttached, CalloutActor->GetFName());
+	CalloutActor->SetCalloutData(CalloutRow, SecondsToRespond, PropertyActor);
+	CalloutActor->SetResolutionDeadline(Record->ResolutionDeadline);
+	if (!CalloutActor->StartCallout())
+	{
+		ActorPool->ReleaseActor(CalloutActor);
+		return false;
+	}
+
+	Record->CalloutActor = CalloutActor;
+	return true;
+}
+
+bool ACalloutsManager::IsPlayerNearby(const FVector& Location, const float Radius) const
+{
+	const float RadiusSquared = FMath::Square(Radius);
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APawn* Pawn = It->IsValid() ? (*It)->GetPawn() : nullptr;
+		if (IsValid(Pawn) && FVector::DistSquared(Pawn->GetActorLocation(), Location) <= RadiusSquared)
+			return true;
+	}
+	return false;
+}
+
+void ACalloutsManager::SpeakPreAlert(const FWfIncidentRecord& Record) const
+{
+	const AWfPropertyActor* PropertyActor = Record.PropertyActor.Get();
+	if (!IsValid(PropertyActor))
+		return;
+
+	FName IncidentType = "medical";
+	if (GetCalloutDataRow(Record.CalloutType).TypeOfIncident != EIncidentType::Medical)
+	{
+		IncidentType = "structure_fire";
+	}
+
+	FString VoxSentence = ". alert3 . stop_tx . . start_tx , golden_crest, " + IncidentType.ToString() + ", ";
+	VoxSentence += PropertyActor->GetCachedAddressForVox() + ".";
 
-	if (IsValid(CalloutActor))
+	// Get the Vox Singleton and send the pre-alert
+	AWfVoxManager* VoxManager = AWfVoxManager::GetInstance(GetWorld());
+	if (IsValid(VoxManager))
 	{
-		CalloutActor->SetCalloutData(*CalloutRowData, SecondsToRespond);
-		CalloutActor->FinishSpawning(SpawnTransform);
-		CalloutActor->StartCallout();
+		VoxManager->SpeakRadio(VoxSentence);
 	}
 }
 
@@ -5,9 +5,13 @@
 
 #include "EngineUtils.h"
 #include "Actors/WfFireStationBase.h"
+#include "Actors/WfRoadManager.h"
 #include "Characters/WfFfCharacterBase.h"
+#include "Components/WfScheduleComponent.h"
+#include "Controllers/WfAiControllerBase.h"
 #include "Kismet/GameplayStatics.h"
 #include "Lib/WfCalloutData.h"
+#include "Lib/WfSimTimings.h"
 #include "Net/UnrealNetwork.h"
 #include "Vehicles/WfFireApparatusBase.h"
 
@@ -62,6 +66,7 @@ void AGameManager::InitializeAssignments(const TSubclassOf<AActor>& ClassType)
     		if (!AssignedFireStations.Contains(FireStation))
     		{
     		    AssignedFireStations.Add(FFireStationAssignments(FireStation));
+    		    AddInventory(FireStation, FireStation->EquipmentLoadout);
                 UE_LOGFMT(LogManager, Display,
                     "Fire Station {FireStation} added to fire stations array (spawned before initialization).", FireStation->GetFireStationNumber());
     		}
@@ -72,6 +77,8 @@ void AGameManager::InitializeAssignments(const TSubclassOf<AActor>& ClassType)
     		if (!AssignedFireApparatuses.Contains(FireApparatus))
             {
     		    AssignedFireApparatuses.Add(FFireApparatusAssignments(FireApparatus));
+    		    DispatchRecommender.RegisterUnit(FireApparatus, FireApparatus->GetClass(), FireApparatus->GetActorLocation());
+    		    AddInventory(FireApparatus, FireApparatus->EquipmentLoadout);
     		    UE_LOGFMT(LogManager, Display,
                     "Fire Apparatus {FireApparatus} added to fire apparatus array (spawned before initialization).", FireApparatus->GetApparatusIdentity());
             }
@@ -223,10 +230,19 @@ TArray<FIncidentAssignments> AGameManager::GetAllIncidentAssignments() const
 }
 
 /**
- * \brief Incident Actor Destroyed: Delete the associated AssignedIncidents entry
+ * \brief Incident Actor Destroyed: Releases every apparatus, firefighter and fire station still on the
+ *  incident, so the units go back to being available, then deletes the associated AssignedIncidents entry
  */
 void AGameManager::RemoveIncidentActor(AWfCalloutActor* IncidentActor)
 {
+    const FIncidentAssignments IncidentAssignment = GetIncidentAssignments(IncidentActor);
+    for (AWfFireApparatusBase* FireApparatus : IncidentAssignment.FireApparatuses)
+        UnassignIncidentFromApparatus(IncidentActor, FireApparatus);
+    for (AWfFfCharacterBase* Firefighter : IncidentAssignment.Firefighters)
+        UnassignIncidentFromFirefighter(IncidentActor, Firefighter);
+    for (AWfFireStationBase* FireStation : IncidentAssignment.FireStations)
+        UnassignIncidentFromFireStation(IncidentActor, FireStation);
+
     AssignedIncidents.RemoveAll([IncidentActor](const FIncidentAssignments& Assignment)
     {
         return Assignment.Incident == IncidentActor;
@@ -254,6 +270,7 @@ void AGameManager::AddFireStation(AWfFireStationBase* FireStation)
     if (!AssignedFireStations.Contains(FireStation))
     {
         AssignedFireStations.Add(FFireStationAssignments(FireStation));
+        AddInventory(FireStation, FireStation->EquipmentLoadout);
         UE_LOGFMT(LogManager, Display, "Tracking New Fire Station: {StationName} (Fire Station #{StationNum})"
             , FireStation->GetName(), FireStation->GetFireStationNumber());
     }
@@ -286,6 +303,7 @@ void AGameManager::RemoveFireStation(AWfFireStationBase* FireStation)
     {
         return Assignment.FireStation == FireStation;
     });
+    Inventory.RemoveContainer(Inventory.FindContainer(FireStation));
     if (!AssignedFireStations.Contains(FireStation))
     {
         UE_LOGFMT(LogManager, Display, "Fire Station Removed: {StationName} (Fire Station #{StationNum})"
@@ -307,6 +325,8 @@ void AGameManager::AddFireApparatus(AWfFireApparatusBase* FireApparatus)
     if (!AssignedFireApparatuses.Contains(FireApparatus))
     {
         AssignedFireApparatuses.Add(FFireApparatusAssignments(FireApparatus));
+        DispatchRecommender.RegisterUnit(FireApparatus, FireApparatus->GetClass(), FireApparatus->GetActorLocation());
+        AddInventory(FireApparatus, FireApparatus->EquipmentLoadout);
         UE_LOGFMT(LogManager, Display, "Tracking New Fire Apparatus: {ApparatusName} ({ApparatusIdentity})"
             , FireApparatus->GetName(), FireApparatus->GetApparatusIdentity());
     }
@@ -362,6 +382,8 @@ void AGameManager::RemoveFireApparatus(AWfFireApparatusBase* FireApparatus)
     {
         return Assignment.FireApparatus == FireApparatus;
     });
+    DispatchRecommender.UnregisterUnit(FireApparatus);
+    Inventory.RemoveContainer(Inventory.FindContainer(FireApparatus));
     if (!AssignedFireApparatuses.Contains(FireApparatus))
     {
         UE_LOGFMT(LogManager, Display, "Fire Apparatus Removed: {FireApparatusName} (Fire Station #{AppIdentity})"
@@ -411,6 +433,10 @@ TArray<FFirefighterAssignments> AGameManager::GetAllFirefighterAssignments() con
  */
 void AGameManager::RemoveFirefighter(AWfFfCharacterBase* Firefighter)
 {
+    const FFirefighterAssignments* FirefighterAssignment = AssignedFirePersonnel.FindByKey(Firefighter);
+    if (FirefighterAssignment != nullptr && IsValid(FirefighterAssignment->FireApparatus))
+        UnassignFirefighterFromApparatus(FirefighterAssignment->FireApparatus, Firefighter);
+
     AssignedFirePersonnel.RemoveAll([Firefighter](const FFirefighterAssignments& Assignment)
     {
         return Assignment.Firefighter == Firefighter;
@@ -432,6 +458,8 @@ void AGameManager::RemoveFirefighter(AWfFfCharacterBase* Firefighter)
  */
 void AGameManager::AssignIncidentToFireApparatus(AWfCalloutActor* IncidentActor, AWfFireApparatusBase* FireApparatus)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
     AddFireApparatus(FireApparatus);
     AddIncidentActor(IncidentActor);
 
@@ -441,12 +469,16 @@ void AGameManager::AssignIncidentToFireApparatus(AWfCalloutActor* IncidentActor,
         if (ApparatusAssignment.FireApparatus == FireApparatus)
         {
             ApparatusAssignment.Incident = IncidentActor;
+            DispatchRecommender.SetUnitAvailable(DispatchRecommender.FindUnit(FireApparatus), false);
             UE_LOGFMT(LogManager, Display, "{ApparatusId} has been assigned to Incident #{IncidentNum}"
                 , FireApparatus->GetApparatusIdentity(), IncidentActor->GetIncidentNumber());
-            for (AWfFfCharacterBase* Firefighter : ApparatusAssignment.Firefighters)
+            for (AWfFfCharacterBase* Firefighter : FireApparatus->GetSeatedFirefighters())
             {
                 AssignIncidentToFirefighter(IncidentActor, Firefighter);
             }
+            // A player at the wheel drives themselves
+            if (!FireApparatus->IsPlayerControlled())
+                FireApparatus->DriveTo(IncidentActor->GetActorLocation());
             break;
         }
     }
@@ -472,6 +504,8 @@ void AGameManager::AssignIncidentToFireApparatus(AWfCalloutActor* IncidentActor,
  */
 void AGameManager::AssignIncidentToFirefighter(AWfCalloutActor* IncidentActor, AWfFfCharacterBase* Firefighter)
 {
+    // Timed by AssignIncidentToFireApparatus(), which calls this for each of its crew
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
     AddIncidentActor(IncidentActor);
     AddFirefighter(Firefighter);
 
@@ -509,6 +543,8 @@ void AGameManager::AssignIncidentToFirefighter(AWfCalloutActor* IncidentActor, A
  */
 void AGameManager::AssignIncidentToFireStation(AWfCalloutActor* IncidentActor, AWfFireStationBase* FireStation)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
     AddIncidentActor(IncidentActor);
     AddFireStation(FireStation);
 
@@ -544,49 +580,133 @@ void AGameManager::AssignIncidentToFireStation(AWfCalloutActor* IncidentActor, A
 }
 
 /**
- * \brief Assigns the specified Firefighter to the specified Fire Apparatus
+ * \brief Assigns the specified Firefighter to the specified Fire Apparatus.
+ *  The apparatus' seat table decides whether there is room, and holds the seat the firefighter takes.
  */
 void AGameManager::AssignFirefighterToFireApparatus(AWfFireApparatusBase* FireApparatus, AWfFfCharacterBase* Firefighter)
 {
-    bool bSuccessful = false;
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
+    if (!HasAuthority() || !IsValid(FireApparatus) || !IsValid(Firefighter))
+        return;
     AddFireApparatus(FireApparatus);
     AddFirefighter(Firefighter);
 
-    for (FFireApparatusAssignments& ApparatusAssignment : AssignedFireApparatuses)
+    FFireApparatusAssignments* ApparatusAssignment = AssignedFireApparatuses.FindByKey(FireApparatus);
+    FFirefighterAssignments* FirefighterAssignment = AssignedFirePersonnel.FindByKey(Firefighter);
+    if (ApparatusAssignment == nullptr || FirefighterAssignment == nullptr)
+        return;
+
+    FFireApparatusAssignments* PreviousAssignment = IsValid(FirefighterAssignment->FireApparatus)
+        ? AssignedFireApparatuses.FindByKey(FirefighterAssignment->FireApparatus) : nullptr;
+    if (!SeatFirefighter(*ApparatusAssignment, *FirefighterAssignment, PreviousAssignment))
+        return;
+
+    if (PreviousAssignment != nullptr && PreviousAssignment != ApparatusAssignment)
+        UpdateApparatusStaffed(*PreviousAssignment);
+    UpdateApparatusStaffed(*ApparatusAssignment);
+    UE_LOGFMT(LogManager, Display, "{CharacterName} has been assigned to {AppIdentity}"
+        , Firefighter->GetCharacterName(), FireApparatus->GetApparatusIdentity());
+}
+
+/**
+ * \brief Same as assigning each firefighter in turn, except the assignments are looked up once
+ *  for the whole batch rather than once per firefighter, and staffing is updated once per apparatus.
+ */
+void AGameManager::AssignCrewsToFireApparatus(const TArray<FWfApparatusCrew>& Crews)
+{
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    if (!HasAuthority())
+        return;
+
+    for (const FWfApparatusCrew& Crew : Crews)
     {
-        if (ApparatusAssignment.FireApparatus == FireApparatus)
+        if (!IsValid(Crew.FireApparatus))
+            continue;
+        AddFireApparatus(Crew.FireApparatus);
+        for (AWfFfCharacterBase* Firefighter : Crew.Firefighters)
         {
-            if (ApparatusAssignment.Firefighters.Num() < FireApparatus->NumberOfSeats)
-            {
-                ApparatusAssignment.Firefighters.Add(Firefighter);
-                UE_LOGFMT(LogManager, Display, "{AppIdentity} is now tracking {CharacterName}"
-                    , FireApparatus->GetApparatusIdentity(), Firefighter->GetCharacterName());
-                bSuccessful = true;
-                break;
-            }
-            UE_LOGFMT(LogManager, Error, "{AppIdentity} has no more seats available for firefighter assignments."
-                , FireApparatus->GetApparatusIdentity(), Firefighter->GetCharacterName());
-            return;
+            if (IsValid(Firefighter))
+                AddFirefighter(Firefighter);
         }
     }
 
-    if (bSuccessful)
+    // Indices rather than pointers, the arrays are not added to past this point
+    TMap<const AWfFireApparatusBase*, int32> ApparatusIndices;
+    ApparatusIndices.Reserve(AssignedFireApparatuses.Num());
+    for (int32 Index = 0; Index < AssignedFireApparatuses.Num(); ++Index)
+        ApparatusIndices.Add(AssignedFireApparatuses[Index].FireApparatus, Index);
+
+    TMap<const AWfFfCharacterBase*, int32> PersonnelIndices;
+    PersonnelIndices.Reserve(AssignedFirePersonnel.Num());
+    for (int32 Index = 0; Index < AssignedFirePersonnel.Num(); ++Index)
+        PersonnelIndices.Add(AssignedFirePersonnel[Index].Firefighter, Index);
+
+    TSet<int32> ChangedApparatus;
+    int32 NumSeated = 0;
+    for (const FWfApparatusCrew& Crew : Crews)
     {
-        for (FFirefighterAssignments& FirefighterAssignment : AssignedFirePersonnel)
+        const int32* ApparatusIndex = ApparatusIndices.Find(Crew.FireApparatus);
+        if (ApparatusIndex == nullptr)
+            continue;
+
+        FFireApparatusAssignments& ApparatusAssignment = AssignedFireApparatuses[*ApparatusIndex];
+        for (AWfFfCharacterBase* Firefighter : Crew.Firefighters)
         {
-            if (FirefighterAssignment.Firefighter == Firefighter)
-            {
-                FirefighterAssignment.FireApparatus = FireApparatus;
-                UE_LOGFMT(LogManager, Display, "{CharacterName} has been assigned to {AppIdentity}"
-                    , Firefighter->GetCharacterName(), FireApparatus->GetApparatusIdentity());
-                return;
-            }
+            const int32* PersonnelIndex = PersonnelIndices.Find(Firefighter);
+            if (PersonnelIndex == nullptr)
+                continue;
+
+            FFirefighterAssignments& FirefighterAssignment = AssignedFirePersonnel[*PersonnelIndex];
+            const int32* PreviousIndex = ApparatusIndices.Find(FirefighterAssignment.FireApparatus);
+            FFireApparatusAssignments* PreviousAssignment = PreviousIndex != nullptr ? &AssignedFireApparatuses[*PreviousIndex] : nullptr;
+            if (!SeatFirefighter(ApparatusAssignment, FirefighterAssignment, PreviousAssignment))
+                break;
+
+            ++NumSeated;
+            if (PreviousIndex != nullptr)
+                ChangedApparatus.Add(*PreviousIndex);
         }
+        ChangedApparatus.Add(*ApparatusIndex);
+    }
+
+    for (const int32 ApparatusIndex : ChangedApparatus)
+        UpdateApparatusStaffed(AssignedFireApparatuses[ApparatusIndex]);
+
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), NumSeated);
+    UE_LOGFMT(LogManager, Display, "Seated {NumSeated} firefighter(s) across {NumApparatus} apparatus"
+        , NumSeated, ChangedApparatus.Num());
+}
+
+bool AGameManager::SeatFirefighter(FFireApparatusAssignments& ApparatusAssignment,
+    FFirefighterAssignments& FirefighterAssignment, FFireApparatusAssignments* PreviousAssignment)
+{
+    AWfFireApparatusBase* FireApparatus = ApparatusAssignment.FireApparatus;
+    AWfFfCharacterBase* Firefighter = FirefighterAssignment.Firefighter;
+    if (FireApparatus->FindOccupantSeat(Firefighter) != INDEX_NONE)
+        return true;
+
+    const int SeatNumber = FireApparatus->FindSeatForCharacter(Firefighter);
+    if (SeatNumber == INDEX_NONE)
+    {
+        UE_LOGFMT(LogManager, Error, "{AppIdentity} has no more seats available for {CharacterName}"
+            , FireApparatus->GetApparatusIdentity(), Firefighter->GetCharacterName());
+        return false;
     }
+
+    if (PreviousAssignment != nullptr && PreviousAssignment != &ApparatusAssignment
+        && IsValid(PreviousAssignment->FireApparatus))
+        PreviousAssignment->FireApparatus->ClearSeatOccupant(Firefighter);
+
+    FireApparatus->SetSeatOccupant(SeatNumber, Firefighter);
+    FirefighterAssignment.FireApparatus = FireApparatus;
+    return true;
 }
 
 void AGameManager::AssignFirefighterToFireStation(AWfFfCharacterBase* Firefighter, AWfFireStationBase* FireStation)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
     AddFirefighter(Firefighter);
     AddFireStation(FireStation);
 
@@ -623,6 +743,8 @@ void AGameManager::AssignFirefighterToFireStation(AWfFfCharacterBase* Firefighte
  */
 void AGameManager::AssignFireApparatusToFireStation(AWfFireApparatusBase* FireApparatus, AWfFireStationBase* FireStation)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    WF_COUNT(STAT_WfNumAssignments, TEXT("Assignments"), 1);
     AddFireStation(FireStation);
     AddFireApparatus(FireApparatus);
 
@@ -662,6 +784,7 @@ void AGameManager::AssignFireApparatusToFireStation(AWfFireApparatusBase* FireAp
  */
 void AGameManager::UnassignIncidentFromApparatus(AWfCalloutActor* IncidentActor, AWfFireApparatusBase* FireApparatus)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
     // Remove the apparatus from the incident
     for (FIncidentAssignments& IncidentAssignment : AssignedIncidents)
     {
@@ -670,7 +793,9 @@ void AGameManager::UnassignIncidentFromApparatus(AWfCalloutActor* IncidentActor,
             IncidentAssignment.FireApparatuses.Remove(FireApparatus);
             UE_LOGFMT(LogManager, Display, "Incident #{IncidentNum} is no longer tracking {AppIdentity}"
                 , IncidentActor->GetIncidentNumber(), FireApparatus->GetApparatusIdentity());
-            for (AWfFfCharacterBase* Firefighter : IncidentAssignment.Firefighters)
+            // Copied, as unassigning removes each firefighter from the list being walked
+            const TArray<AWfFfCharacterBase*> Firefighters = IncidentAssignment.Firefighters;
+            for (AWfFfCharacterBase* Firefighter : Firefighters)
             {
                 UnassignIncidentFromFirefighter(IncidentActor, Firefighter);
             }
@@ -680,9 +805,13 @@ void AGameManager::UnassignIncidentFromApparatus(AWfCalloutActor* IncidentActor,
     // Set the apparatus' incident reference to nullptr (unassigned)
     for (FFireApparatusAssignments& ApparatusAssignment : AssignedFireApparatuses)
     {
-        if (ApparatusAssignment.FireApparatus == FireApparatus)
+        // An apparatus already reassigned to another incident stays with it
+        if (ApparatusAssignment.FireApparatus == FireApparatus && ApparatusAssignment.Incident == IncidentActor)
         {
             ApparatusAssignment.Incident = nullptr;
+            DispatchRecommender.SetUnitAvailable(DispatchRecommender.FindUnit(FireApparatus), true);
+            if (IsValid(FireApparatus))
+                FireApparatus->StopDriving();
             UE_LOGFMT(LogManager, Display, "{AppIdentity} is no longer assigned to an incident."
                 , FireApparatus->GetApparatusIdentity());
         }
@@ -708,7 +837,7 @@ void AGameManager::UnassignIncidentFromFirefighter(AWfCalloutActor* IncidentActo
     // Set the firefighter's incident reference to nullptr (unassigned)
     for (FFirefighterAssignments& FirefighterAssignment : AssignedFirePersonnel)
     {
-        if (FirefighterAssignment.Firefighter == Firefighter)
+        if (FirefighterAssignment.Firefighter == Firefighter && FirefighterAssignment.Incident == IncidentActor)
         {
             FirefighterAssignment.Incident = nullptr;
             UE_LOGFMT(LogManager, Display, "{CharacterName} is no longer assigned to an incident."
@@ -722,6 +851,7 @@ void AGameManager::UnassignIncidentFromFirefighter(AWfCalloutActor* IncidentActo
  */
 void AGameManager::UnassignIncidentFromFireStation(AWfCalloutActor* IncidentActor, AWfFireStationBase* FireStation)
 {
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
     // Remove the fire station from the incident's assigned stations list
     for (FIncidentAssignments& IncidentAssignment : AssignedIncidents)
     {
@@ -753,12 +883,15 @@ void AGameManager::UnassignIncidentFromFireStation(AWfCalloutActor* IncidentActo
  */
 void AGameManager::UnassignFirefighterFromApparatus(AWfFireApparatusBase* FireApparatus, AWfFfCharacterBase* Firefighter)
 {
-    // Remove the firefighter from the apparatus' assigned firefighters list
+    WF_SCOPE_CYCLE(STAT_WfAssignments, TEXT("Assignments"));
+    // Take the firefighter out of the apparatus' seat, which is its crew list
     for (FFireApparatusAssignments& ApparatusAssignment : AssignedFireApparatuses)
     {
         if (ApparatusAssignment.FireApparatus == FireApparatus)
         {
-            ApparatusAssignment.Firefighters.Remove(Firefighter);
+            if (IsValid(FireApparatus))
+                FireApparatus->ClearSeatOccupant(Firefighter);
+            UpdateApparatusStaffed(ApparatusAssignment);
             UE_LOGFMT(LogManager, Display, "{AppIdentity} is no longer tracking {CharacterName}"
                 , FireApparatus->GetApparatusIdentity(), Firefighter->GetCharacterName());
         }
@@ -776,6 +909,345 @@ void AGameManager::UnassignFirefighterFromApparatus(AWfFireApparatusBase* FireAp
     }
 }
 
+void AGameManager::SetFireApparatusInService(AWfFireApparatusBase* FireApparatus, const bool bInService)
+{
+    if (!HasAuthority())
+        return;
+    AddFireApparatus(FireApparatus);
+    DispatchRecommender.SetUnitInService(DispatchRecommender.FindUnit(FireApparatus), bInService);
+    UE_LOGFMT(LogManager, Display, "{AppIdentity} is now {ServiceState}"
+        , FireApparatus->GetApparatusIdentity(), bInService ? "in service" : "out of service");
+}
+
+/**
+ * \brief Recommends the quickest ready apparatus satisfying the incident's minimum units.
+ *  Availability comes from the recommender's bitsets, which are kept current by the
+ *  Assign/Unassign functions. With a road network, the closest units by straight line are
+ *  shortlisted and ranked by road travel time before the quantity of each requirement is cut.
+ */
+TArray<AWfFireApparatusBase*> AGameManager::RecommendUnitsForIncident(
+    const AWfCalloutActor* IncidentActor, bool& bRequirementsMet)
+{
+    bRequirementsMet = false;
+    if (!HasAuthority() || !IsValid(IncidentActor))
+        return {};
+
+    DispatchRequirements.Reset();
+    for (const FCalloutUnits& MinimumUnit : IncidentActor->GetMinimumUnits())
+    {
+        DispatchRequirements.Emplace(MinimumUnit);
+    }
+
+    const FVector IncidentLocation = IncidentActor->GetIncidentLocation();
+    AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this);
+    if (IsValid(RoadManager) && RoadManager->GetRoadGraph().IsBuilt())
+    {
+        const FWfRoadGraph& RoadGraph = RoadManager->GetRoadGraph();
+        bRequirementsMet = DispatchRecommender.Recommend(IncidentLocation, DispatchRequirements, DispatchCandidates,
+            [this, RoadManager, &RoadGraph, &IncidentLocation](const int32 UnitIndex)
+            {
+                const AWfFireApparatusBase* FireApparatus = DispatchRecommender.GetUnitApparatus(UnitIndex);
+                const FVector ApparatusLocation = FireApparatus->GetActorLocation();
+
+                // A unit in quarters uses its station's cached routes; anywhere else is a path search of its own
+                const AWfFireStationBase* FireStation = GetFireApparatusAssignments(FireApparatus).FireStation;
+                if (IsValid(FireStation) && RoadGraph.FindNearestNode(ApparatusLocation)
+                    == RoadGraph.FindNearestNode(FireStation->GetActorLocation()))
+                {
+                    return RoadManager->GetStationTravelTime(FireStation, IncidentLocation);
+                }
+                return RoadManager->GetTravelTime(ApparatusLocation, IncidentLocation);
+            });
+    }
+    else
+    {
+        bRequirementsMet = DispatchRecommender.Recommend(IncidentLocation, DispatchRequirements, DispatchCandidates);
+    }
+
+    TArray<AWfFireApparatusBase*> Recommended;
+    Recommended.Reserve(DispatchCandidates.Num());
+    for (const FWfDispatchCandidate& Candidate : DispatchCandidates)
+    {
+        Recommended.Add(const_cast<AWfFireApparatusBase*>(DispatchRecommender.GetUnitApparatus(Candidate.UnitIndex)));
+    }
+
+    UE_LOGFMT(LogDispatch, Display, "Incident #{IncidentNum}: Recommended {NumUnits} unit(s), requirements {Met}"
+        , IncidentActor->GetIncidentNumber(), Recommended.Num(), bRequirementsMet ? "met" : "NOT met");
+    return Recommended;
+}
+
+/**
+ * \brief An apparatus is staffed while at least one of the firefighters in its seats is on shift.
+ *  Firefighters without a schedule are always on duty.
+ */
+void AGameManager::UpdateApparatusStaffed(const FFireApparatusAssignments& ApparatusAssignment)
+{
+    if (!IsValid(ApparatusAssignment.FireApparatus))
+        return;
+
+    bool bStaffed = false;
+    for (const AWfFfCharacterBase* Firefighter : ApparatusAssignment.FireApparatus->GetSeatedFirefighters())
+    {
+        if (IsValid(Firefighter)
+            && (!IsValid(Firefighter->ScheduleComponent) || Firefighter->ScheduleComponent->IsOnDuty()))
+        {
+            bStaffed = true;
+            break;
+        }
+    }
+    DispatchRecommender.SetUnitStaffed(DispatchRecommender.FindUnit(ApparatusAssignment.FireApparatus), bStaffed);
+}
+
+void AGameManager::RefreshDispatchLocations()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Dispatch"));
+    for (const FFireApparatusAssignments& ApparatusAssignment : AssignedFireApparatuses)
+    {
+        if (IsValid(ApparatusAssignment.FireApparatus))
+        {
+            DispatchRecommender.SetUnitLocation(
+                DispatchRecommender.FindUnit(ApparatusAssignment.FireApparatus), ApparatusAssignment.FireApparatus->GetActorLocation());
+
+            // Shifts change with the simulated clock, not with any assignment
+            UpdateApparatusStaffed(ApparatusAssignment);
+        }
+    }
+}
+
+void AGameManager::StepPatients()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Patients"));
+    PatientStore.Step(PatientStepSeconds * GetSimulatedTimeRate());
+}
+
+void AGameManager::StepNeeds()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Needs"));
+    NeedsStore.Step(NeedsStepSeconds * GetSimulatedTimeRate(), NeedsStepSeconds);
+}
+
+void AGameManager::StepInteractions()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Interactions"));
+    Interactions.Step(InteractionStepSeconds);
+}
+
+/**
+ * \brief Needs come from the needs store and the roster from the firefighter assignments, looked up once
+ *  per refresh. The brain only queues a new decision for inputs that moved past its tolerance.
+ */
+void AGameManager::RefreshBrainInputs()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("BrainInputs"));
+    if (UtilityBrain.GetNumAgents() == 0)
+        return;
+
+    TMap<const AActor*, const FFirefighterAssignments*> Roster;
+    Roster.Reserve(AssignedFirePersonnel.Num());
+    for (const FFirefighterAssignments& Assignment : AssignedFirePersonnel)
+        Roster.Add(Assignment.Firefighter, &Assignment);
+
+    UtilityBrain.ForEachAgent([this, &Roster](const int32 AgentId, AActor* Agent)
+    {
+        const AWfCharacterBase* Character = Cast<AWfCharacterBase>(Agent);
+        if (!IsValid(Character))
+            return;
+
+        const int32 NeedsId = IsValid(Character->AbilityComponent) ? Character->AbilityComponent->GetNeedsId() : INDEX_NONE;
+        if (NeedsStore.IsValidCharacter(NeedsId))
+        {
+            UtilityBrain.SetInput(AgentId, EWfUtilityInput::Hunger, NeedsStore.GetValue(NeedsId, EWfNeed::Hunger) / 100.0f);
+            UtilityBrain.SetInput(AgentId, EWfUtilityInput::Thirst, NeedsStore.GetValue(NeedsId, EWfNeed::Thirst) / 100.0f);
+            UtilityBrain.SetInput(AgentId, EWfUtilityInput::Fatigue, NeedsStore.GetValue(NeedsId, EWfNeed::Fatigue) / 100.0f);
+            UtilityBrain.SetInput(AgentId, EWfUtilityInput::Morale, NeedsStore.GetValue(NeedsId, EWfNeed::Morale) / 100.0f);
+        }
+
+        const FFirefighterAssignments* const* Assignment = Roster.Find(Character);
+        const bool bHasIncident = Assignment != nullptr && IsValid((*Assignment)->Incident);
+        const bool bHasApparatus = Assignment != nullptr && IsValid((*Assignment)->FireApparatus);
+        UtilityBrain.SetInput(AgentId, EWfUtilityInput::HasIncident, bHasIncident ? 1.0f : 0.0f);
+        UtilityBrain.SetInput(AgentId, EWfUtilityInput::HasApparatus, bHasApparatus ? 1.0f : 0.0f);
+
+        const AWfFfCharacterBase* Firefighter = Cast<AWfFfCharacterBase>(Character);
+        const bool bOnDuty = IsValid(Firefighter) && IsValid(Firefighter->ScheduleComponent) && Firefighter->ScheduleComponent->IsOnDuty();
+        UtilityBrain.SetInput(AgentId, EWfUtilityInput::OnDuty, bOnDuty ? 1.0f : 0.0f);
+
+        const EWfSlotState SlotState = Interactions.GetSlotState(Interactions.FindClaim(Character));
+        const bool bInteracting = SlotState == EWfSlotState::Running || SlotState == EWfSlotState::Holding;
+        UtilityBrain.SetInput(AgentId, EWfUtilityInput::Interacting, bInteracting ? 1.0f : 0.0f);
+    });
+}
+
+void AGameManager::StepBrain()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Brain"));
+    UtilityBrain.Update(BrainStepSeconds, BrainBudgetSeconds);
+    for (const FWfUtilityDecision& Change : UtilityBrain.GetChanges())
+    {
+        const APawn* Pawn = Cast<APawn>(UtilityBrain.GetAgent(Change.AgentId));
+        if (IsValid(Pawn))
+        {
+            if (AWfAiControllerBase* Controller = Cast<AWfAiControllerBase>(Pawn->GetController()))
+                Controller->SetDecision(Change.Action);
+        }
+    }
+}
+
+/**
+ * \brief Observers are the players' view targets. Only characters that are not Abstract have their
+ *  location read from the pawn, so the per-update cost of the pawns follows how many are observed.
+ */
+void AGameManager::UpdateCrowdLod()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("CrowdLod"));
+    if (CrowdLod.GetNumAgents() == 0)
+        return;
+
+    CollectObservers();
+    CrowdLod.ForEachAgent([this](const int32 AgentId, const AActor* Agent, const EWfLodLevel Level)
+    {
+        if (Level != EWfLodLevel::Abstract && IsValid(Agent))
+            CrowdLod.SetLocation(AgentId, Agent->GetActorLocation());
+    });
+
+    CrowdLod.Update(ObserverLocations, CrowdLodStepSeconds);
+
+    for (const int32 AgentId : CrowdLod.GetArrivals())
+    {
+        if (AWfCharacterBase* Character = Cast<AWfCharacterBase>(CrowdLod.GetAgent(AgentId)))
+            Character->FinishAbstractTravel();
+    }
+
+    for (const FWfLodTransition& Transition : CrowdLod.GetTransitions())
+    {
+        if (AWfCharacterBase* Character = Cast<AWfCharacterBase>(CrowdLod.GetAgent(Transition.AgentId)))
+            Character->SetLodLevel(Transition.To);
+    }
+}
+
+/**
+ * \brief Only simulated vehicles have their location read from the pawn; kinematic ones are where the
+ *  rails last put them. Moves are applied before mode changes, so a vehicle handed back to physics
+ *  starts from its place on the route.
+ */
+void AGameManager::StepVehicleRails()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("VehicleRails"));
+    if (VehicleRails.GetNumVehicles() == 0)
+        return;
+
+    CollectObservers();
+    VehicleRails.ForEachVehicle([this](const int32 VehicleId, const AActor* Vehicle, const EWfRailMode Mode)
+    {
+        if (Mode != EWfRailMode::Kinematic && IsValid(Vehicle))
+            VehicleRails.SetLocation(VehicleId, Vehicle->GetActorLocation());
+    });
+
+    VehicleRails.Update(ObserverLocations, VehicleRailsStepSeconds);
+
+    for (const int32 VehicleId : VehicleRails.GetMoved())
+    {
+        if (AWfVehicleBase* Vehicle = Cast<AWfVehicleBase>(VehicleRails.GetVehicle(VehicleId)))
+            Vehicle->SetRailTransform(VehicleRails.GetLocation(VehicleId), VehicleRails.GetYaw(VehicleId));
+    }
+
+    for (const FWfRailTransition& Transition : VehicleRails.GetTransitions())
+    {
+        if (AWfVehicleBase* Vehicle = Cast<AWfVehicleBase>(VehicleRails.GetVehicle(Transition.VehicleId)))
+            Vehicle->SetRailMode(Transition.To, VehicleRails.GetVelocity(Transition.VehicleId));
+    }
+
+    for (const FWfRailSteering& Steering : VehicleRails.GetSteering())
+    {
+        if (AWfVehicleBase* Vehicle = Cast<AWfVehicleBase>(VehicleRails.GetVehicle(Steering.VehicleId)))
+            Vehicle->SteerTowards(Steering.Target, Steering.TargetSpeed);
+    }
+
+    for (const int32 VehicleId : VehicleRails.GetArrivals())
+    {
+        if (AWfVehicleBase* Vehicle = Cast<AWfVehicleBase>(VehicleRails.GetVehicle(VehicleId)))
+            Vehicle->FinishRoute();
+    }
+}
+
+void AGameManager::CollectObservers()
+{
+    ObserverLocations.Reset();
+    for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+    {
+        const APlayerController* PlayerController = Iterator->Get();
+        const AActor* ViewTarget = IsValid(PlayerController) ? PlayerController->GetViewTarget() : nullptr;
+        if (IsValid(ViewTarget))
+            ObserverLocations.Add(ViewTarget->GetActorLocation());
+    }
+}
+
+void AGameManager::ProcessEquipmentUse()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Inventory"));
+    if (Inventory.GetNumQueuedConsumption() > 0)
+        Inventory.ProcessConsumption();
+}
+
+void AGameManager::StepHydraulics()
+{
+    WF_SCOPE_SIM_TIMING(TEXT("Hydraulics"));
+    Hydraulics.Update(HydraulicsStepSeconds * GetSimulatedTimeRate(), HydraulicsBudgetSeconds);
+}
+
+void AGameManager::AddInventory(const AActor* Owner, const TMap<TSubclassOf<UEquipmentDataAsset>, float>& Loadout)
+{
+    const int32 ContainerId = Inventory.AddContainer(Owner);
+    for (const auto& Item : Loadout)
+    {
+        const int32 EquipmentId = Inventory.InternEquipment(Item.Key.Get());
+        if (EquipmentId == INDEX_NONE)
+            continue;
+        Inventory.SetCapacity(ContainerId, EquipmentId, Item.Value);
+        Inventory.Restock(ContainerId, EquipmentId, Item.Value - Inventory.GetQuantity(ContainerId, EquipmentId));
+    }
+}
+
+bool AGameManager::CanFireApparatusPerform(const AWfFireApparatusBase* FireApparatus, const int32 TaskId) const
+{
+    return Inventory.CanPerform(Inventory.FindContainer(FireApparatus), TaskId);
+}
+
+/**
+ * \brief Moves equipment from the apparatus' fire station into the apparatus, up to the apparatus' capacity.
+ *  Every item is moved in one transaction, so a failed restock leaves both containers as they were.
+ */
+bool AGameManager::RestockFireApparatus(const AWfFireApparatusBase* FireApparatus)
+{
+    if (!HasAuthority() || !IsValid(FireApparatus))
+        return false;
+
+    const FFireApparatusAssignments ApparatusAssignment = GetFireApparatusAssignments(FireApparatus);
+    const int32 ApparatusId = Inventory.FindContainer(FireApparatus);
+    const int32 StationId = Inventory.FindContainer(ApparatusAssignment.FireStation);
+    if (!Inventory.IsValidContainer(ApparatusId) || !Inventory.IsValidContainer(StationId))
+        return false;
+
+    FWfInventoryTransaction Transaction;
+    for (int32 EquipmentId = 0; EquipmentId < Inventory.GetNumEquipmentTypes(); ++EquipmentId)
+    {
+        const float Capacity = Inventory.GetCapacity(ApparatusId, EquipmentId);
+        const float Wanted = Capacity < TNumericLimits<float>::Max()
+            ? Capacity - Inventory.GetQuantity(ApparatusId, EquipmentId) : 0.0f;
+        const float Amount = FMath::Min(Wanted, Inventory.GetQuantity(StationId, EquipmentId));
+        if (Amount > 0.0f)
+            Transaction.Transfer(StationId, ApparatusId, EquipmentId, Amount);
+    }
+
+    if (Transaction.IsEmpty() || !Inventory.Commit(Transaction))
+        return false;
+
+    UE_LOGFMT(LogManager, Display, "{ThisName}({NetMode}): Restocked {ApparatusIdentity} from Fire Station #{StationNum}"
+        , GetName(), HasAuthority() ? "SRV" : "CLI"
+        , FireApparatus->GetApparatusIdentity(), ApparatusAssignment.FireStation->GetFireStationNumber());
+    return true;
+}
+
 // Create the singleton instance
 void AGameManager::Initialize()
 {
@@ -821,11 +1293,34 @@ void AGameManager::BeginPlay()
     SdtStruct.TimeSinceStart    = FTimespan(0);
     CurrentSimTime = SdtStruct;
 
+    // Props interact wherever StartInteraction is called, so their timers run on clients as well
+    Interactions.TickSeconds = InteractionStepSeconds;
+    GetWorldTimerManager().SetTimer(InteractionTimerHandle,
+        this, &AGameManager::StepInteractions, InteractionStepSeconds, true);
+
     // Initialize the game clock
     if (HasAuthority())
     {
         SyncSimTime();
         GetWorldTimerManager().SetTimer(SimTimerHandle, this, &AGameManager::SyncSimTime, SyncSeconds, true);
+        GetWorldTimerManager().SetTimer(DispatchTimerHandle,
+            this, &AGameManager::RefreshDispatchLocations, DispatchRefreshSeconds, true);
+        GetWorldTimerManager().SetTimer(PatientTimerHandle,
+            this, &AGameManager::StepPatients, PatientStepSeconds, true);
+        GetWorldTimerManager().SetTimer(NeedsTimerHandle,
+            this, &AGameManager::StepNeeds, NeedsStepSeconds, true);
+        GetWorldTimerManager().SetTimer(BrainInputTimerHandle,
+            this, &AGameManager::RefreshBrainInputs, BrainInputSeconds, true);
+        GetWorldTimerManager().SetTimer(BrainTimerHandle,
+            this, &AGameManager::StepBrain, BrainStepSeconds, true);
+        GetWorldTimerManager().SetTimer(CrowdLodTimerHandle,
+            this, &AGameManager::UpdateCrowdLod, CrowdLodStepSeconds, true);
+        GetWorldTimerManager().SetTimer(VehicleRailsTimerHandle,
+            this, &AGameManager::StepVehicleRails, VehicleRailsStepSeconds, true);
+        GetWorldTimerManager().SetTimer(InventoryTimerHandle,
+            this, &AGameManager::ProcessEquipmentUse, InventoryStepSeconds, true);
+        GetWorldTimerManager().SetTimer(HydraulicsTimerHandle,
+            this, &AGameManager::StepHydraulics, HydraulicsStepSeconds, true);
 
         UE_LOGFMT(LogManager, Display
             , "{ThisName}({NetMode}): Game Start Time (UTC) = {SimTime}"
@@ -3,16 +3,19 @@
 
 #include "Actors/WfActorBase.h"
 
+#include "Actors/GameManager.h"
 #include "Characters/WfCharacterBase.h"
 #include "Characters/WfCharacterTags.h"
 #include "Components/ArrowComponent.h"
 #include "Gas/WfAbilityComponent.h"
+#include "Lib/WfInteractionService.h"
 #include "Logging/StructuredLog.h"
 
 
 AWfActorBase::AWfActorBase()
 	: SecondsToComplete(0)
 	, CooldownTime(3.0f)
+	, NumSlots(1)
 	, UsingMesh(nullptr)
 {
 	PrimaryActorTick.bCanEverTick = true;
@@ -50,137 +53,213 @@ UAnimMontage* AWfActorBase::GetInteractionAnimation() const
 }
 
 /**
- * \brief Begins an interaction transaction between this actor and the activator
+ * \brief Begins an interaction transaction between this actor and the activator.
+ *  The activator takes a free slot, or uses the one it reserved; it stops whatever other prop it held first.
  * \param InteractiveActor The actor who is interacting with this actor
  * \return Number of seconds required to activate. Returns negative on failure. Zero means instant.
  */
 float AWfActorBase::StartInteraction(AActor* InteractiveActor)
 {
-	if (!IsValid(InteractiveActor))
+	AWfCharacterBase* Character = Cast<AWfCharacterBase>(InteractiveActor);
+	if (!IsValid(Character))
 	{
 		UE_LOGFMT(LogTemp, Error, "Interacting Actor is Invalid");
 		return -1.0f;
 	}
 
-	if (!TimerInteraction.IsValid())
+	FWfInteractionService* Interactions = GetInteractions();
+	if (Interactions == nullptr)
+		return -1.0f;
+
+	const FWfInteractionSlot Claim = Interactions->FindClaim(Character);
+	if (Claim.PropId == PropId)
+	{
+		// Already interacting, rather than holding a reservation
+		if (Interactions->GetSlotState(Claim) != EWfSlotState::Reserved)
+			return -1.0f;
+	}
+	else
 	{
-		ActorInteracting = Cast<AWfCharacterBase>(InteractiveActor);
-		UWfAbilityComponent* AbilityComponent = ActorInteracting->AbilityComponent;
-		AddEffects(AbilityComponent, EffectsAddedOnStart);
-		RemoveEffects(AbilityComponent, EffectsRemovedOnStart);
+		if (AWfActorBase* OtherProp = Interactions->GetProp(Claim.PropId))
+			OtherProp->StopInteraction(Character);
 
-		if (SecondsToComplete > 0.0f)
-		{
-			FTimerDelegate ActionDelegate;
-			ActionDelegate.BindUObject(this, &AWfActorBase::DoInteraction);
-			UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' has started interaction."
-				, GetName(), HasAuthority() ? "SRV" : "CLI", ActorInteracting->GetName());
-			GetWorld()->GetTimerManager().SetTimer(TimerInteraction, ActionDelegate, SecondsToComplete, false);
-		}
-		else
+		if (Interactions->Reserve(PropId, Character) == INDEX_NONE)
 		{
-			UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' is interacting."
-				, GetName(), HasAuthority() ? "SRV" : "CLI", ActorInteracting->GetName());
-			DoInteraction();
+			UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' found no free slot."
+				, GetName(), HasAuthority() ? "SRV" : "CLI", Character->GetName());
+			return -1.0f;
 		}
-		return SecondsToComplete;
 	}
-	return -1.0f;
+
+	ExecuteEffects(Character->AbilityComponent, EWfInteractionPhase::Start);
+
+	if (SecondsToComplete > 0.0f)
+	{
+		UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' has started interaction."
+			, GetName(), HasAuthority() ? "SRV" : "CLI", Character->GetName());
+		Interactions->StartTimer(Character, SecondsToComplete);
+	}
+	else
+	{
+		UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' is interacting."
+			, GetName(), HasAuthority() ? "SRV" : "CLI", Character->GetName());
+		Interactions->Hold(Character);
+		CompleteInteraction(Character);
+	}
+	return SecondsToComplete;
 }
 
-void AWfActorBase::StopInteraction()
+/**
+ * \brief Failure effects apply if the interaction was still running, stop effects to anyone who started one.
+ *  A mere reservation or place in the queue is given up without effects.
+ */
+void AWfActorBase::StopInteraction(AActor* InteractiveActor)
 {
-	if (!IsValid(ActorInteracting))
+	FWfInteractionService* Interactions = GetInteractions();
+	if (Interactions == nullptr)
+		return;
+
+	if (InteractiveActor == nullptr)
 	{
-		ActorInteracting = nullptr;
-		if (TimerInteraction.IsValid())
-			TimerInteraction.Invalidate();
+		TArray<AActor*> Occupants;
+		Interactions->GetOccupants(PropId, Occupants);
+		for (AActor* Occupant : Occupants)
+			StopInteraction(Occupant);
 		return;
 	}
 
-	UWfAbilityComponent* AbilityComponent = ActorInteracting->AbilityComponent;
-	if (TimerInteraction.IsValid())
+	const FWfInteractionSlot Claim = Interactions->FindClaim(InteractiveActor);
+	if (Claim.PropId != PropId)
 	{
-		AddEffects(AbilityComponent, EffectsAddedOnFailure);
-		RemoveEffects(AbilityComponent, EffectsRemovedOnFailure);
-		TimerInteraction.Invalidate();
+		if (Interactions->FindQueue(InteractiveActor) == PropId)
+			Interactions->Release(InteractiveActor);
+		return;
 	}
 
-	UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' has stopped interacting."
-	, GetName(), HasAuthority() ? "SRV" : "CLI", ActorInteracting->GetName());
+	const EWfSlotState State = Interactions->GetSlotState(Claim);
+	if (State != EWfSlotState::Reserved)
+	{
+		const AWfCharacterBase* Character = Cast<AWfCharacterBase>(InteractiveActor);
+		UWfAbilityComponent* AbilityComponent = IsValid(Character) ? Character->AbilityComponent : nullptr;
+		if (State == EWfSlotState::Running)
+			ExecuteEffects(AbilityComponent, EWfInteractionPhase::Failure);
 
-	AddEffects(AbilityComponent, EffectsAddedOnStop);
-	RemoveEffects(AbilityComponent, EffectsRemovedOnStop);
+		UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Actor '{InteractionActor}' has stopped interacting."
+			, GetName(), HasAuthority() ? "SRV" : "CLI", InteractiveActor->GetName());
 
-	ActorInteracting = nullptr;
+		ExecuteEffects(AbilityComponent, EWfInteractionPhase::Stop);
+	}
+	Interactions->Release(InteractiveActor);
 }
 
-void AWfActorBase::BeginPlay()
+bool AWfActorBase::ReserveInteraction(AActor* InteractiveActor)
 {
-	Super::BeginPlay();
+	FWfInteractionService* Interactions = GetInteractions();
+	return Interactions != nullptr && Interactions->ReserveOrQueue(PropId, InteractiveActor);
 }
 
-void AWfActorBase::DoInteraction()
+AWfActorBase* AWfActorBase::ClaimNearestInteraction(AActor* InteractiveActor, const TSubclassOf<AWfActorBase> PropClass)
 {
-	if (!IsValid(ActorInteracting))
-	{
-		UE_LOGFMT(LogTemp, Error, "{ThisActor}({NetMode}): ActorInteracting was INVALID."
-			, GetName(), HasAuthority() ? "SRV" : "CLI");
+	if (!IsValid(InteractiveActor))
+		return nullptr;
+
+	AGameManager* GameManager = AGameManager::GetInstance(InteractiveActor);
+	if (!IsValid(GameManager))
+		return nullptr;
+
+	FWfInteractionService& Interactions = GameManager->GetInteractions();
+	const UClass* SearchClass = PropClass != nullptr ? PropClass.Get() : StaticClass();
+	return Interactions.GetProp(Interactions.ClaimNearest(InteractiveActor, SearchClass, InteractiveActor->GetActorLocation()).PropId);
+}
+
+void AWfActorBase::CompleteInteraction(AActor* InteractiveActor)
+{
+	// Only characters carry effects
+	const AWfCharacterBase* Character = Cast<AWfCharacterBase>(InteractiveActor);
+	if (!IsValid(Character))
 		return;
-	}
 
-	if (!IsValid(ActorInteracting->AbilityComponent))
+	if (!IsValid(Character->AbilityComponent))
 	{
 		UE_LOGFMT(LogTemp, Error, "{ThisActor}({NetMode}): Actor '{InteractionActor}' does not have a valid Ability Component."
-			, GetName(), HasAuthority() ? "SRV" : "CLI", ActorInteracting->GetName());
+			, GetName(), HasAuthority() ? "SRV" : "CLI", Character->GetName());
 		return;
 	}
 
-	UWfAbilityComponent* AbilityComponent = ActorInteracting->AbilityComponent;
-	AddEffects(AbilityComponent, EffectsAddedOnStart);
-	RemoveEffects(AbilityComponent, EffectsRemovedOnStart);
+	ExecuteEffects(Character->AbilityComponent, EWfInteractionPhase::Success);
 }
 
-void AWfActorBase::RemoveEffects(UAbilitySystemComponent* AbilityComponent, TArray<TSubclassOf<UGameplayEffect>> EffectsArray)
+void AWfActorBase::NotifySlotGranted(AActor* InteractiveActor)
 {
-	if (!IsValid(ActorInteracting))
-		return;
-	if (!IsValid(ActorInteracting->AbilityComponent))
-		return;
+	OnSlotGranted.Broadcast(this, InteractiveActor);
+}
+
+void AWfActorBase::RefreshInteractionEffects()
+{
+	InteractionEffects = FWfInteractionEffects::FindOrBuild(this);
+}
 
-	const FGameplayEffectContextHandle EffectContext = AbilityComponent->MakeEffectContext();
-	for (const auto& GameplayEffect : EffectsArray)
+void AWfActorBase::BeginPlay()
+{
+	Super::BeginPlay();
+	RefreshInteractionEffects();
+
+	AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (IsValid(GameManager) && PropId == INDEX_NONE)
 	{
-		const UGameplayEffect* EffectObject = GameplayEffect->GetDefaultObject<UGameplayEffect>();
-		if (IsValid(EffectObject))
-		{
-			FGameplayEffectQuery EffectQuery;
-			EffectQuery.EffectDefinition = GameplayEffect;
-			UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Removing Effect '{AppliedEffect}' to Actor '{InteractionActor}'"
-				, GetName(), HasAuthority() ? "SRV" : "CLI", GameplayEffect->GetName(), ActorInteracting->GetName());
-			AbilityComponent->RemoveActiveEffects(EffectQuery);
-		}
+		InteractionManager = GameManager;
+		PropId = GameManager->GetInteractions().AddProp(this, NumSlots);
+
+		// Static and stationary props never leave the location they were registered at
+		if (IsRootComponentMovable())
+			TransformUpdatedHandle = GetRootComponent()->TransformUpdated.AddUObject(this, &AWfActorBase::OnRootTransformUpdated);
 	}
 }
 
-void AWfActorBase::AddEffects(UAbilitySystemComponent* AbilityComponent, TArray<TSubclassOf<UGameplayEffect>> EffectsArray)
+void AWfActorBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (TransformUpdatedHandle.IsValid() && IsValid(GetRootComponent()))
+		GetRootComponent()->TransformUpdated.Remove(TransformUpdatedHandle);
+	TransformUpdatedHandle.Reset();
+
+	if (AGameManager* GameManager = InteractionManager.Get())
+		GameManager->GetInteractions().RemoveProp(PropId);
+	InteractionManager.Reset();
+	PropId = INDEX_NONE;
+	Super::EndPlay(EndPlayReason);
+}
+
+FWfInteractionService* AWfActorBase::GetInteractions() const
+{
+	AGameManager* GameManager = InteractionManager.Get();
+	return IsValid(GameManager) && PropId != INDEX_NONE ? &GameManager->GetInteractions() : nullptr;
+}
+
+void AWfActorBase::OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
 {
-	if (!IsValid(ActorInteracting))
+	if (FWfInteractionService* Interactions = GetInteractions())
+		Interactions->MoveProp(PropId, UpdatedComponent->GetComponentLocation());
+}
+
+/**
+ * \brief Applies and removes the phase's effects through the precompiled bundles.
+ *  Bundles are built on first use if the actor has not begun play.
+ */
+void AWfActorBase::ExecuteEffects(UAbilitySystemComponent* AbilityComponent, const EWfInteractionPhase Phase)
+{
+	if (!IsValid(AbilityComponent))
 		return;
-	if (!IsValid(ActorInteracting->AbilityComponent))
+
+	if (!InteractionEffects.IsValid())
+		RefreshInteractionEffects();
+
+	const FWfEffectBundle& Bundle = InteractionEffects->Get(Phase);
+	if (Bundle.IsEmpty())
 		return;
 
-	const FGameplayEffectContextHandle EffectContext = AbilityComponent->MakeEffectContext();
-	for (const auto& GameplayEffect : EffectsArray)
-	{
-		const UGameplayEffect* EffectObject = GameplayEffect->GetDefaultObject<UGameplayEffect>();
-		if (IsValid(EffectObject))
-		{
-			AbilityComponent->ApplyGameplayEffectToSelf(EffectObject, 1, EffectContext);
-			UE_LOGFMT(LogTemp, Display, "{ThisActor}({NetMode}): Applied Effect '{AppliedEffect}' to Actor '{InteractionActor}'"
-				, GetName(), HasAuthority() ? "SRV" : "CLI", GameplayEffect->GetName(), ActorInteracting->GetName());
-		}
-	}
+	UE_LOGFMT(LogTemp, Verbose, "{ThisActor}({NetMode}): Applying {NumAdded} and removing {NumRemoved} effects on Actor '{InteractionActor}'"
+		, GetName(), HasAuthority() ? "SRV" : "CLI", Bundle.Specs.Num(), Bundle.Removed.Num(), GetNameSafe(AbilityComponent->GetOwner()));
+	Bundle.Execute(AbilityComponent);
 }
 
 void AWfActorBase::Tick(float DeltaTime)
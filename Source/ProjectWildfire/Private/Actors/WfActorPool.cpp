@@ -0,0 +1,236 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Actors/WfActorPool.h"
+
+#include "EngineUtils.h"
+#include "Interfaces/WfPoolableInterface.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogActorPool);
+
+AWfActorPool* AWfActorPool::Instance = nullptr;
+
+AWfActorPool::AWfActorPool()
+{
+	PrimaryActorTick.bCanEverTick = false;
+	bReplicates = false;
+}
+
+AWfActorPool* AWfActorPool::GetInstance(UObject* WorldContext)
+{
+	if (Instance == nullptr)
+	{
+		if (WorldContext)
+		{
+			if (UWorld* World = WorldContext->GetWorld())
+			{
+				for (TActorIterator<AWfActorPool> It(World); It; ++It)
+				{
+					return *It;
+				}
+
+				Instance = World->SpawnActor<AWfActorPool>();
+			}
+		}
+	}
+	return Instance;
+}
+
+void AWfActorPool::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (Instance != nullptr && Instance != this)
+	{
+		Destroy();
+		return;
+	}
+	Instance = this;
+
+	UE_LOGFMT(LogActorPool, Display, "{ThisName}({NetMode}): Actor Pool Ready!", GetName(), HasAuthority() ? "SRV" : "CLI");
+}
+
+void AWfActorPool::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+	LogStats();
+	Pools.Reset();
+	if (Instance == this)
+		Instance = nullptr;
+}
+
+/**
+ * \brief Pops free actors until one is still alive; anything destroyed while it waited is dropped.
+ *  The actor is woken up before its poolable hook runs, so the hook can replicate whatever it sets.
+ */
+AActor* AWfActorPool::AcquireActor(const TSubclassOf<AActor> ActorClass, const FTransform& Transform, AActor* NewOwner)
+{
+	if (ActorClass == nullptr)
+		return nullptr;
+
+	FClassPool& Pool = Pools.FindOrAdd(ActorClass.Get());
+	++Pool.NumAcquired;
+
+	AActor* Actor = nullptr;
+	while (!Pool.Free.IsEmpty() && Actor == nullptr)
+	{
+		AActor* FreeActor = Pool.Free.Pop(EAllowShrinking::No).Get();
+		if (IsValid(FreeActor))
+			Actor = FreeActor;
+	}
+
+	if (Actor != nullptr)
+	{
+		++Pool.NumHits;
+		Activate(Actor, Transform, NewOwner);
+	}
+	else
+	{
+		Actor = SpawnPooledActor(ActorClass.Get(), Transform, NewOwner);
+		if (Actor == nullptr)
+			return nullptr;
+		++Pool.NumSpawned;
+	}
+
+	if (IWfPoolableInterface* Poolable = Cast<IWfPoolableInterface>(Actor))
+		Poolable->OnAcquiredFromPool();
+	return Actor;
+}
+
+/**
+ * \brief Resets the actor through its poolable hook, then parks it hidden and dormant.
+ *  Releasing an actor twice, or after it was destroyed, does nothing.
+ */
+void AWfActorPool::ReleaseActor(AActor* Actor)
+{
+	if (!IsValid(Actor))
+		return;
+
+	FClassPool& Pool = Pools.FindOrAdd(Actor->GetClass());
+	if (Pool.Free.Contains(Actor))
+		return;
+
+	if (IWfPoolableInterface* Poolable = Cast<IWfPoolableInterface>(Actor))
+		Poolable->OnReturnedToPool();
+
+	if (Pool.Free.Num() >= MaxFreePerClass)
+	{
+		++Pool.NumDestroyed;
+		Actor->Destroy();
+		return;
+	}
+
+	++Pool.NumReleased;
+	Deactivate(Actor);
+	Pool.Free.Add(Actor);
+}
+
+void AWfActorPool::Prewarm(const TSubclassOf<AActor> ActorClass, const int32 NumFree)
+{
+	if (ActorClass == nullptr)
+		return;
+
+	FClassPool& Pool = Pools.FindOrAdd(ActorClass.Get());
+	const int32 Target = FMath::Min(NumFree, MaxFreePerClass);
+	while (Pool.Free.Num() < Target)
+	{
+		AActor* Actor = SpawnPooledActor(ActorClass.Get(), GetActorTransform(), nullptr);
+		if (Actor == nullptr)
+			break;
+
+		++Pool.NumSpawned;
+		Deactivate(Actor);
+		Pool.Free.Add(Actor);
+	}
+}
+
+float AWfActorPool::GetHitRate(const TSubclassOf<AActor> ActorClass) const
+{
+	const FClassPool* Pool = Pools.Find(ActorClass.Get());
+	if (Pool == nullptr || Pool->NumAcquired == 0)
+		return 0.0f;
+	return static_cast<float>(Pool->NumHits) / Pool->NumAcquired;
+}
+
+int32 AWfActorPool::GetNumFree(const TSubclassOf<AActor> ActorClass) const
+{
+	const FClassPool* Pool = Pools.Find(ActorClass.Get());
+	return Pool != nullptr ? Pool->Free.Num() : 0;
+}
+
+void AWfActorPool::LogStats() const
+{
+	for (const TPair<const UClass*, FClassPool>& Pair : Pools)
+	{
+		const FClassPool& Pool = Pair.Value;
+		const float HitRate = Pool.NumAcquired > 0 ? static_cast<float>(Pool.NumHits) / Pool.NumAcquired : 0.0f;
+		UE_LOGFMT(LogActorPool, Display, "{ThisName}({NetMode}): {Class}: {NumFree} free, {NumInUse} in use, {NumSpawned} spawned, {NumDestroyed} destroyed, {HitRate}% of {NumAcquired} acquires reused"
+			, GetName(), HasAuthority() ? "SRV" : "CLI", GetNameSafe(Pair.Key), Pool.Free.Num()
+			, Pool.NumSpawned - Pool.NumDestroyed - Pool.Free.Num(), Pool.NumSpawned, Pool.NumDestroyed
+			, FMath::RoundToInt(HitRate * 100.0f), Pool.NumAcquired);
+	}
+}
+
+AActor* AWfActorPool::SpawnPooledActor(UClass* ActorClass, const FTransform& Transform, AActor* NewOwner)
+{
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.Owner = NewOwner;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	AActor* Actor = GetWorld()->SpawnActor<AActor>(ActorClass, Transform, SpawnParams);
+	if (!IsValid(Actor))
+	{
+		UE_LOGFMT(LogActorPool, Error, "{ThisName}({NetMode}): Failed to spawn '{Class}' for the pool"
+			, GetName(), HasAuthority() ? "SRV" : "CLI", GetNameSafe(ActorClass));
+		return nullptr;
+	}
+	return Actor;
+}
+
+/**
+ * \brief The hidden flag is replicated before the channel goes dormant, so clients keep a hidden
+ *  copy of the actor rather than destroying it, and waking it later costs a property update instead of a new channel.
+ */
+void AWfActorPool::Deactivate(AActor* Actor)
+{
+	Actor->SetActorHiddenInGame(true);
+	Actor->SetActorEnableCollision(false);
+	Actor->SetActorTickEnabled(false);
+	Actor->GetWorldTimerManager().ClearAllTimersForObject(Actor);
+	if (Actor->GetIsReplicated())
+	{
+		Actor->ForceNetUpdate();
+		Actor->SetNetDormancy(DORM_DormantAll);
+	}
+}
+
+void AWfActorPool::Activate(AActor* Actor, const FTransform& Transform, AActor* NewOwner)
+{
+	if (Actor->GetIsReplicated())
+		Actor->SetNetDormancy(DORM_Awake);
+
+	Actor->SetActorTransform(Transform, false, nullptr, ETeleportType::ResetPhysics);
+	Actor->SetOwner(NewOwner);
+	Actor->SetActorHiddenInGame(false);
+	Actor->SetActorEnableCollision(true);
+	Actor->SetActorTickEnabled(Actor->PrimaryActorTick.bStartWithTickEnabled);
+	if (Actor->GetIsReplicated())
+		Actor->ForceNetUpdate();
+}
+
+
+/******************************************
+ *         STATS
+ */
+
+static FAutoConsoleCommandWithWorld GWfPoolStatsCommand(
+	TEXT("Wf.Pool.Stats"),
+	TEXT("Logs the size and hit rate of every actor pool. Usage: Wf.Pool.Stats"),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (const AWfActorPool* ActorPool = AWfActorPool::GetInstance(World))
+			ActorPool->LogStats();
+	})
+);
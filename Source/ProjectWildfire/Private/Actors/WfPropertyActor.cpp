@@ -3,6 +3,7 @@
 
 #include "Actors/WfPropertyActor.h"
 
+#include "Actors/WfRoadManager.h"
 #include "Statics/WfGlobalTags.h"
 
 
@@ -23,6 +24,24 @@ AWfPropertyActor::AWfPropertyActor()
 void AWfPropertyActor::BeginPlay()
 {
 	Super::BeginPlay();
+
+	AddressLocation = GetActorLocation();
+	PropertyCenter->TransformUpdated.AddUObject(this, &AWfPropertyActor::OnPropertyMoved);
+
+	if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+		RoadManager->RegisterProperty(this);
+}
+
+void AWfPropertyActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+	PropertyCenter->TransformUpdated.RemoveAll(this);
+
+	if (EndPlayReason == EEndPlayReason::Destroyed)
+	{
+		if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+			RoadManager->UnregisterProperty(this);
+	}
 }
 
 void AWfPropertyActor::OnConstruction(const FTransform& Transform)
@@ -49,6 +68,9 @@ void AWfPropertyActor::DetermineAddress()
 	// -Y North +Y South -X West +X East
 	PropertyAddress.BlockNumber = FMath::Abs(FMath::RoundToInt(WorldLocation.X / 10000));
 	PropertyAddress.HouseNumber = FMath::Abs(FMath::RoundToInt(WorldLocation.X /    10));
+
+	// In play, the road manager replaces this with the address of the nearest road (see BeginPlay)
+	bAddressCacheValid = false;
 }
 
 void AWfPropertyActor::Tick(float DeltaTime)
@@ -63,28 +85,84 @@ FStreetAddress AWfPropertyActor::GetStreetAddress() const
 
 FString AWfPropertyActor::GetStreetAddressAsString() const
 {
-	const FStreetAddress StreetAddress = GetStreetAddress();
-	FString HouseNumber = FString::FromInt(StreetAddress.BlockNumber + StreetAddress.HouseNumber);
-	FString AppendSuite = "";
-	if (StreetAddress.SuiteNumber > 0)
-		AppendSuite = " #" + FString::FromInt(StreetAddress.SuiteNumber);
-	return HouseNumber + AppendSuite + " " + StreetAddress.StreetName.ToString() + " " + StreetAddress.StreetType.ToString();
+	return GetCachedAddressString();
 }
 
-// Changes "123 Easy Street" into "1, 2, 3, Easy, Street."
+// Changes "123 Easy Street" into "1 2 3 Easy Street"
 FString AWfPropertyActor::GetStreetAddressForVox() const
 {
-	FString AddressString = GetStreetAddressAsString();
+	return GetCachedAddressForVox();
+}
+
+void AWfPropertyActor::SetStreetAddress(const FStreetAddress& NewAddress)
+{
+	PropertyAddress = NewAddress;
+	bAddressCacheValid = false;
+}
+
+const FString& AWfPropertyActor::GetCachedAddressString() const
+{
+	if (!bAddressCacheValid)
+		UpdateAddressCache();
+	return CachedAddressString;
+}
+
+const FString& AWfPropertyActor::GetCachedAddressForVox() const
+{
+	if (!bAddressCacheValid)
+		UpdateAddressCache();
+	return CachedAddressForVox;
+}
+
+// "123 Easy Street" -> { one, two, three, easy, street }
+const TArray<FName>& AWfPropertyActor::GetStreetAddressVoxTokens() const
+{
+	if (!bAddressCacheValid)
+		UpdateAddressCache();
+	return CachedVoxTokens;
+}
+
+void AWfPropertyActor::UpdateAddressCache() const
+{
+	static const FName DigitWords[10] = {
+		"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine" };
+
+	const FStreetAddress& StreetAddress = PropertyAddress;
+	const FString HouseNumber = FString::FromInt(StreetAddress.BlockNumber + StreetAddress.HouseNumber);
+	const FString StreetName  = StreetAddress.StreetName.ToString();
+	const FString StreetType  = StreetAddress.StreetType.ToString();
+
+	CachedAddressString = HouseNumber;
+	if (StreetAddress.SuiteNumber > 0)
+		CachedAddressString += " #" + FString::FromInt(StreetAddress.SuiteNumber);
+	CachedAddressString += " " + StreetName + " " + StreetType;
 
-	// "123 Easy Street" -> "1 2 3 Easy Street"
-	FString NewSentence;
-	for (TCHAR& SentenceChar : AddressString)
+	// Digits are spoken one at a time, so they are space separated in the vox form
+	CachedAddressForVox.Reset();
+	CachedVoxTokens.Reset();
+	for (const TCHAR SentenceChar : CachedAddressString)
 	{
-		NewSentence += SentenceChar;
+		CachedAddressForVox += SentenceChar;
 		if (FChar::IsDigit(SentenceChar))
-			NewSentence += " ";
+		{
+			CachedAddressForVox += " ";
+			CachedVoxTokens.Add(DigitWords[SentenceChar - TEXT('0')]);
+		}
 	}
-    NewSentence.TrimStartAndEndInline();
+	CachedAddressForVox.TrimStartAndEndInline();
+	CachedVoxTokens.Add(FName(*StreetName.ToLower()));
+	CachedVoxTokens.Add(FName(*StreetType.ToLower()));
+
+	bAddressCacheValid = true;
+}
+
+void AWfPropertyActor::OnPropertyMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateFlags, ETeleportType Teleport)
+{
+	// Only a real move changes the nearest road; ignore sub-meter adjustments
+	if (FVector::DistSquared2D(AddressLocation, GetActorLocation()) < FMath::Square(100.0f))
+		return;
 
-	return NewSentence;
+	AddressLocation = GetActorLocation();
+	if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+		RoadManager->UpdateProperty(this);
 }
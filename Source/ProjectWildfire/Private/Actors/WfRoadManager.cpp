@@ -0,0 +1,461 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Actors/WfRoadManager.h"
+
+#include "EngineUtils.h"
+#include "Actors/GameManager.h"
+#include "Actors/WfFireStationBase.h"
+#include "Actors/WfPropertyActor.h"
+#include "Camera/PlayerCameraManager.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "GameFramework/PlayerController.h"
+#include "Landscapes/WfRoadSplineBase.h"
+#include "Lib/WfSimTimings.h"
+#include "Logging/StructuredLog.h"
+#include "Vehicles/WfFireApparatusBase.h"
+
+
+AWfRoadManager* AWfRoadManager::Instance = nullptr;
+
+AWfRoadManager::AWfRoadManager()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	bReplicates = false;
+
+	RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("Root"));
+}
+
+AWfRoadManager* AWfRoadManager::GetInstance(UObject* WorldContext)
+{
+	if (Instance == nullptr)
+	{
+		if (WorldContext)
+		{
+			if (UWorld* World = WorldContext->GetWorld())
+			{
+				for (TActorIterator<AWfRoadManager> It(World); It; ++It)
+				{
+					return *It;
+				}
+
+				Instance = World->SpawnActor<AWfRoadManager>();
+			}
+		}
+	}
+	return Instance;
+}
+
+void AWfRoadManager::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (Instance != nullptr && Instance != this)
+	{
+		Destroy();
+		return;
+	}
+	Instance = this;
+
+	// Roads and properties that began play before the manager existed
+	for (TActorIterator<AWfRoadSplineBase> It(GetWorld()); It; ++It)
+	{
+		RegisterRoad(*It);
+	}
+	for (TActorIterator<AWfPropertyActor> It(GetWorld()); It; ++It)
+	{
+		RegisterProperty(*It);
+	}
+
+	if (HasAuthority())
+	{
+		GetWorldTimerManager().SetTimer(CoverageTimerHandle,
+			this, &AWfRoadManager::RefreshCoverage, CoverageRefreshSeconds, true);
+	}
+
+	// Traffic is only run where someone can see it (a local player, and car meshes to draw),
+	// and only drawn near where they are looking
+	if (GetNetMode() != NM_DedicatedServer && !TrafficCarMeshes.IsEmpty())
+	{
+		for (UStaticMesh* CarMesh : TrafficCarMeshes)
+		{
+			UInstancedStaticMeshComponent* Proxy = NewObject<UInstancedStaticMeshComponent>(this);
+			Proxy->SetStaticMesh(CarMesh);
+			Proxy->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+			Proxy->SetMobility(EComponentMobility::Movable);
+			Proxy->SetupAttachment(RootComponent);
+			Proxy->RegisterComponent();
+			TrafficProxies.Add(Proxy);
+		}
+		ProxyTransforms.SetNum(TrafficProxies.Num());
+		SetActorTickEnabled(true);
+		GetWorldTimerManager().SetTimer(TrafficTimerHandle,
+			this, &AWfRoadManager::StepTraffic, TrafficStepSeconds, true);
+	}
+
+	UE_LOGFMT(LogRoads, Display, "{ThisName}({NetMode}): Road Manager Ready!", GetName(), HasAuthority() ? "SRV" : "CLI");
+}
+
+void AWfRoadManager::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+	CoverageRaster.Flush();
+	Traffic.Reset();
+	if (Instance == this)
+		Instance = nullptr;
+}
+
+void AWfRoadManager::RegisterRoad(AWfRoadSplineBase* Road)
+{
+	if (!IsValid(Road) || Roads.Contains(Road))
+		return;
+	Roads.Add(Road);
+	RequestRebuild();
+}
+
+void AWfRoadManager::UnregisterRoad(AWfRoadSplineBase* Road)
+{
+	const int32 RoadIndex = GetRoadIndex(Road);
+	if (RoadIndex == INDEX_NONE)
+		return;
+	Roads[RoadIndex] = nullptr;
+	RequestRebuild();
+}
+
+void AWfRoadManager::SetRoadClosed(const AWfRoadSplineBase* Road, const bool bClosed)
+{
+	const int32 RoadIndex = GetRoadIndex(Road);
+	if (RoadIndex != INDEX_NONE)
+		RoadGraph.SetRoadClosed(RoadIndex, bClosed);
+}
+
+float AWfRoadManager::GetTravelTime(const FVector& FromLocation, const FVector& ToLocation) const
+{
+	const int32 FromNode = RoadGraph.FindNearestNode(FromLocation);
+	const int32 ToNode   = RoadGraph.FindNearestNode(ToLocation);
+	const float RoadTime = RoadGraph.FindPath(FromNode, ToNode);
+	if (RoadTime == FWfRoadGraph::UnreachableTime)
+		return -1.0f;
+	return RoadTime + GetOffRoadTime(FromLocation, FromNode) + GetOffRoadTime(ToLocation, ToNode);
+}
+
+float AWfRoadManager::GetStationTravelTime(const AWfFireStationBase* FireStation, const FVector& ToLocation)
+{
+	if (!IsValid(FireStation) || !RoadGraph.IsBuilt())
+		return -1.0f;
+
+	const int32 SourceIndex = FindOrAddStationSource(FireStation);
+	if (SourceIndex == INDEX_NONE)
+		return -1.0f;
+
+	const FVector StationLocation = FireStation->GetActorLocation();
+	const int32 ToNode = RoadGraph.FindNearestNode(ToLocation);
+	const float RoadTime = RoadGraph.GetSourceTravelTime(SourceIndex, ToNode);
+	if (RoadTime == FWfRoadGraph::UnreachableTime)
+		return -1.0f;
+	return RoadTime + GetOffRoadTime(StationLocation, RoadGraph.FindNearestNode(StationLocation)) + GetOffRoadTime(ToLocation, ToNode);
+}
+
+bool AWfRoadManager::FindRoute(const FVector& FromLocation, const FVector& ToLocation, TArray<FVector>& OutRoute) const
+{
+	OutRoute.Reset();
+	TArray<int32> RouteNodes;
+	const float RoadTime = RoadGraph.FindPath(
+		RoadGraph.FindNearestNode(FromLocation), RoadGraph.FindNearestNode(ToLocation), &RouteNodes);
+	if (RoadTime == FWfRoadGraph::UnreachableTime)
+		return false;
+
+	OutRoute.Reserve(RouteNodes.Num());
+	for (const int32 NodeIndex : RouteNodes)
+	{
+		OutRoute.Add(RoadGraph.GetNodeLocation(NodeIndex));
+	}
+	return true;
+}
+
+bool AWfRoadManager::GeocodeLocation(const FVector& Location, FStreetAddress& OutAddress) const
+{
+	FVector RoadPoint;
+	const int32 EdgeIndex = RoadGraph.FindNearestEdge(Location, RoadPoint);
+	if (EdgeIndex == INDEX_NONE)
+		return false;
+
+	const AWfRoadSplineBase* Road = GetRoad(RoadGraph.GetEdgeRoad(EdgeIndex));
+	if (!IsValid(Road))
+		return false;
+
+	const USplineComponent* RoadSpline = Road->RoadSpline;
+	const float InputKey = RoadSpline->FindInputKeyClosestToWorldLocation(RoadPoint);
+	const float Distance = RoadSpline->GetDistanceAlongSplineAtSplineInputKey(InputKey);
+	const FVector Tangent = RoadSpline->GetTangentAtSplineInputKey(InputKey, ESplineCoordinateSpace::World);
+	const bool bOddSide = FVector::CrossProduct(Tangent, Location - RoadPoint).Z > 0.0;
+
+	// Block 1 starts at the beginning of the road; the house number is the position within the block
+	const int32 Block = FMath::FloorToInt32(Distance / BlockLength) + 1;
+	const float BlockFraction = FMath::Fmod(Distance, BlockLength) / BlockLength;
+	const int32 House = FMath::Min(FMath::FloorToInt32(BlockFraction * 50.0f), 49) * 2 + (bOddSide ? 1 : 0);
+
+	OutAddress.BlockNumber = Block * 100;
+	OutAddress.HouseNumber = House;
+	OutAddress.StreetName  = FName(Road->StreetName);
+	OutAddress.StreetType  = FName(Road->StreetType);
+	return true;
+}
+
+void AWfRoadManager::RegisterProperty(AWfPropertyActor* Property)
+{
+	if (!IsValid(Property) || Properties.Contains(Property))
+		return;
+	Properties.Add(Property);
+	UpdateProperty(Property);
+}
+
+void AWfRoadManager::UnregisterProperty(AWfPropertyActor* Property)
+{
+	Properties.Remove(Property);
+	AddressIndex.RemoveProperty(Property);
+}
+
+void AWfRoadManager::UpdateProperty(AWfPropertyActor* Property)
+{
+	if (!IsValid(Property))
+		return;
+
+	// Before the first build the property keeps its authored address; the rebuild re-geocodes it
+	FStreetAddress NewAddress = Property->GetStreetAddress();
+	if (GeocodeLocation(Property->GetActorLocation(), NewAddress))
+		Property->SetStreetAddress(NewAddress);
+
+	AddressIndex.AddProperty(Property, Property->GetCachedAddressString());
+}
+
+AWfPropertyActor* AWfRoadManager::FindPropertyByAddress(const FString& Address) const
+{
+	return const_cast<AWfPropertyActor*>(AddressIndex.FindProperty(Address));
+}
+
+TArray<AWfPropertyActor*> AWfRoadManager::SearchAddresses(const FString& SearchText, const int32 MaxResults) const
+{
+	TArray<const AWfPropertyActor*> Found;
+	AddressIndex.FindPropertiesWithPrefix(SearchText, MaxResults, Found);
+
+	TArray<AWfPropertyActor*> Results;
+	Results.Reserve(Found.Num());
+	for (const AWfPropertyActor* Property : Found)
+	{
+		Results.Add(const_cast<AWfPropertyActor*>(Property));
+	}
+	return Results;
+}
+
+float AWfRoadManager::GetCoverageTime(const FVector& Location, const FName ApparatusType) const
+{
+	const int32 LayerIndex = CoverageRaster.FindLayer(ApparatusType);
+	return LayerIndex == INDEX_NONE ? -1.0f : CoverageRaster.GetTravelTime(Location, LayerIndex);
+}
+
+int32 AWfRoadManager::FindOrAddStationSource(const AWfFireStationBase* FireStation)
+{
+	if (const int32* SourceIndex = StationSources.Find(FireStation))
+		return *SourceIndex;
+
+	const int32 NewSource = RoadGraph.AddSource(RoadGraph.FindNearestNode(FireStation->GetActorLocation()));
+	if (NewSource != INDEX_NONE)
+		StationSources.Add(FireStation, NewSource);
+	return NewSource;
+}
+
+void AWfRoadManager::RefreshCoverage()
+{
+	WF_SCOPE_SIM_TIMING(TEXT("Coverage"));
+	const AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (!RoadGraph.IsBuilt() || !CoverageRaster.IsInitialized() || !IsValid(GameManager))
+		return;
+
+	// A station covers a layer when it has a staffed apparatus of that type; bit 0 is any type
+	TMap<const AWfFireStationBase*, uint32> StationMasks;
+	for (const FFireStationAssignments& StationAssignment : GameManager->GetAllFireStationAssignments())
+	{
+		if (IsValid(StationAssignment.FireStation))
+			StationMasks.Add(StationAssignment.FireStation, 0);
+	}
+	for (const FFireApparatusAssignments& ApparatusAssignment : GameManager->GetAllFireApparatusAssignments())
+	{
+		if (!IsValid(ApparatusAssignment.FireApparatus) || !IsValid(ApparatusAssignment.FireStation)
+			|| ApparatusAssignment.FireApparatus->GetSeatedFirefighters().IsEmpty())
+			continue;
+
+		const int32 LayerIndex = CoverageRaster.FindOrAddLayer(FName(ApparatusAssignment.FireApparatus->GetApparatusIdentityType()));
+		uint32& LayerMask = StationMasks.FindOrAdd(ApparatusAssignment.FireStation);
+		LayerMask |= 1u;
+		if (LayerIndex != INDEX_NONE)
+			LayerMask |= 1u << LayerIndex;
+	}
+
+	for (auto It = CoverageStations.CreateIterator(); It; ++It)
+	{
+		if (!StationMasks.Contains(It.Key()))
+		{
+			CoverageRaster.RemoveStation(It.Key());
+			It.RemoveCurrent();
+		}
+	}
+
+	for (const auto& StationMask : StationMasks)
+	{
+		const AWfFireStationBase* FireStation = StationMask.Key;
+		const FVector StationLocation = FireStation->GetActorLocation();
+		FStationCoverage* Coverage = CoverageStations.Find(FireStation);
+
+		// A station that moved needs a new source node
+		if (Coverage && !Coverage->Location.Equals(StationLocation, 100.0))
+		{
+			if (const int32* SourceIndex = StationSources.Find(FireStation))
+				RoadGraph.RemoveSource(*SourceIndex);
+			StationSources.Remove(FireStation);
+		}
+
+		const int32 SourceIndex = FindOrAddStationSource(FireStation);
+		const bool bChanged = Coverage == nullptr || Coverage->LayerMask != StationMask.Value
+			|| !Coverage->Location.Equals(StationLocation, 100.0)
+			|| RoadGraph.IsSourceDirty(SourceIndex) || RoadGraph.GetSourceVersion(SourceIndex) != Coverage->SourceVersion;
+		if (!bChanged || SourceIndex == INDEX_NONE)
+			continue;
+
+		// Road closures re-route the station, which shows up as a new version of its tree
+		TArray<float> NodeTravelTimes = RoadGraph.GetSourceTravelTimes(SourceIndex);
+		CoverageRaster.SetStation(FireStation, MoveTemp(NodeTravelTimes), StationMask.Value);
+		CoverageStations.Add(FireStation, {StationMask.Value, RoadGraph.GetSourceVersion(SourceIndex), StationLocation});
+	}
+
+	CoverageRaster.Update();
+}
+
+void AWfRoadManager::RequestRebuild()
+{
+	if (!RebuildTimerHandle.IsValid())
+		RebuildTimerHandle = GetWorldTimerManager().SetTimerForNextTick(this, &AWfRoadManager::RebuildRoadGraph);
+}
+
+void AWfRoadManager::RebuildRoadGraph()
+{
+	RebuildTimerHandle.Invalidate();
+
+	// Compact away roads that were unregistered, so indices stay dense
+	Roads.RemoveAll([](const AWfRoadSplineBase* Road) { return !IsValid(Road); });
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	RoadGraph.Reset();
+	StationSources.Reset();
+
+	TArray<FVector> RoadPoints;
+	for (int32 RoadIndex = 0; RoadIndex < Roads.Num(); ++RoadIndex)
+	{
+		const AWfRoadSplineBase* Road = Roads[RoadIndex];
+		Road->GetRoadPoints(RoadPoints);
+		RoadGraph.AddRoad(RoadIndex, RoadPoints, Road->SpeedLimitKph, Road->bOneWay);
+		if (Road->IsRoadClosed())
+			RoadGraph.SetRoadClosed(RoadIndex, true);
+	}
+	RoadGraph.Build(NumLandmarks);
+	CoverageRaster.Initialize(RoadGraph, CoverageCellSize, OffRoadSpeedKph);
+	CoverageStations.Reset();
+	if (GetNetMode() != NM_DedicatedServer && !TrafficCarMeshes.IsEmpty())
+	{
+		Traffic.Initialize(RoadGraph);
+		Traffic.SpawnCars(NumTrafficCars, TrafficSeed);
+	}
+
+	// Addresses depend on the roads, so every property is re-geocoded against the new graph
+	Properties.RemoveAll([](const AWfPropertyActor* Property) { return !IsValid(Property); });
+	AddressIndex.Reset();
+	for (AWfPropertyActor* Property : Properties)
+	{
+		UpdateProperty(Property);
+	}
+
+	UE_LOGFMT(LogRoads, Display, "{ThisName}({NetMode}): Built road graph from {NumRoads} road(s) in {Ms} ms"
+		, GetName(), HasAuthority() ? "SRV" : "CLI", Roads.Num(), (FPlatformTime::Seconds() - StartSeconds) * 1000.0);
+}
+
+void AWfRoadManager::StepTraffic()
+{
+	WF_SCOPE_SIM_TIMING(TEXT("Traffic"));
+	if (!Traffic.IsInitialized())
+		return;
+
+	// The route is used where it is known, on the server; elsewhere the lanes are worked out from the heading
+	TArray<FWfTrafficEmergency, TInlineAllocator<16>> Emergencies;
+	for (TActorIterator<AWfFireApparatusBase> It(GetWorld()); It; ++It)
+	{
+		if (!It->IsResponding())
+			continue;
+		FWfTrafficEmergency& Emergency = Emergencies.Add_GetRef({It->GetActorLocation(), It->GetActorForwardVector()});
+		if (!It->GetRouteEdges(RoadGraph, Emergency.Lane, Emergency.NextLane))
+			Traffic.FindEmergencyLanes(Emergency);
+	}
+
+	Traffic.Step(TrafficStepSeconds, Emergencies);
+	LastTrafficStepTime = GetWorld()->GetTimeSeconds();
+}
+
+/**
+ * \brief Cars are split between the meshes by car index, so a car keeps its mesh as it comes and goes.
+ *  Instances are not tied to cars: each mesh keeps as many as it has cars in range this frame,
+ *  and every one of them is moved in one batch, extrapolated along its lane since the last step.
+ */
+void AWfRoadManager::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+	if (TrafficProxies.IsEmpty())
+		return;
+
+	TrafficObservers.Reset();
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (IsValid(PlayerController) && PlayerController->IsLocalController() && PlayerController->PlayerCameraManager)
+			TrafficObservers.Add(PlayerController->PlayerCameraManager->GetCameraLocation());
+	}
+	Traffic.FindCarsNear(TrafficObservers, TrafficDrawRadius, VisibleCars);
+
+	const float SecondsSinceStep = FMath::Clamp(
+		static_cast<float>(GetWorld()->GetTimeSeconds() - LastTrafficStepTime), 0.0f, TrafficStepSeconds);
+	for (TArray<FTransform>& Transforms : ProxyTransforms)
+		Transforms.Reset();
+	for (const int32 CarIndex : VisibleCars)
+		ProxyTransforms[CarIndex % TrafficProxies.Num()].Add(Traffic.GetCarTransform(CarIndex, SecondsSinceStep));
+
+	for (int32 ProxyIndex = 0; ProxyIndex < TrafficProxies.Num(); ++ProxyIndex)
+	{
+		UInstancedStaticMeshComponent* Proxy = TrafficProxies[ProxyIndex];
+		const TArray<FTransform>& Transforms = ProxyTransforms[ProxyIndex];
+		if (!IsValid(Proxy))
+			continue;
+
+		const int32 NumInstances = Proxy->GetInstanceCount();
+		if (NumInstances > Transforms.Num())
+		{
+			TArray<int32> Unused;
+			for (int32 InstanceIndex = Transforms.Num(); InstanceIndex < NumInstances; ++InstanceIndex)
+				Unused.Add(InstanceIndex);
+			Proxy->RemoveInstances(Unused);
+		}
+		else if (NumInstances < Transforms.Num())
+		{
+			Proxy->AddInstances(TArray<FTransform>(Transforms.GetData() + NumInstances, Transforms.Num() - NumInstances), false, true);
+		}
+
+		if (!Transforms.IsEmpty())
+			Proxy->BatchUpdateInstancesTransforms(0, Transforms, true, true, true);
+	}
+}
+
+float AWfRoadManager::GetOffRoadTime(const FVector& Location, const int32 NodeIndex) const
+{
+	if (NodeIndex == INDEX_NONE)
+		return 0.0f;
+	const float SpeedCmPerSecond = FMath::Max(OffRoadSpeedKph, 1.0f) * 100000.0f / 3600.0f;
+	return FVector::Dist2D(Location, RoadGraph.GetNodeLocation(NodeIndex)) / SpeedCmPerSecond;
+}
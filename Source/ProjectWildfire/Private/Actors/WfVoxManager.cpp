@@ -6,6 +6,7 @@
 #include "Kismet/GameplayStatics.h"
 #include "Logging/StructuredLog.h"
 #include "Components/AudioComponent.h"
+#include "Lib/WfSimTimings.h"
 #include "Statics/WfGameModeBase.h"
 
 
@@ -128,6 +129,7 @@ void AWfVoxManager::SpeakSentence(const TArray<FName>& VoxPhrases, bool bSpatial
 
 void AWfVoxManager::SpeakRadio(const FString& RadioSentence)
 {
+	WF_SCOPE_CYCLE(STAT_WfVoxResolution, TEXT("VoxResolution"));
 	FString NewSentence = RadioSentence;
 
 	// Replace blanks, commas, and period
@@ -236,6 +238,7 @@ void AWfVoxManager::SpeakRadio(const FString& RadioSentence)
 	}
 	UE_LOGFMT(LogTemp, Display, "VoxManager({NetMode}): RADIO '{RadioMessage}'"
 		, HasAuthority() ? "SRV" : "CLI", RadioMessage);
+	WF_COUNT(STAT_WfNumVoxPhrases, TEXT("VoxPhrases"), VoxDataArray.Num());
 	Multicast_RadioCall(VoxDataArray);
 }
 
@@ -257,6 +260,8 @@ void AWfVoxManager::Multicast_Speak_Implementation(const FVoxCallout& VoxCallout
 void AWfVoxManager::Multicast_SpeakSentence_Implementation(
 	const TArray<FName>& VoxPhrases, bool bSpatialAudio, bool bNotifyDelegates)
 {
+	WF_SCOPE_CYCLE(STAT_WfVoxResolution, TEXT("VoxResolution"));
+	WF_COUNT(STAT_WfNumVoxPhrases, TEXT("VoxPhrases"), VoxPhrases.Num());
 	TArray<FVoxData> VoxAnnouncement;
 	for (const auto& VoxPhrase : VoxPhrases)
 	{
@@ -3,9 +3,13 @@
 
 #include "Characters/WfCharacterBase.h"
 
+#include "Actors/GameManager.h"
 #include "Characters/WfCharacterData.h"
 #include "Characters/WfCharacterTags.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Controllers/WfAiControllerBase.h"
 #include "Gas/WfAttributeSet.h"
+#include "GameFramework/CharacterMovementComponent.h"
 #include "Logging/StructuredLog.h"
 #include "Net/UnrealNetwork.h"
 #include "Saves/WfCharacterSaveGame.h"
@@ -34,7 +38,13 @@ void GetChildTagsOfParent(const FGameplayTag& ParentTag, TArray<FGameplayTag>& O
 
 // Sets default values
 AWfCharacterBase::AWfCharacterBase()
-	: CharacterAge(18)
+	: ReducedTickInterval(0.1f)
+	, AbstractNetUpdateFrequency(1.0f)
+	, CharacterAge(18)
+	, LodLevel(EWfLodLevel::Full)
+	, DefaultTickInterval(0.0f)
+	, DefaultNetUpdateFrequency(100.0f)
+	, DefaultAnimTickOption(EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones)
 {
 	// Set this character to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
@@ -155,6 +165,128 @@ void AWfCharacterBase::BeginPlay()
 	{
 		AbilityComponent->InitializeAttributes(CharacterAttributes);
 	}
+
+	DefaultTickInterval = GetActorTickInterval();
+	DefaultNetUpdateFrequency = NetUpdateFrequency;
+	if (IsValid(GetMesh()))
+		DefaultAnimTickOption = GetMesh()->VisibilityBasedAnimTickOption;
+
+	if (HasAuthority())
+	{
+		AGameManager* GameManager = AGameManager::GetInstance(this);
+		if (IsValid(GameManager) && LodId == INDEX_NONE)
+		{
+			LodManager = GameManager;
+			LodId = GameManager->GetCrowdLod().AddAgent(this, GetActorLocation());
+		}
+	}
+}
+
+void AWfCharacterBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (AGameManager* GameManager = LodManager.Get())
+		GameManager->GetCrowdLod().RemoveAgent(LodId);
+	LodManager.Reset();
+	LodId = INDEX_NONE;
+	Super::EndPlay(EndPlayReason);
+}
+
+/**
+ * \brief Rehydrating puts the character where the abstract simulation left it, turns its components back on
+ *  and resumes whatever move was handed over, so the controller's request completes as if never paused.
+ *  Going Abstract hands any move in progress to the crowd LOD first, then stops movement, animation
+ *  and ticking, and drops the replication rate; needs carry on in the needs store either way.
+ */
+void AWfCharacterBase::SetLodLevel(const EWfLodLevel NewLevel)
+{
+	if (NewLevel == LodLevel)
+		return;
+
+	const EWfLodLevel OldLevel = LodLevel;
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	USkeletalMeshComponent* SkeletalMesh = GetMesh();
+
+	if (OldLevel == EWfLodLevel::Abstract)
+	{
+		// Awake first, so the teleport below replicates
+		SetNetDormancy(DORM_Awake);
+		TeleportToLodLocation();
+		Movement->SetComponentTickEnabled(true);
+		if (IsValid(SkeletalMesh))
+			SkeletalMesh->SetComponentTickEnabled(true);
+		NetUpdateFrequency = DefaultNetUpdateFrequency;
+		if (AWfAiControllerBase* AiController = Cast<AWfAiControllerBase>(GetController()))
+			AiController->ResumeSuspendedMove();
+	}
+	else if (NewLevel == EWfLodLevel::Abstract)
+	{
+		LodLevel = NewLevel;
+		if (AGameManager* GameManager = LodManager.Get())
+			GameManager->GetCrowdLod().SetLocation(LodId, GetActorLocation());
+		BeginAbstractTravel();
+	}
+	LodLevel = NewLevel;
+
+	switch (NewLevel)
+	{
+	case EWfLodLevel::Full:
+		SetActorTickEnabled(PrimaryActorTick.bStartWithTickEnabled);
+		SetActorTickInterval(DefaultTickInterval);
+		Movement->SetComponentTickInterval(0.0f);
+		if (IsValid(SkeletalMesh))
+			SkeletalMesh->VisibilityBasedAnimTickOption = DefaultAnimTickOption;
+		break;
+	case EWfLodLevel::Reduced:
+		SetActorTickEnabled(PrimaryActorTick.bStartWithTickEnabled);
+		SetActorTickInterval(FMath::Max(DefaultTickInterval, ReducedTickInterval));
+		Movement->SetComponentTickInterval(ReducedTickInterval);
+		if (IsValid(SkeletalMesh))
+			SkeletalMesh->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered;
+		break;
+	default:
+		Movement->StopMovementImmediately();
+		Movement->SetComponentTickEnabled(false);
+		if (IsValid(SkeletalMesh))
+			SkeletalMesh->SetComponentTickEnabled(false);
+		SetActorTickEnabled(false);
+		NetUpdateFrequency = FMath::Min(DefaultNetUpdateFrequency, AbstractNetUpdateFrequency);
+		SetNetDormancy(DORM_DormantAll);
+		break;
+	}
+
+	OnLodLevelChanged.Broadcast(OldLevel, NewLevel);
+}
+
+void AWfCharacterBase::BeginAbstractTravel()
+{
+	AGameManager* GameManager = LodManager.Get();
+	AWfAiControllerBase* AiController = Cast<AWfAiControllerBase>(GetController());
+	if (!IsValid(GameManager) || !IsValid(AiController) || LodLevel != EWfLodLevel::Abstract)
+		return;
+
+	TArray<FVector> Route;
+	if (AiController->SuspendMove(Route))
+		GameManager->GetCrowdLod().StartTravel(LodId, MoveTemp(Route), GetCharacterMovement()->GetMaxSpeed());
+}
+
+void AWfCharacterBase::FinishAbstractTravel()
+{
+	// Still dormant, so clients are sent the arrival once rather than every abstract step
+	TeleportToLodLocation();
+	FlushNetDormancy();
+	if (AWfAiControllerBase* AiController = Cast<AWfAiControllerBase>(GetController()))
+		AiController->ResumeSuspendedMove();
+}
+
+void AWfCharacterBase::TeleportToLodLocation()
+{
+	const AGameManager* GameManager = LodManager.Get();
+	if (!IsValid(GameManager))
+		return;
+
+	const FVector Location = GameManager->GetCrowdLod().GetLocation(LodId);
+	if (!Location.Equals(GetActorLocation(), 1.0f))
+		TeleportTo(Location, GetActorRotation(), false, true);
 }
 
 void AWfCharacterBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
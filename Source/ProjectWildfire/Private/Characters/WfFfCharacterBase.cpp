@@ -6,6 +6,7 @@
 #include "Characters/WfCharacterTags.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/WfScheduleComponent.h"
+#include "Lib/WfSimTimings.h"
 #include "Logging/StructuredLog.h"
 #include "Net/UnrealNetwork.h"
 #include "Saves/WfCharacterSaveGame.h"
@@ -45,6 +46,8 @@ void AWfFfCharacterBase::SetHourlyRate(float NewHourlyRate)
 
 FJobContractData AWfFfCharacterBase::GetFirefighterJobContract()
 {
+	WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+	WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
 	if (!UGameplayStatics::DoesSaveGameExist(ContractId, ContractUserIndex))
 	{
 		SaveCharacter();
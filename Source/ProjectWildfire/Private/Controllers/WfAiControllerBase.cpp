@@ -3,6 +3,10 @@
 
 #include "Controllers/WfAiControllerBase.h"
 
+#include "Actors/GameManager.h"
+#include "Characters/WfCharacterBase.h"
+#include "Navigation/PathFollowingComponent.h"
+
 
 // Sets default values
 AWfAiControllerBase::AWfAiControllerBase()
@@ -10,13 +14,114 @@ AWfAiControllerBase::AWfAiControllerBase()
 	PrimaryActorTick.bCanEverTick = true;
 }
 
+void AWfAiControllerBase::RequestDecision()
+{
+	if (AGameManager* GameManager = BrainManager.Get())
+		GameManager->GetUtilityBrain().RequestEvaluation(AgentId);
+}
+
+void AWfAiControllerBase::SetDecision(const EWfUtilityAction NewDecision)
+{
+	if (NewDecision == Decision)
+		return;
+
+	const EWfUtilityAction OldDecision = Decision;
+	Decision = NewDecision;
+	OnDecisionChanged.Broadcast(OldDecision, NewDecision);
+}
+
+FPathFollowingRequestResult AWfAiControllerBase::MoveTo(const FAIMoveRequest& MoveRequest, FNavPathSharedPtr* OutPath)
+{
+	const FPathFollowingRequestResult Result = Super::MoveTo(MoveRequest, OutPath);
+	if (Result.Code == EPathFollowingRequestResult::RequestSuccessful)
+	{
+		SuspendedMoveId = FAIRequestID::InvalidRequest;
+		AWfCharacterBase* Character = Cast<AWfCharacterBase>(GetPawn());
+		if (IsValid(Character) && Character->GetLodLevel() == EWfLodLevel::Abstract)
+			Character->BeginAbstractTravel();
+	}
+	return Result;
+}
+
+bool AWfAiControllerBase::SuspendMove(TArray<FVector>& OutRoute)
+{
+	UPathFollowingComponent* PathFollowing = GetPathFollowingComponent();
+	const APawn* ControlledPawn = GetPawn();
+	if (!IsValid(PathFollowing) || !IsValid(ControlledPawn) || PathFollowing->GetStatus() != EPathFollowingStatus::Moving)
+		return false;
+
+	const FNavPathSharedPtr Path = PathFollowing->GetPath();
+	if (!Path.IsValid() || !Path->IsValid())
+		return false;
+
+	// Path points are on the navmesh, the pawn's location is the middle of its capsule
+	const FVector Location = ControlledPawn->GetActorLocation();
+	const FVector HeightOffset(0.0f, 0.0f, Location.Z - ControlledPawn->GetNavAgentLocation().Z);
+	const TArray<FNavPathPoint>& PathPoints = Path->GetPathPoints();
+
+	OutRoute.Reset();
+	OutRoute.Add(Location);
+	for (int32 PointIndex = FMath::Max(PathFollowing->GetNextPathIndex(), 0); PointIndex < PathPoints.Num(); ++PointIndex)
+		OutRoute.Add(PathPoints[PointIndex].Location + HeightOffset);
+	if (OutRoute.Num() < 2)
+		return false;
+
+	SuspendedMoveId = PathFollowing->GetCurrentRequestId();
+	PathFollowing->PauseMove(SuspendedMoveId);
+	return true;
+}
+
+void AWfAiControllerBase::ResumeSuspendedMove()
+{
+	UPathFollowingComponent* PathFollowing = GetPathFollowingComponent();
+	if (IsValid(PathFollowing) && SuspendedMoveId.IsValid())
+		PathFollowing->ResumeMove(SuspendedMoveId);
+	SuspendedMoveId = FAIRequestID::InvalidRequest;
+}
+
 void AWfAiControllerBase::BeginPlay()
 {
 	Super::BeginPlay();
 
 }
 
+void AWfAiControllerBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	RemoveFromBrain();
+	Super::EndPlay(EndPlayReason);
+}
+
+void AWfAiControllerBase::OnPossess(APawn* InPawn)
+{
+	Super::OnPossess(InPawn);
+	if (!HasAuthority() || !IsValid(InPawn))
+		return;
+
+	RemoveFromBrain();
+	AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (IsValid(GameManager))
+	{
+		BrainManager = GameManager;
+		AgentId = GameManager->GetUtilityBrain().AddAgent(InPawn);
+	}
+}
+
+void AWfAiControllerBase::OnUnPossess()
+{
+	RemoveFromBrain();
+	Super::OnUnPossess();
+}
+
 void AWfAiControllerBase::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 }
+
+void AWfAiControllerBase::RemoveFromBrain()
+{
+	if (AGameManager* GameManager = BrainManager.Get())
+		GameManager->GetUtilityBrain().RemoveAgent(AgentId);
+	BrainManager.Reset();
+	AgentId = INDEX_NONE;
+	Decision = EWfUtilityAction::Idle;
+}
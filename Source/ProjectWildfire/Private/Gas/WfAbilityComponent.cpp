@@ -1,12 +1,14 @@
 ﻿// Fill out your copyright notice in the Description page of Project Settings.
 
 #include "Gas/WfAbilityComponent.h"
+#include "Actors/GameManager.h"
 #include "Gas/WfFfAttributeSet.h"
 #include "Logging/StructuredLog.h"
 
 UWfAbilityComponent::UWfAbilityComponent()
 	: StatReduction(0.1f)
 	, ReductionFatigue(0.0f)
+	, ReductionMorale(0.0f)
 	, ReductionThirst(0.07f)
 	, ReductionHunger(0.0f)
 	, AttributeTimeRate(0.5f)
@@ -14,30 +16,28 @@ UWfAbilityComponent::UWfAbilityComponent()
 	SetIsReplicatedByDefault(true);
 }
 
-void UWfAbilityComponent::TimerTick()
+void UWfAbilityComponent::SetNewTimerRate(const float NewTimeRate)
 {
-	if (IsValid(CharacterAttributes))
-	{
-		AddHunger(StatReduction + ReductionHunger);
-		AddThirst(StatReduction + ReductionThirst);
-	}
+	AttributeTimeRate = NewTimeRate;
+	UpdateNeedRates();
 }
 
-void UWfAbilityComponent::SetNewTimerRate(const float NewTimeRate)
+/**
+ * \brief The reductions are amounts per AttributeTimeRate seconds, as they were when every character ran its own timer.
+ *  Hunger and thirst also grow by StatReduction; morale is the one need that goes down.
+ */
+void UWfAbilityComponent::UpdateNeedRates()
 {
-	if (NewTimeRate != AttributeTimeRate || !GetWorld()->GetTimerManager().IsTimerActive(AttributeTimer))
-	{
-		AttributeTimeRate = NewTimeRate;
-		if (AttributeTimer.IsValid())
-		{
-			GetWorld()->GetTimerManager().ClearTimer(AttributeTimer);
-		}
+	AGameManager* GameManager = NeedsManager.Get();
+	if (!IsValid(GameManager) || NeedsId == INDEX_NONE)
+		return;
 
-		FTimerDelegate TimerDelegate;
-		TimerDelegate.BindUObject(this, &UWfAbilityComponent::TimerTick);
-		GetWorld()->GetTimerManager().SetTimer(
-			AttributeTimer, TimerDelegate, AttributeTimeRate, true);
-	}
+	const float PerSecond = AttributeTimeRate > 0.0f ? 1.0f / AttributeTimeRate : 0.0f;
+	FWfNeedsStore& NeedsStore = GameManager->GetNeedsStore();
+	NeedsStore.SetRate(NeedsId, EWfNeed::Hunger,  (StatReduction + ReductionHunger) * PerSecond);
+	NeedsStore.SetRate(NeedsId, EWfNeed::Thirst,  (StatReduction + ReductionThirst) * PerSecond);
+	NeedsStore.SetRate(NeedsId, EWfNeed::Fatigue, ReductionFatigue * PerSecond);
+	NeedsStore.SetRate(NeedsId, EWfNeed::Morale,  -ReductionMorale * PerSecond);
 }
 
 float UWfAbilityComponent::SetHunger(float NewValue)
@@ -137,6 +137,15 @@ void UWfAbilityComponent::BeginPlay()
 	Super::BeginPlay();
 }
 
+void UWfAbilityComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (AGameManager* GameManager = NeedsManager.Get())
+		GameManager->GetNeedsStore().RemoveCharacter(NeedsId);
+	NeedsManager.Reset();
+	NeedsId = INDEX_NONE;
+	Super::EndPlay(EndPlayReason);
+}
+
 void UWfAbilityComponent::InitializeAttributes(UWfAttributeSet* AttributeSet)
 {
 	if (GetOwner()->HasAuthority())
@@ -145,7 +154,13 @@ void UWfAbilityComponent::InitializeAttributes(UWfAttributeSet* AttributeSet)
 		{
 			CharacterAttributes = AttributeSet;
 			CharacterAttributes->OnAttributeUpdated.AddDynamic(this, &UWfAbilityComponent::AttributeUpdated);
-			SetNewTimerRate(AttributeTimeRate);
+			AGameManager* GameManager = AGameManager::GetInstance(this);
+			if (IsValid(GameManager) && NeedsId == INDEX_NONE)
+			{
+				NeedsManager = GameManager;
+				NeedsId = GameManager->GetNeedsStore().AddCharacter(CharacterAttributes);
+			}
+			UpdateNeedRates();
 		}
 	}
 }
@@ -177,6 +192,109 @@ void UWfAbilityComponent::ModifyAttributePercent(const FGameplayAttribute& GameA
 void UWfAbilityComponent::AttributeUpdated(const FGameplayAttribute& GameAttribute, const float OldValue,
                                            const float NewValue)
 {
+	// Changes made outside the needs store, such as eating, become the store's new starting point
+	if (AGameManager* GameManager = NeedsManager.Get())
+		GameManager->GetNeedsStore().SetValue(NeedsId, FWfNeedsStore::FindNeed(GameAttribute), NewValue);
+
+	const EWfAttribute Attribute = UWfAttributeSet::FindAttribute(GameAttribute);
+	if (Attribute == EWfAttribute::Num)
+		return;
+
+	const int32 Index = static_cast<int32>(Attribute);
+	const uint32 Bit = WfAttributeBit(Attribute);
+	if ((DirtyMask & Bit) == 0)
+		DirtyOldValues[Index] = OldValue;
+	DirtyNewValues[Index] = NewValue;
+
+	// The first change of the frame schedules the flush; the rest only update the values
+	if (DirtyMask == 0)
+		GetWorld()->GetTimerManager().SetTimerForNextTick(this, &UWfAbilityComponent::FlushAttributeChanges);
+	DirtyMask |= Bit;
+}
+
+/**
+ * \brief Attributes that ended the frame where they started are dropped. Subscribers only hear about
+ *  frames in which one of their attributes changed.
+ */
+void UWfAbilityComponent::FlushAttributeChanges()
+{
+	FWfAttributeChanges AttributeChanges;
+	for (int32 Index = 0; Index < static_cast<int32>(EWfAttribute::Num); ++Index)
+	{
+		const EWfAttribute Attribute = static_cast<EWfAttribute>(Index);
+		if ((DirtyMask & WfAttributeBit(Attribute)) == 0 || DirtyOldValues[Index] == DirtyNewValues[Index])
+			continue;
+
+		FWfAttributeChange& Change = AttributeChanges.Changes.AddDefaulted_GetRef();
+		Change.Attribute = UWfAttributeSet::GetAttribute(Attribute);
+		Change.OldValue  = DirtyOldValues[Index];
+		Change.NewValue  = DirtyNewValues[Index];
+		AttributeChanges.ChangedMask |= WfAttributeBit(Attribute);
+	}
+	DirtyMask = 0;
+
+	if (AttributeChanges.Changes.IsEmpty())
+		return;
+
 	if (OnAttributeChanged.IsBound())
-		OnAttributeChanged.Broadcast(GameAttribute, OldValue, NewValue);
+	{
+		for (const FWfAttributeChange& Change : AttributeChanges.Changes)
+		{
+			OnAttributeChanged.Broadcast(Change.Attribute, Change.OldValue, Change.NewValue);
+		}
+	}
+
+	if (OnAttributesChanged.IsBound())
+		OnAttributesChanged.Broadcast(AttributeChanges);
+
+	// Copied, so a subscriber can unsubscribe from inside its callback
+	const TArray<FAttributeSubscriber> Subscribers = AttributeSubscribers;
+	for (const FAttributeSubscriber& Subscriber : Subscribers)
+	{
+		if ((Subscriber.AttributeMask & AttributeChanges.ChangedMask) == 0)
+			continue;
+		if (Subscriber.Native.IsBound())
+			Subscriber.Native.Execute(AttributeChanges);
+		else
+			Subscriber.Event.ExecuteIfBound(AttributeChanges);
+	}
+}
+
+FDelegateHandle UWfAbilityComponent::SubscribeToAttributes(const uint32 AttributeMask, FOnAttributesChangedNative&& Delegate)
+{
+	FAttributeSubscriber& Subscriber = AttributeSubscribers.AddDefaulted_GetRef();
+	Subscriber.AttributeMask = AttributeMask;
+	Subscriber.Handle = FDelegateHandle(FDelegateHandle::GenerateNewHandle);
+	Subscriber.Native = MoveTemp(Delegate);
+	return Subscriber.Handle;
+}
+
+void UWfAbilityComponent::UnsubscribeFromAttributes(const FDelegateHandle Handle)
+{
+	AttributeSubscribers.RemoveAll([Handle](const FAttributeSubscriber& Subscriber)
+	{
+		return Subscriber.Handle == Handle;
+	});
+}
+
+void UWfAbilityComponent::K2_SubscribeToAttributes(const int32 AttributeMask, FOnAttributesChangedEvent Event)
+{
+	FAttributeSubscriber& Subscriber = AttributeSubscribers.AddDefaulted_GetRef();
+	Subscriber.AttributeMask = static_cast<uint32>(AttributeMask);
+	Subscriber.Handle = FDelegateHandle(FDelegateHandle::GenerateNewHandle);
+	Subscriber.Event = Event;
+}
+
+void UWfAbilityComponent::K2_UnsubscribeFromAttributes(FOnAttributesChangedEvent Event)
+{
+	AttributeSubscribers.RemoveAll([&Event](const FAttributeSubscriber& Subscriber)
+	{
+		return Subscriber.Event == Event;
+	});
+}
+
+int32 UWfAbilityComponent::GetAttributeMask(const FGameplayAttribute& GameAttribute)
+{
+	const EWfAttribute Attribute = UWfAttributeSet::FindAttribute(GameAttribute);
+	return Attribute != EWfAttribute::Num ? static_cast<int32>(WfAttributeBit(Attribute)) : 0;
 }
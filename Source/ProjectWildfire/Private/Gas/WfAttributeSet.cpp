@@ -3,9 +3,46 @@
 
 #include "Gas/WfAttributeSet.h"
 
+#include "GameplayEffectExtension.h"
 #include "Logging/StructuredLog.h"
 #include "Net/UnrealNetwork.h"
 
+namespace WfAttributes
+{
+	// The data of each attribute, by EWfAttribute
+	constexpr FGameplayAttributeData UWfAttributeSet::* Members[] =
+	{
+#define WF_ATTRIBUTE_MEMBER(PropertyName) &UWfAttributeSet::PropertyName,
+		WF_ATTRIBUTE_LIST(WF_ATTRIBUTE_MEMBER)
+#undef WF_ATTRIBUTE_MEMBER
+	};
+	static_assert(UE_ARRAY_COUNT(Members) == static_cast<int32>(EWfAttribute::Num), "Every attribute needs a member");
+
+	// Built on first use; the properties are what FindAttribute() compares against
+	struct FTable
+	{
+		FTable()
+		{
+			int32 Index = 0;
+#define WF_ATTRIBUTE_ENTRY(PropertyName) \
+			Attributes[Index] = UWfAttributeSet::Get##PropertyName##Attribute(); \
+			Properties[Index] = Attributes[Index].GetUProperty(); \
+			++Index;
+			WF_ATTRIBUTE_LIST(WF_ATTRIBUTE_ENTRY)
+#undef WF_ATTRIBUTE_ENTRY
+		}
+
+		FGameplayAttribute Attributes[static_cast<int32>(EWfAttribute::Num)];
+		const FProperty* Properties[static_cast<int32>(EWfAttribute::Num)];
+	};
+
+	const FTable& GetTable()
+	{
+		static const FTable Table;
+		return Table;
+	}
+}
+
 UWfAttributeSet::UWfAttributeSet()
 	: Health(100.0f)
 	, Fatigue(0.0f)
@@ -28,41 +65,25 @@ UWfAttributeSet::UWfAttributeSet()
  */
 bool UWfAttributeSet::SetAttributeValue(const FGameplayAttribute& GameAttribute, float NewValue)
 {
-	if (!GameAttribute.IsValid())
-		return false;
-
-	const float OldValue = GetAttributeValue(GameAttribute);
-	const float FinalValue = FMath::Clamp(NewValue, 0.0f, 100.0f);
-
-	if (OldValue == FinalValue)
-		return false;
-
-	if (GameAttribute == GetHealthAttribute())	SetHealth(FinalValue);
-	if (GameAttribute == GetMoraleAttribute())  SetMorale(FinalValue);
-	if (GameAttribute == GetFatigueAttribute()) SetFatigue(FinalValue);
-	if (GameAttribute == GetHungerAttribute())  SetHunger(FinalValue);
-	if (GameAttribute == GetThirstAttribute())  SetThirst(FinalValue);
-
-	if (OnAttributeUpdated.IsBound())
-		OnAttributeUpdated.Broadcast(GameAttribute, OldValue, GetAttributeValue(GameAttribute));
-
-	return true;
+	return SetAttributeValue(FindAttribute(GameAttribute), NewValue);
 }
 
 float UWfAttributeSet::ModifyAttribute(const FGameplayAttribute& GameAttribute, float AddValue)
 {
-	if (!GameAttribute.IsValid())
+	const EWfAttribute Attribute = FindAttribute(GameAttribute);
+	if (Attribute == EWfAttribute::Num)
 		return false;
-	return SetAttributeValue(GameAttribute, GetAttributeValue(GameAttribute) + AddValue);
+	return SetAttributeValue(Attribute, GetAttributeValue(Attribute) + AddValue);
 }
 
 float UWfAttributeSet::ModifyAttributePercent(const FGameplayAttribute& GameAttribute, float PercentChange)
 {
-	if (!GameAttribute.IsValid())
+	const EWfAttribute Attribute = FindAttribute(GameAttribute);
+	if (Attribute == EWfAttribute::Num)
 		return false;
-	const float OldValue = GetAttributeValue(GameAttribute);
+	const float OldValue = GetAttributeValue(Attribute);
 	const float ValueChange = OldValue * PercentChange;
-	return SetAttributeValue(GameAttribute,
+	return SetAttributeValue(Attribute,
 		FMath::Clamp(OldValue + ValueChange, 0.0f, 100.0f));
 }
 
@@ -73,14 +94,105 @@ float UWfAttributeSet::ModifyAttributePercent(const FGameplayAttribute& GameAttr
  */
 float UWfAttributeSet::GetAttributeValue(const FGameplayAttribute& GameAttribute) const
 {
-	if (!GameAttribute.IsValid())
+	return GetAttributeValue(FindAttribute(GameAttribute));
+}
+
+EWfAttribute UWfAttributeSet::FindAttribute(const FGameplayAttribute& GameAttribute)
+{
+	const FProperty* Property = GameAttribute.GetUProperty();
+	if (Property == nullptr)
+		return EWfAttribute::Num;
+
+	const WfAttributes::FTable& Table = WfAttributes::GetTable();
+	for (int32 Index = 0; Index < static_cast<int32>(EWfAttribute::Num); ++Index)
+	{
+		if (Table.Properties[Index] == Property)
+			return static_cast<EWfAttribute>(Index);
+	}
+	return EWfAttribute::Num;
+}
+
+FGameplayAttribute UWfAttributeSet::GetAttribute(const EWfAttribute Attribute)
+{
+	if (Attribute >= EWfAttribute::Num)
+		return FGameplayAttribute();
+	return WfAttributes::GetTable().Attributes[static_cast<int32>(Attribute)];
+}
+
+/**
+ * \brief Sets the attribute through the owning ability system component, as the generated setters do,
+ *  and broadcasts the change
+ * \return True if the value changed
+ */
+bool UWfAttributeSet::SetAttributeValue(const EWfAttribute Attribute, float NewValue)
+{
+	if (Attribute >= EWfAttribute::Num)
+		return false;
+
+	const float OldValue = GetAttributeValue(Attribute);
+	const float FinalValue = FMath::Clamp(NewValue, 0.0f, 100.0f);
+
+	if (OldValue == FinalValue)
+		return false;
+
+	const FGameplayAttribute& GameAttribute = WfAttributes::GetTable().Attributes[static_cast<int32>(Attribute)];
+	UAbilitySystemComponent* AbilityComp = GetOwningAbilitySystemComponent();
+	if (ensure(AbilityComp))
+		AbilityComp->SetNumericAttributeBase(GameAttribute, FinalValue);
+
+	if (OnAttributeUpdated.IsBound())
+		OnAttributeUpdated.Broadcast(GameAttribute, OldValue, GetAttributeValue(Attribute));
+
+	return true;
+}
+
+float UWfAttributeSet::GetAttributeValue(const EWfAttribute Attribute) const
+{
+	if (Attribute >= EWfAttribute::Num)
 		return -100.0f;
-	if (GameAttribute == GetHealthAttribute())	{ return GetHealth(); }
-	if (GameAttribute == GetMoraleAttribute())  { return GetMorale(); }
-	if (GameAttribute == GetFatigueAttribute()) { return GetFatigue(); }
-	if (GameAttribute == GetHungerAttribute())  { return GetHunger(); }
-	if (GameAttribute == GetThirstAttribute())  { return GetThirst(); }
-	return -100.0f;
+	return (this->*WfAttributes::Members[static_cast<int32>(Attribute)]).GetCurrentValue();
+}
+
+int32 UWfAttributeSet::ApplyAttributeDeltas(TConstArrayView<FWfAttributeDelta> Deltas)
+{
+	int32 NumChanged = 0;
+	for (const FWfAttributeDelta& Delta : Deltas)
+	{
+		if (IsValid(Delta.AttributeSet) && Delta.Attribute < EWfAttribute::Num && Delta.Delta != 0.0f)
+		{
+			UWfAttributeSet* AttributeSet = Delta.AttributeSet;
+			NumChanged += AttributeSet->SetAttributeValue(Delta.Attribute, AttributeSet->GetAttributeValue(Delta.Attribute) + Delta.Delta);
+		}
+	}
+	return NumChanged;
+}
+
+bool UWfAttributeSet::PreGameplayEffectExecute(FGameplayEffectModCallbackData& Data)
+{
+	PreEffectValue = GetAttributeValue(FindAttribute(Data.EvaluatedData.Attribute));
+	return Super::PreGameplayEffectExecute(Data);
+}
+
+/**
+ * \brief Instant gameplay effects (eating, drinking, resting, ...) change the base value without going through
+ *  SetAttributeValue(). Broadcasting here is what lets the needs store pick up the new value as its starting point.
+ */
+void UWfAttributeSet::PostGameplayEffectExecute(const FGameplayEffectModCallbackData& Data)
+{
+	Super::PostGameplayEffectExecute(Data);
+
+	const EWfAttribute Attribute = FindAttribute(Data.EvaluatedData.Attribute);
+	if (Attribute == EWfAttribute::Num)
+		return;
+
+	const FGameplayAttribute& GameAttribute = WfAttributes::GetTable().Attributes[static_cast<int32>(Attribute)];
+	const float Value = GetAttributeValue(Attribute);
+	const float FinalValue = FMath::Clamp(Value, 0.0f, 100.0f);
+	if (FinalValue != Value)
+		Data.Target.SetNumericAttributeBase(GameAttribute, FinalValue);
+
+	if (PreEffectValue != FinalValue && OnAttributeUpdated.IsBound())
+		OnAttributeUpdated.Broadcast(GameAttribute, PreEffectValue, GetAttributeValue(Attribute));
 }
 
 
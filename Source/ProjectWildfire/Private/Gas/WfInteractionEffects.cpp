@@ -0,0 +1,187 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Gas/WfInteractionEffects.h"
+
+#include "AbilitySystemComponent.h"
+#include "GameplayEffectAggregator.h"
+#include "Actors/WfActorBase.h"
+#include "Engine/World.h"
+#include "UObject/GCObject.h"
+
+
+namespace WfInteractionEffects
+{
+	/**
+	 * \brief The shared class bundles. Their specs point at effect definitions the garbage collector cannot see
+	 *  through a plain map, so the cache reports them itself. It is dropped whenever a world is cleaned up or
+	 *  Blueprints are reinstanced, as either can leave the classes it was built from unloaded or out of date.
+	 */
+	class FClassBundleCache : public FGCObject
+	{
+	public:
+
+		FClassBundleCache()
+		{
+			WorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddRaw(this, &FClassBundleCache::OnWorldCleanup);
+#if WITH_EDITOR
+			ReinstancedHandle = FCoreUObjectDelegates::OnObjectsReinstanced.AddRaw(this, &FClassBundleCache::OnObjectsReinstanced);
+#endif
+		}
+
+		virtual ~FClassBundleCache() override
+		{
+			FWorldDelegates::OnWorldCleanup.Remove(WorldCleanupHandle);
+#if WITH_EDITOR
+			FCoreUObjectDelegates::OnObjectsReinstanced.Remove(ReinstancedHandle);
+#endif
+		}
+
+		virtual void AddReferencedObjects(FReferenceCollector& Collector) override
+		{
+			for (TPair<TObjectKey<UClass>, TSharedRef<FWfInteractionEffects>>& Pair : Bundles)
+			{
+				for (FWfEffectBundle& Bundle : Pair.Value->Phases)
+				{
+					for (FGameplayEffectSpec& Spec : Bundle.Specs)
+						Collector.AddPropertyReferencesWithStructARO(FGameplayEffectSpec::StaticStruct(), &Spec);
+				}
+			}
+		}
+
+		virtual FString GetReferencerName() const override
+		{
+			return TEXT("FWfInteractionEffects");
+		}
+
+		TMap<TObjectKey<UClass>, TSharedRef<FWfInteractionEffects>> Bundles;
+
+	private:
+
+		void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+		{
+			FWfInteractionEffects::ResetCache();
+		}
+
+#if WITH_EDITOR
+		void OnObjectsReinstanced(const FCoreUObjectDelegates::FReplacementObjectMap& ReplacementMap)
+		{
+			FWfInteractionEffects::ResetCache();
+		}
+#endif
+
+		FDelegateHandle WorldCleanupHandle;
+		FDelegateHandle ReinstancedHandle;
+	};
+
+	FClassBundleCache& GetClassBundles()
+	{
+		static FClassBundleCache ClassBundles;
+		return ClassBundles;
+	}
+
+	void BuildBundle(FWfEffectBundle& Bundle, const TArray<TSubclassOf<UGameplayEffect>>& Added,
+		const TArray<TSubclassOf<UGameplayEffect>>& Removed)
+	{
+		for (const TSubclassOf<UGameplayEffect>& GameplayEffect : Added)
+		{
+			if (const UGameplayEffect* EffectObject = GameplayEffect.GetDefaultObject())
+				Bundle.Specs.Emplace(EffectObject, FGameplayEffectContextHandle(), 1.0f);
+		}
+
+		for (const TSubclassOf<UGameplayEffect>& GameplayEffect : Removed)
+		{
+			if (GameplayEffect != nullptr)
+				Bundle.Removed.AddUnique(GameplayEffect);
+		}
+
+		if (!Bundle.Removed.IsEmpty())
+		{
+			Bundle.RemoveQuery.CustomMatchDelegate.BindLambda([Removed = Bundle.Removed](const FActiveGameplayEffect& ActiveEffect)
+			{
+				return ActiveEffect.Spec.Def != nullptr && Removed.Contains(ActiveEffect.Spec.Def->GetClass());
+			});
+		}
+	}
+
+	bool HasDefaultEffects(const AWfActorBase* Actor)
+	{
+		const AWfActorBase* Defaults = Actor->GetClass()->GetDefaultObject<AWfActorBase>();
+		return Actor == Defaults
+			|| (Actor->EffectsAddedOnStart		== Defaults->EffectsAddedOnStart
+			&&	Actor->EffectsRemovedOnStart	== Defaults->EffectsRemovedOnStart
+			&&	Actor->EffectsAddedOnSuccess	== Defaults->EffectsAddedOnSuccess
+			&&	Actor->EffectsRemovedOnSuccess	== Defaults->EffectsRemovedOnSuccess
+			&&	Actor->EffectsAddedOnFailure	== Defaults->EffectsAddedOnFailure
+			&&	Actor->EffectsRemovedOnFailure	== Defaults->EffectsRemovedOnFailure
+			&&	Actor->EffectsAddedOnStop		== Defaults->EffectsAddedOnStop
+			&&	Actor->EffectsRemovedOnStop		== Defaults->EffectsRemovedOnStop);
+	}
+}
+
+/**
+ * \brief The copy keeps the definition, level, modifiers and capture definitions of the template;
+ *  only the context and what it captures from the source are filled in here.
+ *  Aggregators are marked dirty once for the whole bundle rather than once per effect.
+ */
+void FWfEffectBundle::Execute(UAbilitySystemComponent* AbilityComponent) const
+{
+	if (!IsValid(AbilityComponent) || IsEmpty())
+		return;
+
+	FScopedAggregatorOnDirtyBatch AggregatorBatch;
+
+	if (!Specs.IsEmpty())
+	{
+		const FGameplayEffectContextHandle EffectContext = AbilityComponent->MakeEffectContext();
+		for (const FGameplayEffectSpec& Template : Specs)
+		{
+			FGameplayEffectSpec Spec(Template);
+			Spec.SetContext(EffectContext);
+			Spec.CaptureDataFromSource();
+			AbilityComponent->ApplyGameplayEffectSpecToSelf(Spec);
+		}
+	}
+
+	if (!Removed.IsEmpty())
+		AbilityComponent->RemoveActiveEffects(RemoveQuery);
+}
+
+TSharedRef<const FWfInteractionEffects> FWfInteractionEffects::FindOrBuild(const AWfActorBase* Actor)
+{
+	check(IsInGameThread());
+	if (!WfInteractionEffects::HasDefaultEffects(Actor))
+		return Build(Actor);
+
+	TMap<TObjectKey<UClass>, TSharedRef<FWfInteractionEffects>>& ClassBundles = WfInteractionEffects::GetClassBundles().Bundles;
+	if (const TSharedRef<FWfInteractionEffects>* ClassBundle = ClassBundles.Find(Actor->GetClass()))
+		return *ClassBundle;
+
+	const AWfActorBase* Defaults = Actor->GetClass()->GetDefaultObject<AWfActorBase>();
+	return ClassBundles.Add(Actor->GetClass(), BuildMutable(Defaults));
+}
+
+TSharedRef<const FWfInteractionEffects> FWfInteractionEffects::Build(const AWfActorBase* Actor)
+{
+	return BuildMutable(Actor);
+}
+
+TSharedRef<FWfInteractionEffects> FWfInteractionEffects::BuildMutable(const AWfActorBase* Actor)
+{
+	const TSharedRef<FWfInteractionEffects> Effects = MakeShared<FWfInteractionEffects>();
+	WfInteractionEffects::BuildBundle(Effects->Phases[static_cast<int32>(EWfInteractionPhase::Start)],
+		Actor->EffectsAddedOnStart, Actor->EffectsRemovedOnStart);
+	WfInteractionEffects::BuildBundle(Effects->Phases[static_cast<int32>(EWfInteractionPhase::Success)],
+		Actor->EffectsAddedOnSuccess, Actor->EffectsRemovedOnSuccess);
+	WfInteractionEffects::BuildBundle(Effects->Phases[static_cast<int32>(EWfInteractionPhase::Failure)],
+		Actor->EffectsAddedOnFailure, Actor->EffectsRemovedOnFailure);
+	WfInteractionEffects::BuildBundle(Effects->Phases[static_cast<int32>(EWfInteractionPhase::Stop)],
+		Actor->EffectsAddedOnStop, Actor->EffectsRemovedOnStop);
+	return Effects;
+}
+
+void FWfInteractionEffects::ResetCache()
+{
+	check(IsInGameThread());
+	WfInteractionEffects::GetClassBundles().Bundles.Reset();
+}
@@ -0,0 +1,7 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Interfaces/WfPoolableInterface.h"
+
+
+// Add default functionality here for any IWfPoolableInterface functions that are not pure virtual.
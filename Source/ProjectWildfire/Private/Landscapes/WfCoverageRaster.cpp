@@ -0,0 +1,244 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Landscapes/WfCoverageRaster.h"
+
+#include "Async/ParallelFor.h"
+#include "Landscapes/WfRoadGraph.h"
+#include "Logging/StructuredLog.h"
+
+
+FWfCoverageRaster::FWfCoverageRaster()
+	: bLayersDirty(false), bJobRunning(false)
+{
+	// Layer 0 is every apparatus type
+	LayerTypes.Add(NAME_None);
+}
+
+FWfCoverageRaster::~FWfCoverageRaster()
+{
+	Flush();
+}
+
+void FWfCoverageRaster::Initialize(const FWfRoadGraph& RoadGraph, const float InCellSize, const float OffRoadSpeedKph)
+{
+	Flush();
+	Reset();
+	if (!RoadGraph.IsBuilt() || RoadGraph.GetNumNodes() == 0)
+		return;
+
+	FBox2D Bounds(ForceInit);
+	for (int32 NodeIndex = 0; NodeIndex < RoadGraph.GetNumNodes(); ++NodeIndex)
+	{
+		Bounds += FVector2D(RoadGraph.GetNodeLocation(NodeIndex));
+	}
+	Bounds = Bounds.ExpandBy(InCellSize);
+
+	TSharedRef<FGrid, ESPMode::ThreadSafe> NewGrid = MakeShared<FGrid, ESPMode::ThreadSafe>();
+	NewGrid->Origin   = Bounds.Min;
+	NewGrid->CellSize = InCellSize;
+	NewGrid->NumX     = FMath::Max(1, FMath::CeilToInt32(Bounds.GetSize().X / InCellSize));
+	NewGrid->NumY     = FMath::Max(1, FMath::CeilToInt32(Bounds.GetSize().Y / InCellSize));
+
+	const int32 NumCells = NewGrid->NumX * NewGrid->NumY;
+	NewGrid->CellNodes.SetNumUninitialized(NumCells);
+	NewGrid->CellOffRoadTimes.SetNumUninitialized(NumCells);
+
+	// Nearest node lookups only read the graph, so rows can be mapped in parallel
+	const float SpeedCmPerSecond = FMath::Max(OffRoadSpeedKph, 1.0f) * 100000.0f / 3600.0f;
+	FGrid& GridRef = *NewGrid;
+	ParallelFor(GridRef.NumY, [&GridRef, &RoadGraph, SpeedCmPerSecond](const int32 Y)
+	{
+		for (int32 X = 0; X < GridRef.NumX; ++X)
+		{
+			const int32 CellIndex = Y * GridRef.NumX + X;
+			const FVector CellCenter(
+				GridRef.Origin.X + (X + 0.5) * GridRef.CellSize, GridRef.Origin.Y + (Y + 0.5) * GridRef.CellSize, 0.0);
+			const int32 NodeIndex = RoadGraph.FindNearestNode(CellCenter);
+			GridRef.CellNodes[CellIndex] = NodeIndex;
+			GridRef.CellOffRoadTimes[CellIndex] = NodeIndex == INDEX_NONE ? 0.0f
+				: FVector::Dist2D(CellCenter, RoadGraph.GetNodeLocation(NodeIndex)) / SpeedCmPerSecond;
+		}
+	});
+
+	Grid = NewGrid;
+	UE_LOGFMT(LogRoads, Display, "Coverage raster initialized: {NumX} x {NumY} cells of {CellSize} cm"
+		, Grid->NumX, Grid->NumY, InCellSize);
+}
+
+void FWfCoverageRaster::Reset()
+{
+	Flush();
+	Grid.Reset();
+	Stations.Reset();
+	DirtyStations.Reset();
+	Layers.Reset();
+	bLayersDirty = false;
+}
+
+int32 FWfCoverageRaster::FindOrAddLayer(const FName ApparatusType)
+{
+	const int32 LayerIndex = FindLayer(ApparatusType);
+	if (LayerIndex != INDEX_NONE)
+		return LayerIndex;
+	if (LayerTypes.Num() >= MaxLayers)
+		return INDEX_NONE;
+	bLayersDirty = true;
+	return LayerTypes.Add(ApparatusType);
+}
+
+int32 FWfCoverageRaster::FindLayer(const FName ApparatusType) const
+{
+	return ApparatusType.IsNone() ? 0 : LayerTypes.IndexOfByKey(ApparatusType);
+}
+
+void FWfCoverageRaster::SetStation(const void* StationKey, TArray<float>&& NodeTravelTimes, const uint32 LayerMask)
+{
+	FStationState& Station = Stations.FindOrAdd(StationKey);
+	Station.LayerMask = LayerMask;
+	Station.NodeTravelTimes = MakeShared<const TArray<float>, ESPMode::ThreadSafe>(MoveTemp(NodeTravelTimes));
+	Station.Raster.Reset();
+	DirtyStations.Add(StationKey);
+}
+
+void FWfCoverageRaster::RemoveStation(const void* StationKey)
+{
+	if (Stations.Remove(StationKey) > 0)
+	{
+		DirtyStations.Remove(StationKey);
+		bLayersDirty = true;
+	}
+}
+
+void FWfCoverageRaster::Update()
+{
+	if (bJobRunning && Job.IsCompleted())
+		CollectJob();
+
+	if (!bJobRunning && Grid.IsValid() && (!DirtyStations.IsEmpty() || bLayersDirty))
+		LaunchJob();
+}
+
+void FWfCoverageRaster::Flush()
+{
+	if (bJobRunning)
+	{
+		Job.Wait();
+		CollectJob();
+	}
+}
+
+void FWfCoverageRaster::CollectJob()
+{
+	FJobResult& Result = Job.GetResult();
+	for (const auto& StationRaster : Result.StationRasters)
+	{
+		// The station may have changed or gone while the job ran; only keep rasters that are still current
+		FStationState* Station = Stations.Find(StationRaster.Key);
+		if (Station && !DirtyStations.Contains(StationRaster.Key))
+			Station->Raster = StationRaster.Value;
+	}
+	Layers = Result.Layers;
+	Job = {};
+	bJobRunning = false;
+}
+
+float FWfCoverageRaster::GetTravelTime(const FVector& Location, const int32 LayerIndex) const
+{
+	if (!Grid.IsValid() || !Layers.IsValid() || !Layers->IsValidIndex(LayerIndex))
+		return -1.0f;
+
+	const int32 X = FMath::FloorToInt32((Location.X - Grid->Origin.X) / Grid->CellSize);
+	const int32 Y = FMath::FloorToInt32((Location.Y - Grid->Origin.Y) / Grid->CellSize);
+	if (X < 0 || Y < 0 || X >= Grid->NumX || Y >= Grid->NumY)
+		return -1.0f;
+
+	const uint16 Seconds = (*Layers)[LayerIndex][Y * Grid->NumX + X];
+	return Seconds == Uncovered ? -1.0f : Seconds;
+}
+
+/**
+ * \brief Snapshots the changed stations and launches a task that rasterizes them, then rebuilds
+ *  every layer as the per-cell minimum over the stations that cover it.
+ */
+void FWfCoverageRaster::LaunchJob()
+{
+	struct FStationInput
+	{
+		const void* Key;
+		uint32 LayerMask;
+		TSharedPtr<const TArray<float>, ESPMode::ThreadSafe> NodeTravelTimes;
+		TSharedPtr<const TArray<uint16>, ESPMode::ThreadSafe> Raster;
+	};
+
+	TArray<FStationInput> Inputs;
+	Inputs.Reserve(Stations.Num());
+	for (const auto& Station : Stations)
+	{
+		Inputs.Add({Station.Key, Station.Value.LayerMask, Station.Value.NodeTravelTimes, Station.Value.Raster});
+	}
+	DirtyStations.Reset();
+	bLayersDirty = false;
+
+	const int32 NumLayers = LayerTypes.Num();
+	TSharedPtr<const FGrid, ESPMode::ThreadSafe> JobGrid = Grid;
+
+	bJobRunning = true;
+	Job = UE::Tasks::Launch(UE_SOURCE_LOCATION, [Inputs = MoveTemp(Inputs), JobGrid, NumLayers]()
+	{
+		FJobResult Result;
+		const int32 NumCells = JobGrid->NumX * JobGrid->NumY;
+
+		// Rasterize stations that changed since the last job
+		TArray<TSharedPtr<const TArray<uint16>, ESPMode::ThreadSafe>> Rasters;
+		Rasters.Reserve(Inputs.Num());
+		for (const FStationInput& Input : Inputs)
+		{
+			if (Input.Raster.IsValid() || !Input.NodeTravelTimes.IsValid())
+			{
+				Rasters.Add(Input.Raster);
+				continue;
+			}
+
+			TSharedRef<TArray<uint16>, ESPMode::ThreadSafe> Raster = MakeShared<TArray<uint16>, ESPMode::ThreadSafe>();
+			Raster->SetNumUninitialized(NumCells);
+			const TArray<float>& NodeTimes = *Input.NodeTravelTimes;
+			TArray<uint16>& RasterRef = *Raster;
+			ParallelFor(JobGrid->NumY, [&RasterRef, &NodeTimes, &JobGrid](const int32 Y)
+			{
+				for (int32 CellIndex = Y * JobGrid->NumX; CellIndex < (Y + 1) * JobGrid->NumX; ++CellIndex)
+				{
+					const int32 NodeIndex = JobGrid->CellNodes[CellIndex];
+					const float RoadTime = NodeIndex == INDEX_NONE ? FWfRoadGraph::UnreachableTime : NodeTimes[NodeIndex];
+					RasterRef[CellIndex] = RoadTime == FWfRoadGraph::UnreachableTime ? Uncovered
+						: static_cast<uint16>(FMath::Min(RoadTime + JobGrid->CellOffRoadTimes[CellIndex], Uncovered - 1.0f));
+				}
+			});
+			Result.StationRasters.Add(Input.Key, Raster);
+			Rasters.Add(Raster);
+		}
+
+		// Each layer is the minimum over the stations that respond with that apparatus type
+		TSharedRef<TArray<TArray<uint16>>, ESPMode::ThreadSafe> NewLayers = MakeShared<TArray<TArray<uint16>>, ESPMode::ThreadSafe>();
+		NewLayers->SetNum(NumLayers);
+		TArray<TArray<uint16>>& LayersRef = *NewLayers;
+		ParallelFor(NumLayers, [&LayersRef, &Inputs, &Rasters, NumCells](const int32 LayerIndex)
+		{
+			TArray<uint16>& Layer = LayersRef[LayerIndex];
+			Layer.Init(Uncovered, NumCells);
+			for (int32 StationIndex = 0; StationIndex < Inputs.Num(); ++StationIndex)
+			{
+				if ((Inputs[StationIndex].LayerMask & (1u << LayerIndex)) == 0 || !Rasters[StationIndex].IsValid())
+					continue;
+				const uint16* Raster = Rasters[StationIndex]->GetData();
+				uint16* LayerData = Layer.GetData();
+				for (int32 CellIndex = 0; CellIndex < NumCells; ++CellIndex)
+				{
+					LayerData[CellIndex] = FMath::Min(LayerData[CellIndex], Raster[CellIndex]);
+				}
+			}
+		});
+		Result.Layers = NewLayers;
+		return Result;
+	});
+}
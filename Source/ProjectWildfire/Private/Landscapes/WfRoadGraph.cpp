@@ -0,0 +1,728 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Landscapes/WfRoadGraph.h"
+
+#include "Algo/BinarySearch.h"
+#include "Algo/Reverse.h"
+#include "Logging/StructuredLog.h"
+
+DEFINE_LOG_CATEGORY(LogRoads);
+
+
+FWfRoadGraph::FWfRoadGraph()
+	: NumLandmarksBuilt(0), NodeCellSize(5000.0f), SnapTolerance(150.0f), SearchStamp(0), Version(0), bBuilt(false)
+{
+}
+
+void FWfRoadGraph::AddRoad(const int32 RoadIndex, TConstArrayView<FVector> Points, const float SpeedLimitKph, const bool bOneWay)
+{
+	if (Points.Num() < 2)
+		return;
+
+	// Kilometers per hour to centimeters per second
+	const float SpeedCmPerSecond = FMath::Max(SpeedLimitKph, 5.0f) * 100000.0f / 3600.0f;
+
+	bBuilt = false;
+	int32 PreviousNode = FindOrAddNode(Points[0]);
+	for (int32 i = 1; i < Points.Num(); ++i)
+	{
+		const int32 NextNode = FindOrAddNode(Points[i]);
+		if (NextNode == PreviousNode)
+			continue;
+
+		const float TravelTime = FVector::Dist(NodeLocations[PreviousNode], NodeLocations[NextNode]) / SpeedCmPerSecond;
+		PendingEdges.Add({PreviousNode, NextNode, TravelTime, RoadIndex});
+		if (!bOneWay)
+			PendingEdges.Add({NextNode, PreviousNode, TravelTime, RoadIndex});
+		PreviousNode = NextNode;
+	}
+}
+
+void FWfRoadGraph::Build(const int32 NumLandmarks)
+{
+	SplitJunctions();
+	const int32 NumNodes = NodeLocations.Num();
+
+	// Sort the pending edges by source node, so each node's outgoing edges are contiguous
+	PendingEdges.Sort([](const FPendingEdge& A, const FPendingEdge& B)
+	{
+		return A.FromNode < B.FromNode;
+	});
+
+	EdgeOffsets.Init(0, NumNodes + 1);
+	EdgeTargets.SetNumUninitialized(PendingEdges.Num());
+	EdgeTimes.SetNumUninitialized(PendingEdges.Num());
+	EdgeRoads.SetNumUninitialized(PendingEdges.Num());
+	RoadEdges.Reset();
+
+	for (int32 EdgeIndex = 0; EdgeIndex < PendingEdges.Num(); ++EdgeIndex)
+	{
+		const FPendingEdge& Edge = PendingEdges[EdgeIndex];
+		++EdgeOffsets[Edge.FromNode + 1];
+		EdgeTargets[EdgeIndex] = Edge.ToNode;
+		EdgeTimes[EdgeIndex]   = Edge.TravelTime;
+		EdgeRoads[EdgeIndex]   = Edge.RoadIndex;
+		RoadEdges.FindOrAdd(Edge.RoadIndex).Add(EdgeIndex);
+	}
+	for (int32 NodeIndex = 0; NodeIndex < NumNodes; ++NodeIndex)
+	{
+		EdgeOffsets[NodeIndex + 1] += EdgeOffsets[NodeIndex];
+	}
+
+	// Reverse adjacency for the backwards landmark searches
+	ReverseOffsets.Init(0, NumNodes + 1);
+	ReverseSources.SetNumUninitialized(PendingEdges.Num());
+	ReverseEdges.SetNumUninitialized(PendingEdges.Num());
+	for (const FPendingEdge& Edge : PendingEdges)
+	{
+		++ReverseOffsets[Edge.ToNode + 1];
+	}
+	for (int32 NodeIndex = 0; NodeIndex < NumNodes; ++NodeIndex)
+	{
+		ReverseOffsets[NodeIndex + 1] += ReverseOffsets[NodeIndex];
+	}
+	TArray<int32> ReverseFill(ReverseOffsets.GetData(), NumNodes);
+	for (int32 EdgeIndex = 0; EdgeIndex < PendingEdges.Num(); ++EdgeIndex)
+	{
+		const int32 Slot = ReverseFill[PendingEdges[EdgeIndex].ToNode]++;
+		ReverseSources[Slot] = PendingEdges[EdgeIndex].FromNode;
+		ReverseEdges[Slot]   = EdgeIndex;
+	}
+	PendingEdges.Empty();
+
+	// Re-apply closures made before the build
+	ClosedEdges.Init(0, FMath::DivideAndRoundUp(EdgeTargets.Num(), 64));
+	for (const int32 RoadIndex : ClosedRoads)
+	{
+		if (const TArray<int32>* Edges = RoadEdges.Find(RoadIndex))
+		{
+			for (const int32 EdgeIndex : *Edges)
+			{
+				ClosedEdges[EdgeIndex >> 6] |= 1ull << (EdgeIndex & 63);
+			}
+		}
+	}
+
+	SearchTimes.SetNumUninitialized(NumNodes);
+	SearchParents.SetNumUninitialized(NumNodes);
+	SearchStamps.Init(0, NumNodes);
+	SearchStamp = 0;
+
+	SelectLandmarks(NumLandmarks);
+
+	for (FSourceTree& Source : Sources)
+	{
+		Source.bDirty = true;
+	}
+
+	bBuilt = true;
+	++Version;
+	UE_LOGFMT(LogRoads, Display, "Road graph built: {Nodes} nodes, {Edges} edges, {Landmarks} landmarks"
+		, NumNodes, EdgeTargets.Num(), NumLandmarksBuilt);
+}
+
+void FWfRoadGraph::Reset()
+{
+	NodeLocations.Reset();
+	EdgeOffsets.Reset();
+	EdgeTargets.Reset();
+	EdgeTimes.Reset();
+	EdgeRoads.Reset();
+	ReverseOffsets.Reset();
+	ReverseSources.Reset();
+	ReverseEdges.Reset();
+	ClosedEdges.Reset();
+	ClosedRoads.Reset();
+	RoadEdges.Reset();
+	LandmarkFrom.Reset();
+	LandmarkTo.Reset();
+	NumLandmarksBuilt = 0;
+	NodeCells.Reset();
+	PendingEdges.Reset();
+	Sources.Reset();
+	SearchTimes.Reset();
+	SearchParents.Reset();
+	SearchStamps.Reset();
+	bBuilt = false;
+	++Version;
+}
+
+int32 FWfRoadGraph::FindNearestNode(const FVector& Location) const
+{
+	if (NodeLocations.IsEmpty())
+		return INDEX_NONE;
+
+	const FIntPoint Center = GetCell(Location, NodeCellSize);
+	int32 BestNode = INDEX_NONE;
+	double BestDistanceSquared = TNumericLimits<double>::Max();
+
+	// Expand rings of cells until the ring is further away than the best node found
+	constexpr int32 MaxRings = 64;
+	for (int32 Ring = 0; Ring <= MaxRings; ++Ring)
+	{
+		const double RingDistance = FMath::Max(0, Ring - 1) * NodeCellSize;
+		if (BestNode != INDEX_NONE && RingDistance * RingDistance > BestDistanceSquared)
+			break;
+
+		for (int32 X = -Ring; X <= Ring; ++X)
+		{
+			for (int32 Y = -Ring; Y <= Ring; ++Y)
+			{
+				if (FMath::Abs(X) != Ring && FMath::Abs(Y) != Ring)
+					continue;
+				const TArray<int32>* Cell = NodeCells.Find(Center + FIntPoint(X, Y));
+				if (Cell == nullptr)
+					continue;
+				for (const int32 NodeIndex : *Cell)
+				{
+					const double DistanceSquared = FVector::DistSquared2D(NodeLocations[NodeIndex], Location);
+					if (DistanceSquared < BestDistanceSquared)
+					{
+						BestDistanceSquared = DistanceSquared;
+						BestNode = NodeIndex;
+					}
+				}
+			}
+		}
+	}
+
+	// Nothing within the search rings; fall back to a full scan
+	if (BestNode == INDEX_NONE)
+	{
+		for (int32 NodeIndex = 0; NodeIndex < NodeLocations.Num(); ++NodeIndex)
+		{
+			const double DistanceSquared = FVector::DistSquared2D(NodeLocations[NodeIndex], Location);
+			if (DistanceSquared < BestDistanceSquared)
+			{
+				BestDistanceSquared = DistanceSquared;
+				BestNode = NodeIndex;
+			}
+		}
+	}
+	return BestNode;
+}
+
+int32 FWfRoadGraph::FindNearestEdge(const FVector& Location, FVector& OutClosestPoint) const
+{
+	const int32 NearestNode = FindNearestNode(Location);
+	if (!bBuilt || NearestNode == INDEX_NONE)
+		return INDEX_NONE;
+
+	int32 BestEdge = INDEX_NONE;
+	double BestDistanceSquared = TNumericLimits<double>::Max();
+	const auto TestEdge = [&](const int32 EdgeIndex, const int32 FromNode, const int32 ToNode)
+	{
+		const FVector ClosestPoint = FMath::ClosestPointOnSegment(Location, NodeLocations[FromNode], NodeLocations[ToNode]);
+		const double DistanceSquared = FVector::DistSquared2D(ClosestPoint, Location);
+		if (DistanceSquared < BestDistanceSquared)
+		{
+			BestDistanceSquared = DistanceSquared;
+			BestEdge = EdgeIndex;
+			OutClosestPoint = ClosestPoint;
+		}
+	};
+
+	// Outgoing and incoming edges, so one-way roads ending at the node are still found
+	for (int32 EdgeIndex = EdgeOffsets[NearestNode]; EdgeIndex < EdgeOffsets[NearestNode + 1]; ++EdgeIndex)
+	{
+		TestEdge(EdgeIndex, NearestNode, EdgeTargets[EdgeIndex]);
+	}
+	for (int32 Slot = ReverseOffsets[NearestNode]; Slot < ReverseOffsets[NearestNode + 1]; ++Slot)
+	{
+		TestEdge(ReverseEdges[Slot], ReverseSources[Slot], NearestNode);
+	}
+	return BestEdge;
+}
+
+int32 FWfRoadGraph::GetEdgeSource(const int32 EdgeIndex) const
+{
+	// The edge's source node is the one whose CSR range contains it
+	return Algo::UpperBound(EdgeOffsets, EdgeIndex) - 1;
+}
+
+int32 FWfRoadGraph::FindEdge(const int32 FromNode, const int32 ToNode) const
+{
+	if (!bBuilt || !NodeLocations.IsValidIndex(FromNode))
+		return INDEX_NONE;
+
+	int32 FastestEdge = INDEX_NONE;
+	for (int32 EdgeIndex = EdgeOffsets[FromNode]; EdgeIndex < EdgeOffsets[FromNode + 1]; ++EdgeIndex)
+	{
+		if (EdgeTargets[EdgeIndex] == ToNode && IsEdgeOpen(EdgeIndex)
+			&& (FastestEdge == INDEX_NONE || EdgeTimes[EdgeIndex] < EdgeTimes[FastestEdge]))
+			FastestEdge = EdgeIndex;
+	}
+	return FastestEdge;
+}
+
+float FWfRoadGraph::FindPath(const int32 FromNode, const int32 ToNode, TArray<int32>* OutNodes) const
+{
+	if (OutNodes)
+		OutNodes->Reset();
+	if (!bBuilt || !NodeLocations.IsValidIndex(FromNode) || !NodeLocations.IsValidIndex(ToNode))
+		return UnreachableTime;
+
+	// Wrapping the stamp would make stale entries look current
+	if (++SearchStamp == 0)
+	{
+		FMemory::Memzero(SearchStamps.GetData(), SearchStamps.Num() * sizeof(uint32));
+		SearchStamp = 1;
+	}
+
+	struct FOpenNode
+	{
+		float Estimate;
+		int32 NodeIndex;
+	};
+	TArray<FOpenNode, TInlineAllocator<256>> OpenSet;
+	const auto EstimateLess = [](const FOpenNode& A, const FOpenNode& B) { return A.Estimate < B.Estimate; };
+
+	SearchStamps[FromNode]  = SearchStamp;
+	SearchTimes[FromNode]   = 0.0f;
+	SearchParents[FromNode] = INDEX_NONE;
+	OpenSet.HeapPush({GetHeuristic(FromNode, ToNode), FromNode}, EstimateLess);
+
+	while (!OpenSet.IsEmpty())
+	{
+		FOpenNode Current;
+		OpenSet.HeapPop(Current, EstimateLess, EAllowShrinking::No);
+
+		const float CurrentTime = SearchTimes[Current.NodeIndex];
+		if (Current.NodeIndex == ToNode)
+		{
+			if (OutNodes)
+			{
+				for (int32 NodeIndex = ToNode; NodeIndex != INDEX_NONE; NodeIndex = SearchParents[NodeIndex])
+				{
+					OutNodes->Add(NodeIndex);
+				}
+				Algo::Reverse(*OutNodes);
+			}
+			return CurrentTime;
+		}
+
+		// Stale heap entry, a faster route to this node was already expanded
+		if (Current.Estimate > CurrentTime + GetHeuristic(Current.NodeIndex, ToNode) + KINDA_SMALL_NUMBER)
+			continue;
+
+		for (int32 EdgeIndex = EdgeOffsets[Current.NodeIndex]; EdgeIndex < EdgeOffsets[Current.NodeIndex + 1]; ++EdgeIndex)
+		{
+			if (!IsEdgeOpen(EdgeIndex))
+				continue;
+
+			const int32 NextNode = EdgeTargets[EdgeIndex];
+			const float NextTime = CurrentTime + EdgeTimes[EdgeIndex];
+			if (SearchStamps[NextNode] == SearchStamp && SearchTimes[NextNode] <= NextTime)
+				continue;
+
+			SearchStamps[NextNode]  = SearchStamp;
+			SearchTimes[NextNode]   = NextTime;
+			SearchParents[NextNode] = Current.NodeIndex;
+			OpenSet.HeapPush({NextTime + GetHeuristic(NextNode, ToNode), NextNode}, EstimateLess);
+		}
+	}
+	return UnreachableTime;
+}
+
+bool FWfRoadGraph::SetRoadClosed(const int32 RoadIndex, const bool bClosed)
+{
+	if (bClosed == ClosedRoads.Contains(RoadIndex))
+		return false;
+
+	if (bClosed)
+		ClosedRoads.Add(RoadIndex);
+	else
+		ClosedRoads.Remove(RoadIndex);
+	++Version;
+
+	if (!bBuilt)
+		return true;
+
+	if (const TArray<int32>* Edges = RoadEdges.Find(RoadIndex))
+	{
+		for (const int32 EdgeIndex : *Edges)
+		{
+			if (bClosed)
+				ClosedEdges[EdgeIndex >> 6] |= 1ull << (EdgeIndex & 63);
+			else
+				ClosedEdges[EdgeIndex >> 6] &= ~(1ull << (EdgeIndex & 63));
+			InvalidateSourcesForEdge(EdgeIndex, bClosed);
+		}
+	}
+
+	UE_LOGFMT(LogRoads, Display, "Road {RoadIndex} {State}. {NumDirty} cached station tree(s) invalidated."
+		, RoadIndex, bClosed ? "closed" : "reopened", GetNumDirtySources());
+	return true;
+}
+
+int32 FWfRoadGraph::AddSource(const int32 NodeIndex)
+{
+	if (!NodeLocations.IsValidIndex(NodeIndex))
+		return INDEX_NONE;
+
+	FSourceTree NewSource;
+	NewSource.RootNode = NodeIndex;
+	return Sources.Add(MoveTemp(NewSource));
+}
+
+void FWfRoadGraph::RemoveSource(const int32 SourceIndex)
+{
+	if (Sources.IsValidIndex(SourceIndex))
+		Sources.RemoveAt(SourceIndex);
+}
+
+float FWfRoadGraph::GetSourceTravelTime(const int32 SourceIndex, const int32 NodeIndex) const
+{
+	if (!bBuilt || !Sources.IsValidIndex(SourceIndex) || !NodeLocations.IsValidIndex(NodeIndex))
+		return UnreachableTime;
+
+	FSourceTree& Source = Sources[SourceIndex];
+	if (Source.bDirty)
+		RebuildSource(Source);
+	return Source.TravelTimes[NodeIndex];
+}
+
+const TArray<float>& FWfRoadGraph::GetSourceTravelTimes(const int32 SourceIndex) const
+{
+	FSourceTree& Source = Sources[SourceIndex];
+	if (Source.bDirty)
+		RebuildSource(Source);
+	return Source.TravelTimes;
+}
+
+bool FWfRoadGraph::GetSourcePath(const int32 SourceIndex, const int32 NodeIndex, TArray<int32>& OutNodes) const
+{
+	OutNodes.Reset();
+	if (GetSourceTravelTime(SourceIndex, NodeIndex) == UnreachableTime)
+		return false;
+
+	const FSourceTree& Source = Sources[SourceIndex];
+	for (int32 Current = NodeIndex; Current != Source.RootNode; )
+	{
+		OutNodes.Add(Current);
+		Current = GetEdgeSource(Source.ParentEdges[Current]);
+	}
+	OutNodes.Add(Source.RootNode);
+	Algo::Reverse(OutNodes);
+	return true;
+}
+
+int32 FWfRoadGraph::GetNumDirtySources() const
+{
+	int32 NumDirty = 0;
+	for (const FSourceTree& Source : Sources)
+	{
+		NumDirty += Source.bDirty ? 1 : 0;
+	}
+	return NumDirty;
+}
+
+int32 FWfRoadGraph::FindOrAddNode(const FVector& Location)
+{
+	// Snap to any existing node within tolerance, so roads that meet share a node
+	const FIntPoint Center = GetCell(Location, NodeCellSize);
+	const double ToleranceSquared = SnapTolerance * SnapTolerance;
+	for (int32 X = -1; X <= 1; ++X)
+	{
+		for (int32 Y = -1; Y <= 1; ++Y)
+		{
+			if (const TArray<int32>* Cell = NodeCells.Find(Center + FIntPoint(X, Y)))
+			{
+				for (const int32 NodeIndex : *Cell)
+				{
+					if (FVector::DistSquared(NodeLocations[NodeIndex], Location) <= ToleranceSquared)
+						return NodeIndex;
+				}
+			}
+		}
+	}
+
+	const int32 NodeIndex = NodeLocations.Add(Location);
+	NodeCells.FindOrAdd(Center).Add(NodeIndex);
+	return NodeIndex;
+}
+
+/**
+ * \brief Roads only share a node where their points snapped together. A road ending partway along
+ *  another, or two roads crossing between their points, would leave the graph disconnected there.
+ *  Every node lying on another road's edge, and every point where two edges cross, becomes a node
+ *  on those edges, which are split around it. Crossings further apart in height than MaxJunctionHeight
+ *  are bridges and are left alone.
+ */
+void FWfRoadGraph::SplitJunctions()
+{
+	constexpr float MaxJunctionHeight = 300.0f;
+	const int32 NumEdges = PendingEdges.Num();
+	const int32 NumOriginalNodes = NodeLocations.Num();
+
+	// Edges by every cell their bounds, grown by the snap tolerance, overlap
+	TMap<FIntPoint, TArray<int32>> EdgeCells;
+	for (int32 EdgeIndex = 0; EdgeIndex < NumEdges; ++EdgeIndex)
+	{
+		const FVector& From = NodeLocations[PendingEdges[EdgeIndex].FromNode];
+		const FVector& To = NodeLocations[PendingEdges[EdgeIndex].ToNode];
+		const FIntPoint MinCell = GetCell(From.ComponentMin(To) - FVector(SnapTolerance), NodeCellSize);
+		const FIntPoint MaxCell = GetCell(From.ComponentMax(To) + FVector(SnapTolerance), NodeCellSize);
+		for (int32 X = MinCell.X; X <= MaxCell.X; ++X)
+		{
+			for (int32 Y = MinCell.Y; Y <= MaxCell.Y; ++Y)
+			{
+				EdgeCells.FindOrAdd(FIntPoint(X, Y)).Add(EdgeIndex);
+			}
+		}
+	}
+
+	// Nodes each edge is split at, with how far along the edge they are
+	TArray<TArray<TPair<float, int32>>> Splits;
+	Splits.SetNum(NumEdges);
+	int32 NumSplits = 0;
+	const auto AddSplit = [this, &Splits, &NumSplits](const int32 EdgeIndex, const int32 NodeIndex)
+	{
+		const FPendingEdge& Edge = PendingEdges[EdgeIndex];
+		if (NodeIndex == Edge.FromNode || NodeIndex == Edge.ToNode)
+			return;
+		if (Splits[EdgeIndex].ContainsByPredicate([NodeIndex](const TPair<float, int32>& Split) { return Split.Value == NodeIndex; }))
+			return;
+
+		const FVector2D From(NodeLocations[Edge.FromNode]);
+		const FVector2D Span = FVector2D(NodeLocations[Edge.ToNode]) - From;
+		const double Fraction = FVector2D::DotProduct(FVector2D(NodeLocations[NodeIndex]) - From, Span) / FMath::Max(Span.SizeSquared(), UE_DOUBLE_SMALL_NUMBER);
+		if (Fraction > 0.0 && Fraction < 1.0)
+		{
+			Splits[EdgeIndex].Add({static_cast<float>(Fraction), NodeIndex});
+			++NumSplits;
+		}
+	};
+
+	// Nodes on another road's edge, such as the end of a road meeting another at a T
+	const double ToleranceSquared = SnapTolerance * SnapTolerance;
+	for (int32 NodeIndex = 0; NodeIndex < NumOriginalNodes; ++NodeIndex)
+	{
+		const FVector Location = NodeLocations[NodeIndex];
+		const TArray<int32>* Cell = EdgeCells.Find(GetCell(Location, NodeCellSize));
+		if (Cell == nullptr)
+			continue;
+		for (const int32 EdgeIndex : *Cell)
+		{
+			const FVector ClosestPoint = FMath::ClosestPointOnSegment(Location,
+				NodeLocations[PendingEdges[EdgeIndex].FromNode], NodeLocations[PendingEdges[EdgeIndex].ToNode]);
+			if (FVector::DistSquared2D(ClosestPoint, Location) <= ToleranceSquared
+				&& FMath::Abs(ClosestPoint.Z - Location.Z) <= MaxJunctionHeight)
+				AddSplit(EdgeIndex, NodeIndex);
+		}
+	}
+
+	// Edges crossing between their points. Pairs sharing several cells find the same crossing, which snaps to one node.
+	for (const TPair<FIntPoint, TArray<int32>>& Cell : EdgeCells)
+	{
+		const TArray<int32>& CellEdges = Cell.Value;
+		for (int32 First = 0; First < CellEdges.Num(); ++First)
+		{
+			const FPendingEdge& A = PendingEdges[CellEdges[First]];
+			for (int32 Second = First + 1; Second < CellEdges.Num(); ++Second)
+			{
+				const FPendingEdge& B = PendingEdges[CellEdges[Second]];
+				if (A.FromNode == B.FromNode || A.FromNode == B.ToNode || A.ToNode == B.FromNode || A.ToNode == B.ToNode)
+					continue;
+
+				const FVector& BFrom = NodeLocations[B.FromNode];
+				const FVector& BTo = NodeLocations[B.ToNode];
+				FVector Crossing;
+				if (!FMath::SegmentIntersection2D(NodeLocations[A.FromNode], NodeLocations[A.ToNode], BFrom, BTo, Crossing))
+					continue;
+
+				// The crossing takes its height from A; B's height there tells a junction from a bridge
+				const double BFraction = FVector::Dist2D(BFrom, Crossing) / FMath::Max(FVector::Dist2D(BFrom, BTo), UE_DOUBLE_SMALL_NUMBER);
+				if (FMath::Abs(FMath::Lerp(BFrom.Z, BTo.Z, BFraction) - Crossing.Z) > MaxJunctionHeight)
+					continue;
+
+				const int32 NodeIndex = FindOrAddNode(Crossing);
+				AddSplit(CellEdges[First], NodeIndex);
+				AddSplit(CellEdges[Second], NodeIndex);
+			}
+		}
+	}
+
+	if (NumSplits == 0)
+		return;
+
+	// Replace every split edge with a chain of edges through its split nodes, sharing its travel time by length
+	TArray<FPendingEdge> SplitEdges;
+	SplitEdges.Reserve(NumEdges + NumSplits);
+	for (int32 EdgeIndex = 0; EdgeIndex < NumEdges; ++EdgeIndex)
+	{
+		const FPendingEdge& Edge = PendingEdges[EdgeIndex];
+		TArray<TPair<float, int32>>& EdgeSplits = Splits[EdgeIndex];
+		if (EdgeSplits.IsEmpty())
+		{
+			SplitEdges.Add(Edge);
+			continue;
+		}
+
+		EdgeSplits.Sort([](const TPair<float, int32>& Left, const TPair<float, int32>& Right) { return Left.Key < Right.Key; });
+		EdgeSplits.Add({1.0f, Edge.ToNode});
+		const double Length = FMath::Max(FVector::Dist(NodeLocations[Edge.FromNode], NodeLocations[Edge.ToNode]), UE_DOUBLE_SMALL_NUMBER);
+		int32 PreviousNode = Edge.FromNode;
+		for (const TPair<float, int32>& Split : EdgeSplits)
+		{
+			const double PieceLength = FVector::Dist(NodeLocations[PreviousNode], NodeLocations[Split.Value]);
+			SplitEdges.Add({PreviousNode, Split.Value, static_cast<float>(Edge.TravelTime * PieceLength / Length), Edge.RoadIndex});
+			PreviousNode = Split.Value;
+		}
+	}
+	PendingEdges = MoveTemp(SplitEdges);
+
+	UE_LOGFMT(LogRoads, Display, "Road graph junctions: split edges at {Splits} point(s), adding {Nodes} node(s)"
+		, NumSplits, NodeLocations.Num() - NumOriginalNodes);
+}
+
+FIntPoint FWfRoadGraph::GetCell(const FVector& Location, const float CellSize) const
+{
+	return FIntPoint(FMath::FloorToInt32(Location.X / CellSize), FMath::FloorToInt32(Location.Y / CellSize));
+}
+
+void FWfRoadGraph::RunDijkstra(const int32 RootNode, const bool bReverse, const bool bRespectClosures,
+	TArray<float>& OutTimes, TArray<int32>* OutParentEdges) const
+{
+	const int32 NumNodes = NodeLocations.Num();
+	OutTimes.Init(UnreachableTime, NumNodes);
+	if (OutParentEdges)
+		OutParentEdges->Init(INDEX_NONE, NumNodes);
+
+	struct FOpenNode
+	{
+		float Time;
+		int32 NodeIndex;
+	};
+	TArray<FOpenNode> OpenSet;
+	OpenSet.Reserve(FMath::Min(NumNodes, 4096));
+	const auto TimeLess = [](const FOpenNode& A, const FOpenNode& B) { return A.Time < B.Time; };
+
+	OutTimes[RootNode] = 0.0f;
+	OpenSet.HeapPush({0.0f, RootNode}, TimeLess);
+
+	const TArray<int32>& Offsets = bReverse ? ReverseOffsets : EdgeOffsets;
+	while (!OpenSet.IsEmpty())
+	{
+		FOpenNode Current;
+		OpenSet.HeapPop(Current, TimeLess, EAllowShrinking::No);
+		if (Current.Time > OutTimes[Current.NodeIndex])
+			continue;
+
+		for (int32 Slot = Offsets[Current.NodeIndex]; Slot < Offsets[Current.NodeIndex + 1]; ++Slot)
+		{
+			const int32 EdgeIndex = bReverse ? ReverseEdges[Slot] : Slot;
+			if (bRespectClosures && !IsEdgeOpen(EdgeIndex))
+				continue;
+
+			const int32 NextNode = bReverse ? ReverseSources[Slot] : EdgeTargets[Slot];
+			const float NextTime = Current.Time + EdgeTimes[EdgeIndex];
+			if (NextTime < OutTimes[NextNode])
+			{
+				OutTimes[NextNode] = NextTime;
+				if (OutParentEdges)
+					(*OutParentEdges)[NextNode] = EdgeIndex;
+				OpenSet.HeapPush({NextTime, NextNode}, TimeLess);
+			}
+		}
+	}
+}
+
+/**
+ * \brief Picks landmarks by farthest-point selection, which spreads them around the edge of the
+ *  network where they give the tightest bounds, then stores the times to and from each one.
+ */
+void FWfRoadGraph::SelectLandmarks(const int32 NumLandmarks)
+{
+	const int32 NumNodes = NodeLocations.Num();
+	NumLandmarksBuilt = 0;
+	LandmarkFrom.Reset();
+	LandmarkTo.Reset();
+	if (NumNodes == 0 || NumLandmarks <= 0)
+		return;
+
+	LandmarkFrom.SetNumUninitialized(NumLandmarks * NumNodes);
+	LandmarkTo.SetNumUninitialized(NumLandmarks * NumNodes);
+
+	TArray<float> MinTimes;
+	MinTimes.Init(UnreachableTime, NumNodes);
+	TArray<float> FromTimes;
+	TArray<float> ToTimes;
+
+	int32 NextLandmark = 0;
+	for (int32 LandmarkIndex = 0; LandmarkIndex < NumLandmarks; ++LandmarkIndex)
+	{
+		RunDijkstra(NextLandmark, false, false, FromTimes, nullptr);
+		RunDijkstra(NextLandmark, true, false, ToTimes, nullptr);
+		FMemory::Memcpy(&LandmarkFrom[LandmarkIndex * NumNodes], FromTimes.GetData(), NumNodes * sizeof(float));
+		FMemory::Memcpy(&LandmarkTo[LandmarkIndex * NumNodes], ToTimes.GetData(), NumNodes * sizeof(float));
+		++NumLandmarksBuilt;
+
+		// The next landmark is the reachable node furthest from every landmark chosen so far
+		float FurthestTime = -1.0f;
+		for (int32 NodeIndex = 0; NodeIndex < NumNodes; ++NodeIndex)
+		{
+			MinTimes[NodeIndex] = FMath::Min(MinTimes[NodeIndex], FromTimes[NodeIndex]);
+			if (MinTimes[NodeIndex] != UnreachableTime && MinTimes[NodeIndex] > FurthestTime)
+			{
+				FurthestTime = MinTimes[NodeIndex];
+				NextLandmark = NodeIndex;
+			}
+		}
+		if (FurthestTime <= 0.0f)
+			break;
+	}
+
+	LandmarkFrom.SetNum(NumLandmarksBuilt * NumNodes);
+	LandmarkTo.SetNum(NumLandmarksBuilt * NumNodes);
+}
+
+float FWfRoadGraph::GetHeuristic(const int32 NodeIndex, const int32 GoalNode) const
+{
+	// Triangle inequality: d(v,t) >= d(L,t) - d(L,v) and d(v,t) >= d(v,L) - d(t,L)
+	const int32 NumNodes = NodeLocations.Num();
+	float Bound = 0.0f;
+	for (int32 LandmarkIndex = 0; LandmarkIndex < NumLandmarksBuilt; ++LandmarkIndex)
+	{
+		const float* From = &LandmarkFrom[LandmarkIndex * NumNodes];
+		const float* To   = &LandmarkTo[LandmarkIndex * NumNodes];
+		if (From[GoalNode] != UnreachableTime && From[NodeIndex] != UnreachableTime)
+			Bound = FMath::Max(Bound, From[GoalNode] - From[NodeIndex]);
+		if (To[NodeIndex] != UnreachableTime && To[GoalNode] != UnreachableTime)
+			Bound = FMath::Max(Bound, To[NodeIndex] - To[GoalNode]);
+	}
+	return Bound;
+}
+
+void FWfRoadGraph::RebuildSource(FSourceTree& Source) const
+{
+	RunDijkstra(Source.RootNode, false, true, Source.TravelTimes, &Source.ParentEdges);
+	Source.bDirty = false;
+	++Source.Version;
+}
+
+/**
+ * \brief Only trees that the edge change can affect are invalidated.
+ *  Closing an edge matters if the edge is part of the tree; reopening one matters if it
+ *  would give its target node a faster time than the tree currently has.
+ */
+void FWfRoadGraph::InvalidateSourcesForEdge(const int32 EdgeIndex, const bool bClosed)
+{
+	const int32 TargetNode = EdgeTargets[EdgeIndex];
+	const int32 SourceNode = GetEdgeSource(EdgeIndex);
+	for (FSourceTree& Source : Sources)
+	{
+		if (Source.bDirty)
+			continue;
+
+		if (bClosed)
+		{
+			Source.bDirty = Source.ParentEdges[TargetNode] == EdgeIndex;
+		}
+		else if (Source.TravelTimes[SourceNode] != UnreachableTime)
+		{
+			Source.bDirty = Source.TravelTimes[SourceNode] + EdgeTimes[EdgeIndex] < Source.TravelTimes[TargetNode];
+		}
+	}
+}
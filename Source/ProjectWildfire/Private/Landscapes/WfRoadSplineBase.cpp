@@ -3,15 +3,71 @@
 
 #include "Landscapes/WfRoadSplineBase.h"
 
+#include "Actors/WfRoadManager.h"
+
 
 AWfRoadSplineBase::AWfRoadSplineBase()
 {
 	PrimaryActorTick.bCanEverTick = false;
+
+	RoadSpline = CreateDefaultSubobject<USplineComponent>("RoadSpline");
+	SetRootComponent(RoadSpline);
+}
+
+void AWfRoadSplineBase::GetRoadPoints(TArray<FVector>& OutPoints, const float SampleSpacing) const
+{
+	OutPoints.Reset();
+	const int32 NumSplinePoints = RoadSpline->GetNumberOfSplinePoints();
+	if (NumSplinePoints < 2)
+		return;
+
+	const int32 NumSegments = RoadSpline->IsClosedLoop() ? NumSplinePoints : NumSplinePoints - 1;
+	for (int32 PointIndex = 0; PointIndex < NumSegments; ++PointIndex)
+	{
+		const float StartDistance = RoadSpline->GetDistanceAlongSplineAtSplinePoint(PointIndex);
+		const float EndDistance = PointIndex + 1 < NumSplinePoints
+			? RoadSpline->GetDistanceAlongSplineAtSplinePoint(PointIndex + 1) : RoadSpline->GetSplineLength();
+
+		// Curved segments are subdivided so travel distances follow the curve
+		const int32 NumSamples = FMath::Max(1, FMath::CeilToInt32((EndDistance - StartDistance) / SampleSpacing));
+		for (int32 Sample = 0; Sample < NumSamples; ++Sample)
+		{
+			const float Distance = FMath::Lerp(StartDistance, EndDistance, static_cast<float>(Sample) / NumSamples);
+			OutPoints.Add(RoadSpline->GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World));
+		}
+	}
+	OutPoints.Add(RoadSpline->GetLocationAtSplinePoint(
+		RoadSpline->IsClosedLoop() ? 0 : NumSplinePoints - 1, ESplineCoordinateSpace::World));
+}
+
+void AWfRoadSplineBase::SetRoadClosed(const bool bClosed)
+{
+	if (!HasAuthority() || bRoadClosed == bClosed)
+		return;
+
+	bRoadClosed = bClosed;
+	if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+		RoadManager->SetRoadClosed(this, bClosed);
 }
 
 void AWfRoadSplineBase::BeginPlay()
 {
 	Super::BeginPlay();
+	if (HasAuthority())
+	{
+		if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+			RoadManager->RegisterRoad(this);
+	}
+}
+
+void AWfRoadSplineBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+	if (HasAuthority() && EndPlayReason == EEndPlayReason::Destroyed)
+	{
+		if (AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this))
+			RoadManager->UnregisterRoad(this);
+	}
 }
 
 void AWfRoadSplineBase::Tick(float DeltaTime)
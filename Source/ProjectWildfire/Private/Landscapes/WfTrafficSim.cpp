@@ -0,0 +1,461 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Landscapes/WfTrafficSim.h"
+
+#include "Algo/BinarySearch.h"
+#include "Algo/Sort.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Landscapes/WfRoadGraph.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogTraffic);
+
+namespace
+{
+	// Per car random numbers, so cars can pick their turns in any order and on any thread
+	uint32 NextRandom(uint32& Seed)
+	{
+		Seed ^= Seed << 13;
+		Seed ^= Seed >> 17;
+		Seed ^= Seed << 5;
+		return Seed;
+	}
+}
+
+FWfTrafficSim::FWfTrafficSim()
+	: MaxAcceleration(200.0f), ComfortDeceleration(300.0f), MaxDeceleration(900.0f), MinGap(200.0f), TimeHeadway(1.5f)
+	, CarLength(450.0f), LaneOffset(175.0f), ShoulderOffset(250.0f), YieldRadius(8000.0f), ChunkSize(256)
+	, Graph(nullptr)
+{
+}
+
+void FWfTrafficSim::Initialize(const FWfRoadGraph& InGraph)
+{
+	Reset();
+	if (!InGraph.IsBuilt())
+		return;
+
+	Graph = &InGraph;
+	const int32 NumLanes = InGraph.GetNumEdges();
+	LaneStarts.SetNumUninitialized(NumLanes);
+	LaneDirections.SetNumUninitialized(NumLanes);
+	LaneLengths.SetNumUninitialized(NumLanes);
+	LaneSpeeds.SetNumUninitialized(NumLanes);
+	LaneStartNodes.SetNumUninitialized(NumLanes);
+	LaneEndNodes.SetNumUninitialized(NumLanes);
+	for (int32 Lane = 0; Lane < NumLanes; ++Lane)
+	{
+		LaneStartNodes[Lane] = InGraph.GetEdgeSource(Lane);
+		LaneEndNodes[Lane] = InGraph.GetEdgeTarget(Lane);
+		const FVector Start = InGraph.GetNodeLocation(LaneStartNodes[Lane]);
+		const FVector Span = InGraph.GetNodeLocation(LaneEndNodes[Lane]) - Start;
+		LaneStarts[Lane] = Start;
+		LaneLengths[Lane] = FMath::Max(static_cast<float>(Span.Size()), 1.0f);
+		LaneDirections[Lane] = Span.GetSafeNormal(UE_SMALL_NUMBER, FVector::ForwardVector);
+		LaneSpeeds[Lane] = LaneLengths[Lane] / FMath::Max(InGraph.GetEdgeTravelTime(Lane), UE_KINDA_SMALL_NUMBER);
+	}
+	LaneOffsets.SetNumZeroed(NumLanes + 1);
+}
+
+void FWfTrafficSim::Reset()
+{
+	Graph = nullptr;
+	LaneStarts.Reset();
+	LaneDirections.Reset();
+	LaneLengths.Reset();
+	LaneSpeeds.Reset();
+	LaneStartNodes.Reset();
+	LaneEndNodes.Reset();
+	LaneOffsets.Reset();
+	RemoveAllCars();
+}
+
+void FWfTrafficSim::SpawnCars(const int32 NumCars, const int32 Seed)
+{
+	const int32 NumLanes = GetNumLanes();
+	if (!IsInitialized() || NumLanes == 0 || NumCars <= 0)
+		return;
+
+	// Lanes are picked by where a random distance falls along all of them laid end to end
+	TArray<float> LaneEnds;
+	LaneEnds.SetNumUninitialized(NumLanes);
+	float TotalLength = 0.0f;
+	for (int32 Lane = 0; Lane < NumLanes; ++Lane)
+	{
+		TotalLength += LaneLengths[Lane];
+		LaneEnds[Lane] = TotalLength;
+	}
+
+	FRandomStream Random(Seed);
+	const int32 FirstCar = GetNumCars();
+	CarLanes.Reserve(FirstCar + NumCars);
+	for (int32 CarIndex = 0; CarIndex < NumCars; ++CarIndex)
+	{
+		const int32 Lane = FMath::Min(static_cast<int32>(Algo::UpperBound(LaneEnds, Random.FRandRange(0.0f, TotalLength))), NumLanes - 1);
+		const float SpeedFactor = Random.FRandRange(0.8f, 1.1f);
+		uint32 CarSeed = static_cast<uint32>(Random.GetUnsignedInt()) | 1u;
+
+		CarLanes.Add(Lane);
+		CarNextLanes.Add(PickNextLane(Lane, CarSeed));
+		CarPositions.Add(Random.FRandRange(0.0f, LaneLengths[Lane]));
+		CarSpeeds.Add(LaneSpeeds[Lane] * SpeedFactor * 0.5f);
+		CarSpeedFactors.Add(SpeedFactor);
+		CarAccelerations.Add(0.0f);
+		CarYielding.Add(0);
+		CarSeeds.Add(CarSeed);
+	}
+}
+
+void FWfTrafficSim::RemoveAllCars()
+{
+	CarLanes.Reset();
+	CarNextLanes.Reset();
+	CarPositions.Reset();
+	CarSpeeds.Reset();
+	CarSpeedFactors.Reset();
+	CarAccelerations.Reset();
+	CarYielding.Reset();
+	CarSeeds.Reset();
+	LaneCars.Reset();
+}
+
+int32 FWfTrafficSim::GetNumYielding() const
+{
+	int32 NumYielding = 0;
+	for (const uint8 bYielding : CarYielding)
+		NumYielding += bYielding;
+	return NumYielding;
+}
+
+/**
+ * \brief Each parallel pass only writes its own lane's or car's entries, and reads what the previous
+ *  pass left, so no pass needs a lock. Cars reaching the end of their lane are moved serially afterwards;
+ *  a car is never past more than one lane end per step at these speeds, but the loop allows for it.
+ */
+void FWfTrafficSim::Step(const float DeltaSeconds, TConstArrayView<FWfTrafficEmergency> Emergencies)
+{
+	const int32 NumCars = GetNumCars();
+	if (!IsInitialized() || NumCars == 0 || DeltaSeconds <= 0.0f)
+		return;
+
+	const int32 NumCarChunks = FMath::DivideAndRoundUp(NumCars, ChunkSize);
+	const float YieldRadiusSq = FMath::Square(YieldRadius);
+	ParallelFor(NumCarChunks, [this, Emergencies, NumCars, YieldRadiusSq](const int32 Chunk)
+	{
+		const int32 End = FMath::Min((Chunk + 1) * ChunkSize, NumCars);
+		for (int32 CarIndex = Chunk * ChunkSize; CarIndex < End; ++CarIndex)
+		{
+			const int32 Lane = CarLanes[CarIndex];
+			const FVector Location = LaneStarts[Lane] + LaneDirections[Lane] * CarPositions[CarIndex];
+			uint8 bYielding = 0;
+			for (const FWfTrafficEmergency& Emergency : Emergencies)
+			{
+				// Lanes are one way, so a car on either of these is going the same way
+				if (Lane != Emergency.Lane && Lane != Emergency.NextLane)
+					continue;
+				const FVector Offset = Location - Emergency.Location;
+				if (Offset.SizeSquared() < YieldRadiusSq && FVector::DotProduct(Offset, Emergency.Direction) > 0.0)
+				{
+					bYielding = 1;
+					break;
+				}
+			}
+			CarYielding[CarIndex] = bYielding;
+		}
+	}, NumCarChunks < 2 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	SortCarsByLane();
+
+	const int32 NumLaneChunks = FMath::DivideAndRoundUp(GetNumLanes(), ChunkSize);
+	ParallelFor(NumLaneChunks, [this](const int32 Chunk)
+	{
+		const int32 End = FMath::Min((Chunk + 1) * ChunkSize, GetNumLanes());
+		for (int32 Lane = Chunk * ChunkSize; Lane < End; ++Lane)
+			ComputeLaneAccelerations(Lane);
+	}, NumLaneChunks < 2 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	ParallelFor(NumCarChunks, [this, DeltaSeconds, NumCars](const int32 Chunk)
+	{
+		const int32 End = FMath::Min((Chunk + 1) * ChunkSize, NumCars);
+		for (int32 CarIndex = Chunk * ChunkSize; CarIndex < End; ++CarIndex)
+		{
+			const float Speed = FMath::Max(CarSpeeds[CarIndex] + CarAccelerations[CarIndex] * DeltaSeconds, 0.0f);
+			CarPositions[CarIndex] += (CarSpeeds[CarIndex] + Speed) * 0.5f * DeltaSeconds;
+			CarSpeeds[CarIndex] = Speed;
+		}
+	}, NumCarChunks < 2 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	for (int32 CarIndex = 0; CarIndex < NumCars; ++CarIndex)
+	{
+		while (CarPositions[CarIndex] >= LaneLengths[CarLanes[CarIndex]])
+		{
+			const int32 NextLane = CarNextLanes[CarIndex];
+			if (NextLane == INDEX_NONE)
+			{
+				// A dead end with no way back; the car starts over somewhere else
+				CarLanes[CarIndex] = NextRandom(CarSeeds[CarIndex]) % GetNumLanes();
+				CarPositions[CarIndex] = 0.0f;
+				CarSpeeds[CarIndex] = 0.0f;
+			}
+			else
+			{
+				CarPositions[CarIndex] -= LaneLengths[CarLanes[CarIndex]];
+				CarLanes[CarIndex] = NextLane;
+			}
+			CarNextLanes[CarIndex] = PickNextLane(CarLanes[CarIndex], CarSeeds[CarIndex]);
+		}
+	}
+}
+
+/**
+ * \brief The lane is the nearest edge, taken in the direction the vehicle is heading, and the next lane the
+ *  one out of its end that carries straight on; a turn is only known from the route.
+ *  A vehicle going the wrong way down a one way road has no lane, and nobody yields to it.
+ */
+void FWfTrafficSim::FindEmergencyLanes(FWfTrafficEmergency& Emergency) const
+{
+	Emergency.Lane = INDEX_NONE;
+	Emergency.NextLane = INDEX_NONE;
+	if (!IsInitialized())
+		return;
+
+	FVector ClosestPoint;
+	int32 Lane = Graph->FindNearestEdge(Emergency.Location, ClosestPoint);
+	if (Lane != INDEX_NONE && FVector::DotProduct(LaneDirections[Lane], Emergency.Direction) < 0.0)
+		Lane = Graph->FindEdge(LaneEndNodes[Lane], LaneStartNodes[Lane]);
+	if (Lane == INDEX_NONE)
+		return;
+
+	Emergency.Lane = Lane;
+	const int32 Node = LaneEndNodes[Lane];
+	double BestAlignment = -1.0;
+	for (int32 EdgeIndex = Graph->GetEdgeOffset(Node); EdgeIndex < Graph->GetEdgeOffset(Node + 1); ++EdgeIndex)
+	{
+		const double Alignment = FVector::DotProduct(LaneDirections[EdgeIndex], LaneDirections[Lane]);
+		if (Graph->IsEdgeOpen(EdgeIndex) && LaneEndNodes[EdgeIndex] != LaneStartNodes[Lane] && Alignment > BestAlignment)
+		{
+			BestAlignment = Alignment;
+			Emergency.NextLane = EdgeIndex;
+		}
+	}
+}
+
+FTransform FWfTrafficSim::GetCarTransform(const int32 CarIndex, const float SecondsSinceStep) const
+{
+	const int32 Lane = CarLanes[CarIndex];
+	const float Position = FMath::Min(CarPositions[CarIndex] + CarSpeeds[CarIndex] * SecondsSinceStep, LaneLengths[Lane]);
+	return FTransform(LaneDirections[Lane].ToOrientationQuat(), GetCarLocation(CarIndex, Position));
+}
+
+void FWfTrafficSim::FindCarsNear(TConstArrayView<FVector> Observers, const float Radius, TArray<int32>& OutCars) const
+{
+	OutCars.Reset();
+	const float RadiusSq = FMath::Square(Radius);
+	for (int32 CarIndex = 0; CarIndex < GetNumCars(); ++CarIndex)
+	{
+		const FVector Location = LaneStarts[CarLanes[CarIndex]] + LaneDirections[CarLanes[CarIndex]] * CarPositions[CarIndex];
+		for (const FVector& Observer : Observers)
+		{
+			if (FVector::DistSquared(Observer, Location) < RadiusSq)
+			{
+				OutCars.Add(CarIndex);
+				break;
+			}
+		}
+	}
+}
+
+void FWfTrafficSim::SortCarsByLane()
+{
+	const int32 NumLanes = GetNumLanes();
+	const int32 NumCars = GetNumCars();
+
+	// Counting sort by lane, then each lane's few cars by position
+	FMemory::Memzero(LaneOffsets.GetData(), LaneOffsets.Num() * sizeof(int32));
+	for (const int32 Lane : CarLanes)
+		++LaneOffsets[Lane + 1];
+	for (int32 Lane = 0; Lane < NumLanes; ++Lane)
+		LaneOffsets[Lane + 1] += LaneOffsets[Lane];
+
+	LaneCars.SetNumUninitialized(NumCars, EAllowShrinking::No);
+	TArray<int32> Cursors(LaneOffsets.GetData(), NumLanes);
+	for (int32 CarIndex = 0; CarIndex < NumCars; ++CarIndex)
+		LaneCars[Cursors[CarLanes[CarIndex]]++] = CarIndex;
+
+	const int32 NumLaneChunks = FMath::DivideAndRoundUp(NumLanes, ChunkSize);
+	ParallelFor(NumLaneChunks, [this, NumLanes](const int32 Chunk)
+	{
+		const int32 End = FMath::Min((Chunk + 1) * ChunkSize, NumLanes);
+		for (int32 Lane = Chunk * ChunkSize; Lane < End; ++Lane)
+		{
+			TArrayView<int32> Cars(LaneCars.GetData() + LaneOffsets[Lane], LaneOffsets[Lane + 1] - LaneOffsets[Lane]);
+			if (Cars.Num() > 1)
+				Algo::Sort(Cars, [this](const int32 A, const int32 B) { return CarPositions[A] > CarPositions[B]; });
+		}
+	}, NumLaneChunks < 2 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+}
+
+/**
+ * \brief IDM: a = a_max * (1 - (v / v0)^4 - (s* / s)^2), where s* = s0 + v T + v dv / (2 sqrt(a_max b))
+ *  is the gap the driver wants for their speed v and closing speed dv, and s the gap they have.
+ *  A yielding car brakes at the comfortable rate instead, however clear the road ahead is.
+ */
+void FWfTrafficSim::ComputeLaneAccelerations(const int32 Lane)
+{
+	const float BrakingTerm = 2.0f * FMath::Sqrt(MaxAcceleration * ComfortDeceleration);
+	for (int32 Slot = LaneOffsets[Lane]; Slot < LaneOffsets[Lane + 1]; ++Slot)
+	{
+		const int32 CarIndex = LaneCars[Slot];
+		const float Speed = CarSpeeds[CarIndex];
+		const float DesiredSpeed = FMath::Max(LaneSpeeds[Lane] * CarSpeedFactors[CarIndex], 1.0f);
+
+		float Gap = 0.0f;
+		float LeaderSpeed = 0.0f;
+		bool bHasLeader = Slot > LaneOffsets[Lane];
+		if (bHasLeader)
+		{
+			const int32 Leader = LaneCars[Slot - 1];
+			Gap = CarPositions[Leader] - CarPositions[CarIndex] - CarLength;
+			LeaderSpeed = CarSpeeds[Leader];
+		}
+		else
+		{
+			bHasLeader = FindNextLaneLeader(CarIndex, Gap, LeaderSpeed);
+		}
+
+		float Acceleration = 1.0f - FMath::Pow(Speed / DesiredSpeed, 4.0f);
+		if (bHasLeader)
+		{
+			const float WantedGap = MinGap + FMath::Max(0.0f, Speed * TimeHeadway + Speed * (Speed - LeaderSpeed) / BrakingTerm);
+			Acceleration -= FMath::Square(WantedGap / FMath::Max(Gap, 1.0f));
+		}
+		Acceleration = FMath::Clamp(Acceleration * MaxAcceleration, -MaxDeceleration, MaxAcceleration);
+
+		if (CarYielding[CarIndex])
+			Acceleration = FMath::Min(Acceleration, Speed > 0.0f ? -ComfortDeceleration : 0.0f);
+		CarAccelerations[CarIndex] = Acceleration;
+	}
+}
+
+bool FWfTrafficSim::FindNextLaneLeader(const int32 CarIndex, float& OutGap, float& OutSpeed) const
+{
+	const int32 NextLane = CarNextLanes[CarIndex];
+	if (NextLane == INDEX_NONE || LaneOffsets[NextLane] == LaneOffsets[NextLane + 1])
+		return false;
+
+	// The last car on the next lane is the one nearest its start
+	const int32 Leader = LaneCars[LaneOffsets[NextLane + 1] - 1];
+	OutGap = LaneLengths[CarLanes[CarIndex]] - CarPositions[CarIndex] + CarPositions[Leader] - CarLength;
+	OutSpeed = CarSpeeds[Leader];
+	return true;
+}
+
+int32 FWfTrafficSim::PickNextLane(const int32 Lane, uint32& Seed) const
+{
+	const int32 Node = LaneEndNodes[Lane];
+	const int32 FirstEdge = Graph->GetEdgeOffset(Node);
+	const int32 LastEdge = Graph->GetEdgeOffset(Node + 1);
+
+	int32 NumChoices = 0;
+	int32 UTurn = INDEX_NONE;
+	for (int32 EdgeIndex = FirstEdge; EdgeIndex < LastEdge; ++EdgeIndex)
+	{
+		if (!Graph->IsEdgeOpen(EdgeIndex))
+			continue;
+		if (LaneEndNodes[EdgeIndex] == LaneStartNodes[Lane])
+			UTurn = EdgeIndex;
+		else
+			++NumChoices;
+	}
+	if (NumChoices == 0)
+		return UTurn;
+
+	int32 Choice = NextRandom(Seed) % NumChoices;
+	for (int32 EdgeIndex = FirstEdge; EdgeIndex < LastEdge; ++EdgeIndex)
+	{
+		if (Graph->IsEdgeOpen(EdgeIndex) && LaneEndNodes[EdgeIndex] != LaneStartNodes[Lane] && Choice-- == 0)
+			return EdgeIndex;
+	}
+	return UTurn;
+}
+
+FVector FWfTrafficSim::GetCarLocation(const int32 CarIndex, const float Position) const
+{
+	const int32 Lane = CarLanes[CarIndex];
+	const FVector& Direction = LaneDirections[Lane];
+	const FVector Right(-Direction.Y, Direction.X, 0.0);
+	const float Offset = LaneOffset + (CarYielding[CarIndex] ? ShoulderOffset : 0.0f);
+	return LaneStarts[Lane] + Direction * Position + Right * Offset;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Traffic [Cars] [Emergencies] [Steps]
+ *  Builds a 40 by 40 grid of two way roads a block apart, fills it with cars and drives emergency
+ *  vehicles straight across it, so cars keep yielding and pulling away again.
+ */
+static FAutoConsoleCommand GWfBenchTrafficCommand(
+	TEXT("Wf.Bench.Traffic"),
+	TEXT("Benchmarks the traffic simulation. Usage: Wf.Bench.Traffic [Cars=5000] [Emergencies=4] [Steps=200]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumCars = Bench.GetArg(0, 5000);
+		const int32 NumEmergencies = Bench.GetArg(1, 4, 0);
+		const int32 NumSteps = Bench.GetArg(2, 200);
+
+		constexpr int32 GridSize = 40;
+		constexpr float BlockSize = 10000.0f;
+		FWfRoadGraph Graph;
+		for (int32 Line = 0; Line < GridSize; ++Line)
+		{
+			TArray<FVector> Across, Down;
+			for (int32 Step = 0; Step < GridSize; ++Step)
+			{
+				Across.Add(FVector(Step * BlockSize, Line * BlockSize, 0.0f));
+				Down.Add(FVector(Line * BlockSize, Step * BlockSize, 0.0f));
+			}
+			Graph.AddRoad(Line * 2, Across, 50.0f, false);
+			Graph.AddRoad(Line * 2 + 1, Down, 50.0f, false);
+		}
+		Graph.Build();
+
+		FWfTrafficSim Traffic;
+		Traffic.Initialize(Graph);
+		Traffic.SpawnCars(NumCars, 1337);
+
+		TArray<FWfTrafficEmergency> Emergencies;
+		for (int32 EmergencyIndex = 0; EmergencyIndex < NumEmergencies; ++EmergencyIndex)
+		{
+			const float Line = Bench.Random.RandRange(0, GridSize - 1) * BlockSize;
+			Emergencies.Add({ FVector(0.0f, Line, 0.0f), FVector::ForwardVector });
+		}
+
+		int64 TotalYielding = 0;
+		Bench.Run(NumSteps, [&](const int32)
+		{
+			for (FWfTrafficEmergency& Emergency : Emergencies)
+			{
+				Emergency.Location.X += 2000.0f * 0.1f;
+				Traffic.FindEmergencyLanes(Emergency);
+			}
+		},
+		[&](const int32)
+		{
+			Traffic.Step(0.1f, Emergencies);
+			TotalYielding += Traffic.GetNumYielding();
+		});
+
+		UE_LOGFMT(LogTraffic, Display,
+			"Wf.Bench.Traffic: {Cars} cars on {Lanes} lanes, {Emergencies} emergencies, {Steps} steps. {Timing} per step, {Yielding} cars yielding per step."
+			, NumCars, Traffic.GetNumLanes(), NumEmergencies, NumSteps, Bench.Timing.ToString()
+			, static_cast<double>(TotalYielding) / NumSteps);
+	}));
@@ -0,0 +1,675 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Landscapes/WfWildfire.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Logging/StructuredLog.h"
+
+DEFINE_LOG_CATEGORY(LogWildfire);
+
+
+namespace WfWildfire
+{
+	// Neighbour offsets, and their distance in cells
+	static const FIntPoint NeighbourOffsets[8] = {
+		{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}
+	};
+	static const float NeighbourDistances[8] = {
+		1.0f, UE_SQRT_2, 1.0f, UE_SQRT_2, 1.0f, UE_SQRT_2, 1.0f, UE_SQRT_2
+	};
+
+	// Midflame wind is a fraction of the 20 foot wind, depending on canopy; one value keeps it simple
+	constexpr float MidflameWindFactor = 0.4f;
+
+	// Spread rate, in meters per second, that counts as a fully intense fire
+	constexpr float FullIntensitySpreadRate = 0.5f;
+
+	static uint32 HashCell(const int32 X, const int32 Y, const uint32 Seed)
+	{
+		uint32 Hash = static_cast<uint32>(X) * 0x8da6b343u ^ static_cast<uint32>(Y) * 0xd8163841u ^ Seed * 0xcb1ab31fu;
+		Hash ^= Hash >> 16;
+		Hash *= 0x7feb352du;
+		Hash ^= Hash >> 15;
+		Hash *= 0x846ca68bu;
+		Hash ^= Hash >> 16;
+		return Hash;
+	}
+}
+
+
+/******************************************
+ *         FUEL MODELS
+ */
+
+const FWfFuelModel& FWfFuelModel::Get(const EWfFuelModel FuelModel)
+{
+	// BaseSpreadRate, WindCoefficient, WindExponent, PackingRatio, MoistureOfExtinction, ResidenceSeconds, SpottingChance
+	static const FWfFuelModel FuelModels[static_cast<int32>(EWfFuelModel::Num)] = {
+		{0.0f,   0.0f,  1.0f, 1.0f,    0.0f,  0.0f,   0.0f},	// None
+		{0.03f,  0.9f,  1.4f, 0.001f,  0.12f, 60.0f,  0.0005f},	// ShortGrass
+		{0.015f, 0.6f,  1.3f, 0.005f,  0.20f, 300.0f, 0.004f},	// Chaparral
+		{0.004f, 0.35f, 1.2f, 0.03f,   0.30f, 600.0f, 0.001f},	// TimberLitter
+		{0.006f, 0.4f,  1.2f, 0.02f,   0.25f, 1200.0f, 0.006f}	// HeavyTimber
+	};
+	const int32 Index = static_cast<int32>(FuelModel);
+	return FuelModels[Index < static_cast<int32>(EWfFuelModel::Num) ? Index : 0];
+}
+
+
+/******************************************
+ *         PROCEDURAL TERRAIN
+ */
+
+FWfProceduralWildfireTerrain::FWfProceduralWildfireTerrain(const int32 InSeed, const float InReliefMeters, const float InFeatureCells)
+	: Seed(static_cast<uint32>(InSeed)), ReliefMeters(InReliefMeters), FeatureCells(FMath::Max(InFeatureCells, 1.0f))
+{
+}
+
+FWfWildfireCellSample FWfProceduralWildfireTerrain::Sample(const FIntPoint& Cell) const
+{
+	const float X = Cell.X / FeatureCells;
+	const float Y = Cell.Y / FeatureCells;
+
+	FWfWildfireCellSample CellSample;
+	CellSample.Elevation    = ReliefMeters * (Noise(X, Y, 0) + 0.5f * Noise(X * 3.0f, Y * 3.0f, 1)) / 1.5f;
+	CellSample.FuelMoisture = 0.05f + 0.08f * Noise(X * 0.5f, Y * 0.5f, 3);
+
+	const float Fuel = Noise(X * 1.5f, Y * 1.5f, 2);
+	if (Fuel < 0.06f)
+		CellSample.FuelModel = EWfFuelModel::None;
+	else if (Fuel < 0.45f)
+		CellSample.FuelModel = EWfFuelModel::ShortGrass;
+	else if (Fuel < 0.7f)
+		CellSample.FuelModel = EWfFuelModel::Chaparral;
+	else if (Fuel < 0.88f)
+		CellSample.FuelModel = EWfFuelModel::TimberLitter;
+	else
+		CellSample.FuelModel = EWfFuelModel::HeavyTimber;
+	return CellSample;
+}
+
+// Smoothly interpolated lattice noise, from 0 to 1
+float FWfProceduralWildfireTerrain::Noise(const float X, const float Y, const uint32 Channel) const
+{
+	const int32 X0 = FMath::FloorToInt32(X);
+	const int32 Y0 = FMath::FloorToInt32(Y);
+	const float FracX = FMath::SmoothStep(0.0f, 1.0f, X - X0);
+	const float FracY = FMath::SmoothStep(0.0f, 1.0f, Y - Y0);
+	const uint32 ChannelSeed = Seed + Channel * 0x9e3779b9u;
+
+	auto Lattice = [ChannelSeed](const int32 LX, const int32 LY)
+	{
+		return (WfWildfire::HashCell(LX, LY, ChannelSeed) & 0xffffff) / static_cast<float>(0xffffff);
+	};
+	return FMath::Lerp(
+		FMath::Lerp(Lattice(X0, Y0), Lattice(X0 + 1, Y0), FracX),
+		FMath::Lerp(Lattice(X0, Y0 + 1), Lattice(X0 + 1, Y0 + 1), FracX), FracY);
+}
+
+
+/******************************************
+ *         SIMULATION STATE
+ */
+
+/**
+ * \brief Everything the simulation task owns. Only touched by the task while a job runs,
+ *  and by the game thread only when no job is running.
+ */
+struct FWfWildfire::FState
+{
+	struct FBurntChunk
+	{
+		uint64 Rows[64] = {};
+	};
+
+	TSharedPtr<const FWfWildfireTerrain, ESPMode::ThreadSafe> Terrain;
+	float CellMeters = 10.0f;
+	FRandomStream Random;
+
+	double SimSeconds = 0.0;
+	int32 NumSteps = 0;
+	int32 NumBurntCells = 0;
+	uint32 Checksum = 0;
+
+	// Burning cells, structure of arrays
+	TArray<FIntPoint> BurningCells;
+	TArray<float> BurningElevation;
+	TArray<double> BurningBurnout;
+	TArray<float> BurningIntensity;
+	TArray<EWfFuelModel> BurningFuel;
+	TMap<FIntPoint, int32> BurningLookup;
+
+	// Unburnt cells being heated by a burning neighbour, structure of arrays
+	TArray<FIntPoint> FrontCells;
+	TArray<float> FrontProgress;
+	TArray<float> FrontRate;
+	TArray<FWfWildfireCellSample> FrontSamples;
+	TMap<FIntPoint, int32> FrontLookup;
+
+	TMap<FIntPoint, FBurntChunk> BurntChunks;
+
+	struct FIgnition
+	{
+		FIntPoint Cell;
+		FWfWildfireCellSample Sample;
+		float SpreadRate;
+	};
+
+	// Per step scratch, kept to avoid reallocating
+	TArray<float> NeighbourRates;
+	TArray<FWfWildfireCellSample> NeighbourSamples;
+	TArray<float> StepIncrement;
+	TArray<FIgnition> Ignitions;
+
+	bool IsBurnt(const FIntPoint& Cell) const
+	{
+		const FBurntChunk* Chunk = BurntChunks.Find(FIntPoint(Cell.X >> 6, Cell.Y >> 6));
+		return Chunk && (Chunk->Rows[Cell.Y & 63] & (1ull << (Cell.X & 63))) != 0;
+	}
+
+	void MarkBurnt(const FIntPoint& Cell)
+	{
+		uint64& Row = BurntChunks.FindOrAdd(FIntPoint(Cell.X >> 6, Cell.Y >> 6)).Rows[Cell.Y & 63];
+		const uint64 Bit = 1ull << (Cell.X & 63);
+		if ((Row & Bit) == 0)
+		{
+			Row |= Bit;
+			++NumBurntCells;
+		}
+	}
+
+	void ApplyCommand(const FCommand& Command);
+	void Step(const float DeltaSeconds, const FVector2D& Wind);
+	float GetSpreadRate(const int32 BurningIndex, const int32 Direction, const FWfWildfireCellSample& Target, const FVector2D& Wind) const;
+	void IgniteCell(const FIntPoint& Cell, const FWfWildfireCellSample& CellSample, const float SpreadRate);
+	void RemoveBurning(const int32 BurningIndex);
+	void RemoveFront(const int32 FrontIndex);
+	void Publish(FWfWildfireSnapshot& Snapshot) const;
+};
+
+void FWfWildfire::FState::ApplyCommand(const FCommand& Command)
+{
+	if (!Command.bFireBreak)
+	{
+		if (IsBurnt(Command.Cell) || BurningLookup.Contains(Command.Cell))
+			return;
+
+		const FWfWildfireCellSample CellSample = Terrain->Sample(Command.Cell);
+		if (CellSample.FuelModel == EWfFuelModel::None)
+			return;
+
+		if (const int32* FrontIndex = FrontLookup.Find(Command.Cell))
+			RemoveFront(*FrontIndex);
+		IgniteCell(Command.Cell, CellSample, FWfFuelModel::Get(CellSample.FuelModel).BaseSpreadRate);
+		return;
+	}
+
+	// Fire breaks take the fuel away, so the cells count as burnt without ever burning
+	const int32 RadiusSquared = Command.RadiusCells * Command.RadiusCells;
+	for (int32 OffsetY = -Command.RadiusCells; OffsetY <= Command.RadiusCells; ++OffsetY)
+	{
+		for (int32 OffsetX = -Command.RadiusCells; OffsetX <= Command.RadiusCells; ++OffsetX)
+		{
+			if (OffsetX * OffsetX + OffsetY * OffsetY > RadiusSquared)
+				continue;
+
+			const FIntPoint Cell = Command.Cell + FIntPoint(OffsetX, OffsetY);
+			if (const int32* BurningIndex = BurningLookup.Find(Cell))
+				RemoveBurning(*BurningIndex);
+			if (const int32* FrontIndex = FrontLookup.Find(Cell))
+				RemoveFront(*FrontIndex);
+			MarkBurnt(Cell);
+		}
+	}
+}
+
+/**
+ * \brief Advances the fire by one step.
+ *  Spread rates from every burning cell towards its neighbours are computed in parallel, as they
+ *  only read the state. Everything that changes the state runs serially in array order afterwards,
+ *  which keeps the result independent of how the parallel work was scheduled.
+ */
+void FWfWildfire::FState::Step(const float DeltaSeconds, const FVector2D& Wind)
+{
+	SimSeconds += DeltaSeconds;
+	++NumSteps;
+
+	const int32 NumBurning = BurningCells.Num();
+	NeighbourRates.SetNumUninitialized(NumBurning * 8, EAllowShrinking::No);
+	NeighbourSamples.SetNumUninitialized(NumBurning * 8, EAllowShrinking::No);
+
+	ParallelFor(NumBurning, [this, &Wind](const int32 BurningIndex)
+	{
+		for (int32 Direction = 0; Direction < 8; ++Direction)
+		{
+			const int32 Slot = BurningIndex * 8 + Direction;
+			const FIntPoint Target = BurningCells[BurningIndex] + WfWildfire::NeighbourOffsets[Direction];
+			if (IsBurnt(Target) || BurningLookup.Contains(Target))
+			{
+				NeighbourRates[Slot] = 0.0f;
+				continue;
+			}
+
+			const int32* FrontIndex = FrontLookup.Find(Target);
+			NeighbourSamples[Slot] = FrontIndex ? FrontSamples[*FrontIndex] : Terrain->Sample(Target);
+			NeighbourRates[Slot] = GetSpreadRate(BurningIndex, Direction, NeighbourSamples[Slot], Wind);
+		}
+	}, NumBurning < 64 ? EParallelForFlags::ForceSingleThread : EParallelForFlags::None);
+
+	// A cell heated from several sides advances at the fastest of them, as Huygens' principle would have it
+	StepIncrement.Reset();
+	StepIncrement.SetNumZeroed(FrontCells.Num());
+	for (int32 Slot = 0; Slot < NumBurning * 8; ++Slot)
+	{
+		const float Rate = NeighbourRates[Slot];
+		if (Rate <= 0.0f)
+			continue;
+
+		const int32 Direction = Slot % 8;
+		const FIntPoint Target = BurningCells[Slot / 8] + WfWildfire::NeighbourOffsets[Direction];
+		int32 FrontIndex;
+		if (const int32* ExistingIndex = FrontLookup.Find(Target))
+		{
+			FrontIndex = *ExistingIndex;
+		}
+		else
+		{
+			FrontIndex = FrontCells.Add(Target);
+			FrontProgress.Add(0.0f);
+			FrontRate.Add(0.0f);
+			FrontSamples.Add(NeighbourSamples[Slot]);
+			StepIncrement.Add(0.0f);
+			FrontLookup.Add(Target, FrontIndex);
+		}
+
+		const float Increment = Rate * DeltaSeconds / (WfWildfire::NeighbourDistances[Direction] * CellMeters);
+		if (Increment > StepIncrement[FrontIndex])
+		{
+			StepIncrement[FrontIndex] = Increment;
+			FrontRate[FrontIndex] = Rate;
+		}
+	}
+
+	// Walk the front backwards so swap removal only ever moves entries that were already visited.
+	// Cells that nothing heated this step are dropped, cells that caught are moved to the ignitions.
+	Ignitions.Reset();
+	for (int32 FrontIndex = FrontCells.Num() - 1; FrontIndex >= 0; --FrontIndex)
+	{
+		if (StepIncrement[FrontIndex] > 0.0f)
+		{
+			FrontProgress[FrontIndex] += StepIncrement[FrontIndex];
+			if (FrontProgress[FrontIndex] < 1.0f)
+				continue;
+			Ignitions.Add({FrontCells[FrontIndex], FrontSamples[FrontIndex], FrontRate[FrontIndex]});
+		}
+		RemoveFront(FrontIndex);
+	}
+
+	// Burn out before igniting, so new cells are not checked against their own burnout
+	for (int32 BurningIndex = BurningCells.Num() - 1; BurningIndex >= 0; --BurningIndex)
+	{
+		if (BurningBurnout[BurningIndex] <= SimSeconds)
+		{
+			MarkBurnt(BurningCells[BurningIndex]);
+			RemoveBurning(BurningIndex);
+		}
+	}
+
+	for (const FIgnition& Ignition : Ignitions)
+	{
+		IgniteCell(Ignition.Cell, Ignition.Sample, Ignition.SpreadRate);
+	}
+
+	// Spotting: intense cells throw embers downwind, well ahead of the front
+	const float WindSpeed = Wind.Size();
+	if (WindSpeed > 1.0f)
+	{
+		const FVector2D Downwind = Wind / WindSpeed;
+		const float WindScale = FMath::Square(WindSpeed / 10.0f);
+		const int32 NumBurningNow = BurningCells.Num();
+		for (int32 BurningIndex = 0; BurningIndex < NumBurningNow; ++BurningIndex)
+		{
+			const float Chance = FWfFuelModel::Get(BurningFuel[BurningIndex]).SpottingChance
+				* WindScale * BurningIntensity[BurningIndex] * DeltaSeconds;
+			if (Random.FRand() >= Chance)
+				continue;
+
+			const float DistanceCells = Random.FRandRange(3.0f, 12.0f) * FMath::Max(WindSpeed / 10.0f, 0.5f);
+			const FVector2D Direction = Downwind.GetRotated(Random.FRandRange(-15.0f, 15.0f));
+			const FIntPoint Target = BurningCells[BurningIndex] + FIntPoint(
+				FMath::RoundToInt32(Direction.X * DistanceCells), FMath::RoundToInt32(Direction.Y * DistanceCells));
+			if (IsBurnt(Target) || BurningLookup.Contains(Target))
+				continue;
+
+			const FWfWildfireCellSample CellSample = Terrain->Sample(Target);
+			if (CellSample.FuelModel == EWfFuelModel::None || CellSample.FuelMoisture >= FWfFuelModel::Get(CellSample.FuelModel).MoistureOfExtinction)
+				continue;
+
+			if (const int32* FrontIndex = FrontLookup.Find(Target))
+				RemoveFront(*FrontIndex);
+			IgniteCell(Target, CellSample, FWfFuelModel::Get(CellSample.FuelModel).BaseSpreadRate);
+		}
+	}
+}
+
+/**
+ * \brief Rothermel-style spread rate from a burning cell into a neighbour, in meters per second.
+ *  R = R0 * moisture damping * (1 + wind factor + slope factor), taking the wind and slope
+ *  components along the direction of spread. Backing and downhill spread get no boost.
+ */
+float FWfWildfire::FState::GetSpreadRate(const int32 BurningIndex, const int32 Direction,
+	const FWfWildfireCellSample& Target, const FVector2D& Wind) const
+{
+	if (Target.FuelModel == EWfFuelModel::None)
+		return 0.0f;
+
+	const FWfFuelModel& Model = FWfFuelModel::Get(Target.FuelModel);
+	const float MoistureRatio = FMath::Clamp(Target.FuelMoisture / Model.MoistureOfExtinction, 0.0f, 1.0f);
+	const float MoistureDamping = 1.0f - 2.59f * MoistureRatio + 5.11f * FMath::Square(MoistureRatio)
+		- 3.52f * MoistureRatio * MoistureRatio * MoistureRatio;
+	if (MoistureDamping <= 0.0f)
+		return 0.0f;
+
+	const float Distance = WfWildfire::NeighbourDistances[Direction];
+	const FVector2D SpreadDirection = FVector2D(WfWildfire::NeighbourOffsets[Direction]) / Distance;
+	const float WindAlong = FMath::Max(0.0f, FVector2D::DotProduct(Wind, SpreadDirection)) * WfWildfire::MidflameWindFactor;
+	const float WindFactor = WindAlong > 0.0f ? Model.WindCoefficient * FMath::Pow(WindAlong, Model.WindExponent) : 0.0f;
+
+	const float Rise = Target.Elevation - BurningElevation[BurningIndex];
+	const float TanSlope = FMath::Max(0.0f, Rise / (Distance * CellMeters));
+	const float SlopeFactor = 5.275f * FMath::Pow(Model.PackingRatio, -0.3f) * FMath::Square(TanSlope);
+
+	return Model.BaseSpreadRate * MoistureDamping * (1.0f + WindFactor + SlopeFactor);
+}
+
+void FWfWildfire::FState::IgniteCell(const FIntPoint& Cell, const FWfWildfireCellSample& CellSample, const float SpreadRate)
+{
+	const int32 BurningIndex = BurningCells.Add(Cell);
+	BurningElevation.Add(CellSample.Elevation);
+	BurningBurnout.Add(SimSeconds + FWfFuelModel::Get(CellSample.FuelModel).ResidenceSeconds);
+	BurningIntensity.Add(FMath::Clamp(SpreadRate / WfWildfire::FullIntensitySpreadRate, 0.05f, 1.0f));
+	BurningFuel.Add(CellSample.FuelModel);
+	BurningLookup.Add(Cell, BurningIndex);
+	Checksum = HashCombineFast(Checksum, WfWildfire::HashCell(Cell.X, Cell.Y, NumSteps));
+}
+
+void FWfWildfire::FState::RemoveBurning(const int32 BurningIndex)
+{
+	BurningLookup.Remove(BurningCells[BurningIndex]);
+	BurningCells.RemoveAtSwap(BurningIndex, 1, EAllowShrinking::No);
+	BurningElevation.RemoveAtSwap(BurningIndex, 1, EAllowShrinking::No);
+	BurningBurnout.RemoveAtSwap(BurningIndex, 1, EAllowShrinking::No);
+	BurningIntensity.RemoveAtSwap(BurningIndex, 1, EAllowShrinking::No);
+	BurningFuel.RemoveAtSwap(BurningIndex, 1, EAllowShrinking::No);
+	if (BurningCells.IsValidIndex(BurningIndex))
+		BurningLookup[BurningCells[BurningIndex]] = BurningIndex;
+}
+
+void FWfWildfire::FState::RemoveFront(const int32 FrontIndex)
+{
+	FrontLookup.Remove(FrontCells[FrontIndex]);
+	FrontCells.RemoveAtSwap(FrontIndex, 1, EAllowShrinking::No);
+	FrontProgress.RemoveAtSwap(FrontIndex, 1, EAllowShrinking::No);
+	FrontRate.RemoveAtSwap(FrontIndex, 1, EAllowShrinking::No);
+	FrontSamples.RemoveAtSwap(FrontIndex, 1, EAllowShrinking::No);
+	if (FrontCells.IsValidIndex(FrontIndex))
+		FrontLookup[FrontCells[FrontIndex]] = FrontIndex;
+}
+
+void FWfWildfire::FState::Publish(FWfWildfireSnapshot& Snapshot) const
+{
+	Snapshot.SimSeconds       = SimSeconds;
+	Snapshot.NumSteps         = NumSteps;
+	Snapshot.BurningCells     = BurningCells;
+	Snapshot.BurningIntensity = BurningIntensity;
+	Snapshot.NumFrontCells    = FrontCells.Num();
+	Snapshot.NumBurntCells    = NumBurntCells;
+	Snapshot.Checksum         = Checksum;
+}
+
+
+/******************************************
+ *         GAME THREAD
+ */
+
+FWfWildfire::FWfWildfire()
+	: StepSeconds(5.0f), MaxStepsPerJob(60), Origin(FVector2D::ZeroVector), CellSize(1000.0f),
+	  WindVelocity(FVector2D::ZeroVector), PendingSeconds(0.0), bEverIgnited(false), FrontSnapshot(0), bJobRunning(false)
+{
+}
+
+FWfWildfire::~FWfWildfire()
+{
+	Flush();
+}
+
+void FWfWildfire::Initialize(const TSharedRef<const FWfWildfireTerrain, ESPMode::ThreadSafe>& InTerrain,
+	const FVector2D& InOrigin, const float InCellSize, const int32 InSeed)
+{
+	Reset();
+	Origin   = InOrigin;
+	CellSize = FMath::Max(InCellSize, 1.0f);
+
+	State = MakeShared<FState, ESPMode::ThreadSafe>();
+	State->Terrain    = InTerrain;
+	State->CellMeters = CellSize / 100.0f;
+	State->Random.Initialize(InSeed);
+}
+
+void FWfWildfire::Reset()
+{
+	Flush();
+	State.Reset();
+	PendingSeconds = 0.0;
+	PendingCommands.Reset();
+	bEverIgnited = false;
+	Snapshots[0] = FWfWildfireSnapshot();
+	Snapshots[1] = FWfWildfireSnapshot();
+	FrontSnapshot = 0;
+}
+
+void FWfWildfire::Ignite(const FVector& Location)
+{
+	if (!IsInitialized())
+		return;
+
+	PendingCommands.Add({GetCellAtLocation(Location), 0, false});
+	bEverIgnited = true;
+}
+
+void FWfWildfire::AddFireBreak(const FVector& Location, const float Radius)
+{
+	if (!IsInitialized())
+		return;
+
+	PendingCommands.Add({GetCellAtLocation(Location), FMath::Max(0, FMath::FloorToInt32(Radius / CellSize)), true});
+}
+
+void FWfWildfire::Update(const float DeltaSimSeconds)
+{
+	if (bJobRunning && Job.IsCompleted())
+		CollectJob();
+
+	PendingSeconds += FMath::Max(DeltaSimSeconds, 0.0f);
+	if (!bJobRunning)
+		LaunchJob();
+}
+
+void FWfWildfire::Flush()
+{
+	if (bJobRunning)
+	{
+		Job.Wait();
+		CollectJob();
+	}
+}
+
+bool FWfWildfire::IsOut() const
+{
+	return bEverIgnited && !bJobRunning && PendingCommands.IsEmpty() && GetSnapshot().BurningCells.IsEmpty();
+}
+
+FIntPoint FWfWildfire::GetCellAtLocation(const FVector& Location) const
+{
+	return FIntPoint(FMath::FloorToInt32((Location.X - Origin.X) / CellSize), FMath::FloorToInt32((Location.Y - Origin.Y) / CellSize));
+}
+
+FVector FWfWildfire::GetCellLocation(const FIntPoint& Cell) const
+{
+	return FVector(Origin.X + (Cell.X + 0.5) * CellSize, Origin.Y + (Cell.Y + 0.5) * CellSize, 0.0);
+}
+
+/**
+ * \brief Hands the accumulated whole steps and pending commands to a new task, which simulates
+ *  them and publishes into the back snapshot. Leftover time waits for the next update.
+ */
+void FWfWildfire::LaunchJob()
+{
+	if (!IsInitialized() || StepSeconds <= 0.0f)
+		return;
+
+	const int32 NumSteps = FMath::Min(FMath::FloorToInt32(PendingSeconds / StepSeconds), FMath::Max(MaxStepsPerJob, 1));
+	if (NumSteps == 0 && PendingCommands.IsEmpty())
+		return;
+
+	PendingSeconds -= NumSteps * StepSeconds;
+
+	// Nothing burning and nothing to apply; skip the task but keep the clock moving
+	if (PendingCommands.IsEmpty() && State->BurningCells.IsEmpty() && State->FrontCells.IsEmpty())
+	{
+		State->SimSeconds += NumSteps * StepSeconds;
+		State->NumSteps += NumSteps;
+		return;
+	}
+
+	FWfWildfireSnapshot* BackSnapshot = &Snapshots[1 - FrontSnapshot];
+	bJobRunning = true;
+	Job = UE::Tasks::Launch(UE_SOURCE_LOCATION,
+		[JobState = State, Commands = MoveTemp(PendingCommands), NumSteps, Delta = StepSeconds, Wind = WindVelocity, BackSnapshot]()
+	{
+		for (const FCommand& Command : Commands)
+		{
+			JobState->ApplyCommand(Command);
+		}
+		for (int32 StepIndex = 0; StepIndex < NumSteps; ++StepIndex)
+		{
+			JobState->Step(Delta, Wind);
+		}
+		JobState->Publish(*BackSnapshot);
+	});
+	PendingCommands.Reset();
+}
+
+void FWfWildfire::CollectJob()
+{
+	Job = {};
+	bJobRunning = false;
+	FrontSnapshot = 1 - FrontSnapshot;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+namespace WfWildfire
+{
+	struct FBenchResult
+	{
+		double WallSeconds = 0.0;
+		double SimSeconds = 0.0;
+		int32 NumSteps = 0;
+		int32 PeakBurning = 0;
+		int32 PeakFront = 0;
+		int32 NumBurntCells = 0;
+		uint32 Checksum = 0;
+	};
+
+	// Burns from a single ignition until the target area has burnt, the fire goes out, or two sim days pass
+	static FBenchResult RunBench(const int32 Seed, const float WindSpeed, const float TargetCells)
+	{
+		FWfWildfire Wildfire;
+		Wildfire.Initialize(MakeShared<FWfProceduralWildfireTerrain, ESPMode::ThreadSafe>(Seed),
+			FVector2D::ZeroVector, 1000.0f, Seed);
+		Wildfire.SetWind(FVector2D(WindSpeed, WindSpeed * 0.3f));
+
+		// Search outwards for burnable ground to light, so every seed gets a fire
+		const FWfProceduralWildfireTerrain Terrain(Seed);
+		FIntPoint IgnitionCell(0, 0);
+		while (Terrain.Sample(IgnitionCell).FuelModel == EWfFuelModel::None)
+			++IgnitionCell.X;
+		Wildfire.Ignite(Wildfire.GetCellLocation(IgnitionCell));
+
+		FBenchResult Result;
+		const double StartSeconds = FPlatformTime::Seconds();
+		while (true)
+		{
+			Wildfire.Update(Wildfire.StepSeconds * Wildfire.MaxStepsPerJob);
+			Wildfire.Flush();
+
+			const FWfWildfireSnapshot& Snapshot = Wildfire.GetSnapshot();
+			Result.PeakBurning = FMath::Max(Result.PeakBurning, Snapshot.BurningCells.Num());
+			Result.PeakFront   = FMath::Max(Result.PeakFront, Snapshot.NumFrontCells);
+			if (Wildfire.IsOut() || Snapshot.NumBurntCells + Snapshot.BurningCells.Num() >= TargetCells
+				|| Snapshot.SimSeconds >= 48.0 * 3600.0)
+			{
+				break;
+			}
+		}
+		Result.WallSeconds   = FPlatformTime::Seconds() - StartSeconds;
+		Result.SimSeconds    = Wildfire.GetSnapshot().SimSeconds;
+		Result.NumSteps      = Wildfire.GetSnapshot().NumSteps;
+		Result.NumBurntCells = Wildfire.GetSnapshot().NumBurntCells + Wildfire.GetSnapshot().BurningCells.Num();
+		Result.Checksum      = Wildfire.GetSnapshot().Checksum;
+		return Result;
+	}
+}
+
+/**
+ * \brief Wf.Bench.Wildfire [AreaKm2] [Seed] [WindMs] [ExpectedChecksum]
+ *  Burns the same fire twice on 10m cells and checks both runs match. Passing the checksum from
+ *  a known good run turns it into a regression test.
+ */
+static FAutoConsoleCommand GWfBenchWildfireCommand(
+	TEXT("Wf.Bench.Wildfire"),
+	TEXT("Benchmarks the wildfire front. Usage: Wf.Bench.Wildfire [AreaKm2=10] [Seed=1337] [WindMs=6] [ExpectedChecksum]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		const float AreaKm2   = Args.IsValidIndex(0) ? FMath::Max(0.01f, FCString::Atof(*Args[0])) : 10.0f;
+		const int32 Seed      = Args.IsValidIndex(1) ? FCString::Atoi(*Args[1]) : 1337;
+		const float WindSpeed = Args.IsValidIndex(2) ? FMath::Max(0.0f, FCString::Atof(*Args[2])) : 6.0f;
+
+		// 10m cells are 100 square meters, 10,000 to a square kilometer
+		const float TargetCells = AreaKm2 * 10000.0f;
+
+		const WfWildfire::FBenchResult First  = WfWildfire::RunBench(Seed, WindSpeed, TargetCells);
+		const WfWildfire::FBenchResult Second = WfWildfire::RunBench(Seed, WindSpeed, TargetCells);
+		const bool bDeterministic = First.Checksum == Second.Checksum && First.NumBurntCells == Second.NumBurntCells;
+
+		UE_LOGFMT(LogWildfire, Display,
+			"Wf.Bench.Wildfire: {AreaKm2} km2 burnt in {SimHours} sim hours over {Steps} steps. Wall {WallMs} ms ({StepUs} us per step). Peak {PeakBurning} burning, {PeakFront} front cells. Checksum {Checksum}.",
+			First.NumBurntCells / 10000.0f, First.SimSeconds / 3600.0, First.NumSteps, First.WallSeconds * 1000.0,
+			First.WallSeconds * 1000000.0 / FMath::Max(First.NumSteps, 1), First.PeakBurning, First.PeakFront,
+			FString::Printf(TEXT("%08x"), First.Checksum));
+
+		if (!bDeterministic)
+		{
+			UE_LOGFMT(LogWildfire, Error, "Wf.Bench.Wildfire: FAILED - two runs with seed {Seed} differ ({First} vs {Second})",
+				Seed, FString::Printf(TEXT("%08x"), First.Checksum), FString::Printf(TEXT("%08x"), Second.Checksum));
+		}
+		else if (Args.IsValidIndex(3))
+		{
+			const uint32 Expected = FParse::HexNumber(*Args[3]);
+			if (Expected != First.Checksum)
+			{
+				UE_LOGFMT(LogWildfire, Error, "Wf.Bench.Wildfire: FAILED - checksum {Checksum} does not match the expected {Expected}",
+					FString::Printf(TEXT("%08x"), First.Checksum), Args[3]);
+			}
+			else
+			{
+				UE_LOGFMT(LogWildfire, Display, "Wf.Bench.Wildfire: PASSED");
+			}
+		}
+	}));
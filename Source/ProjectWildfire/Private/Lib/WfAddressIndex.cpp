@@ -0,0 +1,189 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfAddressIndex.h"
+
+#include "Algo/BinarySearch.h"
+
+namespace
+{
+	// Street types as players spell them, and the abbreviation they are indexed under
+	struct FStreetSuffix
+	{
+		const TCHAR* Spelling;
+		const TCHAR* Abbreviation;
+	};
+
+	constexpr FStreetSuffix StreetSuffixes[] =
+	{
+		{ TEXT("street"), TEXT("st") },		{ TEXT("str"), TEXT("st") },
+		{ TEXT("road"), TEXT("rd") },
+		{ TEXT("avenue"), TEXT("ave") },	{ TEXT("av"), TEXT("ave") },
+		{ TEXT("boulevard"), TEXT("blvd") },
+		{ TEXT("drive"), TEXT("dr") },
+		{ TEXT("lane"), TEXT("ln") },
+		{ TEXT("court"), TEXT("ct") },
+		{ TEXT("place"), TEXT("pl") },
+		{ TEXT("circle"), TEXT("cir") },
+		{ TEXT("terrace"), TEXT("ter") },
+		{ TEXT("highway"), TEXT("hwy") },
+		{ TEXT("parkway"), TEXT("pkwy") },
+		{ TEXT("trail"), TEXT("trl") },
+		{ TEXT("way"), TEXT("wy") },
+	};
+
+	// Replaces the last word of the key with its abbreviation, if it is a street type
+	void AbbreviateLastWord(FString& Key, const int32 WordStart)
+	{
+		const FStringView Word = FStringView(Key).RightChop(WordStart);
+		for (const FStreetSuffix& Suffix : StreetSuffixes)
+		{
+			if (Word.Equals(Suffix.Spelling, ESearchCase::CaseSensitive))
+			{
+				Key.LeftInline(WordStart, EAllowShrinking::No);
+				Key.Append(Suffix.Abbreviation);
+				return;
+			}
+		}
+	}
+}
+
+
+int32 FWfStringPool::Intern(const FStringView String)
+{
+	const int32 ExistingIndex = Find(String);
+	if (ExistingIndex != INDEX_NONE)
+		return ExistingIndex;
+
+	const int32 StringIndex = Offsets.Add(Characters.Num());
+	Lengths.Add(String.Len());
+	Characters.Append(String.GetData(), String.Len());
+	Characters.Add(TEXT('\0'));
+
+	const uint32 Hash = GetTypeHash(String);
+	int32& BucketHead = Buckets.FindOrAdd(Hash, INDEX_NONE);
+	NextInBucket.Add(BucketHead);
+	BucketHead = StringIndex;
+	return StringIndex;
+}
+
+int32 FWfStringPool::Find(const FStringView String) const
+{
+	const int32* BucketHead = Buckets.Find(GetTypeHash(String));
+	for (int32 StringIndex = BucketHead ? *BucketHead : INDEX_NONE; StringIndex != INDEX_NONE; StringIndex = NextInBucket[StringIndex])
+	{
+		if (Get(StringIndex).Equals(String, ESearchCase::CaseSensitive))
+			return StringIndex;
+	}
+	return INDEX_NONE;
+}
+
+SIZE_T FWfStringPool::GetAllocatedSize() const
+{
+	return Characters.GetAllocatedSize() + Offsets.GetAllocatedSize() + Lengths.GetAllocatedSize()
+		+ Buckets.GetAllocatedSize() + NextInBucket.GetAllocatedSize();
+}
+
+void FWfStringPool::Reset()
+{
+	Characters.Reset();
+	Offsets.Reset();
+	Lengths.Reset();
+	Buckets.Reset();
+	NextInBucket.Reset();
+}
+
+void FWfAddressIndex::AddProperty(const AWfPropertyActor* Property, const FStringView Address)
+{
+	RemoveProperty(Property);
+
+	NormalizeAddress(Address, ScratchKey);
+	const int32 KeyIndex = KeyPool.Intern(ScratchKey);
+
+	// Sorted insert keeps every lookup a binary search; entries are small so the shift is cheap
+	Entries.Insert(FAddressEntry{KeyIndex, Property}, LowerBound(ScratchKey));
+	PropertyKeys.Add(Property, KeyIndex);
+}
+
+void FWfAddressIndex::RemoveProperty(const AWfPropertyActor* Property)
+{
+	int32 KeyIndex;
+	if (!PropertyKeys.RemoveAndCopyValue(Property, KeyIndex))
+		return;
+
+	// Several properties can share an address (suites), so scan the run of matching keys
+	for (int32 EntryIndex = LowerBound(KeyPool.Get(KeyIndex)); EntryIndex < Entries.Num(); ++EntryIndex)
+	{
+		if (Entries[EntryIndex].KeyIndex != KeyIndex)
+			break;
+		if (Entries[EntryIndex].Property == Property)
+		{
+			Entries.RemoveAt(EntryIndex, 1, EAllowShrinking::No);
+			break;
+		}
+	}
+}
+
+const AWfPropertyActor* FWfAddressIndex::FindProperty(const FStringView Address) const
+{
+	NormalizeAddress(Address, ScratchKey);
+	const int32 EntryIndex = LowerBound(ScratchKey);
+	if (Entries.IsValidIndex(EntryIndex) && KeyPool.Get(Entries[EntryIndex].KeyIndex).Equals(ScratchKey, ESearchCase::CaseSensitive))
+		return Entries[EntryIndex].Property;
+	return nullptr;
+}
+
+void FWfAddressIndex::FindPropertiesWithPrefix(const FStringView Prefix, const int32 MaxResults,
+	TArray<const AWfPropertyActor*>& OutProperties) const
+{
+	OutProperties.Reset();
+	NormalizeAddress(Prefix, ScratchKey);
+	for (int32 EntryIndex = LowerBound(ScratchKey); EntryIndex < Entries.Num() && OutProperties.Num() < MaxResults; ++EntryIndex)
+	{
+		if (!KeyPool.Get(Entries[EntryIndex].KeyIndex).StartsWith(ScratchKey, ESearchCase::CaseSensitive))
+			break;
+		OutProperties.Add(Entries[EntryIndex].Property);
+	}
+}
+
+void FWfAddressIndex::Reset()
+{
+	Entries.Reset();
+	PropertyKeys.Reset();
+	KeyPool.Reset();
+}
+
+void FWfAddressIndex::NormalizeAddress(const FStringView Address, FString& OutKey)
+{
+	OutKey.Reset(Address.Len());
+	bool bPendingSpace = false;
+	int32 WordStart = 0;
+	for (const TCHAR Character : Address)
+	{
+		if (FChar::IsAlnum(Character))
+		{
+			if (bPendingSpace && !OutKey.IsEmpty())
+			{
+				AbbreviateLastWord(OutKey, WordStart);
+				OutKey.AppendChar(TEXT(' '));
+				WordStart = OutKey.Len();
+			}
+			OutKey.AppendChar(FChar::ToLower(Character));
+			bPendingSpace = false;
+		}
+		else
+		{
+			// Punctuation separates words the same way whitespace does
+			bPendingSpace = true;
+		}
+	}
+	AbbreviateLastWord(OutKey, WordStart);
+}
+
+int32 FWfAddressIndex::LowerBound(const FStringView Key) const
+{
+	return Algo::LowerBound(Entries, Key, [this](const FAddressEntry& Entry, const FStringView Value)
+	{
+		return KeyPool.Get(Entry.KeyIndex).Compare(Value, ESearchCase::CaseSensitive) < 0;
+	});
+}
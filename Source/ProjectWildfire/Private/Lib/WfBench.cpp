@@ -0,0 +1,26 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfBench.h"
+
+
+FString FWfBenchTiming::ToString() const
+{
+	const double AverageSeconds = NumTimed > 0 ? TotalSeconds / NumTimed : 0.0;
+	return FString::Printf(TEXT("Average %.1f us, Worst %.1f us"), AverageSeconds * 1000000.0, WorstSeconds * 1000000.0);
+}
+
+FWfBench::FWfBench(const TArray<FString>& InArgs)
+	: Random(1337), Args(InArgs)
+{
+}
+
+int32 FWfBench::GetArg(const int32 Index, const int32 Default, const int32 Min) const
+{
+	return Args.IsValidIndex(Index) ? FMath::Max(Min, FCString::Atoi(*Args[Index])) : Default;
+}
+
+float FWfBench::GetFloatArg(const int32 Index, const float Default, const float Min) const
+{
+	return Args.IsValidIndex(Index) ? FMath::Max(Min, FCString::Atof(*Args[Index])) : Default;
+}
@@ -4,9 +4,12 @@
 #include "Lib/WfCalloutData.h"
 
 #include "Actors/GameManager.h"
+#include "Actors/WfActorPool.h"
 #include "Actors/WfPropertyActor.h"
-#include "Actors/WfVoxManager.h"
 #include "Characters/WfFfCharacterBase.h"
+#include "Lib/WfIncidentJournal.h"
+#include "Lib/WfSimTimings.h"
+#include "Misc/ScopeExit.h"
 #include "Net/UnrealNetwork.h"
 #include "Statics/WfGameModeBase.h"
 #include "Statics/WfPlayerStateBase.h"
@@ -68,7 +71,7 @@ FCalloutEquipmentUse::FCalloutEquipmentUse()
 }
 
 FCalloutDataFire::FCalloutDataFire()
-	: TaskProgress(0.25f), Difficulty(0.1f), WaterUsage(0.833)
+	: TaskProgress(0.25f), Difficulty(0.1f), WaterUsage(0.833), RelativeLocation(FVector::ZeroVector)
 {
 }
 
@@ -120,6 +123,80 @@ FCalloutData::FCalloutData(const FCallouts& NewCallout)
 	CalloutActor = AWfCalloutActor::StaticClass();
 }
 
+FCalloutSnapshot::FCalloutSnapshot()
+	: IncidentNumber(0),
+	  TypeOfIncident(EIncidentType::Medical),
+	  Location(FVector::ZeroVector),
+	  PropertyActor(nullptr)
+{
+}
+
+const FCallouts* FCalloutSnapshot::GetCalloutRow() const
+{
+	if (CalloutRow.IsNull())
+		return nullptr;
+	return CalloutRow.GetRow<FCallouts>(TEXT("FCalloutSnapshot"));
+}
+
+/**
+ * \brief The table and property go as object references, which are a few bytes once the client has them.
+ *  The deadline is sent as whole seconds after the start, which is itself whole seconds.
+ */
+bool FCalloutSnapshot::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	bOutSuccess = true;
+
+	UObject* Table = const_cast<UDataTable*>(ToRawPtr(CalloutRow.DataTable));
+	bOutSuccess &= Map->SerializeObject(Ar, UDataTable::StaticClass(), Table);
+	Ar << CalloutRow.RowName;
+
+	uint32 PackedNumber = static_cast<uint32>(FMath::Max(0, IncidentNumber));
+	Ar.SerializeIntPacked(PackedNumber);
+
+	uint8 Type = static_cast<uint8>(TypeOfIncident);
+	Ar << Type;
+
+	bool bLocationSuccess = true;
+	Location.NetSerialize(Ar, Map, bLocationSuccess);
+	bOutSuccess &= bLocationSuccess;
+
+	UObject* Property = PropertyActor;
+	bOutSuccess &= Map->SerializeObject(Ar, AWfPropertyActor::StaticClass(), Property);
+
+	uint64 StartSeconds = static_cast<uint64>(FMath::Max<int64>(0, ServerTimeStart.GetTicks() / ETimespan::TicksPerSecond));
+	Ar.SerializeIntPacked64(StartSeconds);
+	uint32 DeadlineSeconds = static_cast<uint32>(FMath::Clamp<int64>(
+		(ResolutionDeadline - ServerTimeStart).GetTicks() / ETimespan::TicksPerSecond, 0, MAX_uint32));
+	Ar.SerializeIntPacked(DeadlineSeconds);
+
+	bOutSuccess &= SafeNetSerializeTArray_Default<MaxProgressEntries>(Ar, FireProgress);
+	bOutSuccess &= SafeNetSerializeTArray_Default<MaxProgressEntries>(Ar, PatientProgress);
+
+	if (Ar.IsLoading())
+	{
+		CalloutRow.DataTable = Cast<UDataTable>(Table);
+		IncidentNumber = static_cast<int32>(PackedNumber);
+		TypeOfIncident = static_cast<EIncidentType>(Type);
+		PropertyActor = Cast<AWfPropertyActor>(Property);
+		ServerTimeStart = FDateTime(static_cast<int64>(StartSeconds) * ETimespan::TicksPerSecond);
+		ResolutionDeadline = ServerTimeStart + FTimespan::FromSeconds(DeadlineSeconds);
+	}
+	return bOutSuccess;
+}
+
+bool FCalloutSnapshot::operator==(const FCalloutSnapshot& Other) const
+{
+	return CalloutRow == Other.CalloutRow
+		&& IncidentNumber == Other.IncidentNumber
+		&& TypeOfIncident == Other.TypeOfIncident
+		&& Location == Other.Location
+		&& PropertyActor == Other.PropertyActor
+		&& ServerTimeStart == Other.ServerTimeStart
+		&& ResolutionDeadline == Other.ResolutionDeadline
+		&& FireProgress == Other.FireProgress
+		&& PatientProgress == Other.PatientProgress;
+}
+
 AWfCalloutActor::AWfCalloutActor(): IncidentNumber(0)
 {
 }
@@ -129,7 +206,7 @@ AWfCalloutActor::AWfCalloutActor(): IncidentNumber(0)
  * \param NewCallout The callout data to set. Must be validated before passing.
  * \param SecondsToStart The amount of time players have to assign units and respond
  */
-void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsToStart)
+void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsToStart, AWfPropertyActor* PropertyActor)
 {
 	if (bCalloutReady)
 	{
@@ -141,11 +218,15 @@ void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsT
 	FCalloutData NewCallData(NewCallout);
 	NewCallData.SecondsToStart = SecondsToStart;
 
-	// Generate the Location
-	TArray<AActor*> AllActors;
-	UGameplayStatics::GetAllActorsOfClass(GetWorld(), AWfPropertyActor::StaticClass(), AllActors);
-	const int RandomIndex = FMath::RandRange(0, AllActors.Num() - 1);
-	NewCallData.PropertyActor = Cast<AWfPropertyActor>(AllActors[RandomIndex]);
+	// Generate the Location, unless the incident already has one
+	NewCallData.PropertyActor = PropertyActor;
+	if (!IsValid(NewCallData.PropertyActor))
+	{
+		TArray<AActor*> AllActors;
+		UGameplayStatics::GetAllActorsOfClass(GetWorld(), AWfPropertyActor::StaticClass(), AllActors);
+		if (!AllActors.IsEmpty())
+			NewCallData.PropertyActor = Cast<AWfPropertyActor>(AllActors[FMath::RandRange(0, AllActors.Num() - 1)]);
+	}
 
 	if (!IsValid(NewCallData.PropertyActor))
 	{
@@ -195,6 +276,10 @@ void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsT
 				NewPatient.RefusalChance  = NewCallout.RefusalChanceMax * (1.0f - DiffThreshold / NewCallout.RefusalThreshold);
 			else
 				NewPatient.RefusalChance = 0.0f;
+
+			// Sicker patients start further from stable
+			NewPatient.TaskProgress = FMath::Lerp(0.2f, 0.8f, NewPatient.Difficulty);
+			NewCallData.Patients.Add(NewPatient);
 		}
 	}
 
@@ -203,7 +288,7 @@ void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsT
 	int NumberOfFires = NewCallout.MaxFires;
 	if (NewCallout.MaxFires > 0)
 	{
-		if (NewCallout.PatientsMin != NewCallout.PatientsMax)
+		if (NewCallout.MinFires != NewCallout.MaxFires)
 			NumberOfFires = FMath::RandRange(NewCallout.MinFires, NewCallout.MaxFires);
 
 		for (int i = 0; i < NumberOfFires; ++i)
@@ -216,6 +301,11 @@ void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsT
 
 			// Modify water usage based on difficulty
 			NewFire.WaterUsage	   += NewFire.Difficulty * NewFire.WaterUsage;
+
+			// Spread the spots around the property, they join up as the fire grows
+			const FVector2D Offset	= FMath::RandPointInCircle(FireSpotRadius);
+			NewFire.RelativeLocation = FVector(Offset.X, Offset.Y, 0.0f);
+			NewCallData.Fires.Add(NewFire);
 		}
 	}
 
@@ -236,6 +326,31 @@ void AWfCalloutActor::SetCalloutData(FCallouts& NewCallout, const float SecondsT
 	NewCallData.ResolutionDeadline	= CurrentGdt + AddTimespan;
 	NewCallData.ServerTimeStart		= CurrentGdt;
 	CalloutData = NewCallData;
+	UpdateSnapshot();
+}
+
+void AWfCalloutActor::SetCalloutRow(const UDataTable* CalloutsTable, const FName& RowName)
+{
+	Snapshot.CalloutRow.DataTable = CalloutsTable;
+	Snapshot.CalloutRow.RowName = RowName;
+}
+
+/**
+ * \brief The server has the row as it was adjusted for this callout; clients look it up in their own copy of the table.
+ */
+bool AWfCalloutActor::GetCalloutRow(FCallouts& CalloutRow) const
+{
+	if (HasAuthority())
+	{
+		CalloutRow = CalloutData.CalloutData;
+		return true;
+	}
+	if (const FCallouts* Row = Snapshot.GetCalloutRow())
+	{
+		CalloutRow = *Row;
+		return true;
+	}
+	return false;
 }
 
 /**
@@ -249,15 +364,10 @@ bool AWfCalloutActor::StartCallout()
 	if (IsValid(GameManager))
 	{
 		const FDateTime GameDateTime = GameManager->GetSimulatedDateTime();
+		// Expiration is watched by the callouts manager, along with the rest of the lifecycle
 		if (CalloutData.ResolutionDeadline > GameDateTime)
 		{
 			DispatchInitial();
-
-			// Start the expiration detection
-			FTimerDelegate ExpirationDelegate;
-			ExpirationDelegate.BindUObject(this, &AWfCalloutActor::CheckCalloutExpired);
-			GetWorldTimerManager().SetTimer(ExpirationTimer, ExpirationDelegate, 1.0f, true, 1.0f);
-
 			return true;
 		}
 
@@ -284,6 +394,15 @@ FDateTime AWfCalloutActor::GetGameDateTime() const
 	return FDateTime::UtcNow();
 }
 
+FVector AWfCalloutActor::GetIncidentLocation() const
+{
+	if (IsValid(CalloutData.PropertyActor))
+		return CalloutData.PropertyActor->GetActorLocation();
+	if (IsValid(Snapshot.PropertyActor))
+		return Snapshot.PropertyActor->GetActorLocation();
+	return GetActorLocation();
+}
+
 void AWfCalloutActor::AssignUnitToCallout(AWfFireApparatusBase* FireVehicle, AWfFfCharacterBase* FireFighter)
 {
 	if (IsValid(FireVehicle) && IsValid(FireFighter))
@@ -299,8 +418,8 @@ void AWfCalloutActor::AssignUnitToCallout(AWfFireApparatusBase* FireVehicle, AWf
 			if (!bSameVehicle || (bSameVehicle && !bSameCharacter))
 			{
 				AssignedUnits.Add(CalloutAssignment);
-				UE_LOGFMT(LogCallouts, Error, "{ThisName}({NetMode}): {CharName} ({AppName}) has been assigned to this callout."
-					, GetName(), HasAuthority() ? "SRV" : "CLI", CalloutAssignment.AssignedCharacter->GetName(), CalloutAssignment.AssignedVehicle->GetName());
+				FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::UnitAssigned,
+					FireVehicle->GetFName(), FireFighter->GetFName());
 			}
 		}
 	}
@@ -309,7 +428,103 @@ void AWfCalloutActor::AssignUnitToCallout(AWfFireApparatusBase* FireVehicle, AWf
 void AWfCalloutActor::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
 {
 	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
-	DOREPLIFETIME(AWfCalloutActor, CalloutData);
+	DOREPLIFETIME(AWfCalloutActor, Snapshot);
+}
+
+void AWfCalloutActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+
+	// When the level is torn down the game manager goes with it, and must not be spawned again
+	if (EndPlayReason == EEndPlayReason::Destroyed)
+	{
+		ReleaseAssignments();
+		ReleaseIncident();
+	}
+
+	PatientIncidentId = INDEX_NONE;
+	HydraulicNetworkId = INDEX_NONE;
+	ApparatusPumps.Reset();
+	AttackLines.Reset();
+	FireTaskIds.Reset();
+	PatientTaskIds.Reset();
+	Wildfire.Reset();
+	WildfireWater.Reset();
+}
+
+/**
+ * \brief Puts the actor back the way it was spawned. The pool hides it and lets it go dormant
+ *  afterwards, so clients keep it (and its channel) until the next incident wakes it up.
+ */
+void AWfCalloutActor::OnReturnedToPool()
+{
+	ReleaseAssignments();
+	ReleaseIncident();
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::ActorReleased, GetFName());
+	JournalId = INDEX_NONE;
+
+	GetWorldTimerManager().ClearTimer(CalloutTimer);
+	FireGrid.Reset();
+	Wildfire.Reset();
+	WildfireWater.Reset();
+	ApparatusPumps.Reset();
+	AttackLines.Reset();
+	FireTaskIds.Reset();
+	PatientTaskIds.Reset();
+	AssignedUnits.Reset();
+	CalloutData = FCalloutData();
+	Snapshot = FCalloutSnapshot();
+	IncidentNumber = 0;
+	bCalloutReady = false;
+}
+
+void AWfCalloutActor::ReleaseAssignments()
+{
+	if (!HasAuthority())
+		return;
+
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!IsValid(GameManager))
+		return;
+
+	const FIncidentAssignments IncidentAssignments = GameManager->GetIncidentAssignments(this);
+	for (AWfFireApparatusBase* FireApparatus : IncidentAssignments.FireApparatuses)
+		GameManager->UnassignIncidentFromApparatus(this, FireApparatus);
+	for (AWfFfCharacterBase* Firefighter : IncidentAssignments.Firefighters)
+		GameManager->UnassignIncidentFromFirefighter(this, Firefighter);
+
+	// Units can be put on the callout directly, without the game manager's incident tracking them
+	for (const FCalloutAssignment& AssignedUnit : AssignedUnits)
+	{
+		if (IsValid(AssignedUnit.AssignedVehicle))
+			GameManager->UnassignIncidentFromApparatus(this, AssignedUnit.AssignedVehicle);
+		if (IsValid(AssignedUnit.AssignedCharacter))
+			GameManager->UnassignIncidentFromFirefighter(this, AssignedUnit.AssignedCharacter);
+	}
+	AssignedUnits.Reset();
+}
+
+void AWfCalloutActor::ReleaseIncident()
+{
+	if (bCalloutReady && HasAuthority())
+	{
+		if (AGameManager* GameManager = AGameManager::GetInstance(GetWorld()))
+		{
+			GameManager->GetPatientStore().RemoveIncident(PatientIncidentId);
+			GameManager->GetHydraulics().RemoveNetwork(HydraulicNetworkId);
+			GameManager->RemoveIncidentActor(this);
+		}
+	}
+	PatientIncidentId = INDEX_NONE;
+	HydraulicNetworkId = INDEX_NONE;
+}
+
+void AWfCalloutActor::ReturnToPool()
+{
+	if (AWfActorPool* ActorPool = AWfActorPool::GetInstance(this))
+		ActorPool->ReleaseActor(this);
+	else
+		Destroy();
 }
 
 void AWfCalloutActor::ApplyExpiredPenalty()
@@ -335,63 +550,380 @@ void AWfCalloutActor::DispatchInitial()
 	GameManager->AddIncidentActor(this);
 
 	bCalloutReady = true;
+	InitializeFireGrid();
+	InitializeWildfire();
+	if (!CalloutData.Patients.IsEmpty())
+		PatientIncidentId = GameManager->GetPatientStore().AddIncident(CalloutData.Patients);
 
 	// Start the callout timer (progression, value detection, etc)
 	FTimerDelegate CalloutDelegate;
 	CalloutDelegate.BindUObject(this, &AWfCalloutActor::CalloutTick);
 	GetWorldTimerManager().SetTimer(CalloutTimer, CalloutDelegate, 1.0f, true, 1.0f);
 
+	// The radio pre-alert went out when the callouts manager created the incident
 	Multicast_DispatchPreAlert();
+}
 
-	FName IncidentType = "medical";
-	if (CalloutData.CalloutData.TypeOfIncident != EIncidentType::Medical)
-	{
-		IncidentType = "structure_fire";
-	}
+/**
+ * \brief Performs the full dispatch of the incident, once the callouts manager has dispatched it.
+ */
+void AWfCalloutActor::DispatchCallout()
+{
+	if (!HasAuthority())
+		return;
 
-	FString VoxSentence = ". alert3 . stop_tx . . start_tx , golden_crest, " + IncidentType.ToString() + ", ";
-	VoxSentence += CalloutData.PropertyActor->GetStreetAddressForVox() + ".";
+	Multicast_DispatchCallout();
+}
 
-	// Get the Vox Singleton and send the pre-alert
-	AWfVoxManager* VoxManager = AWfVoxManager::GetInstance(GetWorld());
-	if (IsValid(VoxManager))
+void AWfCalloutActor::CloseCallout()
+{
+	if (!HasAuthority())
+		return;
+
+	GetWorldTimerManager().ClearTimer(CalloutTimer);
+	UE_LOGFMT(LogCallouts, Log, "{ThisName}({NetMode}): Incident #{IncidentNum} has been closed."
+		, GetName(), HasAuthority() ? "SRV" : "CLI", IncidentNumber);
+
+	ReturnToPool();
+}
+
+void AWfCalloutActor::ExpireCallout()
+{
+	if (!HasAuthority())
+		return;
+
+	GetWorldTimerManager().ClearTimer(CalloutTimer);
+	UE_LOGFMT(LogCallouts, Warning, "{ThisName}({NetMode}): This callout has passed the deadline and has expired."
+		, GetName(), HasAuthority() ? "SRV" : "CLI");
+
+	ApplyExpiredPenalty();
+	ReturnToPool();
+}
+
+/**
+ * \brief Builds a square fire grid centered on the incident, and lights a cell for every fire spot.
+ *  Medical calls without fire spots don't allocate a grid at all.
+ */
+void AWfCalloutActor::InitializeFireGrid()
+{
+	FireGrid.Reset();
+	if (CalloutData.Fires.IsEmpty() || FireGridCells <= 0 || FireGridCellSize <= 0.0f
+		|| CalloutData.CalloutData.TypeOfIncident == EIncidentType::Vegetation)
+		return;
+
+	const FVector IncidentLocation = GetIncidentLocation();
+	const float HalfExtent = FireGridCells * FireGridCellSize * 0.5f;
+	FireGrid.Initialize(FireGridCells, FireGridCells,
+		FVector2D(IncidentLocation.X - HalfExtent, IncidentLocation.Y - HalfExtent), FireGridCellSize);
+
+	for (const FCalloutDataFire& Fire : CalloutData.Fires)
 	{
-		VoxManager->SpeakRadio(VoxSentence);
+		const int32 CellIndex = FireGrid.GetCellAtLocation(IncidentLocation + Fire.RelativeLocation);
+		FireGrid.Ignite(CellIndex, Fire.TaskProgress, Fire.Difficulty);
 	}
+
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::FireGridStarted, FireGrid.GetNumCells(), CalloutData.Fires.Num());
 }
 
 /**
- * \brief Performs the full dispatch of the incident, destroying the callout if no-one was assigned to it.
+ * \brief Starts the wildfire for vegetation incidents. There is no fuel map yet, so the ground
+ *  comes from the procedural terrain, seeded by the incident number so a given call always burns the same way.
  */
-void AWfCalloutActor::DispatchCallout()
+void AWfCalloutActor::InitializeWildfire()
 {
-	if (!HasAuthority())
+	Wildfire.Reset();
+	WildfireWater.Reset();
+	if (CalloutData.Fires.IsEmpty() || CalloutData.CalloutData.TypeOfIncident != EIncidentType::Vegetation)
 		return;
 
-	Multicast_DispatchCallout();
+	const FVector IncidentLocation = GetIncidentLocation();
+	Wildfire.Initialize(MakeShared<FWfProceduralWildfireTerrain, ESPMode::ThreadSafe>(IncidentNumber),
+		FVector2D(IncidentLocation), WildfireCellSize, IncidentNumber);
+
+	for (const FCalloutDataFire& Fire : CalloutData.Fires)
+	{
+		Wildfire.Ignite(IncidentLocation + Fire.RelativeLocation);
+	}
+
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::WildfireStarted, CalloutData.Fires.Num());
 }
 
-void AWfCalloutActor::CheckCalloutExpired()
+int AWfCalloutActor::ApplyWater(const FVector& Location, const float Radius, const float Gallons)
 {
-	FDateTime GameDateTime = GetGameDateTime();
-	if (CalloutData.ResolutionDeadline < GameDateTime)
+	if (!HasAuthority() || Gallons <= 0.0f)
+		return 0;
+
+	// Enough water on a vegetation fire wets the ground ahead of it, which stops it like a break would.
+	// Water collects per cell until it can wet at least the cell it lands on, then wets as wide an area
+	// as it covers, up to the radius it was applied over.
+	if (Wildfire.IsInitialized())
 	{
-		if (ExpirationTimer.IsValid())
-			ExpirationTimer.Invalidate();
+		const FIntPoint Cell = Wildfire.GetCellAtLocation(Location);
+		float& Collected = WildfireWater.FindOrAdd(Cell);
+		Collected += Gallons;
 
-		if (CalloutTimer.IsValid())
-			CalloutTimer.Invalidate();
+		const float GallonsPerCell = FMath::Max(WildfireGallonsPerCell, 1.0f);
+		if (Collected < GallonsPerCell)
+		{
+			FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::WaterApplied, Gallons, 0);
+			return 0;
+		}
 
-		UE_LOGFMT(LogCallouts, Warning, "{ThisName}({NetMode}): This callout has passed the deadline and has expired."
-			, GetName(), HasAuthority() ? "SRV" : "CLI");
+		const int32 MaxRadiusCells = FMath::FloorToInt32(Radius / Wildfire.GetCellSize());
+		int32 RadiusCells = 0;
+		while (RadiusCells < MaxRadiusCells && FMath::Square(2 * RadiusCells + 3) * GallonsPerCell <= Collected)
+			++RadiusCells;
 
-		Destroy();
+		const int32 NumCells = FMath::Square(2 * RadiusCells + 1);
+		Collected -= NumCells * GallonsPerCell;
+		Wildfire.AddFireBreak(Wildfire.GetCellLocation(Cell), RadiusCells * Wildfire.GetCellSize());
+		FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::WaterApplied, Gallons, NumCells);
+		return NumCells;
+	}
+
+	if (!FireGrid.IsInitialized())
+		return 0;
+
+	const int NumCells = FireGrid.ApplyWater(Location, Radius, Gallons);
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::WaterApplied, Gallons, NumCells);
+	return NumCells;
+}
+
+int32 AWfCalloutActor::GetFireTaskId(const int FireIndex)
+{
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!HasAuthority() || !CalloutData.Fires.IsValidIndex(FireIndex) || !IsValid(GameManager))
+		return INDEX_NONE;
+
+	if (FireTaskIds.Num() != CalloutData.Fires.Num())
+	{
+		FireTaskIds.Reset(CalloutData.Fires.Num());
+		for (const FCalloutDataFire& Fire : CalloutData.Fires)
+			FireTaskIds.Add(GameManager->GetInventory().CompileTask(Fire.EquipmentUsage));
+	}
+	return FireTaskIds[FireIndex];
+}
+
+int32 AWfCalloutActor::GetPatientTaskId(const int PatientIndex)
+{
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!HasAuthority() || !CalloutData.Patients.IsValidIndex(PatientIndex) || !IsValid(GameManager))
+		return INDEX_NONE;
+
+	if (PatientTaskIds.Num() != CalloutData.Patients.Num())
+	{
+		PatientTaskIds.Reset(CalloutData.Patients.Num());
+		for (const FCalloutDataMedical& Patient : CalloutData.Patients)
+			PatientTaskIds.Add(GameManager->GetInventory().CompileTask(Patient.EquipmentUsage));
+	}
+	return PatientTaskIds[PatientIndex];
+}
+
+int32 AWfCalloutActor::FindNearestFire(const FVector& Location) const
+{
+	const FVector IncidentLocation = GetIncidentLocation();
+	int32 NearestFire = INDEX_NONE;
+	double NearestDistanceSquared = TNumericLimits<double>::Max();
+	for (int32 FireIndex = 0; FireIndex < CalloutData.Fires.Num(); ++FireIndex)
+	{
+		const double DistanceSquared = FVector::DistSquared(IncidentLocation + CalloutData.Fires[FireIndex].RelativeLocation, Location);
+		if (DistanceSquared < NearestDistanceSquared)
+		{
+			NearestDistanceSquared = DistanceSquared;
+			NearestFire = FireIndex;
+		}
 	}
+	return NearestFire;
+}
+
+void AWfCalloutActor::TreatPatient(const int PatientIndex, const float TreatmentPerSecond)
+{
+	if (!HasAuthority() || PatientIncidentId == INDEX_NONE)
+		return;
+
+	if (AGameManager* GameManager = AGameManager::GetInstance(GetWorld()))
+	{
+		GameManager->GetPatientStore().SetTreatment(PatientIncidentId, PatientIndex, TreatmentPerSecond);
+		FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::PatientTreated, PatientIndex, TreatmentPerSecond);
+	}
+}
+
+int AWfCalloutActor::LayAttackLine(const AWfFireApparatusBase* FireApparatus, const FVector& NozzleLocation,
+	const float LengthFeet, const float DiameterInches, const float NozzleGpm)
+{
+	int32 Tank, Discharge;
+	if (!FindOrAddApparatusPump(FireApparatus, Tank, Discharge))
+		return -1;
+
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	FWfHydraulics& Hydraulics = GameManager->GetHydraulics();
+	const int32 Tip = Hydraulics.AddJunction(HydraulicNetworkId);
+	Hydraulics.AddHoseLine(HydraulicNetworkId, Discharge, Tip, DiameterInches, LengthFeet);
+
+	FAttackLine& NewLine = AttackLines.AddDefaulted_GetRef();
+	NewLine.Nozzle      = Hydraulics.AddNozzle(HydraulicNetworkId, Tip, NozzleGpm, 100.0f);
+	NewLine.Location    = NozzleLocation;
+	NewLine.ContainerId = GameManager->GetInventory().FindContainer(FireApparatus);
+
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::AttackLineLaid, AttackLines.Num() - 1, NozzleGpm);
+	return AttackLines.Num() - 1;
+}
+
+void AWfCalloutActor::SetAttackLineFlowing(const int AttackLine, const bool bFlowing)
+{
+	if (!HasAuthority() || !AttackLines.IsValidIndex(AttackLine))
+		return;
+
+	if (AGameManager* GameManager = AGameManager::GetInstance(GetWorld()))
+		GameManager->GetHydraulics().SetLineOpen(HydraulicNetworkId, AttackLines[AttackLine].Nozzle, bFlowing);
+}
+
+void AWfCalloutActor::ConnectHydrant(const AWfFireApparatusBase* FireApparatus, const float StaticPsi,
+	const float ResidualPsi, const float ResidualGpm, const float LengthFeet)
+{
+	int32 Tank, Discharge;
+	if (!FindOrAddApparatusPump(FireApparatus, Tank, Discharge))
+		return;
+
+	// Supply line is 5" LDH; the tank takes whatever the hydrant can give it
+	FWfHydraulics& Hydraulics = AGameManager::GetInstance(GetWorld())->GetHydraulics();
+	const int32 Hydrant = Hydraulics.AddHydrant(HydraulicNetworkId, StaticPsi, ResidualPsi, ResidualGpm);
+	Hydraulics.AddHoseLine(HydraulicNetworkId, Hydrant, Tank, 5.0f, LengthFeet);
+	FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::HydrantConnected, StaticPsi, ResidualPsi);
+}
+
+bool AWfCalloutActor::FindOrAddApparatusPump(const AWfFireApparatusBase* FireApparatus, int32& OutTank, int32& OutDischarge)
+{
+	if (!HasAuthority() || !IsValid(FireApparatus) || FireApparatus->PumpRatedGpm <= 0.0f)
+		return false;
+
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!IsValid(GameManager))
+		return false;
+
+	FWfHydraulics& Hydraulics = GameManager->GetHydraulics();
+	if (!Hydraulics.IsValidNetwork(HydraulicNetworkId))
+		HydraulicNetworkId = Hydraulics.AddNetwork();
+
+	if (const TPair<int32, int32>* Existing = ApparatusPumps.Find(FireApparatus))
+	{
+		OutTank = Existing->Key;
+		OutDischarge = Existing->Value;
+		return true;
+	}
+
+	// Pumps are taken to shut off at roughly 1.6 times their rated pressure
+	OutTank = Hydraulics.AddTank(HydraulicNetworkId, FireApparatus->TankGallons);
+	OutDischarge = Hydraulics.AddJunction(HydraulicNetworkId);
+	Hydraulics.AddPump(HydraulicNetworkId, OutTank, OutDischarge,
+		FireApparatus->PumpRatedPsi * 1.6f, FireApparatus->PumpRatedGpm, FireApparatus->PumpRatedPsi);
+	ApparatusPumps.Add(FireApparatus, TPair<int32, int32>(OutTank, OutDischarge));
+	return true;
 }
 
+bool AWfCalloutActor::IsIncidentControlled() const
+{
+	if (!IsFireExtinguished())
+		return false;
+	if (PatientIncidentId == INDEX_NONE)
+		return true;
+
+	const AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+	if (!IsValid(GameManager))
+		return false;
+
+	const FWfPatientStore& PatientStore = GameManager->GetPatientStore();
+	const FWfPatientView View = PatientStore.GetIncidentView(PatientIncidentId);
+	for (int32 PatientIndex = 0; PatientIndex < View.Num; ++PatientIndex)
+	{
+		if (PatientStore.GetState(View.GetStoreIndex(PatientIndex)) == EWfPatientState::Deteriorating)
+			return false;
+	}
+	return true;
+}
+
+bool AWfCalloutActor::IsFireExtinguished() const
+{
+	if (Wildfire.IsInitialized())
+		return Wildfire.IsOut();
+	return !FireGrid.IsInitialized() || FireGrid.IsExtinguished();
+}
+
+/**
+ * \brief Mirrors the patients' condition from the patient store, then advances the fire by the
+ *  simulated time since the last tick and copies the intensity under each fire spot back into its TaskProgress.
+ */
 void AWfCalloutActor::CalloutTick()
 {
-	// TODO
+	if (!HasAuthority())
+		return;
+
+	WF_SCOPE_SIM_TIMING(TEXT("Callouts"));
+	AGameManager* GameManager = AGameManager::GetInstance(GetWorld());
+
+	// Whatever changed below goes out to clients in the snapshot
+	ON_SCOPE_EXIT { UpdateSnapshot(); };
+
+	// Patients are stepped in one batch by the game manager; this just mirrors their condition
+	if (PatientIncidentId != INDEX_NONE && IsValid(GameManager))
+		GameManager->GetPatientStore().CopyToCallout(PatientIncidentId, CalloutData.Patients);
+
+	if (IsFireExtinguished())
+		return;
+
+	float SimSeconds = GetWorldTimerManager().GetTimerRate(CalloutTimer);
+	if (IsValid(GameManager))
+		SimSeconds *= GameManager->GetSimulatedTimeRate();
+
+	// Whatever the attack lines flowed since the last tick lands on the fire now, up to two cells
+	// around the nozzle of whichever grid is burning
+	if (IsValid(GameManager))
+	{
+		const float NozzleRadius = (Wildfire.IsInitialized() ? Wildfire.GetCellSize() : FireGridCellSize) * 2.0f;
+		for (const FAttackLine& AttackLine : AttackLines)
+		{
+			const float Gallons = GameManager->GetHydraulics().TakeDischargedGallons(HydraulicNetworkId, AttackLine.Nozzle);
+			if (Gallons <= 0.0f)
+				continue;
+			ApplyWater(AttackLine.Location, NozzleRadius, Gallons);
+
+			// The fire spot's equipment (foam, nozzles, ...) is used up with the share of its water flowed,
+			// from the apparatus supplying the line, on the game manager's next inventory step
+			const int32 FireIndex = FindNearestFire(AttackLine.Location);
+			const int32 TaskId = GetFireTaskId(FireIndex);
+			if (TaskId != INDEX_NONE && GameManager->GetInventory().IsValidContainer(AttackLine.ContainerId))
+			{
+				const float WaterUsage = FMath::Max(CalloutData.Fires[FireIndex].WaterUsage, 1.0f);
+				GameManager->GetInventory().QueueConsumption(AttackLine.ContainerId, TaskId, Gallons / WaterUsage);
+			}
+		}
+	}
+
+	// The wildfire runs in the background, this publishes the last job and starts the next
+	if (Wildfire.IsInitialized())
+	{
+		Wildfire.Update(SimSeconds);
+		if (Wildfire.IsOut())
+		{
+			for (FCalloutDataFire& Fire : CalloutData.Fires)
+			{
+				Fire.TaskProgress = 0.0f;
+			}
+			FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::FireOut);
+		}
+		return;
+	}
+
+	FireGrid.Advance(SimSeconds);
+
+	const FVector IncidentLocation = GetIncidentLocation();
+	for (FCalloutDataFire& Fire : CalloutData.Fires)
+	{
+		Fire.TaskProgress = FireGrid.GetMaxIntensity(IncidentLocation + Fire.RelativeLocation, FireGridCellSize);
+	}
+
+	if (FireGrid.IsExtinguished())
+		FWfIncidentJournal::Get().Record(JournalId, EWfJournalEvent::FireOut);
 }
 
 
@@ -400,6 +932,38 @@ void AWfCalloutActor::CalloutTick()
  */
 
 
+void AWfCalloutActor::UpdateSnapshot()
+{
+	if (!HasAuthority())
+		return;
+
+	Snapshot.IncidentNumber     = IncidentNumber;
+	Snapshot.TypeOfIncident     = CalloutData.CalloutData.TypeOfIncident;
+	Snapshot.PropertyActor      = CalloutData.PropertyActor;
+	Snapshot.Location           = GetIncidentLocation();
+	Snapshot.ServerTimeStart    = CalloutData.ServerTimeStart;
+	Snapshot.ResolutionDeadline = CalloutData.ResolutionDeadline;
+
+	// Clamped to what NetSerialize sends, so the server's copy matches what clients receive
+	Snapshot.FireProgress.SetNumUninitialized(FMath::Min(CalloutData.Fires.Num(), FCalloutSnapshot::MaxProgressEntries));
+	for (int32 i = 0; i < Snapshot.FireProgress.Num(); ++i)
+	{
+		Snapshot.FireProgress[i] = FCalloutSnapshot::QuantizeProgress(CalloutData.Fires[i].TaskProgress);
+	}
+	Snapshot.PatientProgress.SetNumUninitialized(FMath::Min(CalloutData.Patients.Num(), FCalloutSnapshot::MaxProgressEntries));
+	for (int32 i = 0; i < Snapshot.PatientProgress.Num(); ++i)
+	{
+		Snapshot.PatientProgress[i] = FCalloutSnapshot::QuantizeProgress(CalloutData.Patients[i].TaskProgress);
+	}
+}
+
+void AWfCalloutActor::OnRep_Snapshot()
+{
+	if (OnCalloutSnapshotUpdated.IsBound())
+		OnCalloutSnapshotUpdated.Broadcast(this);
+}
+
+
 /**
  * \brief Notifies delegates (such as the vox/dispatch and ui systems) that a call is new and has started
  */
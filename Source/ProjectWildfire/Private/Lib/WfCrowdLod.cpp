@@ -0,0 +1,271 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfCrowdLod.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogCrowdLod);
+
+FWfCrowdLod::FWfCrowdLod()
+	: FullRadius(5000.0f), ReducedRadius(15000.0f), Hysteresis(0.1f), MaxTransitionsPerUpdate(32)
+{
+}
+
+int32 FWfCrowdLod::AddAgent(AActor* Agent, const FVector& Location)
+{
+	Agents.Add(Agent);
+	Locations.Add(Location);
+	Levels.Add(EWfLodLevel::Full);
+	Travels.AddDefaulted();
+
+	const int32 AgentId = Ids.Add();
+	return AgentId;
+}
+
+void FWfCrowdLod::RemoveAgent(const int32 AgentId)
+{
+	if (!IsValidAgent(AgentId))
+		return;
+
+	const int32 Index = Ids.IndexOf(AgentId);
+	Agents.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Locations.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Levels.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Travels.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Ids.Remove(AgentId);
+}
+
+AActor* FWfCrowdLod::GetAgent(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) ? Agents[Ids.IndexOf(AgentId)].ResolveObjectPtr() : nullptr;
+}
+
+EWfLodLevel FWfCrowdLod::GetLevel(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) ? Levels[Ids.IndexOf(AgentId)] : EWfLodLevel::Full;
+}
+
+FVector FWfCrowdLod::GetLocation(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) ? Locations[Ids.IndexOf(AgentId)] : FVector::ZeroVector;
+}
+
+void FWfCrowdLod::SetLocation(const int32 AgentId, const FVector& Location)
+{
+	if (IsValidAgent(AgentId))
+		Locations[Ids.IndexOf(AgentId)] = Location;
+}
+
+void FWfCrowdLod::StartTravel(const int32 AgentId, TArray<FVector>&& Route, const float Speed)
+{
+	if (!IsValidAgent(AgentId))
+		return;
+
+	FTravel& Travel = Travels[Ids.IndexOf(AgentId)];
+	Travel.Route = MoveTemp(Route);
+	Travel.Segment = 0;
+	Travel.SegmentOffset = 0.0f;
+	Travel.Speed = FMath::Max(Speed, 0.0f);
+	if (!Travel.Route.IsEmpty())
+		Locations[Ids.IndexOf(AgentId)] = Travel.Route[0];
+}
+
+void FWfCrowdLod::StopTravel(const int32 AgentId)
+{
+	if (IsValidAgent(AgentId))
+		Travels[Ids.IndexOf(AgentId)] = FTravel();
+}
+
+bool FWfCrowdLod::IsTravelling(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) && Travels[Ids.IndexOf(AgentId)].Route.Num() > 1;
+}
+
+/**
+ * \brief Every agent is measured against every observer, which is a handful of players, so this is one
+ *  pass over the locations. Level changes beyond MaxTransitionsPerUpdate are sorted, rehydration nearest
+ *  first and then demotion farthest first, and whatever falls past the limit waits for the next update.
+ *  An agent rehydrated from Abstract stops travelling; its owner resumes the move from GetLocation().
+ */
+void FWfCrowdLod::Update(TConstArrayView<FVector> Observers, const float DeltaSeconds)
+{
+	Transitions.Reset();
+	Arrivals.Reset();
+	Candidates.Reset();
+
+	const int32 NumAgents = Agents.Num();
+	for (int32 Index = 0; Index < NumAgents; ++Index)
+	{
+		if (Levels[Index] == EWfLodLevel::Abstract && Travels[Index].Route.Num() > 1 && AdvanceTravel(Index, DeltaSeconds))
+			Arrivals.Add(Ids.IdOf(Index));
+	}
+
+	for (int32 Index = 0; Index < NumAgents; ++Index)
+	{
+		float NearestDistSq = TNumericLimits<float>::Max();
+		for (const FVector& Observer : Observers)
+			NearestDistSq = FMath::Min(NearestDistSq, static_cast<float>(FVector::DistSquared(Observer, Locations[Index])));
+
+		const EWfLodLevel Level = PickLevel(Levels[Index], NearestDistSq);
+		if (Level != Levels[Index])
+			Candidates.Add({ Index, Level, NearestDistSq });
+	}
+
+	if (Candidates.Num() > MaxTransitionsPerUpdate)
+	{
+		Candidates.Sort([this](const FCandidate& A, const FCandidate& B)
+		{
+			const bool bRaiseA = A.To < Levels[A.Index];
+			const bool bRaiseB = B.To < Levels[B.Index];
+			if (bRaiseA != bRaiseB)
+				return bRaiseA;
+			return bRaiseA ? A.DistSq < B.DistSq : A.DistSq > B.DistSq;
+		});
+	}
+
+	const int32 NumTransitions = FMath::Min(Candidates.Num(), MaxTransitionsPerUpdate);
+	for (int32 CandidateIndex = 0; CandidateIndex < NumTransitions; ++CandidateIndex)
+	{
+		const FCandidate& Candidate = Candidates[CandidateIndex];
+		Transitions.Add({ Ids.IdOf(Candidate.Index), Levels[Candidate.Index], Candidate.To });
+		if (Levels[Candidate.Index] == EWfLodLevel::Abstract)
+			Travels[Candidate.Index] = FTravel();
+		Levels[Candidate.Index] = Candidate.To;
+	}
+}
+
+int32 FWfCrowdLod::GetNumAtLevel(const EWfLodLevel Level) const
+{
+	int32 NumAtLevel = 0;
+	for (const EWfLodLevel AgentLevel : Levels)
+		NumAtLevel += AgentLevel == Level ? 1 : 0;
+	return NumAtLevel;
+}
+
+void FWfCrowdLod::Reset()
+{
+	Agents.Reset();
+	Locations.Reset();
+	Levels.Reset();
+	Travels.Reset();
+	Ids.Reset();
+	Candidates.Reset();
+	Transitions.Reset();
+	Arrivals.Reset();
+}
+
+bool FWfCrowdLod::AdvanceTravel(const int32 Index, const float DeltaSeconds)
+{
+	FTravel& Travel = Travels[Index];
+	const int32 LastPoint = Travel.Route.Num() - 1;
+	float Remaining = Travel.Speed * DeltaSeconds;
+	while (Remaining > 0.0f && Travel.Segment < LastPoint)
+	{
+		const float SegmentLength = FVector::Dist(Travel.Route[Travel.Segment], Travel.Route[Travel.Segment + 1]);
+		const float SegmentLeft = SegmentLength - Travel.SegmentOffset;
+		if (Remaining < SegmentLeft)
+		{
+			Travel.SegmentOffset += Remaining;
+			Remaining = 0.0f;
+		}
+		else
+		{
+			Remaining -= SegmentLeft;
+			++Travel.Segment;
+			Travel.SegmentOffset = 0.0f;
+		}
+	}
+
+	if (Travel.Segment >= LastPoint)
+	{
+		Locations[Index] = Travel.Route.Last();
+		Travel = FTravel();
+		return true;
+	}
+
+	const FVector& From = Travel.Route[Travel.Segment];
+	const FVector& To = Travel.Route[Travel.Segment + 1];
+	const float SegmentLength = FVector::Dist(From, To);
+	Locations[Index] = SegmentLength > KINDA_SMALL_NUMBER ? FMath::Lerp(From, To, Travel.SegmentOffset / SegmentLength) : To;
+	return false;
+}
+
+EWfLodLevel FWfCrowdLod::PickLevel(const EWfLodLevel Current, const float DistSq) const
+{
+	const float FullReach = FullRadius * (Current == EWfLodLevel::Full ? 1.0f + Hysteresis : 1.0f);
+	if (DistSq < FMath::Square(FullReach))
+		return EWfLodLevel::Full;
+
+	const float ReducedReach = ReducedRadius * (Current != EWfLodLevel::Abstract ? 1.0f + Hysteresis : 1.0f);
+	if (DistSq < FMath::Square(ReducedReach))
+		return EWfLodLevel::Reduced;
+
+	return EWfLodLevel::Abstract;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Lod [Agents] [Observers] [Steps]
+ *  Scatters agents over a 4 km square, with a third of them walking a random route, and moves the
+ *  observers across it in a straight line, so agents keep changing level. No actors are involved; this
+ *  times the store's update, not the pawns applying the transitions.
+ */
+static FAutoConsoleCommand GWfBenchLodCommand(
+	TEXT("Wf.Bench.Lod"),
+	TEXT("Benchmarks the crowd LOD. Usage: Wf.Bench.Lod [Agents=1000] [Observers=8] [Steps=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumAgents = Bench.GetArg(0, 1000);
+		const int32 NumObservers = Bench.GetArg(1, 8, 0);
+		const int32 NumSteps = Bench.GetArg(2, 1000);
+
+		FRandomStream& Random = Bench.Random;
+		const auto RandomLocation = [&Random]()
+		{
+			return FVector(Random.FRandRange(0.0f, 400000.0f), Random.FRandRange(0.0f, 400000.0f), 0.0f);
+		};
+
+		FWfCrowdLod CrowdLod;
+		for (int32 AgentIndex = 0; AgentIndex < NumAgents; ++AgentIndex)
+		{
+			const FVector Location = RandomLocation();
+			const int32 AgentId = CrowdLod.AddAgent(nullptr, Location);
+			if (AgentIndex % 3 == 0)
+				CrowdLod.StartTravel(AgentId, { Location, RandomLocation(), RandomLocation() }, 150.0f);
+		}
+
+		TArray<FVector> Observers;
+		TArray<FVector> Velocities;
+		for (int32 ObserverIndex = 0; ObserverIndex < NumObservers; ++ObserverIndex)
+		{
+			Observers.Add(RandomLocation());
+			Velocities.Add(FVector(Random.FRandRange(-2000.0f, 2000.0f), Random.FRandRange(-2000.0f, 2000.0f), 0.0f));
+		}
+
+		int64 TotalTransitions = 0;
+		Bench.Run(NumSteps, [&](const int32)
+		{
+			for (int32 ObserverIndex = 0; ObserverIndex < NumObservers; ++ObserverIndex)
+				Observers[ObserverIndex] += Velocities[ObserverIndex] * 0.25f;
+		},
+		[&](const int32)
+		{
+			CrowdLod.Update(Observers, 0.25f);
+			TotalTransitions += CrowdLod.GetTransitions().Num();
+		});
+
+		UE_LOGFMT(LogCrowdLod, Display,
+			"Wf.Bench.Lod: {Agents} agents, {Observers} observers, {Steps} steps. {Timing} per update, {Transitions} transitions per update. Now {Full} full, {Reduced} reduced, {Abstract} abstract."
+			, NumAgents, NumObservers, NumSteps, Bench.Timing.ToString()
+			, static_cast<double>(TotalTransitions) / NumSteps, CrowdLod.GetNumAtLevel(EWfLodLevel::Full)
+			, CrowdLod.GetNumAtLevel(EWfLodLevel::Reduced), CrowdLod.GetNumAtLevel(EWfLodLevel::Abstract));
+	}));
@@ -0,0 +1,400 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfDispatchRecommender.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Lib/WfCalloutData.h"
+#include "Logging/StructuredLog.h"
+#include "Statics/WfGlobalData.h"
+#include "Vehicles/WfFireApparatusBase.h"
+
+DEFINE_LOG_CATEGORY(LogDispatch);
+
+
+FWfUnitRequirement::FWfUnitRequirement()
+	: UnitClass(nullptr), Quantity(0), bIsRequired(true)
+{
+}
+
+FWfUnitRequirement::FWfUnitRequirement(const FCalloutUnits& CalloutUnits)
+	: UnitClass(CalloutUnits.ResourceUnitType.Get()), Quantity(CalloutUnits.QuantityMinimum), bIsRequired(true)
+{
+}
+
+FWfUnitRequirement::FWfUnitRequirement(const FResourceNeeds& ResourceNeeds)
+	: UnitClass(ResourceNeeds.ResourceType.Get()), Quantity(ResourceNeeds.MinimumQuantity), bIsRequired(ResourceNeeds.bIsRequired)
+{
+}
+
+FWfDispatchRecommender::FWfDispatchRecommender()
+	: NumUnits(0)
+{
+}
+
+int32 FWfDispatchRecommender::RegisterUnit(const AWfFireApparatusBase* Apparatus, const UClass* UnitClass, const FVector& Location)
+{
+	if (Apparatus == nullptr)
+		return INDEX_NONE;
+
+	if (const int32* ExistingIndex = UnitLookup.Find(Apparatus))
+		return *ExistingIndex;
+
+	int32 UnitIndex;
+	if (!FreeUnitIndices.IsEmpty())
+	{
+		UnitIndex = FreeUnitIndices.Pop(EAllowShrinking::No);
+	}
+	else
+	{
+		UnitIndex = UnitApparatus.AddDefaulted();
+		UnitClasses.AddDefaulted();
+		UnitX.AddDefaulted();
+		UnitY.AddDefaulted();
+		UnitFlags.AddZeroed();
+
+		// Grow every mask when the unit table crosses a word boundary
+		const int32 NumWords = FMath::DivideAndRoundUp(UnitApparatus.Num(), 64);
+		if (ReadyMask.Num() < NumWords)
+		{
+			ReadyMask.SetNumZeroed(NumWords);
+			PickedMask.SetNumZeroed(NumWords);
+			for (auto& ClassMask : ClassMasks)
+			{
+				ClassMask.Value.SetNumZeroed(NumWords);
+			}
+		}
+	}
+
+	UnitApparatus[UnitIndex] = Apparatus;
+	UnitClasses[UnitIndex]   = UnitClass;
+	UnitX[UnitIndex]         = Location.X;
+	UnitY[UnitIndex]         = Location.Y;
+
+	// New units are available and in service, but unstaffed until a firefighter is assigned
+	UnitFlags[UnitIndex] = Flag_Registered | Flag_Available | Flag_InService;
+	UpdateReadyBit(UnitIndex);
+
+	for (auto& ClassMask : ClassMasks)
+	{
+		SetMaskBit(ClassMask.Value, UnitIndex, UnitClass != nullptr && UnitClass->IsChildOf(ClassMask.Key));
+	}
+
+	UnitLookup.Add(Apparatus, UnitIndex);
+	++NumUnits;
+	return UnitIndex;
+}
+
+void FWfDispatchRecommender::UnregisterUnit(const AWfFireApparatusBase* Apparatus)
+{
+	UnregisterUnit(FindUnit(Apparatus));
+}
+
+void FWfDispatchRecommender::UnregisterUnit(const int32 UnitIndex)
+{
+	if (!UnitFlags.IsValidIndex(UnitIndex) || (UnitFlags[UnitIndex] & Flag_Registered) == 0)
+		return;
+
+	UnitLookup.Remove(UnitApparatus[UnitIndex]);
+	UnitApparatus[UnitIndex] = nullptr;
+	UnitClasses[UnitIndex]   = nullptr;
+	UnitFlags[UnitIndex]     = 0;
+	UpdateReadyBit(UnitIndex);
+
+	for (auto& ClassMask : ClassMasks)
+	{
+		SetMaskBit(ClassMask.Value, UnitIndex, false);
+	}
+
+	FreeUnitIndices.Push(UnitIndex);
+	--NumUnits;
+}
+
+int32 FWfDispatchRecommender::FindUnit(const AWfFireApparatusBase* Apparatus) const
+{
+	const int32* UnitIndex = UnitLookup.Find(Apparatus);
+	return UnitIndex ? *UnitIndex : INDEX_NONE;
+}
+
+const AWfFireApparatusBase* FWfDispatchRecommender::GetUnitApparatus(const int32 UnitIndex) const
+{
+	return UnitApparatus.IsValidIndex(UnitIndex) ? UnitApparatus[UnitIndex] : nullptr;
+}
+
+void FWfDispatchRecommender::SetUnitAvailable(const int32 UnitIndex, const bool bAvailable)
+{
+	SetUnitFlag(UnitIndex, Flag_Available, bAvailable);
+}
+
+void FWfDispatchRecommender::SetUnitStaffed(const int32 UnitIndex, const bool bStaffed)
+{
+	SetUnitFlag(UnitIndex, Flag_Staffed, bStaffed);
+}
+
+void FWfDispatchRecommender::SetUnitInService(const int32 UnitIndex, const bool bInService)
+{
+	SetUnitFlag(UnitIndex, Flag_InService, bInService);
+}
+
+void FWfDispatchRecommender::SetUnitLocation(const int32 UnitIndex, const FVector& Location)
+{
+	if (!UnitFlags.IsValidIndex(UnitIndex))
+		return;
+	UnitX[UnitIndex] = Location.X;
+	UnitY[UnitIndex] = Location.Y;
+}
+
+bool FWfDispatchRecommender::IsUnitReady(const int32 UnitIndex) const
+{
+	return UnitFlags.IsValidIndex(UnitIndex) && (UnitFlags[UnitIndex] & Flag_Ready) == Flag_Ready;
+}
+
+int32 FWfDispatchRecommender::GetNumReadyUnits() const
+{
+	int32 NumReady = 0;
+	for (const uint64 Word : ReadyMask)
+	{
+		NumReady += FMath::CountBits(Word);
+	}
+	return NumReady;
+}
+
+bool FWfDispatchRecommender::Recommend(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+	TArray<FWfDispatchCandidate>& OutCandidates) const
+{
+	return RecommendRanked(Location, Requirements, OutCandidates, nullptr, 1);
+}
+
+bool FWfDispatchRecommender::Recommend(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+	TArray<FWfDispatchCandidate>& OutCandidates, FTravelTimeFunction GetTravelTime, const int32 ShortlistFactor) const
+{
+	return RecommendRanked(Location, Requirements, OutCandidates, &GetTravelTime, FMath::Max(ShortlistFactor, 1));
+}
+
+bool FWfDispatchRecommender::RecommendRanked(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+	TArray<FWfDispatchCandidate>& OutCandidates, const FTravelTimeFunction* GetTravelTime, const int32 ShortlistFactor) const
+{
+	OutCandidates.Reset();
+	FMemory::Memzero(PickedMask.GetData(), PickedMask.Num() * sizeof(uint64));
+	bool bSatisfied = true;
+
+	for (int32 RequirementIndex = 0; RequirementIndex < Requirements.Num(); ++RequirementIndex)
+	{
+		const FWfUnitRequirement& Requirement = Requirements[RequirementIndex];
+		if (Requirement.Quantity <= 0)
+			continue;
+
+		FindClosest(Location, Requirement, RequirementIndex, Requirement.Quantity * ShortlistFactor, Shortlist);
+
+		if (GetTravelTime != nullptr)
+		{
+			for (FWfDispatchCandidate& Candidate : Shortlist)
+			{
+				const float TravelTime = (*GetTravelTime)(Candidate.UnitIndex);
+				Candidate.TravelTime = TravelTime < 0.0f ? TNumericLimits<float>::Max() : TravelTime;
+			}
+			// The shortlist is closest first, so units the same time away (or without a route) stay in that order
+			Shortlist.StableSort([](const FWfDispatchCandidate& A, const FWfDispatchCandidate& B)
+			{
+				return A.TravelTime < B.TravelTime;
+			});
+		}
+
+		const int32 NumPicked = FMath::Min(Shortlist.Num(), Requirement.Quantity);
+		for (int32 Index = 0; Index < NumPicked; ++Index)
+		{
+			const FWfDispatchCandidate& Candidate = Shortlist[Index];
+			PickedMask[Candidate.UnitIndex / 64] |= 1ull << (Candidate.UnitIndex % 64);
+			OutCandidates.Add(Candidate);
+		}
+
+		if (Requirement.bIsRequired && NumPicked < Requirement.Quantity)
+			bSatisfied = false;
+	}
+
+	// Quickest (or closest) first overall, so the first unit dispatched is the first unit on scene
+	OutCandidates.Sort([](const FWfDispatchCandidate& A, const FWfDispatchCandidate& B)
+	{
+		if (A.TravelTime != B.TravelTime)
+			return A.TravelTime < B.TravelTime;
+		return A.DistanceSquared < B.DistanceSquared;
+	});
+	return bSatisfied;
+}
+
+void FWfDispatchRecommender::FindClosest(const FVector& Location, const FWfUnitRequirement& Requirement,
+	const int32 RequirementIndex, const int32 MaxCount, TArray<FWfDispatchCandidate>& OutClosest) const
+{
+	OutClosest.Reset();
+	const TArray<uint64>& ClassMask = GetClassMask(Requirement.UnitClass);
+	const float IncidentX = Location.X;
+	const float IncidentY = Location.Y;
+
+	for (int32 WordIndex = 0; WordIndex < ReadyMask.Num(); ++WordIndex)
+	{
+		uint64 Word = ReadyMask[WordIndex] & ClassMask[WordIndex] & ~PickedMask[WordIndex];
+		while (Word != 0)
+		{
+			const int32 UnitIndex = WordIndex * 64 + static_cast<int32>(FMath::CountTrailingZeros64(Word));
+			Word &= Word - 1;
+
+			const float DeltaX = UnitX[UnitIndex] - IncidentX;
+			const float DeltaY = UnitY[UnitIndex] - IncidentY;
+			const float DistanceSquared = DeltaX * DeltaX + DeltaY * DeltaY;
+
+			if (OutClosest.Num() == MaxCount && DistanceSquared >= OutClosest.Last().DistanceSquared)
+				continue;
+
+			int32 InsertAt = OutClosest.Num();
+			while (InsertAt > 0 && OutClosest[InsertAt - 1].DistanceSquared > DistanceSquared)
+			{
+				--InsertAt;
+			}
+			if (OutClosest.Num() == MaxCount)
+				OutClosest.Pop(EAllowShrinking::No);
+			OutClosest.Insert(FWfDispatchCandidate{UnitIndex, RequirementIndex, DistanceSquared, 0.0f}, InsertAt);
+		}
+	}
+}
+
+void FWfDispatchRecommender::Reset()
+{
+	UnitApparatus.Reset();
+	UnitClasses.Reset();
+	UnitX.Reset();
+	UnitY.Reset();
+	UnitFlags.Reset();
+	ReadyMask.Reset();
+	PickedMask.Reset();
+	ClassMasks.Reset();
+	UnitLookup.Reset();
+	FreeUnitIndices.Reset();
+	NumUnits = 0;
+}
+
+void FWfDispatchRecommender::SetUnitFlag(const int32 UnitIndex, const uint8 Flag, const bool bValue)
+{
+	if (!UnitFlags.IsValidIndex(UnitIndex) || (UnitFlags[UnitIndex] & Flag_Registered) == 0)
+		return;
+
+	if (bValue)
+		UnitFlags[UnitIndex] |= Flag;
+	else
+		UnitFlags[UnitIndex] &= ~Flag;
+	UpdateReadyBit(UnitIndex);
+}
+
+void FWfDispatchRecommender::UpdateReadyBit(const int32 UnitIndex)
+{
+	SetMaskBit(ReadyMask, UnitIndex, (UnitFlags[UnitIndex] & Flag_Ready) == Flag_Ready);
+}
+
+void FWfDispatchRecommender::SetMaskBit(TArray<uint64>& Mask, const int32 UnitIndex, const bool bValue) const
+{
+	const uint64 Bit = 1ull << (UnitIndex % 64);
+	if (bValue)
+		Mask[UnitIndex / 64] |= Bit;
+	else
+		Mask[UnitIndex / 64] &= ~Bit;
+}
+
+/**
+ * \brief Returns the mask of units that are, or inherit from, the given class.
+ *  Built once per class and then maintained by RegisterUnit/UnregisterUnit.
+ *  A null class matches every registered unit.
+ */
+const TArray<uint64>& FWfDispatchRecommender::GetClassMask(const UClass* UnitClass) const
+{
+	if (const TArray<uint64>* ClassMask = ClassMasks.Find(UnitClass))
+		return *ClassMask;
+
+	TArray<uint64>& NewMask = ClassMasks.Add(UnitClass);
+	NewMask.SetNumZeroed(ReadyMask.Num());
+	for (int32 UnitIndex = 0; UnitIndex < UnitClasses.Num(); ++UnitIndex)
+	{
+		if ((UnitFlags[UnitIndex] & Flag_Registered) == 0)
+			continue;
+		if (UnitClass == nullptr || (UnitClasses[UnitIndex] && UnitClasses[UnitIndex]->IsChildOf(UnitClass)))
+			NewMask[UnitIndex / 64] |= 1ull << (UnitIndex % 64);
+	}
+	return NewMask;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Dispatch [Units] [Incidents]
+ *  Registers synthetic units spread over a 20km square, marks a portion of them busy,
+ *  then times a recommendation for every concurrent incident.
+ */
+static FAutoConsoleCommand GWfBenchDispatchCommand(
+	TEXT("Wf.Bench.Dispatch"),
+	TEXT("Benchmarks the dispatch recommender. Usage: Wf.Bench.Dispatch [Units=1000] [Incidents=200]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumUnits     = Bench.GetArg(0, 1000);
+		const int32 NumIncidents = Bench.GetArg(1, 200);
+		constexpr float MapExtent = 2000000.0f;
+
+		FRandomStream& Random = Bench.Random;
+		FWfDispatchRecommender Recommender;
+
+		// Pointers are only used as keys and are never dereferenced
+		for (int32 i = 0; i < NumUnits; ++i)
+		{
+			const AWfFireApparatusBase* FakeApparatus = reinterpret_cast<const AWfFireApparatusBase*>(static_cast<UPTRINT>(i + 1) * 16);
+			const FVector Location(Random.FRandRange(0.0f, MapExtent), Random.FRandRange(0.0f, MapExtent), 0.0f);
+			const int32 UnitIndex = Recommender.RegisterUnit(FakeApparatus, AWfFireApparatusBase::StaticClass(), Location);
+			Recommender.SetUnitStaffed(UnitIndex, Random.FRand() > 0.1f);
+			Recommender.SetUnitAvailable(UnitIndex, Random.FRand() > 0.3f);
+		}
+
+		TArray<FWfUnitRequirement> Requirements;
+		FWfUnitRequirement& Engines = Requirements.AddDefaulted_GetRef();
+		Engines.UnitClass = AWfFireApparatusBase::StaticClass();
+		Engines.Quantity  = 3;
+		FWfUnitRequirement& AnyUnit = Requirements.AddDefaulted_GetRef();
+		AnyUnit.UnitClass = AWfVehicleBase::StaticClass();
+		AnyUnit.Quantity  = 2;
+
+		TArray<FVector> IncidentLocations;
+		IncidentLocations.Reserve(NumIncidents);
+		for (int32 i = 0; i < NumIncidents; ++i)
+		{
+			IncidentLocations.Emplace(Random.FRandRange(0.0f, MapExtent), Random.FRandRange(0.0f, MapExtent), 0.0f);
+		}
+
+		// Warm up the class masks and scratch buffers
+		TArray<FWfDispatchCandidate> Candidates;
+		Candidates.Reserve(16);
+		Recommender.Recommend(IncidentLocations[0], Requirements, Candidates);
+
+		int32 NumSatisfied = 0;
+		for (const FVector& IncidentLocation : IncidentLocations)
+		{
+			bool bSatisfied = false;
+			Bench.Timing.Time([&]()
+			{
+				bSatisfied = Recommender.Recommend(IncidentLocation, Requirements, Candidates);
+			});
+			if (!bSatisfied)
+				continue;
+			++NumSatisfied;
+
+			// Commit the units so later incidents see reduced availability, as a real dispatch would
+			for (const FWfDispatchCandidate& Candidate : Candidates)
+			{
+				Recommender.SetUnitAvailable(Candidate.UnitIndex, false);
+			}
+		}
+
+		UE_LOGFMT(LogDispatch, Display,
+			"Wf.Bench.Dispatch: {Units} units, {Incidents} incidents, {Satisfied} satisfied. Total {TotalMs} ms, {Timing}. {Ready} units still ready.",
+			NumUnits, NumIncidents, NumSatisfied, Bench.Timing.TotalSeconds * 1000.0,
+			Bench.Timing.ToString(), Recommender.GetNumReadyUnits());
+	}));
@@ -0,0 +1,435 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfFireGrid.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+DEFINE_LOG_CATEGORY(LogFire);
+
+
+FWfFireGridSettings::FWfFireGridSettings()
+	: SpreadRate(0.2f),
+	  RegenerationRate(0.05f),
+	  BurnRate(0.004f),
+	  DryingRate(0.02f),
+	  MoistureDamping(0.1f),
+	  WaterUsage(0.833f),
+	  WaterSoak(0.05f),
+	  ExtinguishThreshold(0.01f),
+	  MaxSubstepSeconds(0.5f),
+	  MaxSubsteps(120)
+{
+}
+
+FWfFireGrid::FWfFireGrid()
+	: NumX(0), NumY(0), Origin(FVector2D::ZeroVector), CellSize(100.0f), Stride(0),
+	  NumTilesX(0), NumTilesY(0), NumPendingTiles(0), NumBurningCells(0), TotalIntensity(0.0f)
+{
+}
+
+void FWfFireGrid::Initialize(const int32 InNumX, const int32 InNumY, const FVector2D& InOrigin, const float InCellSize,
+	const float DefaultFuel)
+{
+	Reset();
+	if (InNumX <= 0 || InNumY <= 0 || InCellSize <= 0.0f)
+		return;
+
+	NumX     = InNumX;
+	NumY     = InNumY;
+	Origin   = InOrigin;
+	CellSize = InCellSize;
+	Stride   = NumX + 2;
+
+	// The border cells are never stepped, they only have to read as cold
+	const int32 NumPaddedCells = Stride * (NumY + 2);
+	Intensity.SetNumZeroed(NumPaddedCells);
+	NextIntensity.SetNumZeroed(NumPaddedCells);
+	Fuel.Init(FMath::Clamp(DefaultFuel, 0.0f, 1.0f), NumPaddedCells);
+	Moisture.SetNumZeroed(NumPaddedCells);
+	Difficulty.SetNumZeroed(NumPaddedCells);
+	Water.SetNumZeroed(NumPaddedCells);
+
+	NumTilesX = FMath::DivideAndRoundUp(NumX, TileSize);
+	NumTilesY = FMath::DivideAndRoundUp(NumY, TileSize);
+	const int32 NumTiles = NumTilesX * NumTilesY;
+	TileBurningCells.SetNumZeroed(NumTiles);
+	TileIntensity.SetNumZeroed(NumTiles);
+	TileWasActive.SetNumZeroed(NumTiles);
+	TilePending.SetNumZeroed(NumTiles);
+	ActiveTiles.Reserve(NumTiles);
+}
+
+void FWfFireGrid::Reset()
+{
+	NumX = 0;
+	NumY = 0;
+	Stride = 0;
+	Intensity.Reset();
+	NextIntensity.Reset();
+	Fuel.Reset();
+	Moisture.Reset();
+	Difficulty.Reset();
+	Water.Reset();
+	NumTilesX = 0;
+	NumTilesY = 0;
+	TileBurningCells.Reset();
+	TileIntensity.Reset();
+	TileWasActive.Reset();
+	TilePending.Reset();
+	ActiveTiles.Reset();
+	NumPendingTiles = 0;
+	NumBurningCells = 0;
+	TotalIntensity = 0.0f;
+}
+
+int32 FWfFireGrid::GetCellAtLocation(const FVector& Location) const
+{
+	if (!IsInitialized())
+		return INDEX_NONE;
+
+	const int32 X = FMath::FloorToInt32((Location.X - Origin.X) / CellSize);
+	const int32 Y = FMath::FloorToInt32((Location.Y - Origin.Y) / CellSize);
+	if (X < 0 || Y < 0 || X >= NumX || Y >= NumY)
+		return INDEX_NONE;
+	return GetCellIndex(X, Y);
+}
+
+FVector FWfFireGrid::GetCellLocation(const int32 CellIndex) const
+{
+	const int32 X = CellIndex % Stride - 1;
+	const int32 Y = CellIndex / Stride - 1;
+	return FVector(Origin.X + (X + 0.5) * CellSize, Origin.Y + (Y + 0.5) * CellSize, 0.0);
+}
+
+void FWfFireGrid::SetCell(const int32 CellIndex, const float InFuel, const float InMoisture, const float InDifficulty)
+{
+	if (!Fuel.IsValidIndex(CellIndex))
+		return;
+
+	Fuel[CellIndex]       = FMath::Clamp(InFuel, 0.0f, 1.0f);
+	Moisture[CellIndex]   = FMath::Clamp(InMoisture, 0.0f, 1.0f);
+	Difficulty[CellIndex] = FMath::Clamp(InDifficulty, 0.0f, 1.0f);
+}
+
+void FWfFireGrid::Ignite(const int32 CellIndex, const float InIntensity, const float InDifficulty)
+{
+	if (!Fuel.IsValidIndex(CellIndex) || Fuel[CellIndex] <= 0.0f)
+		return;
+
+	Intensity[CellIndex]  = FMath::Max(Intensity[CellIndex], FMath::Clamp(InIntensity, 0.0f, 1.0f));
+	Difficulty[CellIndex] = FMath::Clamp(InDifficulty, 0.0f, 1.0f);
+	MarkTilePending(CellIndex);
+}
+
+int32 FWfFireGrid::ApplyWater(const FVector& Location, const float Radius, const float Gallons)
+{
+	if (!IsInitialized() || Gallons <= 0.0f)
+		return 0;
+
+	const int32 MinX = FMath::Max(0, FMath::FloorToInt32((Location.X - Radius - Origin.X) / CellSize));
+	const int32 MinY = FMath::Max(0, FMath::FloorToInt32((Location.Y - Radius - Origin.Y) / CellSize));
+	const int32 MaxX = FMath::Min(NumX - 1, FMath::FloorToInt32((Location.X + Radius - Origin.X) / CellSize));
+	const int32 MaxY = FMath::Min(NumY - 1, FMath::FloorToInt32((Location.Y + Radius - Origin.Y) / CellSize));
+
+	// Count first so the water is split evenly
+	const float RadiusSquared = FMath::Square(FMath::Max(Radius, CellSize * 0.5f));
+	int32 NumWetCells = 0;
+	for (int32 Y = MinY; Y <= MaxY; ++Y)
+	{
+		for (int32 X = MinX; X <= MaxX; ++X)
+		{
+			if (FVector::DistSquared2D(GetCellLocation(GetCellIndex(X, Y)), Location) <= RadiusSquared)
+				++NumWetCells;
+		}
+	}
+
+	// Too small to cover a cell center, so it all lands in the cell underneath
+	if (NumWetCells == 0)
+	{
+		const int32 CellIndex = GetCellAtLocation(Location);
+		if (CellIndex == INDEX_NONE)
+			return 0;
+		Water[CellIndex] += Gallons;
+		MarkTilePending(CellIndex);
+		return 1;
+	}
+
+	const float GallonsPerCell = Gallons / NumWetCells;
+	for (int32 Y = MinY; Y <= MaxY; ++Y)
+	{
+		for (int32 X = MinX; X <= MaxX; ++X)
+		{
+			const int32 CellIndex = GetCellIndex(X, Y);
+			if (FVector::DistSquared2D(GetCellLocation(CellIndex), Location) <= RadiusSquared)
+			{
+				Water[CellIndex] += GallonsPerCell;
+				MarkTilePending(CellIndex);
+			}
+		}
+	}
+	return NumWetCells;
+}
+
+int32 FWfFireGrid::Advance(const float DeltaSeconds)
+{
+	if (!IsInitialized() || DeltaSeconds <= 0.0f)
+		return 0;
+
+	// Past MaxSubsteps the steps get longer rather than the frame getting slower; the clamps keep it bounded
+	const float MaxStep = FMath::Max(Settings.MaxSubstepSeconds, KINDA_SMALL_NUMBER);
+	const int32 NumSteps = FMath::Clamp(FMath::CeilToInt32(DeltaSeconds / MaxStep), 1, FMath::Max(1, Settings.MaxSubsteps));
+	const float StepSeconds = DeltaSeconds / NumSteps;
+
+	for (int32 StepIndex = 0; StepIndex < NumSteps; ++StepIndex)
+	{
+		Step(StepSeconds);
+
+		// Nothing left to simulate, the remaining substeps would be no-ops
+		if (IsExtinguished())
+			return StepIndex + 1;
+	}
+	return NumSteps;
+}
+
+void FWfFireGrid::Step(const float DeltaSeconds)
+{
+	if (!IsInitialized())
+		return;
+
+	GatherActiveTiles();
+	if (ActiveTiles.Num() == 0)
+	{
+		NumBurningCells = 0;
+		TotalIntensity = 0.0f;
+		return;
+	}
+
+	// Each tile only writes its own cells, and only reads the neighbouring intensity from the previous step
+	ParallelFor(ActiveTiles.Num(), [this, DeltaSeconds](const int32 Index)
+	{
+		StepTile(ActiveTiles[Index], DeltaSeconds);
+	});
+	Swap(Intensity, NextIntensity);
+
+	NumBurningCells = 0;
+	TotalIntensity = 0.0f;
+	for (const int32 TileIndex : ActiveTiles)
+	{
+		NumBurningCells += TileBurningCells[TileIndex];
+		TotalIntensity  += TileIntensity[TileIndex];
+	}
+}
+
+float FWfFireGrid::GetMaxIntensity(const FVector& Location, const float Radius) const
+{
+	if (!IsInitialized())
+		return 0.0f;
+
+	const int32 MinX = FMath::Max(0, FMath::FloorToInt32((Location.X - Radius - Origin.X) / CellSize));
+	const int32 MinY = FMath::Max(0, FMath::FloorToInt32((Location.Y - Radius - Origin.Y) / CellSize));
+	const int32 MaxX = FMath::Min(NumX - 1, FMath::FloorToInt32((Location.X + Radius - Origin.X) / CellSize));
+	const int32 MaxY = FMath::Min(NumY - 1, FMath::FloorToInt32((Location.Y + Radius - Origin.Y) / CellSize));
+
+	float MaxIntensity = 0.0f;
+	for (int32 Y = MinY; Y <= MaxY; ++Y)
+	{
+		for (int32 X = MinX; X <= MaxX; ++X)
+		{
+			MaxIntensity = FMath::Max(MaxIntensity, Intensity[GetCellIndex(X, Y)]);
+		}
+	}
+	return MaxIntensity;
+}
+
+/**
+ * \brief Advances every cell of a tile by one step.
+ *  The inner loop walks a contiguous row with no branches, so the compiler can vectorize it.
+ */
+void FWfFireGrid::StepTile(const int32 TileIndex, const float DeltaSeconds)
+{
+	const int32 MinX = (TileIndex % NumTilesX) * TileSize;
+	const int32 MinY = (TileIndex / NumTilesX) * TileSize;
+	const int32 RowLength = FMath::Min(MinX + TileSize, NumX) - MinX;
+	const int32 MaxY = FMath::Min(MinY + TileSize, NumY);
+
+	// Heat is the sum of four neighbours, so the spread coefficient carries the average
+	const float SpreadScale    = Settings.SpreadRate * DeltaSeconds * 0.25f;
+	const float RegenScale     = Settings.RegenerationRate * DeltaSeconds;
+	const float BurnScale      = Settings.BurnRate * DeltaSeconds;
+	const float DryScale       = Settings.DryingRate * DeltaSeconds * 0.25f;
+	const float DampScale      = Settings.MoistureDamping * DeltaSeconds;
+	const float WaterUsage     = FMath::Max(Settings.WaterUsage, KINDA_SMALL_NUMBER);
+	const float WaterSoak      = Settings.WaterSoak;
+	const float Threshold      = Settings.ExtinguishThreshold;
+
+	int32 BurningCells = 0;
+	float SumIntensity = 0.0f;
+
+	for (int32 Y = MinY; Y < MaxY; ++Y)
+	{
+		const int32 RowStart = GetCellIndex(MinX, Y);
+		const float* RESTRICT Current = Intensity.GetData() + RowStart;
+		const float* RESTRICT Above   = Current - Stride;
+		const float* RESTRICT Below   = Current + Stride;
+		const float* RESTRICT CellDifficulty = Difficulty.GetData() + RowStart;
+		float* RESTRICT Next        = NextIntensity.GetData() + RowStart;
+		float* RESTRICT CellFuel    = Fuel.GetData() + RowStart;
+		float* RESTRICT CellMoist   = Moisture.GetData() + RowStart;
+		float* RESTRICT CellWater   = Water.GetData() + RowStart;
+
+		for (int32 X = 0; X < RowLength; ++X)
+		{
+			const float Self = Current[X];
+			const float Heat = Current[X - 1] + Current[X + 1] + Above[X] + Below[X];
+			const float HasFuel = CellFuel[X] > 0.0f ? 1.0f : 0.0f;
+			const float Dryness = 1.0f - CellMoist[X];
+
+			// Spread from the neighbours, regenerate towards full intensity, and lose heat to moisture
+			float Value = Self
+				+ SpreadScale * Heat * Dryness
+				+ RegenScale * CellDifficulty[X] * Self * (1.0f - Self)
+				- DampScale * CellMoist[X] * Self;
+
+			// Water knocks the flames down first, anything left over soaks into the cell
+			const float GallonsPerUnit = WaterUsage * (1.0f + CellDifficulty[X]);
+			const float KnockDown = FMath::Min(CellWater[X] / GallonsPerUnit, FMath::Max(Value, 0.0f));
+			const float Leftover = CellWater[X] - KnockDown * GallonsPerUnit;
+			Value -= KnockDown;
+			CellWater[X] = 0.0f;
+
+			Value = FMath::Clamp(Value, 0.0f, 1.0f) * HasFuel;
+			Value = Value >= Threshold ? Value : 0.0f;
+
+			CellFuel[X]  = FMath::Max(CellFuel[X] - BurnScale * Value, 0.0f);
+			CellMoist[X] = FMath::Clamp(CellMoist[X] - DryScale * Heat + Leftover * WaterSoak, 0.0f, 1.0f);
+			Next[X] = Value;
+
+			BurningCells += Value > 0.0f ? 1 : 0;
+			SumIntensity += Value;
+		}
+	}
+
+	TileBurningCells[TileIndex] = BurningCells;
+	TileIntensity[TileIndex] = SumIntensity;
+}
+
+/**
+ * \brief Builds the list of tiles to step: tiles that were ignited or watered, plus every
+ *  tile burning after the last step and its four neighbours (the stencil reaches one cell across).
+ *  Tiles dropping out have their stale copy in the back buffer cleared, so both buffers stay cold.
+ */
+void FWfFireGrid::GatherActiveTiles()
+{
+	ActiveTiles.Reset();
+	for (int32 TileY = 0; TileY < NumTilesY; ++TileY)
+	{
+		for (int32 TileX = 0; TileX < NumTilesX; ++TileX)
+		{
+			const int32 TileIndex = TileY * NumTilesX + TileX;
+			const bool bActive = TilePending[TileIndex] != 0
+				|| TileBurningCells[TileIndex] > 0
+				|| (TileX > 0 && TileBurningCells[TileIndex - 1] > 0)
+				|| (TileX < NumTilesX - 1 && TileBurningCells[TileIndex + 1] > 0)
+				|| (TileY > 0 && TileBurningCells[TileIndex - NumTilesX] > 0)
+				|| (TileY < NumTilesY - 1 && TileBurningCells[TileIndex + NumTilesX] > 0);
+
+			if (bActive)
+			{
+				ActiveTiles.Add(TileIndex);
+			}
+			else if (TileWasActive[TileIndex])
+			{
+				ZeroTile(NextIntensity, TileIndex);
+				TileIntensity[TileIndex] = 0.0f;
+			}
+			TileWasActive[TileIndex] = bActive ? 1 : 0;
+			TilePending[TileIndex] = 0;
+		}
+	}
+	NumPendingTiles = 0;
+}
+
+void FWfFireGrid::ZeroTile(TArray<float>& Buffer, const int32 TileIndex)
+{
+	const int32 MinX = (TileIndex % NumTilesX) * TileSize;
+	const int32 MinY = (TileIndex / NumTilesX) * TileSize;
+	const int32 RowLength = FMath::Min(MinX + TileSize, NumX) - MinX;
+	const int32 MaxY = FMath::Min(MinY + TileSize, NumY);
+	for (int32 Y = MinY; Y < MaxY; ++Y)
+	{
+		FMemory::Memzero(Buffer.GetData() + GetCellIndex(MinX, Y), RowLength * sizeof(float));
+	}
+}
+
+void FWfFireGrid::MarkTilePending(const int32 CellIndex)
+{
+	const int32 TileIndex = GetCellTile(CellIndex);
+	if (TilePending[TileIndex] == 0)
+	{
+		TilePending[TileIndex] = 1;
+		++NumPendingTiles;
+	}
+}
+
+int32 FWfFireGrid::GetCellTile(const int32 CellIndex) const
+{
+	const int32 X = CellIndex % Stride - 1;
+	const int32 Y = CellIndex / Stride - 1;
+	return (Y / TileSize) * NumTilesX + X / TileSize;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.FireGrid [Size] [Ticks] [SimRate] [Ignitions]
+ *  Fills a Size x Size grid with random fuel, moisture and difficulty, lights random cells,
+ *  then times fixed 10 Hz ticks. At higher sim rates each tick is split into substeps.
+ */
+static FAutoConsoleCommand GWfBenchFireGridCommand(
+	TEXT("Wf.Bench.FireGrid"),
+	TEXT("Benchmarks the fire grid. Usage: Wf.Bench.FireGrid [Size=1000] [Ticks=50] [SimRate=1] [Ignitions=5000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 Size         = Bench.GetArg(0, 1000);
+		const int32 NumTicks     = Bench.GetArg(1, 50);
+		const float SimRate      = Bench.GetFloatArg(2, 1.0f, 0.01f);
+		const int32 NumIgnitions = Bench.GetArg(3, 5000, 0);
+		constexpr float TickSeconds = 0.1f;
+
+		FRandomStream& Random = Bench.Random;
+		FWfFireGrid FireGrid;
+		FireGrid.Initialize(Size, Size, FVector2D::ZeroVector, 200.0f);
+
+		for (int32 Y = 0; Y < Size; ++Y)
+		{
+			for (int32 X = 0; X < Size; ++X)
+			{
+				FireGrid.SetCell(FireGrid.GetCellIndex(X, Y), Random.FRandRange(0.3f, 1.0f),
+					Random.FRandRange(0.0f, 0.4f), Random.FRand());
+			}
+		}
+		for (int32 i = 0; i < NumIgnitions; ++i)
+		{
+			FireGrid.Ignite(FireGrid.GetCellIndex(Random.RandHelper(Size), Random.RandHelper(Size)), 1.0f, Random.FRand());
+		}
+
+		int32 TotalSubsteps = 0;
+		Bench.Run(NumTicks, [](const int32) {}, [&FireGrid, &TotalSubsteps, SimRate](const int32)
+		{
+			TotalSubsteps += FireGrid.Advance(TickSeconds * SimRate);
+		});
+		const double AverageMs = Bench.Timing.TotalSeconds * 1000.0 / NumTicks;
+
+		UE_LOGFMT(LogFire, Display,
+			"Wf.Bench.FireGrid: {Cells} cells, {Ticks} ticks at {SimRate}x, {Substeps} substeps. Average {AvgMs} ms, Worst {WorstMs} ms per tick ({Budget}% of a 10 Hz budget). {Burning} burning cells in {Tiles} active tiles.",
+			FireGrid.GetNumCells(), NumTicks, SimRate, TotalSubsteps, AverageMs, Bench.Timing.WorstSeconds * 1000.0,
+			AverageMs / (TickSeconds * 1000.0) * 100.0, FireGrid.GetNumBurningCells(), FireGrid.GetNumActiveTiles());
+	}));
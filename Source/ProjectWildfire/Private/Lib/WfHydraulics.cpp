@@ -0,0 +1,474 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfHydraulics.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+DEFINE_LOG_CATEGORY(LogHydraulics);
+
+
+FWfHydraulicsSettings::FWfHydraulicsSettings()
+	: FlowTolerance(0.5f),
+	  MaxIterationsPerUpdate(8),
+	  PressureSweeps(4),
+	  MinLinearFlow(1.0f)
+{
+}
+
+FWfHydraulics::FWfHydraulics()
+	: NextNetwork(0)
+{
+}
+
+int32 FWfHydraulics::AddNetwork()
+{
+	const int32 NetworkId = Networks.Add(FNetwork());
+	AddNode(Networks[NetworkId], ENodeKind::Fixed, 0.0f);
+	return NetworkId;
+}
+
+void FWfHydraulics::RemoveNetwork(const int32 NetworkId)
+{
+	if (Networks.IsValidIndex(NetworkId))
+		Networks.RemoveAt(NetworkId);
+}
+
+int32 FWfHydraulics::AddJunction(const int32 NetworkId)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+	return AddNode(Networks[NetworkId], ENodeKind::Junction, 0.0f);
+}
+
+int32 FWfHydraulics::AddTank(const int32 NetworkId, const float Gallons)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+
+	FNetwork& Network = Networks[NetworkId];
+	const int32 Node = AddNode(Network, ENodeKind::Tank, 0.0f);
+	Network.TankGallons[Node] = FMath::Max(Gallons, 0.0f);
+	return Node;
+}
+
+int32 FWfHydraulics::AddHydrant(const int32 NetworkId, const float StaticPsi, const float ResidualPsi, const float ResidualGpm)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+
+	// The main is a fixed pressure source behind a line that loses (static - residual) at the residual flow
+	FNetwork& Network = Networks[NetworkId];
+	const int32 Main = AddNode(Network, ENodeKind::Fixed, StaticPsi);
+	const int32 Outlet = AddNode(Network, ENodeKind::Junction, StaticPsi);
+	const float Drop = FMath::Max(StaticPsi - ResidualPsi, 1.0f);
+	const int32 Line = AddLine(Network, Main, Outlet, Drop / FMath::Square(FMath::Max(ResidualGpm, 1.0f)), 0.0f);
+	Network.CheckValve[Line] = 1;
+	return Outlet;
+}
+
+int32 FWfHydraulics::AddPump(const int32 NetworkId, const int32 FromNode, const int32 ToNode,
+	const float ShutoffPsi, const float RatedGpm, const float RatedPsi)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+
+	// A quadratic pump curve is the same shape as a line's friction loss, just with a gain on top
+	FNetwork& Network = Networks[NetworkId];
+	const float Droop = FMath::Max(ShutoffPsi - RatedPsi, 1.0f) / FMath::Square(FMath::Max(RatedGpm, 1.0f));
+	const int32 Line = AddLine(Network, FromNode, ToNode, Droop, ShutoffPsi);
+	if (Line != INDEX_NONE)
+		Network.CheckValve[Line] = 1;
+	return Line;
+}
+
+int32 FWfHydraulics::AddHoseLine(const int32 NetworkId, const int32 FromNode, const int32 ToNode,
+	const float DiameterInches, const float LengthFeet)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+
+	// FL = C * (Q / 100)^2 * (L / 100), with C = 2 for 2.5" hose and scaling by diameter^-4.87
+	const float Coefficient = 2.0f * FMath::Pow(2.5f / FMath::Max(DiameterInches, 0.5f), 4.87f);
+	const float Resistance = Coefficient * FMath::Max(LengthFeet, 1.0f) * 1.0e-6f;
+	return AddLine(Networks[NetworkId], FromNode, ToNode, Resistance, 0.0f);
+}
+
+int32 FWfHydraulics::AddNozzle(const int32 NetworkId, const int32 Node, const float RatedGpm, const float RatedPsi)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return INDEX_NONE;
+
+	const float Resistance = FMath::Max(RatedPsi, 1.0f) / FMath::Square(FMath::Max(RatedGpm, 1.0f));
+	return AddLine(Networks[NetworkId], Node, 0, Resistance, 0.0f);
+}
+
+void FWfHydraulics::SetLineOpen(const int32 NetworkId, const int32 Line, const bool bOpen)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return;
+
+	FNetwork& Network = Networks[NetworkId];
+	if (Network.LineOpen.IsValidIndex(Line) && (Network.LineOpen[Line] != 0) != bOpen)
+	{
+		Network.LineOpen[Line] = bOpen ? 1 : 0;
+		Network.bConverged = false;
+	}
+}
+
+void FWfHydraulics::RefillTank(const int32 NetworkId, const int32 Node, const float Gallons)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return;
+
+	FNetwork& Network = Networks[NetworkId];
+	if (Network.NodeKind.IsValidIndex(Node) && Network.NodeKind[Node] == ENodeKind::Tank)
+	{
+		// A dry tank shuts its lines off, so refilling one changes the network
+		Network.bConverged &= Network.TankGallons[Node] > 0.0f;
+		Network.TankGallons[Node] += FMath::Max(Gallons, 0.0f);
+	}
+}
+
+int32 FWfHydraulics::Update(const float SimSeconds, const double BudgetSeconds)
+{
+	const double StartSeconds = FPlatformTime::Seconds();
+	const int32 MaxIndex = Networks.GetMaxIndex();
+
+	int32 NumSolved = 0;
+	for (int32 Visited = 0; Visited < MaxIndex; ++Visited)
+	{
+		const int32 NetworkId = (NextNetwork + Visited) % MaxIndex;
+		if (!Networks.IsAllocated(NetworkId))
+			continue;
+
+		FNetwork& Network = Networks[NetworkId];
+		if (Network.bConverged)
+			continue;
+
+		Network.bConverged = Solve(Network);
+		++NumSolved;
+
+		if (FPlatformTime::Seconds() - StartSeconds >= BudgetSeconds)
+		{
+			NextNetwork = (NetworkId + 1) % MaxIndex;
+			break;
+		}
+	}
+
+	// Networks the solver did not get to keep flowing at their last solution
+	for (FNetwork& Network : Networks)
+	{
+		Integrate(Network, SimSeconds);
+	}
+	return NumSolved;
+}
+
+float FWfHydraulics::GetPressure(const int32 NetworkId, const int32 Node) const
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return 0.0f;
+
+	const TArray<float>& Pressure = Networks[NetworkId].Pressure;
+	return Pressure.IsValidIndex(Node) ? Pressure[Node] : 0.0f;
+}
+
+float FWfHydraulics::GetFlow(const int32 NetworkId, const int32 Line) const
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return 0.0f;
+
+	const TArray<float>& Flow = Networks[NetworkId].Flow;
+	return Flow.IsValidIndex(Line) ? Flow[Line] : 0.0f;
+}
+
+float FWfHydraulics::GetTankGallons(const int32 NetworkId, const int32 Node) const
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return 0.0f;
+
+	const TArray<float>& TankGallons = Networks[NetworkId].TankGallons;
+	return TankGallons.IsValidIndex(Node) ? TankGallons[Node] : 0.0f;
+}
+
+float FWfHydraulics::TakeDischargedGallons(const int32 NetworkId, const int32 Line)
+{
+	if (!Networks.IsValidIndex(NetworkId))
+		return 0.0f;
+
+	TArray<float>& Discharged = Networks[NetworkId].Discharged;
+	if (!Discharged.IsValidIndex(Line))
+		return 0.0f;
+
+	const float Gallons = Discharged[Line];
+	Discharged[Line] = 0.0f;
+	return Gallons;
+}
+
+bool FWfHydraulics::IsConverged(const int32 NetworkId) const
+{
+	return Networks.IsValidIndex(NetworkId) && Networks[NetworkId].bConverged;
+}
+
+void FWfHydraulics::Reset()
+{
+	Networks.Reset();
+	NextNetwork = 0;
+}
+
+int32 FWfHydraulics::AddNode(FNetwork& Network, const ENodeKind Kind, const float Pressure)
+{
+	Network.Pressure.Add(Pressure);
+	Network.TankGallons.Add(0.0f);
+	Network.NodeKind.Add(Kind);
+	Network.bTopologyDirty = true;
+	Network.bConverged = false;
+	return Network.NodeKind.Num() - 1;
+}
+
+int32 FWfHydraulics::AddLine(FNetwork& Network, const int32 FromNode, const int32 ToNode, const float Resistance, const float Gain)
+{
+	if (!Network.NodeKind.IsValidIndex(FromNode) || !Network.NodeKind.IsValidIndex(ToNode) || FromNode == ToNode)
+		return INDEX_NONE;
+
+	Network.LineFrom.Add(FromNode);
+	Network.LineTo.Add(ToNode);
+	Network.Resistance.Add(FMath::Max(Resistance, UE_KINDA_SMALL_NUMBER));
+	Network.Gain.Add(Gain);
+	Network.Flow.Add(Settings.MinLinearFlow);
+	Network.Conductance.Add(0.0f);
+	Network.Discharged.Add(0.0f);
+	Network.LineOpen.Add(1);
+	Network.CheckValve.Add(0);
+	Network.bTopologyDirty = true;
+	Network.bConverged = false;
+	return Network.LineFrom.Num() - 1;
+}
+
+bool FWfHydraulics::IsLineFlowing(const FNetwork& Network, const int32 Line) const
+{
+	// A dry tank has nothing to give, but can still be filled
+	const int32 From = Network.LineFrom[Line];
+	return Network.LineOpen[Line] != 0
+		&& (Network.NodeKind[From] != ENodeKind::Tank || Network.TankGallons[From] > 0.0f);
+}
+
+void FWfHydraulics::BuildAdjacency(FNetwork& Network)
+{
+	const int32 NumNodes = Network.NodeKind.Num();
+	const int32 NumLines = Network.LineFrom.Num();
+
+	Network.AdjacencyStart.Reset();
+	Network.AdjacencyStart.SetNumZeroed(NumNodes + 1);
+	for (int32 Line = 0; Line < NumLines; ++Line)
+	{
+		++Network.AdjacencyStart[Network.LineFrom[Line] + 1];
+		++Network.AdjacencyStart[Network.LineTo[Line] + 1];
+	}
+	for (int32 Node = 0; Node < NumNodes; ++Node)
+	{
+		Network.AdjacencyStart[Node + 1] += Network.AdjacencyStart[Node];
+	}
+
+	TArray<int32, TInlineAllocator<64>> Cursor(Network.AdjacencyStart.GetData(), NumNodes);
+	Network.AdjacentLines.SetNumUninitialized(NumLines * 2);
+	for (int32 Line = 0; Line < NumLines; ++Line)
+	{
+		Network.AdjacentLines[Cursor[Network.LineFrom[Line]]++] = Line;
+		Network.AdjacentLines[Cursor[Network.LineTo[Line]]++] = Line;
+	}
+	Network.bTopologyDirty = false;
+}
+
+/**
+ * \brief Each iteration linearizes every line around its current flow, Q = G * (dP + Gain) + C, sweeps
+ *  the junction pressures so the linearized flows balance, then recomputes the flows from the new pressures.
+ *  The flows are what converge; the pressures only need to be good enough to move them.
+ */
+bool FWfHydraulics::Solve(FNetwork& Network)
+{
+	if (Network.bTopologyDirty)
+		BuildAdjacency(Network);
+
+	const int32 NumNodes = Network.NodeKind.Num();
+	const int32 NumLines = Network.LineFrom.Num();
+	const float MinFlow = FMath::Max(Settings.MinLinearFlow, UE_KINDA_SMALL_NUMBER);
+
+	const int32* RESTRICT From = Network.LineFrom.GetData();
+	const int32* RESTRICT To   = Network.LineTo.GetData();
+	const float* RESTRICT R    = Network.Resistance.GetData();
+	const float* RESTRICT Gain = Network.Gain.GetData();
+	float* RESTRICT Flow       = Network.Flow.GetData();
+	float* RESTRICT G          = Network.Conductance.GetData();
+	float* RESTRICT Pressure   = Network.Pressure.GetData();
+
+	// The constant term of each line's linearization
+	TArray<float, TInlineAllocator<64>> Offset;
+	Offset.SetNumUninitialized(NumLines);
+
+	for (int32 Iteration = 0; Iteration < Settings.MaxIterationsPerUpdate; ++Iteration)
+	{
+		for (int32 Line = 0; Line < NumLines; ++Line)
+		{
+			if (!IsLineFlowing(Network, Line))
+			{
+				G[Line] = 0.0f;
+				Flow[Line] = 0.0f;
+				Offset[Line] = 0.0f;
+				continue;
+			}
+			const float Q = Flow[Line];
+			G[Line] = 1.0f / (2.0f * R[Line] * FMath::Max(FMath::Abs(Q), MinFlow));
+			Offset[Line] = Q - G[Line] * R[Line] * Q * FMath::Abs(Q);
+		}
+
+		for (int32 Sweep = 0; Sweep < Settings.PressureSweeps; ++Sweep)
+		{
+			for (int32 Node = 0; Node < NumNodes; ++Node)
+			{
+				if (Network.NodeKind[Node] != ENodeKind::Junction)
+					continue;
+
+				float SumG = 0.0f;
+				float Sum = 0.0f;
+				for (int32 Adjacent = Network.AdjacencyStart[Node]; Adjacent < Network.AdjacencyStart[Node + 1]; ++Adjacent)
+				{
+					const int32 Line = Network.AdjacentLines[Adjacent];
+					if (To[Line] == Node)
+						Sum += G[Line] * (Pressure[From[Line]] + Gain[Line]) + Offset[Line];
+					else
+						Sum += G[Line] * (Pressure[To[Line]] - Gain[Line]) - Offset[Line];
+					SumG += G[Line];
+				}
+				if (SumG > 0.0f)
+					Pressure[Node] = Sum / SumG;
+			}
+		}
+
+		float MaxChange = 0.0f;
+		for (int32 Line = 0; Line < NumLines; ++Line)
+		{
+			if (G[Line] == 0.0f)
+				continue;
+
+			float NewFlow = G[Line] * (Pressure[From[Line]] + Gain[Line] - Pressure[To[Line]]) + Offset[Line];
+			if (Network.CheckValve[Line])
+				NewFlow = FMath::Max(NewFlow, 0.0f);
+			MaxChange = FMath::Max(MaxChange, FMath::Abs(NewFlow - Flow[Line]));
+			Flow[Line] = NewFlow;
+		}
+
+		if (MaxChange <= Settings.FlowTolerance)
+			return true;
+	}
+	return false;
+}
+
+void FWfHydraulics::Integrate(FNetwork& Network, const float SimSeconds)
+{
+	const float Minutes = SimSeconds / 60.0f;
+	const int32 NumLines = Network.LineFrom.Num();
+	for (int32 Line = 0; Line < NumLines; ++Line)
+	{
+		const float Flow = Network.Flow[Line];
+		if (Flow == 0.0f)
+			continue;
+
+		const float Gallons = Flow * Minutes;
+		const int32 From = Network.LineFrom[Line];
+		const int32 To = Network.LineTo[Line];
+		if (Network.NodeKind[From] == ENodeKind::Tank)
+			Network.TankGallons[From] -= Gallons;
+		if (Network.NodeKind[To] == ENodeKind::Tank)
+			Network.TankGallons[To] += Gallons;
+		if (To == 0)
+			Network.Discharged[Line] += Gallons;
+	}
+
+	for (int32 Node = 0; Node < Network.NodeKind.Num(); ++Node)
+	{
+		if (Network.NodeKind[Node] == ENodeKind::Tank && Network.TankGallons[Node] <= 0.0f && Network.TankGallons[Node] != 0.0f)
+		{
+			Network.TankGallons[Node] = 0.0f;
+			Network.bConverged = false;
+		}
+	}
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Hydraulics [Networks] [LinesPerNetwork] [Updates] [BudgetMs]
+ *  Builds one network per incident: an engine drafting from its tank or fed from a hydrant, with
+ *  attack lines off the pump. Each update opens or shuts one nozzle somewhere, and times the solve.
+ */
+static FAutoConsoleCommand GWfBenchHydraulicsCommand(
+	TEXT("Wf.Bench.Hydraulics"),
+	TEXT("Benchmarks the hydraulics solver. Usage: Wf.Bench.Hydraulics [Networks=40] [LinesPerNetwork=8] [Updates=200] [BudgetMs=2]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumNetworks = Bench.GetArg(0, 40);
+		const int32 NumLines    = Bench.GetArg(1, 8);
+		const int32 NumUpdates  = Bench.GetArg(2, 200);
+		const double BudgetMs   = Bench.GetFloatArg(3, 2.0f, 0.01f);
+
+		FRandomStream& Random = Bench.Random;
+		FWfHydraulics Hydraulics;
+		TArray<TPair<int32, int32>> Nozzles;
+		for (int32 NetworkIndex = 0; NetworkIndex < NumNetworks; ++NetworkIndex)
+		{
+			const int32 NetworkId = Hydraulics.AddNetwork();
+			const int32 Intake = NetworkIndex % 2 == 0
+				? Hydraulics.AddTank(NetworkId, 500.0f)
+				: Hydraulics.AddJunction(NetworkId);
+			if (NetworkIndex % 2 != 0)
+			{
+				const int32 Hydrant = Hydraulics.AddHydrant(NetworkId, 80.0f, 50.0f, 1000.0f);
+				Hydraulics.AddHoseLine(NetworkId, Hydrant, Intake, 5.0f, Random.FRandRange(100.0f, 800.0f));
+			}
+
+			const int32 Discharge = Hydraulics.AddJunction(NetworkId);
+			Hydraulics.AddPump(NetworkId, Intake, Discharge, 250.0f, 1500.0f, 150.0f);
+			for (int32 LineIndex = 0; LineIndex < NumLines; ++LineIndex)
+			{
+				const int32 Tip = Hydraulics.AddJunction(NetworkId);
+				Hydraulics.AddHoseLine(NetworkId, Discharge, Tip, 1.75f, Random.FRandRange(100.0f, 400.0f));
+				Nozzles.Add(TPair<int32, int32>(NetworkId, Hydraulics.AddNozzle(NetworkId, Tip, 150.0f, 100.0f)));
+			}
+		}
+
+		// Cold start, solved to convergence
+		FWfBenchTiming Cold;
+		Cold.Time([&Hydraulics]()
+		{
+			int32 ColdUpdates = 0;
+			while (Hydraulics.Update(0.0f, 1.0) > 0 && ++ColdUpdates < 1000) {}
+		});
+
+		int32 NumSolved = 0;
+		Bench.Run(NumUpdates, [&Hydraulics, &Nozzles, &Random](const int32)
+		{
+			const TPair<int32, int32>& Nozzle = Nozzles[Random.RandHelper(Nozzles.Num())];
+			Hydraulics.SetLineOpen(Nozzle.Key, Nozzle.Value, Random.FRand() < 0.7f);
+		}, [&Hydraulics, &NumSolved, BudgetMs](const int32)
+		{
+			NumSolved += Hydraulics.Update(1.0f, BudgetMs / 1000.0);
+		});
+
+		float TotalGallons = 0.0f;
+		for (const TPair<int32, int32>& Nozzle : Nozzles)
+		{
+			TotalGallons += Hydraulics.TakeDischargedGallons(Nozzle.Key, Nozzle.Value);
+		}
+
+		UE_LOGFMT(LogHydraulics, Display,
+			"Wf.Bench.Hydraulics: {Networks} networks x {Lines} lines. Cold solve {ColdMs} ms. {Updates} updates: {Timing}, {Solved} network solves. {Gallons} gallons discharged.",
+			NumNetworks, NumLines, Cold.TotalSeconds * 1000.0, NumUpdates, Bench.Timing.ToString(),
+			NumSolved, TotalGallons);
+	}));
@@ -0,0 +1,345 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfIncidentJournal.h"
+
+#include "HAL/PlatformFileManager.h"
+#include "Lib/WfIncidentLifecycle.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+DEFINE_LOG_CATEGORY(LogJournal);
+
+namespace WfJournal
+{
+	constexpr uint32 Magic = 0x314A4657;	// "WFJ1"
+	constexpr uint32 Version = 1;
+
+	enum class EChunk : uint8
+	{
+		Names = 1,		// uint32 count, then (uint32 id, FString name) each
+		Entries,		// uint32 count, then the entries as they are in memory
+		Dropped			// int32 incident number, uint32 events dropped
+	};
+
+	// How each event reads when decoded; {0} and {1} are its arguments
+	const TCHAR* const EventFormats[] =
+	{
+		TEXT("Callout rejected: {0}"),
+		TEXT("Created from '{0}' at {1}"),
+		TEXT("{0} -> {1}"),
+		TEXT("Actor {0} attached"),
+		TEXT("Actor {0} released"),
+		TEXT("{0} assigned with {1}"),
+		TEXT("Attack line {0} laid, {1} gpm"),
+		TEXT("Hydrant connected, {0} psi static, {1} psi residual"),
+		TEXT("{0} gallons applied over {1} cells"),
+		TEXT("Patient {0} treated at {1}/s"),
+		TEXT("Fire grid of {0} cells started with {1} fire spots"),
+		TEXT("Wildfire started with {0} fire spots"),
+		TEXT("Fire out")
+	};
+	static_assert(UE_ARRAY_COUNT(EventFormats) == static_cast<int32>(EWfJournalEvent::Num), "Every journal event needs a format");
+}
+
+FWfIncidentJournal& FWfIncidentJournal::Get()
+{
+	static FWfIncidentJournal Singleton;
+	return Singleton;
+}
+
+FWfIncidentJournal::FWfIncidentJournal()
+{
+}
+
+FWfIncidentJournal::~FWfIncidentJournal()
+{
+	if (IsStarted())
+		Stop();
+}
+
+/**
+ * \brief Every ring is allocated up front, so opening an incident or recording never allocates.
+ *  The file header holds what the decoder needs to turn cycle counts into times.
+ */
+bool FWfIncidentJournal::Start(const FString& Path, const int32 MaxIncidents, const int32 EntriesPerIncident)
+{
+	if (IsStarted())
+		Stop();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Path));
+	FileHandle.Reset(PlatformFile.OpenWrite(*Path));
+	if (!FileHandle.IsValid())
+	{
+		UE_LOGFMT(LogJournal, Error, "FWfIncidentJournal: Failed to open '{Path}' for writing", Path);
+		return false;
+	}
+
+	const uint32 Capacity = FMath::RoundUpToPowerOfTwo(static_cast<uint32>(FMath::Max(EntriesPerIncident, 2)));
+	Rings.SetNum(FMath::Max(MaxIncidents, 1) + 1);
+	for (FRing& Ring : Rings)
+	{
+		Ring.Entries.SetNumUninitialized(Capacity);
+		Ring.Mask = Capacity - 1;
+	}
+	Rings[ServerJournalId].State.store(FRing::Open, std::memory_order_release);
+
+	WriteBuffer.Reset();
+	FMemoryWriter Writer(WriteBuffer);
+	uint32 Magic = WfJournal::Magic;
+	uint32 Version = WfJournal::Version;
+	double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+	uint64 StartCycles = FPlatformTime::Cycles64();
+	int64 StartUtcTicks = FDateTime::UtcNow().GetTicks();
+	Writer << Magic << Version << SecondsPerCycle << StartCycles << StartUtcTicks;
+	FileHandle->Write(WriteBuffer.GetData(), WriteBuffer.Num());
+
+	UE_LOGFMT(LogJournal, Display, "FWfIncidentJournal: Journaling up to {MaxIncidents} incidents to '{Path}'", MaxIncidents, Path);
+	return true;
+}
+
+void FWfIncidentJournal::Stop()
+{
+	if (!IsStarted())
+		return;
+
+	// With the last flush done, the game thread can drain what is left itself
+	WaitForFlush();
+	for (FRing& Ring : Rings)
+	{
+		if (Ring.State.load(std::memory_order_relaxed) == FRing::Open)
+			Ring.State.store(FRing::Closing, std::memory_order_relaxed);
+	}
+	DrainRings();
+
+	FileHandle->Flush();
+	FileHandle.Reset();
+	Rings.Empty();
+	WrittenNames.Reset();
+}
+
+int32 FWfIncidentJournal::OpenIncident(const int32 IncidentNumber)
+{
+	for (int32 JournalId = ServerJournalId + 1; JournalId < Rings.Num(); ++JournalId)
+	{
+		FRing& Ring = Rings[JournalId];
+		if (Ring.State.load(std::memory_order_acquire) != FRing::Free)
+			continue;
+
+		Ring.IncidentNumber = IncidentNumber;
+		Ring.Head.store(0, std::memory_order_relaxed);
+		Ring.Tail.store(0, std::memory_order_relaxed);
+		Ring.NumDropped.store(0, std::memory_order_relaxed);
+		Ring.State.store(FRing::Open, std::memory_order_release);
+		return JournalId;
+	}
+	return INDEX_NONE;
+}
+
+void FWfIncidentJournal::CloseIncident(const int32 JournalId)
+{
+	if (JournalId > ServerJournalId && JournalId < Rings.Num())
+		Rings[JournalId].State.store(FRing::Closing, std::memory_order_release);
+}
+
+void FWfIncidentJournal::Flush()
+{
+	if (!IsStarted() || (FlushJob.IsValid() && !FlushJob.IsCompleted()))
+		return;
+
+	FlushJob = UE::Tasks::Launch(UE_SOURCE_LOCATION, [this]()
+	{
+		DrainRings();
+	});
+}
+
+void FWfIncidentJournal::WaitForFlush()
+{
+	if (FlushJob.IsValid())
+		FlushJob.Wait();
+	FlushJob = {};
+}
+
+/**
+ * \brief Copies every ring's published entries out and hands the space back to the game thread,
+ *  then writes the names those entries use that the file does not have yet, the entries, and any drops.
+ *  Closing rings are freed once drained, which is what lets OpenIncident() reuse them.
+ */
+void FWfIncidentJournal::DrainRings()
+{
+	DrainBuffer.Reset();
+	WriteBuffer.Reset();
+	FMemoryWriter Writer(WriteBuffer);
+
+	for (FRing& Ring : Rings)
+	{
+		const uint8 State = Ring.State.load(std::memory_order_acquire);
+		if (State == FRing::Free)
+			continue;
+
+		const uint32 Head = Ring.Head.load(std::memory_order_acquire);
+		for (uint32 Index = Ring.Tail.load(std::memory_order_relaxed); Index != Head; ++Index)
+		{
+			DrainBuffer.Add(Ring.Entries.GetData()[Index & Ring.Mask]);
+		}
+		Ring.Tail.store(Head, std::memory_order_release);
+
+		uint32 NumDropped = Ring.NumDropped.exchange(0, std::memory_order_relaxed);
+		if (NumDropped > 0)
+		{
+			uint8 Chunk = static_cast<uint8>(WfJournal::EChunk::Dropped);
+			int32 IncidentNumber = Ring.IncidentNumber;
+			Writer << Chunk << IncidentNumber << NumDropped;
+		}
+
+		if (State == FRing::Closing)
+			Ring.State.store(FRing::Free, std::memory_order_release);
+	}
+
+	if (!DrainBuffer.IsEmpty())
+	{
+		TArray<TPair<uint32, FString>> NewNames;
+		for (const FWfJournalEntry& Entry : DrainBuffer)
+		{
+			for (int32 ArgIndex = 0; ArgIndex < 2; ++ArgIndex)
+			{
+				if (static_cast<FWfJournalArg::EType>(Entry.ArgTypes >> (ArgIndex * 2) & 3) != FWfJournalArg::EType::Name)
+					continue;
+
+				const uint32 NameId = static_cast<uint32>(Entry.Args[ArgIndex] >> 32);
+				bool bWritten;
+				WrittenNames.Add(NameId, &bWritten);
+				if (!bWritten)
+					NewNames.Emplace(NameId, FName::CreateFromDisplayId(FNameEntryId::FromUnstableInt(NameId), NAME_NO_NUMBER_INTERNAL).ToString());
+			}
+		}
+
+		if (!NewNames.IsEmpty())
+		{
+			uint8 Chunk = static_cast<uint8>(WfJournal::EChunk::Names);
+			uint32 NumNames = NewNames.Num();
+			Writer << Chunk << NumNames;
+			for (TPair<uint32, FString>& Name : NewNames)
+			{
+				Writer << Name.Key << Name.Value;
+			}
+		}
+
+		uint8 Chunk = static_cast<uint8>(WfJournal::EChunk::Entries);
+		uint32 NumEntries = DrainBuffer.Num();
+		Writer << Chunk << NumEntries;
+		Writer.Serialize(DrainBuffer.GetData(), DrainBuffer.Num() * sizeof(FWfJournalEntry));
+	}
+
+	if (!WriteBuffer.IsEmpty())
+		FileHandle->Write(WriteBuffer.GetData(), WriteBuffer.Num());
+}
+
+bool FWfIncidentJournal::Decode(const FString& Path, FString& OutText)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Path))
+		return false;
+
+	FMemoryReader Reader(Bytes);
+	uint32 Magic = 0, Version = 0;
+	double SecondsPerCycle = 0.0;
+	uint64 StartCycles = 0;
+	int64 StartUtcTicks = 0;
+	Reader << Magic << Version << SecondsPerCycle << StartCycles << StartUtcTicks;
+	if (Reader.IsError() || Magic != WfJournal::Magic || Version > WfJournal::Version)
+		return false;
+
+	OutText = FString::Printf(TEXT("Journal started %s UTC\n"), *FDateTime(StartUtcTicks).ToString());
+
+	const UEnum* StateEnum = StaticEnum<EWfIncidentState>();
+	TMap<uint32, FString> Names;
+	TArray<FWfJournalEntry> Entries;
+
+	auto FormatArg = [&](const FWfJournalEntry& Entry, const int32 ArgIndex) -> FString
+	{
+		const uint64 Bits = Entry.Args[ArgIndex];
+		switch (static_cast<FWfJournalArg::EType>(Entry.ArgTypes >> (ArgIndex * 2) & 3))
+		{
+		case FWfJournalArg::EType::Int:
+			if (Entry.Event == static_cast<uint8>(EWfJournalEvent::StateChanged))
+				return StateEnum->GetNameStringByValue(static_cast<int64>(Bits));
+			return LexToString(static_cast<int64>(Bits));
+		case FWfJournalArg::EType::Float:
+		{
+			double Value;
+			FMemory::Memcpy(&Value, &Bits, sizeof(Value));
+			return FString::Printf(TEXT("%.2f"), Value);
+		}
+		case FWfJournalArg::EType::Name:
+		{
+			const FString* Name = Names.Find(static_cast<uint32>(Bits >> 32));
+			const int32 Number = static_cast<int32>(Bits & MAX_uint32);
+			const FString Plain = Name ? *Name : TEXT("<unknown>");
+			return Number != NAME_NO_NUMBER_INTERNAL ? FString::Printf(TEXT("%s_%d"), *Plain, NAME_INTERNAL_TO_EXTERNAL(Number)) : Plain;
+		}
+		default:
+			return FString();
+		}
+	};
+
+	while (!Reader.AtEnd() && !Reader.IsError())
+	{
+		uint8 Chunk = 0;
+		Reader << Chunk;
+		switch (static_cast<WfJournal::EChunk>(Chunk))
+		{
+		case WfJournal::EChunk::Names:
+		{
+			uint32 NumNames = 0;
+			Reader << NumNames;
+			for (uint32 i = 0; i < NumNames && !Reader.IsError(); ++i)
+			{
+				uint32 NameId = 0;
+				FString Name;
+				Reader << NameId << Name;
+				Names.Add(NameId, MoveTemp(Name));
+			}
+			break;
+		}
+
+		case WfJournal::EChunk::Entries:
+		{
+			uint32 NumEntries = 0;
+			Reader << NumEntries;
+			if (static_cast<int64>(NumEntries) * sizeof(FWfJournalEntry) > Reader.TotalSize() - Reader.Tell())
+				return false;
+
+			Entries.SetNumUninitialized(NumEntries);
+			Reader.Serialize(Entries.GetData(), NumEntries * sizeof(FWfJournalEntry));
+			for (const FWfJournalEntry& Entry : Entries)
+			{
+				const double Seconds = static_cast<double>(Entry.Cycles - StartCycles) * SecondsPerCycle;
+				const TCHAR* Format = Entry.Event < UE_ARRAY_COUNT(WfJournal::EventFormats)
+					? WfJournal::EventFormats[Entry.Event] : TEXT("Unknown event {0} {1}");
+				const FString Line = FString::Format(Format, { FormatArg(Entry, 0), FormatArg(Entry, 1) });
+				OutText += FString::Printf(TEXT("[%12.6f] #%d %s\n"), Seconds, Entry.IncidentNumber, *Line);
+			}
+			break;
+		}
+
+		case WfJournal::EChunk::Dropped:
+		{
+			int32 IncidentNumber = 0;
+			uint32 NumDropped = 0;
+			Reader << IncidentNumber << NumDropped;
+			OutText += FString::Printf(TEXT("#%d dropped %u events\n"), IncidentNumber, NumDropped);
+			break;
+		}
+
+		default:
+			return false;
+		}
+	}
+	return !Reader.IsError();
+}
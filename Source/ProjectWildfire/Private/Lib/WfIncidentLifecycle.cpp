@@ -0,0 +1,174 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfIncidentLifecycle.h"
+
+
+FWfIncidentStateMachine::FWfIncidentStateMachine()
+	: bCompiled(false)
+{
+	FMemory::Memset(NextState, static_cast<uint8>(EWfIncidentState::Num), sizeof(NextState));
+}
+
+void FWfIncidentStateMachine::AddTransition(const EWfIncidentState From, const EWfIncidentEvent Event, const EWfIncidentState To)
+{
+	check(!bCompiled);
+	NextState[static_cast<int32>(From) * NumEvents + static_cast<int32>(Event)] = static_cast<uint8>(To);
+}
+
+void FWfIncidentStateMachine::AddEnterHook(const EWfIncidentState State, FHook Hook)
+{
+	check(!bCompiled);
+	EnterHooks[static_cast<int32>(State)].Add(MoveTemp(Hook));
+}
+
+void FWfIncidentStateMachine::AddExitHook(const EWfIncidentState State, FHook Hook)
+{
+	check(!bCompiled);
+	ExitHooks[static_cast<int32>(State)].Add(MoveTemp(Hook));
+}
+
+void FWfIncidentStateMachine::AddTransitionHook(const EWfIncidentState From, const EWfIncidentState To, FHook Hook)
+{
+	check(!bCompiled);
+	EdgeHooks.Add(GetEdgeIndex(From, To), MoveTemp(Hook));
+}
+
+void FWfIncidentStateMachine::AddAnyTransitionHook(FHook Hook)
+{
+	check(!bCompiled);
+	AnyHooks.Add(MoveTemp(Hook));
+}
+
+/**
+ * \brief Copies every hook that can run for an edge into one contiguous run. Edges that no
+ *  transition uses get an empty run, so the tables only cost what the lifecycle actually has.
+ */
+void FWfIncidentStateMachine::Compile()
+{
+	bool bEdgeUsed[NumStates * NumStates] = {};
+	for (int32 From = 0; From < NumStates; ++From)
+	{
+		for (int32 Event = 0; Event < NumEvents; ++Event)
+		{
+			const uint8 To = NextState[From * NumEvents + Event];
+			if (To < NumStates)
+				bEdgeUsed[From * NumStates + To] = true;
+		}
+	}
+
+	CompiledHooks.Reset();
+	EdgeHookStart.SetNumUninitialized(NumStates * NumStates + 1);
+
+	TArray<const FHook*> EdgeList;
+	for (int32 Edge = 0; Edge < NumStates * NumStates; ++Edge)
+	{
+		EdgeHookStart[Edge] = CompiledHooks.Num();
+		if (!bEdgeUsed[Edge])
+			continue;
+
+		const int32 From = Edge / NumStates;
+		const int32 To = Edge % NumStates;
+		CompiledHooks.Append(ExitHooks[From]);
+
+		EdgeList.Reset();
+		EdgeHooks.MultiFindPointer(Edge, EdgeList, true);
+		for (const FHook* Hook : EdgeList)
+		{
+			CompiledHooks.Add(*Hook);
+		}
+
+		CompiledHooks.Append(AnyHooks);
+		CompiledHooks.Append(EnterHooks[To]);
+	}
+	EdgeHookStart[NumStates * NumStates] = CompiledHooks.Num();
+	bCompiled = true;
+}
+
+EWfIncidentState FWfIncidentStateMachine::GetNextState(const EWfIncidentState From, const EWfIncidentEvent Event) const
+{
+	if (From >= EWfIncidentState::Num || Event >= EWfIncidentEvent::Num)
+		return EWfIncidentState::Num;
+	return static_cast<EWfIncidentState>(NextState[static_cast<int32>(From) * NumEvents + static_cast<int32>(Event)]);
+}
+
+bool FWfIncidentStateMachine::Fire(const int32 Id, EWfIncidentState& State, const EWfIncidentEvent Event) const
+{
+	check(bCompiled);
+	const EWfIncidentState From = State;
+	const EWfIncidentState To = GetNextState(From, Event);
+	if (To == EWfIncidentState::Num)
+		return false;
+
+	// The state changes first, so a hook that looks the incident up sees where it is going
+	State = To;
+	const int32 Edge = GetEdgeIndex(From, To);
+	for (int32 HookIndex = EdgeHookStart[Edge]; HookIndex < EdgeHookStart[Edge + 1]; ++HookIndex)
+	{
+		CompiledHooks[HookIndex](Id, From, To);
+	}
+	return true;
+}
+
+
+FWfIncidentHandle FWfIncidentPool::Acquire()
+{
+	const int32 Index = FreeSlots.IsEmpty() ? Records.AddDefaulted() : FreeSlots.Pop(EAllowShrinking::No);
+
+	// The generation survives the reset, so handles to the slot's previous incident stay stale
+	FWfIncidentRecord& Record = Records[Index];
+	const uint32 Generation = Record.Generation;
+	Record = FWfIncidentRecord();
+	Record.Generation = Generation;
+	Record.bInUse = true;
+
+	FWfIncidentHandle Handle;
+	Handle.Index = Index;
+	Handle.Generation = Generation;
+	return Handle;
+}
+
+void FWfIncidentPool::Release(const FWfIncidentHandle Handle)
+{
+	FWfIncidentRecord* Record = Get(Handle);
+	if (Record == nullptr)
+		return;
+
+	Record->bInUse = false;
+	Record->CalloutActor.Reset();
+	Record->PropertyActor.Reset();
+	Record->CalloutActorClass = nullptr;
+	++Record->Generation;
+	FreeSlots.Add(Handle.Index);
+}
+
+FWfIncidentRecord* FWfIncidentPool::Get(const FWfIncidentHandle Handle)
+{
+	if (!Records.IsValidIndex(Handle.Index))
+		return nullptr;
+
+	FWfIncidentRecord& Record = Records[Handle.Index];
+	return Record.bInUse && Record.Generation == Handle.Generation ? &Record : nullptr;
+}
+
+const FWfIncidentRecord* FWfIncidentPool::Get(const FWfIncidentHandle Handle) const
+{
+	return const_cast<FWfIncidentPool*>(this)->Get(Handle);
+}
+
+FWfIncidentHandle FWfIncidentPool::GetHandle(const int32 Index) const
+{
+	FWfIncidentHandle Handle;
+	if (Records.IsValidIndex(Index) && Records[Index].bInUse)
+	{
+		Handle.Index = Index;
+		Handle.Generation = Records[Index].Generation;
+	}
+	return Handle;
+}
+
+void FWfIncidentPool::Reset()
+{
+	Records.Reset();
+	FreeSlots.Reset();
+}
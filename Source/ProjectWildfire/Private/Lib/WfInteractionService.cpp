@@ -0,0 +1,559 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfInteractionService.h"
+
+#include "Actors/WfActorBase.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogInteraction);
+
+FWfInteractionService::FWfInteractionService()
+	: TickSeconds(0.1f), ReserveSeconds(30.0f), CellSize(2000.0f)
+	, CurrentTick(0), NextTimerId(0), NumTimers(0), Accumulated(0.0f)
+{
+}
+
+int32 FWfInteractionService::AddProp(AWfActorBase* Prop, const int32 NumSlots)
+{
+	FProp NewProp;
+	NewProp.Actor = Prop;
+	NewProp.Class = IsValid(Prop) ? Prop->GetClass() : nullptr;
+	NewProp.Location = IsValid(Prop) ? Prop->GetActorLocation() : FVector::ZeroVector;
+	NewProp.Cell = GetCell(NewProp.Location);
+
+	const int32 SlotCount = FMath::Clamp(NumSlots, 1, 32);
+	NewProp.Slots.SetNum(SlotCount);
+	NewProp.FreeMask = SlotCount == 32 ? MAX_uint32 : (1u << SlotCount) - 1;
+
+	const int32 PropId = Props.Add(MoveTemp(NewProp));
+	Cells.FindOrAdd(Props[PropId].Cell).Add(PropId);
+	return PropId;
+}
+
+void FWfInteractionService::MoveProp(const int32 PropId, const FVector& Location)
+{
+	if (!IsValidProp(PropId))
+		return;
+
+	FProp& Prop = Props[PropId];
+	Prop.Location = Location;
+
+	const FIntPoint NewCell = GetCell(Location);
+	if (NewCell == Prop.Cell)
+		return;
+
+	if (TArray<int32>* Cell = Cells.Find(Prop.Cell))
+	{
+		Cell->RemoveSwap(PropId, EAllowShrinking::No);
+		if (Cell->IsEmpty())
+			Cells.Remove(Prop.Cell);
+	}
+	Prop.Cell = NewCell;
+	Cells.FindOrAdd(NewCell).Add(PropId);
+}
+
+void FWfInteractionService::RemoveProp(const int32 PropId)
+{
+	if (!IsValidProp(PropId))
+		return;
+
+	FProp& Prop = Props[PropId];
+	for (const FSlot& Slot : Prop.Slots)
+	{
+		if (Slot.State != EWfSlotState::Free)
+			Claims.Remove(Slot.Occupant);
+	}
+	for (const TObjectKey<AActor>& Waiting : Prop.Queue)
+		Queued.Remove(Waiting);
+
+	if (TArray<int32>* Cell = Cells.Find(Prop.Cell))
+	{
+		Cell->RemoveSwap(PropId, EAllowShrinking::No);
+		if (Cell->IsEmpty())
+			Cells.Remove(Prop.Cell);
+	}
+
+	// Timers still on the wheel no longer match any slot, and are dropped when they fall due
+	Props.RemoveAt(PropId);
+}
+
+AWfActorBase* FWfInteractionService::GetProp(const int32 PropId) const
+{
+	return IsValidProp(PropId) ? Props[PropId].Actor.Get() : nullptr;
+}
+
+int32 FWfInteractionService::Reserve(const int32 PropId, AActor* Character)
+{
+	if (!IsValidProp(PropId) || !IsValid(Character))
+		return INDEX_NONE;
+
+	const FWfInteractionSlot Claim = FindClaim(Character);
+	if (Claim.PropId == PropId)
+		return Claim.Slot;
+
+	if (Props[PropId].FreeMask == 0)
+		ReclaimAbandoned(PropId);
+	if (Props[PropId].FreeMask == 0)
+		return INDEX_NONE;
+
+	Release(Character);
+	const int32 Slot = TakeSlot(PropId, Character, EWfSlotState::Reserved);
+	Schedule(PropId, Slot, ETimerKind::Expire, ReserveSeconds);
+	return Slot;
+}
+
+bool FWfInteractionService::ReserveOrQueue(const int32 PropId, AActor* Character)
+{
+	if (Reserve(PropId, Character) != INDEX_NONE)
+		return true;
+	if (!IsValidProp(PropId) || !IsValid(Character))
+		return false;
+
+	const int32* QueuedOn = Queued.Find(Character);
+	if (QueuedOn != nullptr && *QueuedOn == PropId)
+		return false;
+
+	Release(Character);
+	Props[PropId].Queue.Add(Character);
+	Queued.Add(Character, PropId);
+	return false;
+}
+
+void FWfInteractionService::Release(AActor* Character)
+{
+	if (const FWfInteractionSlot* Claim = Claims.Find(Character))
+	{
+		const FWfInteractionSlot Held = *Claim;
+		FreeSlot(Held.PropId, Held.Slot);
+		GrantQueued(Held.PropId);
+		return;
+	}
+
+	int32 PropId = INDEX_NONE;
+	if (Queued.RemoveAndCopyValue(Character, PropId) && IsValidProp(PropId))
+		Props[PropId].Queue.Remove(Character);
+}
+
+/**
+ * \brief Only the nine cells around the location are searched, so a prop farther than one cell away
+ *  is not found even when nothing closer is free. Callers searching wider should go through the actors.
+ */
+int32 FWfInteractionService::FindNearestFree(const UClass* PropClass, const FVector& Location) const
+{
+	const FIntPoint Center = GetCell(Location);
+	int32 NearestId = INDEX_NONE;
+	double NearestDistSq = TNumericLimits<double>::Max();
+
+	for (int32 OffsetY = -1; OffsetY <= 1; ++OffsetY)
+	{
+		for (int32 OffsetX = -1; OffsetX <= 1; ++OffsetX)
+		{
+			const TArray<int32>* Cell = Cells.Find(Center + FIntPoint(OffsetX, OffsetY));
+			if (Cell == nullptr)
+				continue;
+
+			for (const int32 PropId : *Cell)
+			{
+				const FProp& Prop = Props[PropId];
+				if (Prop.FreeMask == 0 || !Prop.Actor.IsValid())
+					continue;
+				if (PropClass != nullptr && !Prop.Class->IsChildOf(PropClass))
+					continue;
+
+				const double DistSq = FVector::DistSquared(Prop.Location, Location);
+				if (DistSq < NearestDistSq)
+				{
+					NearestDistSq = DistSq;
+					NearestId = PropId;
+				}
+			}
+		}
+	}
+	return NearestId;
+}
+
+FWfInteractionSlot FWfInteractionService::ClaimNearest(AActor* Character, const UClass* PropClass, const FVector& Location)
+{
+	FWfInteractionSlot Claim;
+	const int32 PropId = FindNearestFree(PropClass, Location);
+	if (PropId == INDEX_NONE)
+		return Claim;
+
+	const int32 Slot = Reserve(PropId, Character);
+	if (Slot != INDEX_NONE)
+	{
+		Claim.PropId = PropId;
+		Claim.Slot = Slot;
+	}
+	return Claim;
+}
+
+FWfInteractionSlot FWfInteractionService::FindClaim(const AActor* Character) const
+{
+	const FWfInteractionSlot* Claim = Claims.Find(Character);
+	return Claim != nullptr ? *Claim : FWfInteractionSlot();
+}
+
+int32 FWfInteractionService::FindQueue(const AActor* Character) const
+{
+	const int32* PropId = Queued.Find(Character);
+	return PropId != nullptr ? *PropId : INDEX_NONE;
+}
+
+EWfSlotState FWfInteractionService::GetSlotState(const FWfInteractionSlot& Claim) const
+{
+	if (!IsValidProp(Claim.PropId) || !Props[Claim.PropId].Slots.IsValidIndex(Claim.Slot))
+		return EWfSlotState::Free;
+	return Props[Claim.PropId].Slots[Claim.Slot].State;
+}
+
+AActor* FWfInteractionService::GetOccupant(const FWfInteractionSlot& Claim) const
+{
+	if (GetSlotState(Claim) == EWfSlotState::Free)
+		return nullptr;
+	return Props[Claim.PropId].Slots[Claim.Slot].Occupant.ResolveObjectPtr();
+}
+
+void FWfInteractionService::GetOccupants(const int32 PropId, TArray<AActor*>& OutCharacters) const
+{
+	if (!IsValidProp(PropId))
+		return;
+
+	for (const FSlot& Slot : Props[PropId].Slots)
+	{
+		if (Slot.State == EWfSlotState::Free)
+			continue;
+		if (AActor* Occupant = Slot.Occupant.ResolveObjectPtr())
+			OutCharacters.Add(Occupant);
+	}
+}
+
+bool FWfInteractionService::StartTimer(AActor* Character, const float Seconds)
+{
+	const FWfInteractionSlot Claim = FindClaim(Character);
+	if (!Claim.IsValid())
+		return false;
+
+	Props[Claim.PropId].Slots[Claim.Slot].State = EWfSlotState::Running;
+	Schedule(Claim.PropId, Claim.Slot, ETimerKind::Complete, Seconds);
+	return true;
+}
+
+bool FWfInteractionService::Hold(AActor* Character)
+{
+	const FWfInteractionSlot Claim = FindClaim(Character);
+	if (!Claim.IsValid())
+		return false;
+
+	FSlot& Slot = Props[Claim.PropId].Slots[Claim.Slot];
+	Slot.State = EWfSlotState::Holding;
+	Slot.TimerId = 0;
+	return true;
+}
+
+/**
+ * \brief Whole ticks are taken from the accumulated time and their buckets emptied of what fell due.
+ *  A step longer than the wheel sweeps every bucket once. Due timers are collected before any fire,
+ *  so props can start, stop and reserve from their completion without disturbing the sweep.
+ */
+void FWfInteractionService::Step(const float DeltaSeconds)
+{
+	if (TickSeconds <= 0.0f)
+		return;
+
+	Accumulated += DeltaSeconds;
+	const int32 NumTicks = FMath::FloorToInt32(Accumulated / TickSeconds);
+	if (NumTicks <= 0)
+		return;
+	Accumulated -= NumTicks * TickSeconds;
+
+	if (NumTicks >= NumBuckets)
+	{
+		CurrentTick += NumTicks;
+		for (int32 BucketIndex = 0; BucketIndex < NumBuckets; ++BucketIndex)
+			CollectBucket(BucketIndex);
+	}
+	else
+	{
+		for (int32 TickIndex = 0; TickIndex < NumTicks; ++TickIndex)
+		{
+			++CurrentTick;
+			CollectBucket(static_cast<int32>(CurrentTick % NumBuckets));
+		}
+	}
+
+	TArray<FTimer> Due = MoveTemp(Fired);
+	for (const FTimer& Timer : Due)
+		Fire(Timer);
+	Due.Reset();
+	Fired = MoveTemp(Due);
+}
+
+void FWfInteractionService::Reset()
+{
+	Props.Empty();
+	Cells.Reset();
+	Claims.Reset();
+	Queued.Reset();
+	for (TArray<FTimer>& Bucket : Buckets)
+		Bucket.Reset();
+	Fired.Reset();
+	CurrentTick = 0;
+	NumTimers = 0;
+	Accumulated = 0.0f;
+}
+
+FIntPoint FWfInteractionService::GetCell(const FVector& Location) const
+{
+	const float InvCellSize = CellSize > 0.0f ? 1.0f / CellSize : 0.0f;
+	return FIntPoint(FMath::FloorToInt32(Location.X * InvCellSize), FMath::FloorToInt32(Location.Y * InvCellSize));
+}
+
+int32 FWfInteractionService::TakeSlot(const int32 PropId, AActor* Character, const EWfSlotState State)
+{
+	FProp& Prop = Props[PropId];
+	const int32 Slot = static_cast<int32>(FMath::CountTrailingZeros(Prop.FreeMask));
+	Prop.FreeMask &= ~(1u << Slot);
+	Prop.Slots[Slot].Occupant = Character;
+	Prop.Slots[Slot].State = State;
+	Prop.Slots[Slot].TimerId = 0;
+
+	FWfInteractionSlot& Claim = Claims.Add(Character);
+	Claim.PropId = PropId;
+	Claim.Slot = Slot;
+	return Slot;
+}
+
+void FWfInteractionService::FreeSlot(const int32 PropId, const int32 Slot)
+{
+	FProp& Prop = Props[PropId];
+	FSlot& Freed = Prop.Slots[Slot];
+	Claims.Remove(Freed.Occupant);
+	Freed.Occupant = TObjectKey<AActor>();
+	Freed.State = EWfSlotState::Free;
+	Freed.TimerId = 0;
+	Prop.FreeMask |= 1u << Slot;
+}
+
+// Slots held by characters that were destroyed without releasing them
+void FWfInteractionService::ReclaimAbandoned(const int32 PropId)
+{
+	FProp& Prop = Props[PropId];
+	for (int32 Slot = 0; Slot < Prop.Slots.Num(); ++Slot)
+	{
+		if (Prop.Slots[Slot].State != EWfSlotState::Free && Prop.Slots[Slot].Occupant.ResolveObjectPtr() == nullptr)
+			FreeSlot(PropId, Slot);
+	}
+}
+
+/**
+ * \brief Characters destroyed while they waited are skipped. The prop is told about each grant
+ *  only once every grant is made, as its handlers may reserve, release or start interactions.
+ */
+void FWfInteractionService::GrantQueued(const int32 PropId)
+{
+	if (!IsValidProp(PropId))
+		return;
+
+	TArray<AActor*, TInlineAllocator<4>> Granted;
+	while (Props[PropId].FreeMask != 0 && !Props[PropId].Queue.IsEmpty())
+	{
+		const TObjectKey<AActor> Waiting = Props[PropId].Queue[0];
+		Props[PropId].Queue.RemoveAt(0, 1, EAllowShrinking::No);
+		Queued.Remove(Waiting);
+
+		AActor* Character = Waiting.ResolveObjectPtr();
+		if (!IsValid(Character))
+			continue;
+
+		const int32 Slot = TakeSlot(PropId, Character, EWfSlotState::Reserved);
+		Schedule(PropId, Slot, ETimerKind::Expire, ReserveSeconds);
+		Granted.Add(Character);
+	}
+
+	if (AWfActorBase* Prop = Props[PropId].Actor.Get())
+	{
+		for (AActor* Character : Granted)
+			Prop->NotifySlotGranted(Character);
+	}
+}
+
+void FWfInteractionService::Schedule(const int32 PropId, const int32 Slot, const ETimerKind Kind, const float Seconds)
+{
+	if (++NextTimerId == 0)
+		++NextTimerId;
+
+	FTimer Timer;
+	Timer.DueTick = CurrentTick + FMath::Max(1, FMath::CeilToInt32(Seconds / TickSeconds));
+	Timer.TimerId = NextTimerId;
+	Timer.PropId = PropId;
+	Timer.Slot = Slot;
+	Timer.Kind = Kind;
+	Buckets[Timer.DueTick % NumBuckets].Add(Timer);
+	Props[PropId].Slots[Slot].TimerId = Timer.TimerId;
+	++NumTimers;
+}
+
+void FWfInteractionService::CollectBucket(const int32 BucketIndex)
+{
+	TArray<FTimer>& Bucket = Buckets[BucketIndex];
+	for (int32 Index = Bucket.Num() - 1; Index >= 0; --Index)
+	{
+		if (Bucket[Index].DueTick <= CurrentTick)
+		{
+			Fired.Add(Bucket[Index]);
+			Bucket.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+			--NumTimers;
+		}
+	}
+}
+
+/**
+ * \brief A timer only acts if its slot still carries its id; cancelled and rescheduled timers,
+ *  and those of removed props, are left on the wheel and dropped here.
+ */
+void FWfInteractionService::Fire(const FTimer& Timer)
+{
+	if (!IsValidProp(Timer.PropId) || !Props[Timer.PropId].Slots.IsValidIndex(Timer.Slot))
+		return;
+
+	FSlot& Slot = Props[Timer.PropId].Slots[Timer.Slot];
+	if (Slot.TimerId != Timer.TimerId)
+		return;
+	Slot.TimerId = 0;
+
+	AActor* Occupant = Slot.Occupant.ResolveObjectPtr();
+	if (Timer.Kind == ETimerKind::Expire)
+	{
+		if (Slot.State != EWfSlotState::Reserved)
+			return;
+		UE_LOGFMT(LogInteraction, Verbose, "Reservation of '{Character}' on '{Prop}' expired"
+			, GetNameSafe(Occupant), GetNameSafe(Props[Timer.PropId].Actor.Get()));
+		FreeSlot(Timer.PropId, Timer.Slot);
+		GrantQueued(Timer.PropId);
+		return;
+	}
+
+	if (Slot.State != EWfSlotState::Running)
+		return;
+
+	AWfActorBase* Prop = Props[Timer.PropId].Actor.Get();
+	if (Occupant == nullptr || Prop == nullptr)
+	{
+		FreeSlot(Timer.PropId, Timer.Slot);
+		GrantQueued(Timer.PropId);
+		return;
+	}
+
+	Slot.State = EWfSlotState::Holding;
+	Prop->CompleteInteraction(Occupant);
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Interactions [Props] [Characters] [Steps]
+ *  Spawns props over a 2 km square and characters among them, into a service of its own. Each step,
+ *  every idle character claims the nearest free prop and starts a short interaction on it, or queues on
+ *  a random prop if none is free nearby; characters done with a prop release it. The claims and the
+ *  wheel are timed separately. The spawned actors are destroyed afterwards.
+ */
+static FAutoConsoleCommand GWfBenchInteractionsCommand(
+	TEXT("Wf.Bench.Interactions"),
+	TEXT("Benchmarks the interaction service. Usage: Wf.Bench.Interactions [Props=2000] [Characters=500] [Steps=1000]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		if (World == nullptr)
+			return;
+
+		FWfBench Bench(Args);
+		const int32 NumProps = Bench.GetArg(0, 2000);
+		const int32 NumCharacters = Bench.GetArg(1, 500);
+		const int32 NumSteps = Bench.GetArg(2, 1000);
+
+		FRandomStream& Random = Bench.Random;
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		const auto RandomLocation = [&Random]()
+		{
+			return FVector(Random.FRandRange(0.0f, 200000.0f), Random.FRandRange(0.0f, 200000.0f), 0.0f);
+		};
+
+		FWfInteractionService Interactions;
+		TArray<int32> PropIds;
+		TArray<AActor*> Spawned;
+		for (int32 PropIndex = 0; PropIndex < NumProps; ++PropIndex)
+		{
+			AWfActorBase* Prop = World->SpawnActor<AWfActorBase>(RandomLocation(), FRotator::ZeroRotator, SpawnParams);
+			if (Prop == nullptr)
+				continue;
+			Spawned.Add(Prop);
+			PropIds.Add(Interactions.AddProp(Prop, Random.RandRange(1, 4)));
+		}
+
+		TArray<AActor*> Characters;
+		for (int32 CharacterIndex = 0; CharacterIndex < NumCharacters; ++CharacterIndex)
+		{
+			AActor* Character = World->SpawnActor<AActor>(AActor::StaticClass(), RandomLocation(), FRotator::ZeroRotator, SpawnParams);
+			if (Character == nullptr)
+				continue;
+			Spawned.Add(Character);
+			Characters.Add(Character);
+		}
+
+		// The claims are timed apart from the wheel, which is the step
+		FWfBenchTiming Claims;
+		int32 NumClaimed = 0;
+		int32 NumQueued = 0;
+		Bench.Run(PropIds.IsEmpty() ? 0 : NumSteps, [&](const int32)
+		{
+			Claims.Time([&]()
+			{
+				for (AActor* Character : Characters)
+				{
+					const EWfSlotState State = Interactions.GetSlotState(Interactions.FindClaim(Character));
+					if (State == EWfSlotState::Holding)
+					{
+						Interactions.Release(Character);
+					}
+					else if (State == EWfSlotState::Reserved)
+					{
+						Interactions.StartTimer(Character, Random.FRandRange(0.5f, 3.0f));
+					}
+					else if (State == EWfSlotState::Free)
+					{
+						if (Interactions.ClaimNearest(Character, nullptr, Character->GetActorLocation()).IsValid())
+						{
+							Interactions.StartTimer(Character, Random.FRandRange(0.5f, 3.0f));
+							++NumClaimed;
+						}
+						else if (!Interactions.ReserveOrQueue(PropIds[Random.RandHelper(PropIds.Num())], Character))
+						{
+							++NumQueued;
+						}
+					}
+				}
+			});
+		},
+		[&Interactions](const int32)
+		{
+			Interactions.Step(Interactions.TickSeconds);
+		});
+
+		UE_LOGFMT(LogInteraction, Display,
+			"Wf.Bench.Interactions: {Props} props, {Characters} characters, {Steps} steps, {Claimed} claims, {Queued} queued. Claims {ClaimTiming}, wheel {WheelTiming} per step."
+			, PropIds.Num(), Characters.Num(), NumSteps, NumClaimed, NumQueued
+			, Claims.ToString(), Bench.Timing.ToString());
+
+		Interactions.Reset();
+		for (AActor* Actor : Spawned)
+			Actor->Destroy();
+	}));
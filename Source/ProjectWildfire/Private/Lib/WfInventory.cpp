@@ -0,0 +1,493 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfInventory.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Lib/WfCalloutData.h"
+#include "Logging/StructuredLog.h"
+#include "UObject/UObjectIterator.h"
+
+DEFINE_LOG_CATEGORY(LogInventory);
+
+
+namespace WfInventory
+{
+	static const FWfEquipmentMask EmptyMask;
+
+	// Containers have no limit on an item until a capacity is set
+	constexpr float Unlimited = TNumericLimits<float>::Max();
+}
+
+
+/******************************************
+ *         MASKS & TRANSACTIONS
+ */
+
+bool FWfEquipmentMask::IsEmpty() const
+{
+	uint64 Any = 0;
+	for (int32 Word = 0; Word < NumWords; ++Word)
+	{
+		Any |= Words[Word];
+	}
+	return Any == 0;
+}
+
+bool FWfEquipmentMask::ContainsAll(const FWfEquipmentMask& Other) const
+{
+	uint64 Missing = 0;
+	for (int32 Word = 0; Word < NumWords; ++Word)
+	{
+		Missing |= Other.Words[Word] & ~Words[Word];
+	}
+	return Missing == 0;
+}
+
+FWfEquipmentMask& FWfEquipmentMask::operator|=(const FWfEquipmentMask& Other)
+{
+	for (int32 Word = 0; Word < NumWords; ++Word)
+	{
+		Words[Word] |= Other.Words[Word];
+	}
+	return *this;
+}
+
+FWfEquipmentMask FWfEquipmentMask::Without(const FWfEquipmentMask& Other) const
+{
+	FWfEquipmentMask Result;
+	for (int32 Word = 0; Word < NumWords; ++Word)
+	{
+		Result.Words[Word] = Words[Word] & ~Other.Words[Word];
+	}
+	return Result;
+}
+
+void FWfInventoryTransaction::Add(const int32 ContainerId, const int32 EquipmentId, const float Amount)
+{
+	Deltas.Add(FDelta{ContainerId, EquipmentId, Amount});
+}
+
+void FWfInventoryTransaction::Transfer(const int32 FromContainerId, const int32 ToContainerId, const int32 EquipmentId, const float Amount)
+{
+	Add(FromContainerId, EquipmentId, -Amount);
+	Add(ToContainerId, EquipmentId, Amount);
+}
+
+
+/******************************************
+ *         INVENTORY
+ */
+
+FWfInventory::FWfInventory()
+{
+}
+
+int32 FWfInventory::InternEquipment(const UClass* EquipmentClass)
+{
+	if (EquipmentClass == nullptr)
+		return INDEX_NONE;
+
+	if (const int32* ExistingId = EquipmentLookup.Find(EquipmentClass))
+		return *ExistingId;
+
+	if (EquipmentClasses.Num() >= MaxEquipmentTypes)
+	{
+		UE_LOGFMT(LogInventory, Error, "Cannot track equipment '{Equipment}', all {Max} equipment ids are in use"
+			, EquipmentClass->GetName(), MaxEquipmentTypes);
+		return INDEX_NONE;
+	}
+
+	const int32 EquipmentId = EquipmentClasses.Add(EquipmentClass);
+	EquipmentLookup.Add(EquipmentClass, EquipmentId);
+	return EquipmentId;
+}
+
+int32 FWfInventory::FindEquipment(const UClass* EquipmentClass) const
+{
+	const int32* EquipmentId = EquipmentLookup.Find(EquipmentClass);
+	return EquipmentId ? *EquipmentId : INDEX_NONE;
+}
+
+const UClass* FWfInventory::GetEquipmentClass(const int32 EquipmentId) const
+{
+	return EquipmentClasses.IsValidIndex(EquipmentId) ? EquipmentClasses[EquipmentId] : nullptr;
+}
+
+int32 FWfInventory::AddContainer(const UObject* Owner)
+{
+	if (const int32* ExistingId = ContainerLookup.Find(Owner))
+		return *ExistingId;
+
+	FContainer NewContainer;
+	NewContainer.Owner = Owner;
+	EnsureSized(NewContainer);
+	const int32 ContainerId = Containers.Add(MoveTemp(NewContainer));
+	ContainerLookup.Add(Owner, ContainerId);
+	return ContainerId;
+}
+
+void FWfInventory::RemoveContainer(const int32 ContainerId)
+{
+	if (!Containers.IsValidIndex(ContainerId))
+		return;
+
+	ContainerLookup.Remove(Containers[ContainerId].Owner);
+	Containers.RemoveAt(ContainerId);
+
+	// Requests against a removed container would otherwise land on whatever reuses its id
+	QueuedConsumption.RemoveAll([ContainerId](const FConsumption& Consumption)
+	{
+		return Consumption.ContainerId == ContainerId;
+	});
+}
+
+int32 FWfInventory::FindContainer(const UObject* Owner) const
+{
+	const int32* ContainerId = ContainerLookup.Find(Owner);
+	return ContainerId ? *ContainerId : INDEX_NONE;
+}
+
+void FWfInventory::SetCapacity(const int32 ContainerId, const int32 EquipmentId, const float Capacity)
+{
+	if (!Containers.IsValidIndex(ContainerId) || !EquipmentClasses.IsValidIndex(EquipmentId))
+		return;
+
+	FContainer& Container = Containers[ContainerId];
+	EnsureSized(Container);
+	Container.Capacities[EquipmentId] = FMath::Max(Capacity, 0.0f);
+	Container.Quantities[EquipmentId] = FMath::Min(Container.Quantities[EquipmentId], Container.Capacities[EquipmentId]);
+	UpdateStockBit(Container, EquipmentId);
+}
+
+float FWfInventory::GetQuantity(const int32 ContainerId, const int32 EquipmentId) const
+{
+	if (!Containers.IsValidIndex(ContainerId))
+		return 0.0f;
+
+	const TArray<float>& Quantities = Containers[ContainerId].Quantities;
+	return Quantities.IsValidIndex(EquipmentId) ? Quantities[EquipmentId] : 0.0f;
+}
+
+float FWfInventory::GetCapacity(const int32 ContainerId, const int32 EquipmentId) const
+{
+	if (!Containers.IsValidIndex(ContainerId))
+		return 0.0f;
+
+	const TArray<float>& Capacities = Containers[ContainerId].Capacities;
+	return Capacities.IsValidIndex(EquipmentId) ? Capacities[EquipmentId] : WfInventory::Unlimited;
+}
+
+const FWfEquipmentMask& FWfInventory::GetStockMask(const int32 ContainerId) const
+{
+	return Containers.IsValidIndex(ContainerId) ? Containers[ContainerId].StockMask : WfInventory::EmptyMask;
+}
+
+int32 FWfInventory::CompileTask(TConstArrayView<FCalloutEquipmentUse> EquipmentUsage)
+{
+	FTask NewTask;
+	for (const FCalloutEquipmentUse& Usage : EquipmentUsage)
+	{
+		const int32 EquipmentId = InternEquipment(Usage.EquipmentUsed.Get());
+		if (EquipmentId == INDEX_NONE)
+		{
+			if (Usage.EquipmentUsed.Get() == nullptr)
+				continue;
+			return INDEX_NONE;
+		}
+
+		NewTask.RequiredMask.Set(EquipmentId);
+		if (!Usage.bNoConsume && Usage.TotalUsageValue > 0.0f)
+		{
+			NewTask.ConsumableIds.Add(EquipmentId);
+			NewTask.ConsumableRates.Add(Usage.TotalUsageValue);
+		}
+		NewTask.Hash = HashCombineFast(NewTask.Hash, HashCombineFast(GetTypeHash(EquipmentId),
+			HashCombineFast(GetTypeHash(Usage.bNoConsume), GetTypeHash(Usage.TotalUsageValue))));
+	}
+
+	TArray<int32, TInlineAllocator<4>> Candidates;
+	TaskLookup.MultiFind(NewTask.Hash, Candidates);
+	for (const int32 Candidate : Candidates)
+	{
+		const FTask& Existing = Tasks[Candidate];
+		if (FMemory::Memcmp(&Existing.RequiredMask, &NewTask.RequiredMask, sizeof(FWfEquipmentMask)) == 0
+			&& Existing.ConsumableIds == NewTask.ConsumableIds && Existing.ConsumableRates == NewTask.ConsumableRates)
+		{
+			return Candidate;
+		}
+	}
+
+	const uint32 Hash = NewTask.Hash;
+	const int32 TaskId = Tasks.Add(MoveTemp(NewTask));
+	TaskLookup.Add(Hash, TaskId);
+	return TaskId;
+}
+
+const FWfEquipmentMask& FWfInventory::GetTaskMask(const int32 TaskId) const
+{
+	return Tasks.IsValidIndex(TaskId) ? Tasks[TaskId].RequiredMask : WfInventory::EmptyMask;
+}
+
+bool FWfInventory::CanPerform(const int32 ContainerId, const int32 TaskId) const
+{
+	return Containers.IsValidIndex(ContainerId) && Tasks.IsValidIndex(TaskId)
+		&& Containers[ContainerId].StockMask.ContainsAll(Tasks[TaskId].RequiredMask);
+}
+
+FWfEquipmentMask FWfInventory::GetMissingEquipment(const int32 TaskId, TConstArrayView<int32> ContainerIds) const
+{
+	if (!Tasks.IsValidIndex(TaskId))
+		return FWfEquipmentMask();
+
+	FWfEquipmentMask Pooled;
+	for (const int32 ContainerId : ContainerIds)
+	{
+		if (Containers.IsValidIndex(ContainerId))
+			Pooled |= Containers[ContainerId].StockMask;
+	}
+	return Tasks[TaskId].RequiredMask.Without(Pooled);
+}
+
+void FWfInventory::FindCapableContainers(const int32 TaskId, TConstArrayView<int32> ContainerIds, TArray<int32>& OutContainerIds) const
+{
+	if (!Tasks.IsValidIndex(TaskId))
+		return;
+
+	const FWfEquipmentMask& RequiredMask = Tasks[TaskId].RequiredMask;
+	for (const int32 ContainerId : ContainerIds)
+	{
+		if (Containers.IsValidIndex(ContainerId) && Containers[ContainerId].StockMask.ContainsAll(RequiredMask))
+			OutContainerIds.Add(ContainerId);
+	}
+}
+
+int32 FWfInventory::QueueConsumption(const int32 ContainerId, const int32 TaskId, const float Progress)
+{
+	return QueuedConsumption.Add(FConsumption{ContainerId, TaskId, FMath::Max(Progress, 0.0f)});
+}
+
+void FWfInventory::ProcessConsumption(TArray<float>* OutProgress)
+{
+	if (OutProgress)
+		OutProgress->SetNumUninitialized(QueuedConsumption.Num(), EAllowShrinking::No);
+
+	for (int32 RequestIndex = 0; RequestIndex < QueuedConsumption.Num(); ++RequestIndex)
+	{
+		const FConsumption& Request = QueuedConsumption[RequestIndex];
+		float Progress = 0.0f;
+		if (Containers.IsValidIndex(Request.ContainerId) && Tasks.IsValidIndex(Request.TaskId))
+		{
+			FContainer& Container = Containers[Request.ContainerId];
+			const FTask& Task = Tasks[Request.TaskId];
+
+			// Tools that aren't consumed still have to be on hand
+			if (Container.StockMask.ContainsAll(Task.RequiredMask))
+			{
+				Progress = Request.Progress;
+				for (int32 Index = 0; Index < Task.ConsumableIds.Num(); ++Index)
+				{
+					const float Needed = Task.ConsumableRates[Index] * Request.Progress;
+					if (Needed > 0.0f)
+						Progress = FMath::Min(Progress, Request.Progress * Container.Quantities[Task.ConsumableIds[Index]] / Needed);
+				}
+
+				for (int32 Index = 0; Index < Task.ConsumableIds.Num(); ++Index)
+				{
+					const int32 EquipmentId = Task.ConsumableIds[Index];
+					Container.Quantities[EquipmentId] = FMath::Max(0.0f, Container.Quantities[EquipmentId] - Task.ConsumableRates[Index] * Progress);
+					UpdateStockBit(Container, EquipmentId);
+				}
+			}
+		}
+
+		if (OutProgress)
+			(*OutProgress)[RequestIndex] = Progress;
+	}
+	QueuedConsumption.Reset();
+}
+
+/**
+ * \brief Validates the net change to every (container, equipment) pair first, then applies them.
+ *  A transfer between two containers is checked as a whole, so it can never half happen.
+ */
+bool FWfInventory::Commit(const FWfInventoryTransaction& Transaction)
+{
+	CommitTotals.Reset();
+	for (const FWfInventoryTransaction::FDelta& Delta : Transaction.Deltas)
+	{
+		if (!Containers.IsValidIndex(Delta.ContainerId) || !EquipmentClasses.IsValidIndex(Delta.EquipmentId))
+			return false;
+		CommitTotals.FindOrAdd(TPair<int32, int32>(Delta.ContainerId, Delta.EquipmentId)) += Delta.Amount;
+	}
+
+	for (const auto& Total : CommitTotals)
+	{
+		const float NewQuantity = GetQuantity(Total.Key.Key, Total.Key.Value) + Total.Value;
+		if (NewQuantity < -UE_KINDA_SMALL_NUMBER || NewQuantity > GetCapacity(Total.Key.Key, Total.Key.Value) + UE_KINDA_SMALL_NUMBER)
+			return false;
+	}
+
+	for (const auto& Total : CommitTotals)
+	{
+		FContainer& Container = Containers[Total.Key.Key];
+		EnsureSized(Container);
+		float& Quantity = Container.Quantities[Total.Key.Value];
+		Quantity = FMath::Clamp(Quantity + Total.Value, 0.0f, Container.Capacities[Total.Key.Value]);
+		UpdateStockBit(Container, Total.Key.Value);
+	}
+	return true;
+}
+
+bool FWfInventory::Restock(const int32 ContainerId, const int32 EquipmentId, const float Amount)
+{
+	FWfInventoryTransaction Transaction;
+	Transaction.Add(ContainerId, EquipmentId, Amount);
+	return Commit(Transaction);
+}
+
+bool FWfInventory::RestockToCapacity(const int32 ContainerId)
+{
+	if (!Containers.IsValidIndex(ContainerId))
+		return false;
+
+	FContainer& Container = Containers[ContainerId];
+	EnsureSized(Container);
+
+	FWfInventoryTransaction Transaction;
+	for (int32 EquipmentId = 0; EquipmentId < Container.Capacities.Num(); ++EquipmentId)
+	{
+		if (Container.Capacities[EquipmentId] < WfInventory::Unlimited && Container.Quantities[EquipmentId] < Container.Capacities[EquipmentId])
+			Transaction.Add(ContainerId, EquipmentId, Container.Capacities[EquipmentId] - Container.Quantities[EquipmentId]);
+	}
+	return Transaction.IsEmpty() || Commit(Transaction);
+}
+
+bool FWfInventory::Transfer(const int32 FromContainerId, const int32 ToContainerId, const int32 EquipmentId, const float Amount)
+{
+	FWfInventoryTransaction Transaction;
+	Transaction.Transfer(FromContainerId, ToContainerId, EquipmentId, Amount);
+	return Commit(Transaction);
+}
+
+void FWfInventory::Reset()
+{
+	EquipmentClasses.Reset();
+	EquipmentLookup.Reset();
+	Containers.Reset();
+	ContainerLookup.Reset();
+	Tasks.Reset();
+	TaskLookup.Reset();
+	QueuedConsumption.Reset();
+}
+
+void FWfInventory::EnsureSized(FContainer& Container) const
+{
+	const int32 NumTypes = EquipmentClasses.Num();
+	if (Container.Quantities.Num() < NumTypes)
+	{
+		Container.Quantities.SetNumZeroed(NumTypes);
+		const int32 OldCapacities = Container.Capacities.Num();
+		Container.Capacities.SetNumUninitialized(NumTypes);
+		for (int32 EquipmentId = OldCapacities; EquipmentId < NumTypes; ++EquipmentId)
+		{
+			Container.Capacities[EquipmentId] = WfInventory::Unlimited;
+		}
+	}
+}
+
+void FWfInventory::UpdateStockBit(FContainer& Container, const int32 EquipmentId) const
+{
+	if (Container.Quantities[EquipmentId] > 0.0f)
+		Container.StockMask.Set(EquipmentId);
+	else
+		Container.StockMask.Clear(EquipmentId);
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Inventory [Units] [Iterations]
+ *  Stocks synthetic apparatus from a pool of fake equipment types, then times resolving a task's
+ *  requirements across every unit on the incident, and one batch of consumption for all of them.
+ */
+static FAutoConsoleCommand GWfBenchInventoryCommand(
+	TEXT("Wf.Bench.Inventory"),
+	TEXT("Benchmarks the inventory engine. Usage: Wf.Bench.Inventory [Units=50] [Iterations=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumUnits      = Bench.GetArg(0, 50);
+		const int32 NumIterations = Bench.GetArg(1, 10000);
+		constexpr int32 NumTypes = 64;
+
+		FRandomStream& Random = Bench.Random;
+		FWfInventory Inventory;
+
+		// Any distinct class pointers will do; they are only used as keys
+		TArray<UClass*> EquipmentTypes;
+		for (TObjectIterator<UClass> It; It && EquipmentTypes.Num() < NumTypes; ++It)
+		{
+			EquipmentTypes.Add(*It);
+		}
+		for (UClass* EquipmentType : EquipmentTypes)
+		{
+			Inventory.InternEquipment(EquipmentType);
+		}
+
+		TArray<int32> ContainerIds;
+		for (int32 UnitIndex = 0; UnitIndex < NumUnits; ++UnitIndex)
+		{
+			const UObject* FakeOwner = reinterpret_cast<const UObject*>(static_cast<UPTRINT>(UnitIndex + 1) * 16);
+			const int32 ContainerId = Inventory.AddContainer(FakeOwner);
+			ContainerIds.Add(ContainerId);
+			for (int32 EquipmentId = 0; EquipmentId < Inventory.GetNumEquipmentTypes(); ++EquipmentId)
+			{
+				if (Random.FRand() < 0.8f)
+					Inventory.Restock(ContainerId, EquipmentId, Random.FRandRange(1.0f, 100.0f));
+			}
+		}
+
+		TArray<FCalloutEquipmentUse> EquipmentUsage;
+		for (int32 Index = 0; Index < 8; ++Index)
+		{
+			FCalloutEquipmentUse& Usage = EquipmentUsage.AddDefaulted_GetRef();
+			Usage.EquipmentUsed   = EquipmentTypes[Random.RandHelper(EquipmentTypes.Num())];
+			Usage.bNoConsume      = Index % 2 == 0;
+			Usage.TotalUsageValue = 5.0f;
+		}
+		const int32 TaskId = Inventory.CompileTask(EquipmentUsage);
+
+		TArray<int32> Capable;
+		Capable.Reserve(NumUnits);
+		int32 NumResolved = 0;
+		Bench.Run(NumIterations, [&Capable](const int32) { Capable.Reset(); }, [&](const int32)
+		{
+			Inventory.FindCapableContainers(TaskId, ContainerIds, Capable);
+			NumResolved += Inventory.GetMissingEquipment(TaskId, ContainerIds).IsEmpty() ? 1 : 0;
+		});
+
+		// Queueing is part of the batch, so the whole iteration is timed
+		TArray<float> Progress;
+		FWfBenchTiming Consume;
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			Consume.Time([&]()
+			{
+				for (const int32 ContainerId : ContainerIds)
+				{
+					Inventory.QueueConsumption(ContainerId, TaskId, 0.001f);
+				}
+				Inventory.ProcessConsumption(&Progress);
+			});
+		}
+
+		UE_LOGFMT(LogInventory, Display,
+			"Wf.Bench.Inventory: {Units} units, {Types} equipment types. Resolve {ResolveTiming} ({Capable} capable alone, pooled {Pooled}), consume batch {ConsumeTiming}.",
+			NumUnits, Inventory.GetNumEquipmentTypes(), Bench.Timing.ToString(), Capable.Num(),
+			NumResolved > 0 ? "satisfied" : "missing items", Consume.ToString());
+	}));
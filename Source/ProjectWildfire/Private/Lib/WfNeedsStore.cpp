@@ -0,0 +1,199 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfNeedsStore.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogNeeds);
+
+FWfNeedsStore::FWfNeedsStore()
+	: ThresholdStep(10.0f), WriteBackSeconds(5.0f), WriteBackTolerance(0.5f), SecondsSinceWriteBack(0.0f), NumWritten(0)
+{
+}
+
+int32 FWfNeedsStore::AddCharacter(UWfAttributeSet* AttributeSet)
+{
+	AttributeSets.Add(AttributeSet);
+	for (int32 NeedIndex = 0; NeedIndex < NumNeeds; ++NeedIndex)
+	{
+		const float Value = IsValid(AttributeSet)
+			? FMath::Clamp(AttributeSet->GetAttributeValue(GetAttribute(static_cast<EWfNeed>(NeedIndex))), 0.0f, 100.0f) : 0.0f;
+		Values[NeedIndex].Add(Value);
+		Written[NeedIndex].Add(Value);
+		Rates[NeedIndex].Add(0.0f);
+	}
+
+	const int32 NeedsId = Ids.Add();
+	return NeedsId;
+}
+
+void FWfNeedsStore::RemoveCharacter(const int32 NeedsId)
+{
+	if (!IsValidCharacter(NeedsId))
+		return;
+
+	const int32 Index = Ids.IndexOf(NeedsId);
+	for (int32 NeedIndex = 0; NeedIndex < NumNeeds; ++NeedIndex)
+	{
+		Values[NeedIndex].RemoveAtSwap(Index, 1, EAllowShrinking::No);
+		Rates[NeedIndex].RemoveAtSwap(Index, 1, EAllowShrinking::No);
+		Written[NeedIndex].RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	}
+	AttributeSets.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Ids.Remove(NeedsId);
+}
+
+void FWfNeedsStore::SetRate(const int32 NeedsId, const EWfNeed Need, const float PerSecond)
+{
+	if (IsValidCharacter(NeedsId) && Need < EWfNeed::Num)
+		Rates[static_cast<int32>(Need)][Ids.IndexOf(NeedsId)] = PerSecond;
+}
+
+void FWfNeedsStore::SetValue(const int32 NeedsId, const EWfNeed Need, const float Value)
+{
+	if (!IsValidCharacter(NeedsId) || Need >= EWfNeed::Num)
+		return;
+
+	const int32 Index = Ids.IndexOf(NeedsId);
+	const float Clamped = FMath::Clamp(Value, 0.0f, 100.0f);
+	Values[static_cast<int32>(Need)][Index] = Clamped;
+	Written[static_cast<int32>(Need)][Index] = Clamped;
+}
+
+float FWfNeedsStore::GetValue(const int32 NeedsId, const EWfNeed Need) const
+{
+	if (!IsValidCharacter(NeedsId) || Need >= EWfNeed::Num)
+		return 0.0f;
+	return Values[static_cast<int32>(Need)][Ids.IndexOf(NeedsId)];
+}
+
+/**
+ * \brief One pass per need over its values and rates, with no branches, then a pass that compares each
+ *  value to the one last written to decide what the attribute sets get to hear about.
+ */
+void FWfNeedsStore::Step(const float SimSeconds, const float WallSeconds)
+{
+	const int32 NumCharacters = AttributeSets.Num();
+	for (int32 NeedIndex = 0; NeedIndex < NumNeeds; ++NeedIndex)
+	{
+		float* RESTRICT Value = Values[NeedIndex].GetData();
+		const float* RESTRICT Rate = Rates[NeedIndex].GetData();
+		for (int32 Index = 0; Index < NumCharacters; ++Index)
+		{
+			Value[Index] = FMath::Clamp(Value[Index] + Rate[Index] * SimSeconds, 0.0f, 100.0f);
+		}
+	}
+
+	SecondsSinceWriteBack += WallSeconds;
+	const bool bThrottledWrite = SecondsSinceWriteBack >= WriteBackSeconds;
+	if (bThrottledWrite)
+		SecondsSinceWriteBack = 0.0f;
+
+	const float InvThresholdStep = ThresholdStep > 0.0f ? 1.0f / ThresholdStep : 0.0f;
+	NumWritten = 0;
+	for (int32 NeedIndex = 0; NeedIndex < NumNeeds; ++NeedIndex)
+	{
+		const float* Value = Values[NeedIndex].GetData();
+		const float* Last = Written[NeedIndex].GetData();
+		for (int32 Index = 0; Index < NumCharacters; ++Index)
+		{
+			const bool bCrossed = FMath::FloorToInt32(Value[Index] * InvThresholdStep) != FMath::FloorToInt32(Last[Index] * InvThresholdStep);
+			const bool bDue = bThrottledWrite && FMath::Abs(Value[Index] - Last[Index]) >= WriteBackTolerance;
+			if (bCrossed || bDue)
+				WriteBack(Index, NeedIndex);
+		}
+	}
+}
+
+void FWfNeedsStore::WriteBack(const int32 Index, const int32 NeedIndex)
+{
+	const float Value = Values[NeedIndex][Index];
+	Written[NeedIndex][Index] = Value;
+	if (UWfAttributeSet* AttributeSet = AttributeSets[Index].Get())
+	{
+		AttributeSet->SetAttributeValue(GetAttribute(static_cast<EWfNeed>(NeedIndex)), Value);
+		++NumWritten;
+	}
+}
+
+void FWfNeedsStore::Reset()
+{
+	for (int32 NeedIndex = 0; NeedIndex < NumNeeds; ++NeedIndex)
+	{
+		Values[NeedIndex].Reset();
+		Rates[NeedIndex].Reset();
+		Written[NeedIndex].Reset();
+	}
+	AttributeSets.Reset();
+	Ids.Reset();
+	SecondsSinceWriteBack = 0.0f;
+	NumWritten = 0;
+}
+
+EWfAttribute FWfNeedsStore::GetAttribute(const EWfNeed Need)
+{
+	switch (Need)
+	{
+	case EWfNeed::Hunger:	return EWfAttribute::Hunger;
+	case EWfNeed::Thirst:	return EWfAttribute::Thirst;
+	case EWfNeed::Fatigue:	return EWfAttribute::Fatigue;
+	case EWfNeed::Morale:	return EWfAttribute::Morale;
+	default:				return EWfAttribute::Num;
+	}
+}
+
+EWfNeed FWfNeedsStore::FindNeed(const FGameplayAttribute& GameAttribute)
+{
+	switch (UWfAttributeSet::FindAttribute(GameAttribute))
+	{
+	case EWfAttribute::Hunger:	return EWfNeed::Hunger;
+	case EWfAttribute::Thirst:	return EWfNeed::Thirst;
+	case EWfAttribute::Fatigue:	return EWfNeed::Fatigue;
+	case EWfAttribute::Morale:	return EWfNeed::Morale;
+	default:					return EWfNeed::Num;
+	}
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Needs [Characters] [Steps]
+ *  Fills the store with characters at random rates and times the batch step. No attribute sets
+ *  are attached, so this measures the simulation and the write back decisions only.
+ */
+static FAutoConsoleCommand GWfBenchNeedsCommand(
+	TEXT("Wf.Bench.Needs"),
+	TEXT("Benchmarks the needs store. Usage: Wf.Bench.Needs [Characters=1000] [Steps=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumCharacters = Bench.GetArg(0, 1000);
+		const int32 NumSteps = Bench.GetArg(1, 1000);
+
+		FRandomStream& Random = Bench.Random;
+		FWfNeedsStore NeedsStore;
+		for (int32 CharacterIndex = 0; CharacterIndex < NumCharacters; ++CharacterIndex)
+		{
+			const int32 NeedsId = NeedsStore.AddCharacter(nullptr);
+			NeedsStore.SetRate(NeedsId, EWfNeed::Hunger, Random.FRandRange(0.1f, 0.4f));
+			NeedsStore.SetRate(NeedsId, EWfNeed::Thirst, Random.FRandRange(0.2f, 0.6f));
+			NeedsStore.SetRate(NeedsId, EWfNeed::Fatigue, Random.FRandRange(0.0f, 0.2f));
+			NeedsStore.SetRate(NeedsId, EWfNeed::Morale, -Random.FRandRange(0.0f, 0.1f));
+		}
+
+		Bench.Run(NumSteps, [](const int32) {}, [&NeedsStore](const int32)
+		{
+			NeedsStore.Step(1.0f, 1.0f);
+		});
+
+		UE_LOGFMT(LogNeeds, Display,
+			"Wf.Bench.Needs: {Characters} characters, {Steps} steps. {Timing} per step.",
+			NeedsStore.GetNumCharacters(), NumSteps, Bench.Timing.ToString());
+	}));
@@ -0,0 +1,228 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfPatientStore.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Lib/WfCalloutData.h"
+#include "Logging/StructuredLog.h"
+
+
+FWfPatientStore::FWfPatientStore()
+	: DeteriorationRate(1.0f / 3600.0f), CriticalSeconds(600.0f), NumDeteriorating(0)
+{
+}
+
+int32 FWfPatientStore::AddIncident(TConstArrayView<FCalloutDataMedical> Patients)
+{
+	// New incidents always go on the end, so existing views stay valid
+	const int32 Start = Condition.Num();
+	const int32 Num = Patients.Num();
+	const int32 NewNum = Start + Num;
+
+	Condition.Reserve(NewNum);
+	Difficulty.Reserve(NewNum);
+	RefusalChance.Reserve(NewNum);
+	for (const FCalloutDataMedical& Patient : Patients)
+	{
+		Condition.Add(FMath::Clamp(Patient.TaskProgress, 0.0f, 1.0f));
+		Difficulty.Add(FMath::Clamp(Patient.Difficulty, 0.0f, 1.0f));
+		RefusalChance.Add(Patient.RefusalChance);
+	}
+	Treatment.AddZeroed(Num);
+	CriticalTime.AddZeroed(Num);
+	Alive.Reserve(NewNum);
+	Active.Reserve(NewNum);
+	for (int32 StoreIndex = Start; StoreIndex < NewNum; ++StoreIndex)
+	{
+		Alive.Add(1.0f);
+		Active.Add(Condition[StoreIndex] > 0.0f ? 1.0f : 0.0f);
+	}
+	HeartRate.AddZeroed(Num);
+	SystolicPressure.AddZeroed(Num);
+	RespiratoryRate.AddZeroed(Num);
+	OxygenSaturation.AddZeroed(Num);
+
+	// Vitals are only written by Step(); a zero length step fills them in without changing anyone's condition
+	if (Num > 0)
+		Step(0.0f);
+
+	return Incidents.Add(FIncidentRange{Start, Num});
+}
+
+void FWfPatientStore::RemoveIncident(const int32 IncidentId)
+{
+	if (!Incidents.IsValidIndex(IncidentId))
+		return;
+
+	const FIncidentRange Range = Incidents[IncidentId];
+	Incidents.RemoveAt(IncidentId);
+	if (Range.Num == 0)
+		return;
+
+	for (TArray<float>* Array : {&Condition, &Difficulty, &RefusalChance, &Treatment, &CriticalTime, &Active, &Alive,
+		&HeartRate, &SystolicPressure, &RespiratoryRate, &OxygenSaturation})
+	{
+		Array->RemoveAt(Range.Start, Range.Num, EAllowShrinking::No);
+	}
+
+	for (FIncidentRange& Incident : Incidents)
+	{
+		if (Incident.Start > Range.Start)
+			Incident.Start -= Range.Num;
+	}
+}
+
+FWfPatientView FWfPatientStore::GetIncidentView(const int32 IncidentId) const
+{
+	FWfPatientView View;
+	if (Incidents.IsValidIndex(IncidentId))
+	{
+		View.Start = Incidents[IncidentId].Start;
+		View.Num   = Incidents[IncidentId].Num;
+	}
+	return View;
+}
+
+void FWfPatientStore::SetTreatment(const int32 IncidentId, const int32 PatientIndex, const float TreatmentPerSecond)
+{
+	const FWfPatientView View = GetIncidentView(IncidentId);
+	if (View.IsValidIndex(PatientIndex))
+		Treatment[View.GetStoreIndex(PatientIndex)] = FMath::Max(TreatmentPerSecond, 0.0f);
+}
+
+/**
+ * \brief Advances every patient in one pass over the arrays.
+ *  Harder patients deteriorate faster and respond to treatment more slowly. A patient whose
+ *  condition reaches zero is stabilized; one left at critical for CriticalSeconds dies.
+ *  Stabilized and deceased patients are masked out with a multiply, so the loop has no branches.
+ */
+void FWfPatientStore::Step(const float DeltaSeconds)
+{
+	const int32 NumPatients = Condition.Num();
+	const float WorsenScale = DeteriorationRate * DeltaSeconds;
+
+	float* RESTRICT CellCondition  = Condition.GetData();
+	const float* RESTRICT CellDiff = Difficulty.GetData();
+	const float* RESTRICT CellTreat = Treatment.GetData();
+	float* RESTRICT CellCritical   = CriticalTime.GetData();
+	float* RESTRICT CellActive     = Active.GetData();
+	float* RESTRICT CellAlive      = Alive.GetData();
+	float* RESTRICT CellHeart      = HeartRate.GetData();
+	float* RESTRICT CellPressure   = SystolicPressure.GetData();
+	float* RESTRICT CellBreathing  = RespiratoryRate.GetData();
+	float* RESTRICT CellOxygen     = OxygenSaturation.GetData();
+
+	float ActiveSum = 0.0f;
+	for (int32 Index = 0; Index < NumPatients; ++Index)
+	{
+		const float IsActive = CellActive[Index];
+		const float Worsen = WorsenScale * (1.0f + 4.0f * CellDiff[Index]);
+		const float Heal = CellTreat[Index] * DeltaSeconds / (1.0f + 2.0f * CellDiff[Index]);
+		const float Value = FMath::Clamp(CellCondition[Index] + IsActive * (Worsen - Heal), 0.0f, 1.0f);
+
+		// Time spent critical resets as soon as the patient improves
+		const float Critical = (CellCritical[Index] + DeltaSeconds * IsActive) * (Value >= 1.0f ? 1.0f : 0.0f);
+		const float StillAlive = CellAlive[Index] * (Critical < CriticalSeconds ? 1.0f : 0.0f);
+		const float StillActive = IsActive * StillAlive * (Value > 0.0f ? 1.0f : 0.0f);
+
+		CellCondition[Index] = Value;
+		CellCritical[Index]  = Critical;
+		CellAlive[Index]     = StillAlive;
+		CellActive[Index]    = StillActive;
+
+		CellHeart[Index]     = StillAlive * (72.0f + 68.0f * Value);
+		CellPressure[Index]  = StillAlive * (122.0f - 52.0f * Value);
+		CellBreathing[Index] = StillAlive * (14.0f + 20.0f * Value);
+		CellOxygen[Index]    = StillAlive * (98.0f - 22.0f * Value * Value);
+
+		ActiveSum += StillActive;
+	}
+	NumDeteriorating = FMath::RoundToInt32(ActiveSum);
+}
+
+void FWfPatientStore::CopyToCallout(const int32 IncidentId, TArrayView<FCalloutDataMedical> OutPatients) const
+{
+	const FWfPatientView View = GetIncidentView(IncidentId);
+	const int32 NumToCopy = FMath::Min(View.Num, OutPatients.Num());
+	for (int32 PatientIndex = 0; PatientIndex < NumToCopy; ++PatientIndex)
+	{
+		OutPatients[PatientIndex].TaskProgress = Condition[View.GetStoreIndex(PatientIndex)];
+	}
+}
+
+EWfPatientState FWfPatientStore::GetState(const int32 StoreIndex) const
+{
+	if (Alive[StoreIndex] == 0.0f)
+		return EWfPatientState::Deceased;
+	return Active[StoreIndex] == 0.0f ? EWfPatientState::Stabilized : EWfPatientState::Deteriorating;
+}
+
+FWfPatientVitals FWfPatientStore::GetVitals(const int32 StoreIndex) const
+{
+	FWfPatientVitals Vitals;
+	Vitals.HeartRate        = HeartRate[StoreIndex];
+	Vitals.SystolicPressure = SystolicPressure[StoreIndex];
+	Vitals.RespiratoryRate  = RespiratoryRate[StoreIndex];
+	Vitals.OxygenSaturation = OxygenSaturation[StoreIndex];
+	return Vitals;
+}
+
+void FWfPatientStore::Reset()
+{
+	Incidents.Reset();
+	for (TArray<float>* Array : {&Condition, &Difficulty, &RefusalChance, &Treatment, &CriticalTime, &Active, &Alive,
+		&HeartRate, &SystolicPressure, &RespiratoryRate, &OxygenSaturation})
+	{
+		Array->Reset();
+	}
+	NumDeteriorating = 0;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Patients [Incidents] [PatientsPerIncident] [Steps]
+ *  Fills the store with mass casualty incidents, treats every other patient, and times the batch step.
+ */
+static FAutoConsoleCommand GWfBenchPatientsCommand(
+	TEXT("Wf.Bench.Patients"),
+	TEXT("Benchmarks the patient store. Usage: Wf.Bench.Patients [Incidents=20] [PatientsPerIncident=250] [Steps=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumIncidents = Bench.GetArg(0, 20);
+		const int32 NumPerIncident = Bench.GetArg(1, 250);
+		const int32 NumSteps = Bench.GetArg(2, 1000);
+
+		FRandomStream& Random = Bench.Random;
+		FWfPatientStore PatientStore;
+		TArray<FCalloutDataMedical> Patients;
+		Patients.SetNum(NumPerIncident);
+		for (int32 IncidentIndex = 0; IncidentIndex < NumIncidents; ++IncidentIndex)
+		{
+			for (FCalloutDataMedical& Patient : Patients)
+			{
+				Patient.Difficulty   = Random.FRand();
+				Patient.TaskProgress = Random.FRandRange(0.2f, 0.9f);
+			}
+			const int32 IncidentId = PatientStore.AddIncident(Patients);
+			for (int32 PatientIndex = 0; PatientIndex < NumPerIncident; PatientIndex += 2)
+			{
+				PatientStore.SetTreatment(IncidentId, PatientIndex, 0.002f);
+			}
+		}
+
+		Bench.Run(NumSteps, [](const int32) {}, [&PatientStore](const int32)
+		{
+			PatientStore.Step(1.0f);
+		});
+
+		UE_LOGFMT(LogCallouts, Display,
+			"Wf.Bench.Patients: {Patients} patients in {Incidents} incidents, {Steps} steps. {Timing} per step. {Deteriorating} still deteriorating.",
+			PatientStore.GetNumPatients(), NumIncidents, NumSteps, Bench.Timing.ToString(), PatientStore.GetNumDeteriorating());
+	}));
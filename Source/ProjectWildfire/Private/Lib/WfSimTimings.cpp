@@ -0,0 +1,151 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfSimTimings.h"
+
+#include "Dom/JsonObject.h"
+#include "HAL/IConsoleManager.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+
+DEFINE_LOG_CATEGORY(LogSimTimings);
+
+DEFINE_STAT(STAT_WfAssignments);
+DEFINE_STAT(STAT_WfCalloutGeneration);
+DEFINE_STAT(STAT_WfVoxResolution);
+DEFINE_STAT(STAT_WfNameGeneration);
+DEFINE_STAT(STAT_WfSaveIO);
+
+DEFINE_STAT(STAT_WfNumAssignments);
+DEFINE_STAT(STAT_WfNumCallouts);
+DEFINE_STAT(STAT_WfNumVoxPhrases);
+DEFINE_STAT(STAT_WfNumNames);
+DEFINE_STAT(STAT_WfNumSaves);
+
+UE_TRACE_CHANNEL_DEFINE(WildfireChannel);
+
+bool GWfStatsEnabled = false;
+
+static FAutoConsoleVariableRef CVarWfStatsEnabled(
+	TEXT("Wf.Stats.Enabled"),
+	GWfStatsEnabled,
+	TEXT("Accumulates simulation timings and counters for Wf.Stats.Dump and the stress harness. 0: off, 1: on")
+);
+
+FWfSimTimings& FWfSimTimings::Get()
+{
+	static FWfSimTimings Singleton;
+	return Singleton;
+}
+
+void FWfSimTimings::Add(const FName System, const double Seconds)
+{
+	check(IsInGameThread());
+	FWfSimTiming& Timing = Timings.FindOrAdd(System);
+	Timing.TotalSeconds += Seconds;
+	Timing.MaxSeconds = FMath::Max(Timing.MaxSeconds, Seconds);
+	++Timing.NumCalls;
+}
+
+void FWfSimTimings::AddCount(const FName Counter, const int64 Amount)
+{
+	check(IsInGameThread());
+	Counters.FindOrAdd(Counter) += Amount;
+}
+
+double FWfSimTimings::GetSecondsSinceReset() const
+{
+	return ResetSeconds > 0.0 ? FPlatformTime::Seconds() - ResetSeconds : 0.0;
+}
+
+void FWfSimTimings::Reset()
+{
+	Timings.Reset();
+	Counters.Reset();
+	ResetSeconds = FPlatformTime::Seconds();
+}
+
+bool FWfSimTimings::EnterCycle(const FName System)
+{
+	check(IsInGameThread());
+	const bool bOutermost = !OpenCycles.Contains(System);
+	OpenCycles.Add(System);
+	return bOutermost;
+}
+
+void FWfSimTimings::ExitCycle()
+{
+	check(IsInGameThread());
+	OpenCycles.Pop(EAllowShrinking::No);
+}
+
+void FWfSimTimings::WriteJson(FJsonObject& Root, const double WallSeconds) const
+{
+	TSharedRef<FJsonObject> Systems = MakeShared<FJsonObject>();
+	for (const TPair<FName, FWfSimTiming>& Pair : Timings)
+	{
+		const FWfSimTiming& Timing = Pair.Value;
+		TSharedRef<FJsonObject> System = MakeShared<FJsonObject>();
+		System->SetNumberField(TEXT("calls"), Timing.NumCalls);
+		System->SetNumberField(TEXT("total_ms"), Timing.TotalSeconds * 1000.0);
+		System->SetNumberField(TEXT("avg_ms"), Timing.NumCalls > 0 ? Timing.TotalSeconds * 1000.0 / Timing.NumCalls : 0.0);
+		System->SetNumberField(TEXT("max_ms"), Timing.MaxSeconds * 1000.0);
+		System->SetNumberField(TEXT("ms_per_second"), WallSeconds > 0.0 ? Timing.TotalSeconds * 1000.0 / WallSeconds : 0.0);
+		Systems->SetObjectField(Pair.Key.ToString(), System);
+	}
+	Root.SetObjectField(TEXT("systems"), Systems);
+
+	TSharedRef<FJsonObject> CounterObject = MakeShared<FJsonObject>();
+	for (const TPair<FName, int64>& Pair : Counters)
+	{
+		CounterObject->SetNumberField(Pair.Key.ToString(), Pair.Value);
+	}
+	Root.SetObjectField(TEXT("counters"), CounterObject);
+}
+
+
+/******************************************
+ *         CONSOLE
+ */
+
+/**
+ * \brief Wf.Stats.Dump [Path]
+ *  Writes every system's timing and every counter since the last reset to JSON. Defaults to Saved/Stats/Stats-<time>.json
+ */
+static FAutoConsoleCommandWithWorldAndArgs GWfStatsDumpCommand(
+	TEXT("Wf.Stats.Dump"),
+	TEXT("Writes per-system timings and counts to JSON. Needs Wf.Stats.Enabled 1. Usage: Wf.Stats.Dump [Path]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		const FWfSimTimings& SimTimings = FWfSimTimings::Get();
+		if (!FWfSimTimings::IsEnabled() && SimTimings.GetTimings().IsEmpty())
+			UE_LOGFMT(LogSimTimings, Warning, "Wf.Stats.Dump: Nothing recorded. Set Wf.Stats.Enabled 1 first");
+
+		const FString Path = Args.IsValidIndex(0) ? Args[0] : FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Stats"),
+			FString::Printf(TEXT("Stats-%s.json"), *FDateTime::UtcNow().ToString(TEXT("%Y%m%d-%H%M%S"))));
+
+		const double WallSeconds = SimTimings.GetSecondsSinceReset();
+		TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+		Root->SetStringField(TEXT("world"), IsValid(World) ? World->GetMapName() : FString());
+		Root->SetNumberField(TEXT("wall_seconds"), WallSeconds);
+		SimTimings.WriteJson(*Root, WallSeconds);
+
+		FString Json;
+		const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+		if (FJsonSerializer::Serialize(Root, Writer) && FFileHelper::SaveStringToFile(Json, *Path))
+			UE_LOGFMT(LogSimTimings, Display, "Wf.Stats.Dump: Wrote '{Path}'", Path);
+		else
+			UE_LOGFMT(LogSimTimings, Error, "Wf.Stats.Dump: Failed to write '{Path}'", Path);
+	})
+);
+
+static FAutoConsoleCommand GWfStatsResetCommand(
+	TEXT("Wf.Stats.Reset"),
+	TEXT("Clears every simulation timing and counter. Usage: Wf.Stats.Reset"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		FWfSimTimings::Get().Reset();
+	})
+);
@@ -0,0 +1,384 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfUtilityBrain.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogBrain);
+
+float FWfConsideration::Evaluate(const float Value) const
+{
+	const float X = FMath::Clamp(Value, 0.0f, 1.0f) - XShift;
+	float Y;
+	switch (Curve)
+	{
+	case EWfUtilityCurve::Power:	Y = Slope * FMath::Pow(FMath::Max(X, 0.0f), Exponent) + YShift; break;
+	case EWfUtilityCurve::Logistic:	Y = 1.0f / (1.0f + FMath::Exp(-Slope * X)) + YShift; break;
+	default:						Y = Slope * X + YShift; break;
+	}
+	return FMath::Clamp(Y, 0.0f, 1.0f);
+}
+
+void FWfConsideration::EvaluateMany(const float* Inputs, TConstArrayView<int32> Indices, float* OutFactors) const
+{
+	const int32 Num = Indices.Num();
+	switch (Curve)
+	{
+	case EWfUtilityCurve::Power:
+		for (int32 Slot = 0; Slot < Num; ++Slot)
+		{
+			const float X = FMath::Clamp(Inputs[Indices[Slot]], 0.0f, 1.0f) - XShift;
+			OutFactors[Slot] = FMath::Clamp(Slope * FMath::Pow(FMath::Max(X, 0.0f), Exponent) + YShift, 0.0f, 1.0f);
+		}
+		break;
+	case EWfUtilityCurve::Logistic:
+		for (int32 Slot = 0; Slot < Num; ++Slot)
+		{
+			const float X = FMath::Clamp(Inputs[Indices[Slot]], 0.0f, 1.0f) - XShift;
+			OutFactors[Slot] = FMath::Clamp(1.0f / (1.0f + FMath::Exp(-Slope * X)) + YShift, 0.0f, 1.0f);
+		}
+		break;
+	default:
+		for (int32 Slot = 0; Slot < Num; ++Slot)
+		{
+			const float X = FMath::Clamp(Inputs[Indices[Slot]], 0.0f, 1.0f) - XShift;
+			OutFactors[Slot] = FMath::Clamp(Slope * X + YShift, 0.0f, 1.0f);
+		}
+		break;
+	}
+}
+
+FWfUtilityBrain::FWfUtilityBrain()
+	: InputTolerance(0.05f), ReevaluateSeconds(5.0f), Momentum(0.1f), InteractingMomentum(0.4f)
+	, QueueHead(0), SweepCursor(0), SweepCarry(0.0f), NumEvaluated(0)
+{
+	Actions = MakeDefaultActions();
+}
+
+int32 FWfUtilityBrain::AddAgent(AActor* Agent)
+{
+	const int32 Index = Agents.Add(Agent);
+	for (int32 InputIndex = 0; InputIndex < NumInputs; ++InputIndex)
+		Inputs[InputIndex].Add(0.0f);
+	Decisions.Add(EWfUtilityAction::Idle);
+	bQueued.Add(false);
+
+	const int32 AgentId = Ids.Add();
+	if (Agent != nullptr)
+		ActorToId.Add(Agent, AgentId);
+
+	Enqueue(Index);
+	return AgentId;
+}
+
+void FWfUtilityBrain::RemoveAgent(const int32 AgentId)
+{
+	if (!IsValidAgent(AgentId))
+		return;
+
+	const int32 Index = Ids.IndexOf(AgentId);
+	ActorToId.Remove(Agents[Index]);
+	for (int32 InputIndex = 0; InputIndex < NumInputs; ++InputIndex)
+		Inputs[InputIndex].RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Decisions.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	bQueued.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Agents.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Ids.Remove(AgentId);
+}
+
+int32 FWfUtilityBrain::FindAgent(const AActor* Agent) const
+{
+	const int32* AgentId = ActorToId.Find(Agent);
+	return AgentId != nullptr ? *AgentId : INDEX_NONE;
+}
+
+AActor* FWfUtilityBrain::GetAgent(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) ? Agents[Ids.IndexOf(AgentId)].ResolveObjectPtr() : nullptr;
+}
+
+void FWfUtilityBrain::SetInput(const int32 AgentId, const EWfUtilityInput Input, const float Value)
+{
+	if (!IsValidAgent(AgentId) || Input >= EWfUtilityInput::Num)
+		return;
+
+	const int32 Index = Ids.IndexOf(AgentId);
+	float& Stored = Inputs[static_cast<int32>(Input)][Index];
+	const float Clamped = FMath::Clamp(Value, 0.0f, 1.0f);
+	if (FMath::Abs(Clamped - Stored) <= InputTolerance)
+		return;
+
+	Stored = Clamped;
+	Enqueue(Index);
+}
+
+float FWfUtilityBrain::GetInput(const int32 AgentId, const EWfUtilityInput Input) const
+{
+	if (!IsValidAgent(AgentId) || Input >= EWfUtilityInput::Num)
+		return 0.0f;
+	return Inputs[static_cast<int32>(Input)][Ids.IndexOf(AgentId)];
+}
+
+void FWfUtilityBrain::RequestEvaluation(const int32 AgentId)
+{
+	if (IsValidAgent(AgentId))
+		Enqueue(Ids.IndexOf(AgentId));
+}
+
+EWfUtilityAction FWfUtilityBrain::GetDecision(const int32 AgentId) const
+{
+	return IsValidAgent(AgentId) ? Decisions[Ids.IndexOf(AgentId)] : EWfUtilityAction::Idle;
+}
+
+/**
+ * \brief The sweep takes as many agents per update as it needs to visit each once per ReevaluateSeconds,
+ *  carrying the fraction over, so periodic decisions are spread across updates rather than bunched.
+ *  Ids of agents removed while queued are skipped when they come up.
+ */
+void FWfUtilityBrain::Update(const float DeltaSeconds, const double BudgetSeconds)
+{
+	Changes.Reset();
+	NumEvaluated = 0;
+
+	const int32 NumAgents = Agents.Num();
+	if (NumAgents > 0 && ReevaluateSeconds > 0.0f)
+	{
+		SweepCarry += NumAgents * DeltaSeconds / ReevaluateSeconds;
+		const int32 NumSwept = FMath::Min(FMath::FloorToInt32(SweepCarry), NumAgents);
+		SweepCarry -= NumSwept;
+		for (int32 SweepIndex = 0; SweepIndex < NumSwept; ++SweepIndex)
+		{
+			SweepCursor = SweepCursor < NumAgents - 1 ? SweepCursor + 1 : 0;
+			Enqueue(SweepCursor);
+		}
+	}
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	TArray<int32, TInlineAllocator<ChunkSize>> Chunk;
+	while (QueueHead < Queue.Num())
+	{
+		Chunk.Reset();
+		while (QueueHead < Queue.Num() && Chunk.Num() < ChunkSize)
+		{
+			const int32 AgentId = Queue[QueueHead++];
+			if (!IsValidAgent(AgentId))
+				continue;
+
+			const int32 Index = Ids.IndexOf(AgentId);
+			if (bQueued[Index])
+			{
+				bQueued[Index] = false;
+				Chunk.Add(Index);
+			}
+		}
+
+		EvaluateChunk(Chunk);
+		NumEvaluated += Chunk.Num();
+		if (FPlatformTime::Seconds() - StartSeconds >= BudgetSeconds)
+			break;
+	}
+
+	if (QueueHead >= Queue.Num())
+	{
+		Queue.Reset();
+		QueueHead = 0;
+	}
+	else if (QueueHead > Queue.Num() / 2)
+	{
+		Queue.RemoveAt(0, QueueHead, EAllowShrinking::No);
+		QueueHead = 0;
+	}
+}
+
+void FWfUtilityBrain::SetActions(TArray<FWfUtilityActionDef>&& NewActions)
+{
+	Actions = MoveTemp(NewActions);
+	for (int32 Index = 0; Index < Agents.Num(); ++Index)
+		Enqueue(Index);
+}
+
+/**
+ * \brief Needs only matter off an incident, and an incident outweighs everything else.
+ *  Training and maintenance fill a shift, and give way as fatigue builds.
+ */
+TArray<FWfUtilityActionDef> FWfUtilityBrain::MakeDefaultActions()
+{
+	const auto Consider = [](const EWfUtilityInput Input, const EWfUtilityCurve Curve,
+		const float Slope, const float XShift = 0.0f, const float YShift = 0.0f, const float Exponent = 1.0f)
+	{
+		FWfConsideration Consideration;
+		Consideration.Input = Input;
+		Consideration.Curve = Curve;
+		Consideration.Slope = Slope;
+		Consideration.Exponent = Exponent;
+		Consideration.XShift = XShift;
+		Consideration.YShift = YShift;
+		return Consideration;
+	};
+	const FWfConsideration OffIncident = Consider(EWfUtilityInput::HasIncident, EWfUtilityCurve::Linear, -1.0f, 0.0f, 1.0f);
+	const FWfConsideration Rested = Consider(EWfUtilityInput::Fatigue, EWfUtilityCurve::Linear, -1.0f, 0.0f, 1.0f);
+	const FWfConsideration OnDuty = Consider(EWfUtilityInput::OnDuty, EWfUtilityCurve::Linear, 0.8f, 0.0f, 0.2f);
+
+	TArray<FWfUtilityActionDef> Defaults;
+	Defaults.Add({ EWfUtilityAction::Idle, 0.05f, {} });
+	Defaults.Add({ EWfUtilityAction::Eat, 1.0f,
+		{ Consider(EWfUtilityInput::Hunger, EWfUtilityCurve::Logistic, 12.0f, 0.6f), OffIncident } });
+	Defaults.Add({ EWfUtilityAction::Drink, 1.0f,
+		{ Consider(EWfUtilityInput::Thirst, EWfUtilityCurve::Logistic, 12.0f, 0.55f), OffIncident } });
+	Defaults.Add({ EWfUtilityAction::Sleep, 1.0f,
+		{ Consider(EWfUtilityInput::Fatigue, EWfUtilityCurve::Power, 1.0f, 0.0f, 0.0f, 2.0f), OffIncident } });
+	Defaults.Add({ EWfUtilityAction::Train, 0.35f,
+		{ OnDuty, Consider(EWfUtilityInput::Morale, EWfUtilityCurve::Linear, 0.5f, 0.0f, 0.5f), Rested, OffIncident } });
+	Defaults.Add({ EWfUtilityAction::MaintainApparatus, 0.3f,
+		{ OnDuty, Consider(EWfUtilityInput::HasApparatus, EWfUtilityCurve::Linear, 1.0f), Rested, OffIncident } });
+	Defaults.Add({ EWfUtilityAction::Respond, 1.0f,
+		{ Consider(EWfUtilityInput::HasIncident, EWfUtilityCurve::Linear, 1.0f) } });
+	return Defaults;
+}
+
+void FWfUtilityBrain::Reset()
+{
+	for (int32 InputIndex = 0; InputIndex < NumInputs; ++InputIndex)
+		Inputs[InputIndex].Reset();
+	Decisions.Reset();
+	bQueued.Reset();
+	Agents.Reset();
+	Ids.Reset();
+	ActorToId.Reset();
+	Queue.Reset();
+	QueueHead = 0;
+	SweepCursor = 0;
+	SweepCarry = 0.0f;
+	Changes.Reset();
+	NumEvaluated = 0;
+}
+
+void FWfUtilityBrain::Enqueue(const int32 Index)
+{
+	if (bQueued[Index])
+		return;
+	bQueued[Index] = true;
+	Queue.Add(Ids.IdOf(Index));
+}
+
+/**
+ * \brief Every action is scored for the whole chunk one consideration at a time, so the curve is chosen
+ *  once per consideration rather than once per agent. The compensation factor keeps actions with many
+ *  considerations from losing out to those with few just by multiplying more fractions together.
+ *  Momentum only goes to an action that still scores above zero, so it cannot keep an agent on one that
+ *  no longer applies.
+ */
+void FWfUtilityBrain::EvaluateChunk(TConstArrayView<int32> Indices)
+{
+	const int32 Num = Indices.Num();
+	if (Num == 0)
+		return;
+
+	float Scores[ChunkSize];
+	float Factors[ChunkSize];
+	float BestScores[ChunkSize];
+	EWfUtilityAction BestActions[ChunkSize];
+	for (int32 Slot = 0; Slot < Num; ++Slot)
+	{
+		BestScores[Slot] = -1.0f;
+		BestActions[Slot] = EWfUtilityAction::Idle;
+	}
+
+	const float* Interacting = Inputs[static_cast<int32>(EWfUtilityInput::Interacting)].GetData();
+	for (const FWfUtilityActionDef& Def : Actions)
+	{
+		for (int32 Slot = 0; Slot < Num; ++Slot)
+			Scores[Slot] = Def.Weight;
+
+		const float Compensation = Def.Considerations.IsEmpty() ? 0.0f : 1.0f - 1.0f / Def.Considerations.Num();
+		for (const FWfConsideration& Consideration : Def.Considerations)
+		{
+			Consideration.EvaluateMany(Inputs[static_cast<int32>(Consideration.Input)].GetData(), Indices, Factors);
+			for (int32 Slot = 0; Slot < Num; ++Slot)
+				Scores[Slot] *= Factors[Slot] + (1.0f - Factors[Slot]) * Compensation * Factors[Slot];
+		}
+
+		for (int32 Slot = 0; Slot < Num; ++Slot)
+		{
+			const int32 Index = Indices[Slot];
+			float Score = Scores[Slot];
+			if (Decisions[Index] == Def.Action && Score > 0.0f)
+				Score += Momentum + InteractingMomentum * Interacting[Index];
+			if (Score > BestScores[Slot])
+			{
+				BestScores[Slot] = Score;
+				BestActions[Slot] = Def.Action;
+			}
+		}
+	}
+
+	for (int32 Slot = 0; Slot < Num; ++Slot)
+	{
+		const int32 Index = Indices[Slot];
+		if (Decisions[Index] != BestActions[Slot])
+		{
+			Decisions[Index] = BestActions[Slot];
+			Changes.Add({ Ids.IdOf(Index), BestActions[Slot], BestScores[Slot] });
+		}
+	}
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Brain [Agents] [Steps] [BudgetUs]
+ *  Fills the brain with agents at random inputs, then each step nudges the needs of a tenth of them
+ *  as the needs store would and runs one budgeted update. Reports the time per update, how many agents
+ *  each update got through and how many decisions changed.
+ */
+static FAutoConsoleCommand GWfBenchBrainCommand(
+	TEXT("Wf.Bench.Brain"),
+	TEXT("Benchmarks the utility brain. Usage: Wf.Bench.Brain [Agents=500] [Steps=1000] [BudgetUs=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumAgents = Bench.GetArg(0, 500);
+		const int32 NumSteps = Bench.GetArg(1, 1000);
+		const double BudgetSeconds = Bench.GetArg(2, 1000) / 1000000.0;
+
+		FRandomStream& Random = Bench.Random;
+		FWfUtilityBrain Brain;
+		TArray<int32> AgentIds;
+		for (int32 AgentIndex = 0; AgentIndex < NumAgents; ++AgentIndex)
+		{
+			const int32 AgentId = Brain.AddAgent(nullptr);
+			for (int32 InputIndex = 0; InputIndex < static_cast<int32>(EWfUtilityInput::Num); ++InputIndex)
+				Brain.SetInput(AgentId, static_cast<EWfUtilityInput>(InputIndex), Random.FRand());
+			AgentIds.Add(AgentId);
+		}
+
+		int64 TotalEvaluated = 0;
+		int64 TotalChanges = 0;
+		Bench.Run(NumSteps, [&](const int32)
+		{
+			for (int32 Nudge = 0; Nudge < NumAgents / 10; ++Nudge)
+			{
+				const int32 AgentId = AgentIds[Random.RandHelper(AgentIds.Num())];
+				const EWfUtilityInput Input = static_cast<EWfUtilityInput>(Random.RandHelper(static_cast<int32>(EWfUtilityInput::Morale) + 1));
+				Brain.SetInput(AgentId, Input, Brain.GetInput(AgentId, Input) + Random.FRandRange(-0.1f, 0.1f));
+			}
+		},
+		[&](const int32)
+		{
+			Brain.Update(0.1f, BudgetSeconds);
+			TotalEvaluated += Brain.GetNumEvaluated();
+			TotalChanges += Brain.GetChanges().Num();
+		});
+
+		UE_LOGFMT(LogBrain, Display,
+			"Wf.Bench.Brain: {Agents} agents, {Steps} steps. {Timing} per update, {Evaluated} evaluated and {Changed} changed per update, {Queued} still queued."
+			, Brain.GetNumAgents(), NumSteps, Bench.Timing.ToString()
+			, static_cast<double>(TotalEvaluated) / NumSteps, static_cast<double>(TotalChanges) / NumSteps, Brain.GetNumQueued());
+	}));
@@ -0,0 +1,515 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Lib/WfVehicleRails.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Landscapes/WfRoadGraph.h"
+#include "Lib/WfBench.h"
+#include "Logging/StructuredLog.h"
+
+
+DEFINE_LOG_CATEGORY(LogRails);
+
+FWfVehicleRails::FWfVehicleRails()
+	: WakeRadius(15000.0f), RiskRadius(5000.0f), Hysteresis(0.1f), LookAheadDistance(1500.0f), ArriveDistance(500.0f)
+	, RouteGraphVersion(0)
+{
+}
+
+int32 FWfVehicleRails::AddVehicle(AActor* Vehicle, const FVector& Location)
+{
+	Vehicles.Add(Vehicle);
+	Locations.Add(Location);
+	Yaws.Add(0.0f);
+	Modes.Add(EWfRailMode::None);
+	Trips.AddDefaulted();
+
+	const int32 VehicleId = Ids.Add();
+	return VehicleId;
+}
+
+void FWfVehicleRails::RemoveVehicle(const int32 VehicleId)
+{
+	if (!IsValidVehicle(VehicleId))
+		return;
+
+	const int32 Index = Ids.IndexOf(VehicleId);
+	ReleaseRoute(Trips[Index].RouteIndex);
+
+	Vehicles.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Locations.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Yaws.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Modes.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Trips.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+	Ids.Remove(VehicleId);
+}
+
+AActor* FWfVehicleRails::GetVehicle(const int32 VehicleId) const
+{
+	return IsValidVehicle(VehicleId) ? Vehicles[Ids.IndexOf(VehicleId)].ResolveObjectPtr() : nullptr;
+}
+
+EWfRailMode FWfVehicleRails::GetMode(const int32 VehicleId) const
+{
+	return IsValidVehicle(VehicleId) ? Modes[Ids.IndexOf(VehicleId)] : EWfRailMode::None;
+}
+
+FVector FWfVehicleRails::GetLocation(const int32 VehicleId) const
+{
+	return IsValidVehicle(VehicleId) ? Locations[Ids.IndexOf(VehicleId)] : FVector::ZeroVector;
+}
+
+float FWfVehicleRails::GetYaw(const int32 VehicleId) const
+{
+	return IsValidVehicle(VehicleId) ? Yaws[Ids.IndexOf(VehicleId)] : 0.0f;
+}
+
+FVector FWfVehicleRails::GetVelocity(const int32 VehicleId) const
+{
+	if (!IsOnRoute(VehicleId))
+		return FVector::ZeroVector;
+
+	const FTrip& Trip = Trips[Ids.IndexOf(VehicleId)];
+	FVector From, To;
+	float FromTime, ToTime;
+	GetSegment(Trip, Trip.Segment, From, To, FromTime, ToTime);
+	return ToTime > FromTime ? (To - From) / (ToTime - FromTime) : FVector::ZeroVector;
+}
+
+void FWfVehicleRails::SetLocation(const int32 VehicleId, const FVector& Location)
+{
+	if (IsValidVehicle(VehicleId))
+		Locations[Ids.IndexOf(VehicleId)] = Location;
+}
+
+/**
+ * \brief Only the road part of the trip comes from the shared route. The lead in and lead out are
+ *  straight lines driven at the off road speed, the same way AWfRoadManager estimates travel times.
+ */
+bool FWfVehicleRails::StartRoute(const int32 VehicleId, const FWfRoadGraph& Graph, const FVector& Destination, const float OffRoadSpeed)
+{
+	if (!IsValidVehicle(VehicleId) || !Graph.IsBuilt())
+		return false;
+
+	const int32 Index = Ids.IndexOf(VehicleId);
+	const int32 RouteIndex = AcquireRoute(Graph,
+		Graph.FindNearestNode(Locations[Index]), Graph.FindNearestNode(Destination));
+	if (RouteIndex == INDEX_NONE)
+		return false;
+
+	ReleaseRoute(Trips[Index].RouteIndex);
+
+	const FRoute& Route = Routes[RouteIndex];
+	const float Speed = FMath::Max(OffRoadSpeed, 1.0f);
+	FTrip& Trip = Trips[Index];
+	Trip.RouteIndex = RouteIndex;
+	Trip.Start = Locations[Index];
+	Trip.End = Destination;
+	Trip.LeadInTime = FVector::Dist(Trip.Start, Route.Points[0]) / Speed;
+	Trip.LeadOutTime = FVector::Dist(Route.Points.Last(), Trip.End) / Speed;
+	Trip.Segment = 0;
+	Trip.Time = 0.0f;
+	return true;
+}
+
+void FWfVehicleRails::StopRoute(const int32 VehicleId)
+{
+	if (!IsValidVehicle(VehicleId))
+		return;
+
+	FTrip& Trip = Trips[Ids.IndexOf(VehicleId)];
+	ReleaseRoute(Trip.RouteIndex);
+	Trip = FTrip();
+}
+
+bool FWfVehicleRails::IsOnRoute(const int32 VehicleId) const
+{
+	return IsValidVehicle(VehicleId) && Trips[Ids.IndexOf(VehicleId)].RouteIndex != INDEX_NONE;
+}
+
+/**
+ * \brief Segment S of the road runs from node S - 1 to node S; the lead in, segment 0, joins the road at node 0
+ *  and the lead out leaves it at the last node, so neither is an edge.
+ */
+bool FWfVehicleRails::GetRouteEdges(const int32 VehicleId, const FWfRoadGraph& Graph, int32& OutEdge, int32& OutNextEdge) const
+{
+	OutEdge = INDEX_NONE;
+	OutNextEdge = INDEX_NONE;
+	if (!IsOnRoute(VehicleId))
+		return false;
+
+	const FTrip& Trip = Trips[Ids.IndexOf(VehicleId)];
+	const FRoute& Route = Routes[Trip.RouteIndex];
+	if (Route.GraphVersion != Graph.GetVersion())
+		return false;
+
+	if (Trip.Segment > 0 && Trip.Segment < Route.Nodes.Num())
+		OutEdge = Graph.FindEdge(Route.Nodes[Trip.Segment - 1], Route.Nodes[Trip.Segment]);
+	if (Trip.Segment + 1 < Route.Nodes.Num())
+		OutNextEdge = Graph.FindEdge(Route.Nodes[Trip.Segment], Route.Nodes[Trip.Segment + 1]);
+	return OutEdge != INDEX_NONE || OutNextEdge != INDEX_NONE;
+}
+
+/**
+ * \brief One pass over the vehicles, each measured against the observers and the vehicles that are a risk,
+ *  which are few. A Kinematic vehicle costs one segment interpolation, plus a step to the next segment now and then.
+ *  Only vehicles simulated for their own sake are a risk: those off the rails, and those near an observer.
+ *  A vehicle woken by risk is not one itself, or two of them could keep each other simulated forever.
+ *  Vehicles that left their route go back to None, and physics, whatever they were.
+ */
+void FWfVehicleRails::Update(TConstArrayView<FVector> Observers, const float DeltaSeconds)
+{
+	Transitions.Reset();
+	Moved.Reset();
+	Steering.Reset();
+	Arrivals.Reset();
+
+	SimulatedLocations.Reset();
+	NearObserver.Init(false, Vehicles.Num());
+	for (int32 Index = 0; Index < Vehicles.Num(); ++Index)
+	{
+		// Staying simulated takes Hysteresis further than waking up
+		const float Reach = Modes[Index] == EWfRailMode::Physics ? 1.0f + Hysteresis : 1.0f;
+		for (const FVector& Observer : Observers)
+		{
+			if (FVector::DistSquared(Observer, Locations[Index]) < FMath::Square(WakeRadius * Reach))
+			{
+				NearObserver[Index] = true;
+				break;
+			}
+		}
+		if (Modes[Index] == EWfRailMode::None || (Modes[Index] == EWfRailMode::Physics && NearObserver[Index]))
+			SimulatedLocations.Add(Locations[Index]);
+	}
+
+	for (int32 Index = 0; Index < Vehicles.Num(); ++Index)
+	{
+		const EWfRailMode Mode = Modes[Index];
+		if (Trips[Index].RouteIndex == INDEX_NONE)
+		{
+			if (Mode != EWfRailMode::None)
+			{
+				Transitions.Add({ Ids.IdOf(Index), Mode, EWfRailMode::None });
+				Modes[Index] = EWfRailMode::None;
+			}
+			continue;
+		}
+
+		bool bArrived = false;
+		if (Mode == EWfRailMode::Kinematic)
+		{
+			bArrived = AdvanceKinematic(Index, DeltaSeconds);
+			Moved.Add(Ids.IdOf(Index));
+		}
+		else if (Mode == EWfRailMode::Physics)
+		{
+			bArrived = TrackPhysics(Index);
+		}
+
+		if (bArrived)
+		{
+			Arrivals.Add(Ids.IdOf(Index));
+			ReleaseRoute(Trips[Index].RouteIndex);
+			Trips[Index] = FTrip();
+			if (Mode != EWfRailMode::None)
+				Transitions.Add({ Ids.IdOf(Index), Mode, EWfRailMode::None });
+			Modes[Index] = EWfRailMode::None;
+			continue;
+		}
+
+		const float Reach = Mode == EWfRailMode::Physics ? 1.0f + Hysteresis : 1.0f;
+		const FVector& Location = Locations[Index];
+		bool bSimulate = NearObserver[Index];
+		for (int32 Other = 0; !bSimulate && Other < SimulatedLocations.Num(); ++Other)
+		{
+			// A vehicle that is a risk finds itself at distance zero, which is not one
+			const double DistSq = FVector::DistSquared(SimulatedLocations[Other], Location);
+			bSimulate = DistSq > 1.0 && DistSq < FMath::Square(RiskRadius * Reach);
+		}
+
+		const EWfRailMode NewMode = bSimulate ? EWfRailMode::Physics : EWfRailMode::Kinematic;
+		if (NewMode == Mode)
+			continue;
+
+		Transitions.Add({ Ids.IdOf(Index), Mode, NewMode });
+		Modes[Index] = NewMode;
+		if (NewMode == EWfRailMode::Physics)
+		{
+			TrackPhysics(Index);
+		}
+		else if (Mode == EWfRailMode::None)
+		{
+			AdvanceKinematic(Index, 0.0f);
+			Moved.Add(Ids.IdOf(Index));
+		}
+	}
+}
+
+int32 FWfVehicleRails::GetNumInMode(const EWfRailMode Mode) const
+{
+	int32 NumInMode = 0;
+	for (const EWfRailMode VehicleMode : Modes)
+		NumInMode += VehicleMode == Mode ? 1 : 0;
+	return NumInMode;
+}
+
+void FWfVehicleRails::Reset()
+{
+	Vehicles.Reset();
+	Locations.Reset();
+	Yaws.Reset();
+	Modes.Reset();
+	Trips.Reset();
+	Ids.Reset();
+	Routes.Reset();
+	RouteCache.Reset();
+	SimulatedLocations.Reset();
+	NearObserver.Reset();
+	Transitions.Reset();
+	Moved.Reset();
+	Steering.Reset();
+	Arrivals.Reset();
+}
+
+/**
+ * \brief Routes are cached by their end nodes, so a station sending several units to one incident finds
+ *  the path once. A change to the graph empties the cache; vehicles already on a route keep driving it.
+ */
+int32 FWfVehicleRails::AcquireRoute(const FWfRoadGraph& Graph, const int32 FromNode, const int32 ToNode)
+{
+	if (FromNode == INDEX_NONE || ToNode == INDEX_NONE)
+		return INDEX_NONE;
+
+	if (RouteGraphVersion != Graph.GetVersion())
+	{
+		RouteCache.Reset();
+		RouteGraphVersion = Graph.GetVersion();
+	}
+
+	const uint64 Key = static_cast<uint64>(static_cast<uint32>(FromNode)) << 32 | static_cast<uint32>(ToNode);
+	if (const int32* CachedIndex = RouteCache.Find(Key))
+	{
+		++Routes[*CachedIndex].NumUsers;
+		return *CachedIndex;
+	}
+
+	TArray<int32> Nodes;
+	if (Graph.FindPath(FromNode, ToNode, &Nodes) == FWfRoadGraph::UnreachableTime || Nodes.IsEmpty())
+		return INDEX_NONE;
+
+	FRoute Route;
+	Route.Key = Key;
+	Route.NumUsers = 1;
+	Route.GraphVersion = Graph.GetVersion();
+	Route.Points.Reserve(Nodes.Num());
+	Route.Times.Reserve(Nodes.Num());
+	float Time = 0.0f;
+	for (int32 NodeIndex = 0; NodeIndex < Nodes.Num(); ++NodeIndex)
+	{
+		const int32 EdgeIndex = NodeIndex > 0 ? Graph.FindEdge(Nodes[NodeIndex - 1], Nodes[NodeIndex]) : INDEX_NONE;
+		if (EdgeIndex != INDEX_NONE)
+			Time += Graph.GetEdgeTravelTime(EdgeIndex);
+		Route.Points.Add(Graph.GetNodeLocation(Nodes[NodeIndex]));
+		Route.Times.Add(Time);
+	}
+	Route.Nodes = MoveTemp(Nodes);
+
+	const int32 RouteIndex = Routes.Add(MoveTemp(Route));
+	RouteCache.Add(Key, RouteIndex);
+	return RouteIndex;
+}
+
+void FWfVehicleRails::ReleaseRoute(const int32 RouteIndex)
+{
+	if (!Routes.IsValidIndex(RouteIndex) || --Routes[RouteIndex].NumUsers > 0)
+		return;
+
+	const int32* CachedIndex = RouteCache.Find(Routes[RouteIndex].Key);
+	if (CachedIndex != nullptr && *CachedIndex == RouteIndex)
+		RouteCache.Remove(Routes[RouteIndex].Key);
+	Routes.RemoveAt(RouteIndex);
+}
+
+int32 FWfVehicleRails::GetNumSegments(const FTrip& Trip) const
+{
+	return Routes[Trip.RouteIndex].Points.Num() + 1;
+}
+
+void FWfVehicleRails::GetSegment(const FTrip& Trip, const int32 Segment,
+	FVector& OutFrom, FVector& OutTo, float& OutFromTime, float& OutToTime) const
+{
+	const FRoute& Route = Routes[Trip.RouteIndex];
+	const int32 NumPoints = Route.Points.Num();
+	if (Segment == 0)
+	{
+		OutFrom = Trip.Start;
+		OutTo = Route.Points[0];
+		OutFromTime = 0.0f;
+		OutToTime = Trip.LeadInTime;
+	}
+	else if (Segment < NumPoints)
+	{
+		OutFrom = Route.Points[Segment - 1];
+		OutTo = Route.Points[Segment];
+		OutFromTime = Trip.LeadInTime + Route.Times[Segment - 1];
+		OutToTime = Trip.LeadInTime + Route.Times[Segment];
+	}
+	else
+	{
+		OutFrom = Route.Points.Last();
+		OutTo = Trip.End;
+		OutFromTime = Trip.LeadInTime + Route.Times.Last();
+		OutToTime = OutFromTime + Trip.LeadOutTime;
+	}
+}
+
+bool FWfVehicleRails::AdvanceKinematic(const int32 Index, const float DeltaSeconds)
+{
+	FTrip& Trip = Trips[Index];
+	const int32 LastSegment = GetNumSegments(Trip) - 1;
+	Trip.Time += DeltaSeconds;
+
+	FVector From, To;
+	float FromTime, ToTime;
+	GetSegment(Trip, Trip.Segment, From, To, FromTime, ToTime);
+	while (Trip.Time >= ToTime && Trip.Segment < LastSegment)
+		GetSegment(Trip, ++Trip.Segment, From, To, FromTime, ToTime);
+
+	if (Trip.Time >= ToTime)
+	{
+		Locations[Index] = To;
+		return true;
+	}
+
+	const float Alpha = ToTime > FromTime ? (Trip.Time - FromTime) / (ToTime - FromTime) : 1.0f;
+	Locations[Index] = FMath::Lerp(From, To, Alpha);
+	if (!From.Equals(To))
+		Yaws[Index] = (To - From).Rotation().Yaw;
+	return false;
+}
+
+/**
+ * \brief The vehicle moves on to the next segment once it is past the end of the current one, and its
+ *  time is that of the closest point on the segment. The steering target is LookAheadDistance further on.
+ */
+bool FWfVehicleRails::TrackPhysics(const int32 Index)
+{
+	FTrip& Trip = Trips[Index];
+	const FVector& Location = Locations[Index];
+	const int32 LastSegment = GetNumSegments(Trip) - 1;
+
+	FVector From, To;
+	float FromTime, ToTime;
+	GetSegment(Trip, Trip.Segment, From, To, FromTime, ToTime);
+	while (Trip.Segment < LastSegment && FVector::DotProduct(Location - To, To - From) >= 0.0)
+		GetSegment(Trip, ++Trip.Segment, From, To, FromTime, ToTime);
+
+	if (Trip.Segment == LastSegment && FVector::DistSquared(Location, Trip.End) < FMath::Square(ArriveDistance))
+		return true;
+
+	const FVector Direction = To - From;
+	const double LengthSq = Direction.SizeSquared();
+	const float Alpha = LengthSq > KINDA_SMALL_NUMBER
+		? static_cast<float>(FMath::Clamp(FVector::DotProduct(Location - From, Direction) / LengthSq, 0.0, 1.0)) : 1.0f;
+	Trip.Time = FMath::Lerp(FromTime, ToTime, Alpha);
+	const float TargetSpeed = ToTime > FromTime ? static_cast<float>(FMath::Sqrt(LengthSq)) / (ToTime - FromTime) : 0.0f;
+
+	// Walk the look ahead along the segments that follow
+	FVector Target = FMath::Lerp(From, To, static_cast<double>(Alpha));
+	float Remaining = LookAheadDistance;
+	int32 Segment = Trip.Segment;
+	while (Remaining > 0.0f)
+	{
+		const float SegmentLeft = FVector::Dist(Target, To);
+		if (Remaining <= SegmentLeft || Segment >= LastSegment)
+		{
+			Target = SegmentLeft > KINDA_SMALL_NUMBER ? Target + (To - Target) * FMath::Min(Remaining / SegmentLeft, 1.0f) : To;
+			break;
+		}
+		Remaining -= SegmentLeft;
+		Target = To;
+		GetSegment(Trip, ++Segment, From, To, FromTime, ToTime);
+	}
+
+	Steering.Add({ Ids.IdOf(Index), Target, TargetSpeed });
+	return false;
+}
+
+
+/******************************************
+ *         BENCHMARK
+ */
+
+/**
+ * \brief Wf.Bench.Rails [Vehicles] [Observers] [Steps]
+ *  Builds a 20 by 20 grid of roads a block apart and sends every vehicle between two random
+ *  intersections, with the observers crossing the grid, so vehicles keep waking and going back on the
+ *  rails. No actors are involved; this times the store's update, not the pawns being placed.
+ */
+static FAutoConsoleCommand GWfBenchRailsCommand(
+	TEXT("Wf.Bench.Rails"),
+	TEXT("Benchmarks the vehicle rails. Usage: Wf.Bench.Rails [Vehicles=200] [Observers=8] [Steps=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+	{
+		FWfBench Bench(Args);
+		const int32 NumVehicles = Bench.GetArg(0, 200);
+		const int32 NumObservers = Bench.GetArg(1, 8, 0);
+		const int32 NumSteps = Bench.GetArg(2, 1000);
+
+		constexpr int32 GridSize = 20;
+		constexpr float BlockSize = 10000.0f;
+		FWfRoadGraph Graph;
+		for (int32 Line = 0; Line < GridSize; ++Line)
+		{
+			TArray<FVector> Across, Down;
+			for (int32 Step = 0; Step < GridSize; ++Step)
+			{
+				Across.Add(FVector(Step * BlockSize, Line * BlockSize, 0.0f));
+				Down.Add(FVector(Line * BlockSize, Step * BlockSize, 0.0f));
+			}
+			Graph.AddRoad(Line * 2, Across, 50.0f, false);
+			Graph.AddRoad(Line * 2 + 1, Down, 50.0f, false);
+		}
+		Graph.Build();
+
+		FRandomStream& Random = Bench.Random;
+		const auto RandomLocation = [&Random]()
+		{
+			return FVector(Random.RandRange(0, GridSize - 1) * BlockSize, Random.RandRange(0, GridSize - 1) * BlockSize, 0.0f);
+		};
+
+		FWfVehicleRails Rails;
+		for (int32 VehicleIndex = 0; VehicleIndex < NumVehicles; ++VehicleIndex)
+			Rails.StartRoute(Rails.AddVehicle(nullptr, RandomLocation()), Graph, RandomLocation(), 400.0f);
+
+		TArray<FVector> Observers;
+		TArray<FVector> Velocities;
+		for (int32 ObserverIndex = 0; ObserverIndex < NumObservers; ++ObserverIndex)
+		{
+			Observers.Add(RandomLocation());
+			Velocities.Add(FVector(Random.FRandRange(-2000.0f, 2000.0f), Random.FRandRange(-2000.0f, 2000.0f), 0.0f));
+		}
+
+		int64 TotalTransitions = 0;
+		Bench.Run(NumSteps, [&](const int32)
+		{
+			// Vehicles that arrived in the last update set off again
+			for (const int32 VehicleId : Rails.GetArrivals())
+				Rails.StartRoute(VehicleId, Graph, RandomLocation(), 400.0f);
+			for (int32 ObserverIndex = 0; ObserverIndex < NumObservers; ++ObserverIndex)
+				Observers[ObserverIndex] += Velocities[ObserverIndex] * 0.1f;
+		},
+		[&](const int32)
+		{
+			// Simulated vehicles hold still here, so they are tracked but never arrive
+			Rails.Update(Observers, 0.1f);
+			TotalTransitions += Rails.GetTransitions().Num();
+		});
+
+		UE_LOGFMT(LogRails, Display,
+			"Wf.Bench.Rails: {Vehicles} vehicles, {Observers} observers, {Steps} steps. {Timing} per update, {PerVehicleUs} us per vehicle, {Transitions} transitions per update. Now {Kinematic} kinematic, {Physics} simulated, {Routes} cached routes."
+			, NumVehicles, NumObservers, NumSteps, Bench.Timing.ToString()
+			, Bench.Timing.TotalSeconds * 1000000.0 / NumSteps / NumVehicles, static_cast<double>(TotalTransitions) / NumSteps
+			, Rails.GetNumInMode(EWfRailMode::Kinematic), Rails.GetNumInMode(EWfRailMode::Physics), Rails.GetNumRoutes());
+	}));
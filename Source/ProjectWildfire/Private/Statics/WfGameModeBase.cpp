@@ -8,6 +8,7 @@
 #include "Characters/WfCharacterTags.h"
 #include "Characters/WfCharacterData.h"
 #include "Kismet/GameplayStatics.h"
+#include "Lib/WfSimTimings.h"
 #include "Logging/StructuredLog.h"
 
 
@@ -71,6 +72,8 @@ int AWfGameModeBase::GetNextFireStationNumber() const
 
 TArray<FString> AWfGameModeBase::GenerateRandomName(const FGameplayTag& Gender, const FGameplayTag& Ethnicity) const
 {
+    WF_SCOPE_CYCLE(STAT_WfNameGeneration, TEXT("NameGeneration"));
+    WF_COUNT(STAT_WfNumNames, TEXT("NamesGenerated"), 1);
     // Ensure data tables are valid
     FString NameFirst, NameMiddle, NameLast;
     if (!FirstNamesTable || !LastNamesTable)
@@ -389,7 +392,11 @@ UWfSaveGame* AWfGameModeBase::CreateNewCharacter(const FGameplayTag& NewCharacte
             + FTimespan(FMath::RandRange(0,5), FMath::RandRange(4, 23), 0, 0);
     }
 
-    UGameplayStatics::SaveGameToSlot(GameSave, GameSave->SaveSlotName, GameSave->SaveSlotIndex);
+    {
+        WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+        WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
+        UGameplayStatics::SaveGameToSlot(GameSave, GameSave->SaveSlotName, GameSave->SaveSlotIndex);
+    }
     return GameSave;
 }
 
@@ -450,6 +457,8 @@ void AWfGameModeBase::JobContractExpired(const FJobContractData& JobContract, bo
                     }
                     if (bDeleteSave)
                     {
+                        WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+                        WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
                         UGameplayStatics::DeleteGameInSlot(JobContract.ContractId, JobContract.UserIndex);
                     }
                     return;
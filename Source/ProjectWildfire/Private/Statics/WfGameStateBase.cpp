@@ -4,6 +4,7 @@
 #include "ProjectWildfire/Public/Statics/WfGameStateBase.h"
 
 #include "Kismet/GameplayStatics.h"
+#include "Lib/WfSimTimings.h"
 #include "Logging/StructuredLog.h"
 #include "Net/UnrealNetwork.h"
 #include "Statics/WfGameModeBase.h"
@@ -15,6 +16,8 @@ AWfGameStateBase::AWfGameStateBase()
 
 UWfFirefighterSaveGame* AWfGameStateBase::GetSaveGameFromJobContract(const FJobContractData& JobContract)
 {
+	WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+	WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
 	if (UGameplayStatics::DoesSaveGameExist(JobContract.ContractId, JobContract.UserIndex))
 	{
 		USaveGame* SaveGame = UGameplayStatics::LoadGameFromSlot(JobContract.ContractId, JobContract.UserIndex);
@@ -6,6 +6,7 @@
 #include "OnlineSubsystem.h"
 #include "Characters/WfCharacterTags.h"
 #include "Interfaces/OnlineIdentityInterface.h"
+#include "Lib/WfSimTimings.h"
 #include "Saves/WfPlayerSave.h"
 #include "Statics/WfGameModeBase.h"
 
@@ -47,7 +48,12 @@ void AWfPlayerState::BeginPlay()
 		if (UGameplayStatics::DoesSaveGameExist(SaveSlotName, SaveUserIndex))
 		{
 			UE_LOGFMT(LogTemp, Display, "Reloading Existing Player Save ({SaveSlotName} {uIndex}", SaveSlotName, SaveUserIndex);
-			UWfPlayerSave* PlayerSave = Cast<UWfPlayerSave>( UGameplayStatics::LoadGameFromSlot(SaveSlotName, SaveUserIndex) );
+			UWfPlayerSave* PlayerSave = nullptr;
+			{
+				WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+				WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
+				PlayerSave = Cast<UWfPlayerSave>( UGameplayStatics::LoadGameFromSlot(SaveSlotName, SaveUserIndex) );
+			}
 			if (IsValid(PlayerSave))
 			{
 				for (const auto& SavedPersonnelData : PlayerSave->SavedPersonnel)
@@ -96,6 +102,8 @@ void AWfPlayerState::BeginPlay()
 			{
 				// TODO - Set up saving of default personnel
 				UE_LOGFMT(LogTemp, Warning, "Saving of generated personnel is not yet implemented!");
+				WF_SCOPE_CYCLE(STAT_WfSaveIO, TEXT("SaveIO"));
+				WF_COUNT(STAT_WfNumSaves, TEXT("Saves"), 1);
 				UGameplayStatics::SaveGameToSlot(NewPlayerSave, SaveSlotName, SaveUserIndex);
 			}
 
@@ -0,0 +1,56 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Tools/WfJournalDecodeCommandlet.h"
+
+#include "Lib/WfIncidentJournal.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/FileHelper.h"
+
+
+UWfJournalDecodeCommandlet::UWfJournalDecodeCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UWfJournalDecodeCommandlet::Main(const FString& Params)
+{
+	TArray<FString> Tokens, Switches;
+	TMap<FString, FString> SwitchParams;
+	ParseCommandLine(*Params, Tokens, Switches, SwitchParams);
+
+	if (Tokens.IsEmpty())
+	{
+		UE_LOGFMT(LogJournal, Error, "Usage: -run=WfJournalDecode <JournalPath> [-Out=<TextPath>]");
+		return 1;
+	}
+
+	FString Text;
+	if (!FWfIncidentJournal::Decode(Tokens[0], Text))
+	{
+		UE_LOGFMT(LogJournal, Error, "'{Path}' is not a readable incident journal", Tokens[0]);
+		return 1;
+	}
+
+	if (const FString* OutPath = SwitchParams.Find(TEXT("Out")))
+	{
+		if (!FFileHelper::SaveStringToFile(Text, **OutPath))
+		{
+			UE_LOGFMT(LogJournal, Error, "Failed to write '{Path}'", *OutPath);
+			return 1;
+		}
+		UE_LOGFMT(LogJournal, Display, "Decoded '{Journal}' to '{Path}'", Tokens[0], *OutPath);
+		return 0;
+	}
+
+	TArray<FString> Lines;
+	Text.ParseIntoArrayLines(Lines);
+	for (const FString& Line : Lines)
+	{
+		UE_LOGFMT(LogJournal, Display, "{Line}", Line);
+	}
+	return 0;
+}
@@ -0,0 +1,457 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Tools/WfStressHarness.h"
+
+#include "Actors/CalloutsManager.h"
+#include "Actors/GameManager.h"
+#include "Actors/WfActorPool.h"
+#include "Dom/JsonObject.h"
+#include "Engine/NetDriver.h"
+#include "HAL/IConsoleManager.h"
+#include "Lib/WfCalloutData.h"
+#include "Lib/WfSimTimings.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/App.h"
+#include "Misc/EngineVersion.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/JsonSerializer.h"
+#include "Vehicles/WfFireApparatusBase.h"
+
+
+DEFINE_LOG_CATEGORY(LogStress);
+
+namespace WfStress
+{
+	// Seconds between assignment steps, roughly how often a busy player acts
+	constexpr float AssignmentSeconds = 1.0f;
+
+	// Water put on each fire spot per assignment step when no apparatus could be assigned
+	constexpr float GallonsPerStep = 50.0f;
+
+	// Treatment each patient receives once units are on scene
+	constexpr float TreatmentPerSecond = 1.0f / 300.0f;
+
+	float GetPercentile(const TArray<float>& Sorted, const float Percentile)
+	{
+		if (Sorted.IsEmpty())
+			return 0.0f;
+		const int32 Index = FMath::Clamp(FMath::CeilToInt(Percentile * Sorted.Num()) - 1, 0, Sorted.Num() - 1);
+		return Sorted[Index];
+	}
+}
+
+AWfStressHarness::AWfStressHarness()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+	bReplicates = false;
+}
+
+AWfStressHarness* AWfStressHarness::StartRun(UWorld* World, const FWfStressSettings& Settings)
+{
+	if (!IsValid(World) || World->GetNetMode() == NM_Client)
+		return nullptr;
+
+	AWfStressHarness* Harness = World->SpawnActor<AWfStressHarness>();
+	if (!IsValid(Harness) || !Harness->BeginRun(Settings))
+		return nullptr;
+	return Harness;
+}
+
+/**
+ * \brief Records the baseline every delta in the report is measured from, then starts generating callouts.
+ * \return False (and the harness is destroyed) if the managers the run drives are missing
+ */
+bool AWfStressHarness::BeginRun(const FWfStressSettings& NewSettings)
+{
+	ACalloutsManager* CalloutsManager = ACalloutsManager::GetInstance(this);
+	AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (!IsValid(CalloutsManager) || !IsValid(GameManager))
+	{
+		UE_LOGFMT(LogStress, Error, "{ThisName}({NetMode}): Cannot start a stress run without the game and callouts managers"
+			, GetName(), HasAuthority() ? "SRV" : "CLI");
+		Destroy();
+		return false;
+	}
+
+	Settings = NewSettings;
+	Settings.DurationSeconds = FMath::Max(1.0f, Settings.DurationSeconds);
+	Settings.CalloutsPerMinute = FMath::Max(0.01f, Settings.CalloutsPerMinute);
+
+	bPreviousStatsEnabled = FWfSimTimings::IsEnabled();
+	FWfSimTimings::SetEnabled(true);
+	FWfSimTimings::Get().Reset();
+	FrameSeconds.Reset();
+	FrameSeconds.Reserve(FMath::CeilToInt(Settings.DurationSeconds * 120.0f));
+
+	RunStartTime = FPlatformTime::Seconds();
+	RunStartUtc = FDateTime::UtcNow();
+	LastFrameTime = RunStartTime;
+
+	StartUsedMemory = FPlatformMemory::GetStats().UsedPhysical;
+	PeakUsedMemory = StartUsedMemory;
+	if (const UNetDriver* NetDriver = GetWorld()->GetNetDriver())
+	{
+		StartOutBytes = NetDriver->OutTotalBytes;
+		StartOutPackets = NetDriver->OutTotalPackets;
+	}
+
+	PreGcHandle = FCoreUObjectDelegates::GetPreGarbageCollectDelegate().AddUObject(this, &AWfStressHarness::OnPreGarbageCollect);
+	PostGcHandle = FCoreUObjectDelegates::GetPostGarbageCollect().AddUObject(this, &AWfStressHarness::OnPostGarbageCollect);
+	CalloutsManager->OnIncidentStateChanged.AddDynamic(this, &AWfStressHarness::OnIncidentStateChanged);
+
+	PreviousSimTimeRate = GameManager->GetSimulatedTimeRate();
+	GameManager->SetSimulatedTimeRate(Settings.SimTimeRate);
+
+	FTimerManager& TimerManager = GetWorldTimerManager();
+	TimerManager.SetTimer(CalloutTimerHandle, this, &AWfStressHarness::GenerateCallout, 60.0f / Settings.CalloutsPerMinute, true, 0.0f);
+	if (Settings.bSimulateAssignments)
+		TimerManager.SetTimer(AssignmentTimerHandle, this, &AWfStressHarness::SimulateAssignments, WfStress::AssignmentSeconds, true);
+	TimerManager.SetTimer(FinishTimerHandle, this, &AWfStressHarness::FinishRun, Settings.DurationSeconds, false);
+
+	bRunning = true;
+	SetActorTickEnabled(true);
+
+	UE_LOGFMT(LogStress, Display, "{ThisName}({NetMode}): Stress run started - {Seconds}s, {Rate} callouts/min, sim rate {SimRate}"
+		, GetName(), HasAuthority() ? "SRV" : "CLI", Settings.DurationSeconds, Settings.CalloutsPerMinute, Settings.SimTimeRate);
+	return true;
+}
+
+void AWfStressHarness::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+	if (!bRunning)
+		return;
+
+	// The tick's own delta is fixed under -benchmark, so frames are timed by the wall clock
+	const double Now = FPlatformTime::Seconds();
+	FrameSeconds.Add(static_cast<float>(Now - LastFrameTime));
+	LastFrameTime = Now;
+
+	PeakUsedMemory = FMath::Max<uint64>(PeakUsedMemory, FPlatformMemory::GetStats().UsedPhysical);
+}
+
+void AWfStressHarness::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	Super::EndPlay(EndPlayReason);
+	FCoreUObjectDelegates::GetPreGarbageCollectDelegate().Remove(PreGcHandle);
+	FCoreUObjectDelegates::GetPostGarbageCollect().Remove(PostGcHandle);
+}
+
+void AWfStressHarness::GenerateCallout()
+{
+	if (ACalloutsManager* CalloutsManager = ACalloutsManager::GetInstance(this))
+	{
+		CalloutsManager->GenerateCallout();
+		++NumGenerated;
+		PeakActiveIncidents = FMath::Max(PeakActiveIncidents, CalloutsManager->GetActiveIncidents().Num());
+	}
+}
+
+/**
+ * \brief Pre-alerts are dispatched straight away and given the recommended units. Incidents whose units
+ *  have had TravelSeconds to get there arrive, and incidents on scene are worked until they are controlled.
+ *  Closing is left to the callouts manager, so the whole lifecycle runs as it would in play.
+ */
+void AWfStressHarness::SimulateAssignments()
+{
+	ACalloutsManager* CalloutsManager = ACalloutsManager::GetInstance(this);
+	AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (!IsValid(CalloutsManager) || !IsValid(GameManager))
+		return;
+
+	const double WorldSeconds = GetWorld()->GetTimeSeconds();
+	for (const int IncidentNumber : CalloutsManager->GetActiveIncidents())
+	{
+		switch (CalloutsManager->GetIncidentState(IncidentNumber))
+		{
+		case EWfIncidentState::PreAlert:
+			CalloutsManager->DispatchIncident(IncidentNumber);
+			break;
+
+		case EWfIncidentState::Dispatched:
+		{
+			AWfCalloutActor* CalloutActor = CalloutsManager->GetIncidentActor(IncidentNumber);
+			if (!IsValid(CalloutActor))
+				break;
+
+			// Units are sent once. Until the callouts manager sees them, the incident is only moved along.
+			bool bAlreadyAssigned;
+			AssignedIncidents.Add(IncidentNumber, &bAlreadyAssigned);
+			if (bAlreadyAssigned)
+			{
+				CalloutsManager->TriggerIncident(IncidentNumber, EWfIncidentEvent::Respond);
+				break;
+			}
+
+			bool bRequirementsMet;
+			const TArray<AWfFireApparatusBase*> Recommended = GameManager->RecommendUnitsForIncident(CalloutActor, bRequirementsMet);
+			for (AWfFireApparatusBase* FireApparatus : Recommended)
+			{
+				GameManager->AssignIncidentToFireApparatus(CalloutActor, FireApparatus);
+			}
+			NumAssignedApparatus += Recommended.Num();
+
+			// Without apparatus in the level the incident is walked along by hand
+			if (Recommended.IsEmpty())
+				CalloutsManager->TriggerIncident(IncidentNumber, EWfIncidentEvent::Respond);
+			break;
+		}
+
+		case EWfIncidentState::EnRoute:
+		{
+			const double* Dispatched = DispatchedSeconds.Find(IncidentNumber);
+			if (Dispatched && WorldSeconds - *Dispatched >= Settings.TravelSeconds)
+				CalloutsManager->TriggerIncident(IncidentNumber, EWfIncidentEvent::Arrive);
+			break;
+		}
+
+		case EWfIncidentState::OnScene:
+			WorkIncident(IncidentNumber);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/**
+ * \brief The first step on scene lays a line to every fire spot and starts treating every patient.
+ *  Incidents with no apparatus to pump from get water put straight on the fire every step instead.
+ */
+void AWfStressHarness::WorkIncident(const int IncidentNumber)
+{
+	AWfCalloutActor* CalloutActor = ACalloutsManager::GetInstance(this)->GetIncidentActor(IncidentNumber);
+	AGameManager* GameManager = AGameManager::GetInstance(this);
+	if (!IsValid(CalloutActor) || !IsValid(GameManager))
+		return;
+
+	const FCalloutData CalloutData = CalloutActor->GetCalloutData();
+	const FVector IncidentLocation = CalloutActor->GetIncidentLocation();
+	const FIncidentAssignments Assignments = GameManager->GetIncidentAssignments(CalloutActor);
+	const AWfFireApparatusBase* FireApparatus = Assignments.FireApparatuses.IsEmpty() ? nullptr : Assignments.FireApparatuses[0];
+
+	bool bAlreadyWorked;
+	WorkedIncidents.Add(IncidentNumber, &bAlreadyWorked);
+	if (!bAlreadyWorked)
+	{
+		for (int PatientIndex = 0; PatientIndex < CalloutData.Patients.Num(); ++PatientIndex)
+		{
+			CalloutActor->TreatPatient(PatientIndex, WfStress::TreatmentPerSecond);
+		}
+		if (IsValid(FireApparatus))
+		{
+			for (const FCalloutDataFire& Fire : CalloutData.Fires)
+			{
+				CalloutActor->LayAttackLine(FireApparatus, IncidentLocation + Fire.RelativeLocation);
+			}
+		}
+	}
+
+	if (!IsValid(FireApparatus))
+	{
+		for (const FCalloutDataFire& Fire : CalloutData.Fires)
+		{
+			CalloutActor->ApplyWater(IncidentLocation + Fire.RelativeLocation, 400.0f, WfStress::GallonsPerStep);
+		}
+	}
+}
+
+void AWfStressHarness::OnIncidentStateChanged(const int IncidentNumber, const EWfIncidentState NewState)
+{
+	switch (NewState)
+	{
+	case EWfIncidentState::Dispatched:
+		DispatchedSeconds.Add(IncidentNumber, GetWorld()->GetTimeSeconds());
+		break;
+	case EWfIncidentState::Closed:
+		++NumClosed;
+		DispatchedSeconds.Remove(IncidentNumber);
+		AssignedIncidents.Remove(IncidentNumber);
+		WorkedIncidents.Remove(IncidentNumber);
+		break;
+	case EWfIncidentState::Expired:
+		++NumExpired;
+		DispatchedSeconds.Remove(IncidentNumber);
+		AssignedIncidents.Remove(IncidentNumber);
+		WorkedIncidents.Remove(IncidentNumber);
+		break;
+	default:
+		break;
+	}
+}
+
+void AWfStressHarness::OnPreGarbageCollect()
+{
+	GcStartSeconds = FPlatformTime::Seconds();
+}
+
+void AWfStressHarness::OnPostGarbageCollect()
+{
+	if (GcStartSeconds <= 0.0)
+		return;
+
+	const double Seconds = FPlatformTime::Seconds() - GcStartSeconds;
+	GcTotalSeconds += Seconds;
+	GcMaxSeconds = FMath::Max(GcMaxSeconds, Seconds);
+	++NumGcRuns;
+	GcStartSeconds = 0.0;
+}
+
+void AWfStressHarness::FinishRun()
+{
+	if (!bRunning)
+		return;
+
+	bRunning = false;
+	SetActorTickEnabled(false);
+	GetWorldTimerManager().ClearAllTimersForObject(this);
+
+	if (ACalloutsManager* CalloutsManager = ACalloutsManager::GetInstance(this))
+		CalloutsManager->OnIncidentStateChanged.RemoveDynamic(this, &AWfStressHarness::OnIncidentStateChanged);
+	if (AGameManager* GameManager = AGameManager::GetInstance(this))
+		GameManager->SetSimulatedTimeRate(PreviousSimTimeRate);
+	FWfSimTimings::SetEnabled(bPreviousStatsEnabled);
+
+	FString ReportPath = Settings.ReportPath;
+	if (ReportPath.IsEmpty())
+	{
+		ReportPath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Stress"),
+			FString::Printf(TEXT("Stress-%s.json"), *RunStartUtc.ToString(TEXT("%Y%m%d-%H%M%S"))));
+	}
+
+	if (WriteReport(ReportPath))
+	{
+		UE_LOGFMT(LogStress, Display, "{ThisName}({NetMode}): Stress run finished - {NumGenerated} callouts, {NumClosed} closed, {NumExpired} expired. Report written to '{Path}'"
+			, GetName(), HasAuthority() ? "SRV" : "CLI", NumGenerated, NumClosed, NumExpired, ReportPath);
+	}
+	else
+	{
+		UE_LOGFMT(LogStress, Error, "{ThisName}({NetMode}): Failed to write the stress report to '{Path}'"
+			, GetName(), HasAuthority() ? "SRV" : "CLI", ReportPath);
+	}
+
+	if (Settings.bExitWhenDone)
+		FPlatformMisc::RequestExit(false, TEXT("AWfStressHarness::FinishRun"));
+	Destroy();
+}
+
+/**
+ * \brief Times are in milliseconds and memory in megabytes. The build block identifies what was
+ *  measured, so reports from different builds can be compared by whatever collects them.
+ */
+bool AWfStressHarness::WriteReport(const FString& Path) const
+{
+	constexpr double BytesPerMegabyte = 1024.0 * 1024.0;
+	const double WallSeconds = FPlatformTime::Seconds() - RunStartTime;
+
+	TSharedRef<FJsonObject> Root = MakeShared<FJsonObject>();
+
+	TSharedRef<FJsonObject> Build = MakeShared<FJsonObject>();
+	Build->SetStringField(TEXT("version"), FApp::GetBuildVersion());
+	Build->SetStringField(TEXT("configuration"), LexToString(FApp::GetBuildConfiguration()));
+	Build->SetNumberField(TEXT("changelist"), FEngineVersion::Current().GetChangelist());
+	Build->SetStringField(TEXT("map"), GetWorld()->GetMapName());
+	Build->SetStringField(TEXT("started_utc"), RunStartUtc.ToIso8601());
+	Root->SetObjectField(TEXT("build"), Build);
+
+	TSharedRef<FJsonObject> SettingsJson = MakeShared<FJsonObject>();
+	SettingsJson->SetNumberField(TEXT("duration_seconds"), Settings.DurationSeconds);
+	SettingsJson->SetNumberField(TEXT("callouts_per_minute"), Settings.CalloutsPerMinute);
+	SettingsJson->SetNumberField(TEXT("sim_time_rate"), Settings.SimTimeRate);
+	SettingsJson->SetBoolField(TEXT("simulate_assignments"), Settings.bSimulateAssignments);
+	SettingsJson->SetNumberField(TEXT("travel_seconds"), Settings.TravelSeconds);
+	Root->SetObjectField(TEXT("settings"), SettingsJson);
+
+	TArray<float> Sorted = FrameSeconds;
+	Sorted.Sort();
+	double TotalFrameSeconds = 0.0;
+	for (const float Seconds : FrameSeconds)
+	{
+		TotalFrameSeconds += Seconds;
+	}
+	TSharedRef<FJsonObject> Frames = MakeShared<FJsonObject>();
+	Frames->SetNumberField(TEXT("count"), FrameSeconds.Num());
+	Frames->SetNumberField(TEXT("avg_ms"), FrameSeconds.IsEmpty() ? 0.0 : TotalFrameSeconds * 1000.0 / FrameSeconds.Num());
+	Frames->SetNumberField(TEXT("p50_ms"), WfStress::GetPercentile(Sorted, 0.50f) * 1000.0);
+	Frames->SetNumberField(TEXT("p95_ms"), WfStress::GetPercentile(Sorted, 0.95f) * 1000.0);
+	Frames->SetNumberField(TEXT("p99_ms"), WfStress::GetPercentile(Sorted, 0.99f) * 1000.0);
+	Frames->SetNumberField(TEXT("max_ms"), Sorted.IsEmpty() ? 0.0 : Sorted.Last() * 1000.0);
+	Root->SetObjectField(TEXT("frames"), Frames);
+
+	const uint64 EndUsedMemory = FPlatformMemory::GetStats().UsedPhysical;
+	TSharedRef<FJsonObject> Memory = MakeShared<FJsonObject>();
+	Memory->SetNumberField(TEXT("start_mb"), StartUsedMemory / BytesPerMegabyte);
+	Memory->SetNumberField(TEXT("end_mb"), EndUsedMemory / BytesPerMegabyte);
+	Memory->SetNumberField(TEXT("peak_mb"), FMath::Max(PeakUsedMemory, EndUsedMemory) / BytesPerMegabyte);
+	Root->SetObjectField(TEXT("memory"), Memory);
+
+	TSharedRef<FJsonObject> Gc = MakeShared<FJsonObject>();
+	Gc->SetNumberField(TEXT("count"), NumGcRuns);
+	Gc->SetNumberField(TEXT("total_ms"), GcTotalSeconds * 1000.0);
+	Gc->SetNumberField(TEXT("max_ms"), GcMaxSeconds * 1000.0);
+	Root->SetObjectField(TEXT("gc"), Gc);
+
+	// Only meaningful with clients connected; a server nobody has joined sends nothing
+	TSharedRef<FJsonObject> Replication = MakeShared<FJsonObject>();
+	if (const UNetDriver* NetDriver = GetWorld()->GetNetDriver())
+	{
+		const uint64 OutBytes = NetDriver->OutTotalBytes - StartOutBytes;
+		Replication->SetNumberField(TEXT("clients"), NetDriver->ClientConnections.Num());
+		Replication->SetNumberField(TEXT("out_bytes"), OutBytes);
+		Replication->SetNumberField(TEXT("out_packets"), NetDriver->OutTotalPackets - StartOutPackets);
+		Replication->SetNumberField(TEXT("out_bytes_per_second"), WallSeconds > 0.0 ? OutBytes / WallSeconds : 0.0);
+	}
+	Root->SetObjectField(TEXT("replication"), Replication);
+
+	FWfSimTimings::Get().WriteJson(*Root, WallSeconds);
+
+	TSharedRef<FJsonObject> Incidents = MakeShared<FJsonObject>();
+	Incidents->SetNumberField(TEXT("generated"), NumGenerated);
+	Incidents->SetNumberField(TEXT("closed"), NumClosed);
+	Incidents->SetNumberField(TEXT("expired"), NumExpired);
+	Incidents->SetNumberField(TEXT("peak_active"), PeakActiveIncidents);
+	Incidents->SetNumberField(TEXT("apparatus_assigned"), NumAssignedApparatus);
+	if (const AWfActorPool* ActorPool = AWfActorPool::GetInstance(GetWorld()))
+	{
+		Incidents->SetNumberField(TEXT("actor_pool_hit_rate"), ActorPool->GetHitRate(AWfCalloutActor::StaticClass()));
+		Incidents->SetNumberField(TEXT("actor_pool_free"), ActorPool->GetNumFree(AWfCalloutActor::StaticClass()));
+	}
+	Root->SetObjectField(TEXT("incidents"), Incidents);
+
+	FString Json;
+	const TSharedRef<TJsonWriter<>> Writer = TJsonWriterFactory<>::Create(&Json);
+	if (!FJsonSerializer::Serialize(Root, Writer))
+		return false;
+	return FFileHelper::SaveStringToFile(Json, *Path);
+}
+
+
+/******************************************
+ *         CONSOLE
+ */
+
+/**
+ * \brief Wf.Stress.Run [Seconds] [CalloutsPerMinute] [SimRate] [Assign] [ReportPath]
+ *  Starts a stress run on the server. Add -WfStressExit to the command line to quit when the report is written.
+ */
+static FAutoConsoleCommandWithWorldAndArgs GWfStressRunCommand(
+	TEXT("Wf.Stress.Run"),
+	TEXT("Generates callouts for a while and writes a JSON report. Usage: Wf.Stress.Run [Seconds=300] [CalloutsPerMinute=60] [SimRate=60] [Assign=1] [ReportPath]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+	{
+		FWfStressSettings Settings;
+		Settings.DurationSeconds      = Args.IsValidIndex(0) ? FMath::Max(1.0f, FCString::Atof(*Args[0])) : 300.0f;
+		Settings.CalloutsPerMinute    = Args.IsValidIndex(1) ? FMath::Max(0.01f, FCString::Atof(*Args[1])) : 60.0f;
+		Settings.SimTimeRate          = Args.IsValidIndex(2) ? FMath::Max(0.0f, FCString::Atof(*Args[2])) : 60.0f;
+		Settings.bSimulateAssignments = Args.IsValidIndex(3) ? FCString::Atoi(*Args[3]) != 0 : true;
+		Settings.ReportPath           = Args.IsValidIndex(4) ? Args[4] : FString();
+		Settings.bExitWhenDone        = FParse::Param(FCommandLine::Get(), TEXT("WfStressExit"));
+
+		if (AWfStressHarness::StartRun(World, Settings) == nullptr)
+			UE_LOGFMT(LogStress, Error, "Wf.Stress.Run: The stress run did not start; it only runs on the server, once the managers are up");
+	})
+);
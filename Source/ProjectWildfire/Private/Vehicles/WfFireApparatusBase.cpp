@@ -3,6 +3,7 @@
 
 #include "Vehicles/WfFireApparatusBase.h"
 
+#include "Characters/WfFfCharacterBase.h"
 #include "Net/UnrealNetwork.h"
 
 
@@ -45,6 +46,36 @@ void AWfFireApparatusBase::SetFirefighterAssigned(AWfFfCharacterBase* FireFighte
 	}
 }
 
+TArray<AWfFfCharacterBase*> AWfFireApparatusBase::GetSeatedFirefighters() const
+{
+	TArray<AWfCharacterBase*> Occupants;
+	GetVehicleSeats().GetOccupants(Occupants);
+
+	TArray<AWfFfCharacterBase*> Firefighters;
+	Firefighters.Reserve(Occupants.Num());
+	for (AWfCharacterBase* Occupant : Occupants)
+	{
+		if (AWfFfCharacterBase* Firefighter = Cast<AWfFfCharacterBase>(Occupant))
+			Firefighters.Add(Firefighter);
+	}
+	return Firefighters;
+}
+
+void AWfFireApparatusBase::SetEmergencyLights(const bool bEnabled)
+{
+	if (!HasAuthority())
+	{
+		Server_SetEmergencyLights(bEnabled);
+		return;
+	}
+	bEmergencyLights = bEnabled;
+}
+
+bool AWfFireApparatusBase::IsResponding() const
+{
+	return bEmergencyLights || GetRailMode() != EWfRailMode::None;
+}
+
 FString AWfFireApparatusBase::GetApparatusIdentity() const
 {
 	if (!IdentityOverride.IsEmpty())
@@ -82,6 +113,7 @@ void AWfFireApparatusBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>&
 	DOREPLIFETIME(AWfFireApparatusBase, IdentityStation);
 	DOREPLIFETIME(AWfFireApparatusBase, IdentityType);
 	DOREPLIFETIME(AWfFireApparatusBase, IdentityUnique);
+	DOREPLIFETIME(AWfFireApparatusBase, bEmergencyLights);
 }
 
 void AWfFireApparatusBase::Server_SetFirefighterAssigned_Implementation(AWfFfCharacterBase* FireFighter, const bool bAssign)
@@ -89,6 +121,11 @@ void AWfFireApparatusBase::Server_SetFirefighterAssigned_Implementation(AWfFfCha
 	SetFirefighterAssigned(FireFighter, bAssign);
 }
 
+void AWfFireApparatusBase::Server_SetEmergencyLights_Implementation(const bool bEnabled)
+{
+	SetEmergencyLights(bEnabled);
+}
+
 void AWfFireApparatusBase::OnRep_IdentityUnique_Implementation(const int32 OldIdentityValue)
 {
 	const FString OldCallsign = FString::Printf(
@@ -5,9 +5,13 @@
 #include "ChaosWheeledVehicleMovementComponent.h"
 #include "EnhancedInputComponent.h"
 #include "EnhancedInputSubsystems.h"
+#include "Actors/GameManager.h"
+#include "Actors/WfRoadManager.h"
 #include "Camera/CameraComponent.h"
 #include "Characters/WfCharacterBase.h"
+#include "Characters/WfCharacterTags.h"
 #include "Components/InputComponent.h"
+#include "Components/SkeletalMeshComponent.h"
 #include "Engine/World.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Logging/StructuredLog.h"
@@ -41,23 +45,44 @@ AWfVehicleBase::AWfVehicleBase()
     SteeringConfig.SteeringCurve.GetRichCurve()->AddKey(40.f, 0.7f);
     SteeringConfig.SteeringCurve.GetRichCurve()->AddKey(120.f, 0.6f);
 
+    VehicleSeats.SetOwner(this);
 }
 
 void AWfVehicleBase::BeginPlay()
 {
     Super::BeginPlay();
+
+    if (HasAuthority())
+    {
+        AGameManager* GameManager = AGameManager::GetInstance(this);
+        if (IsValid(GameManager) && RailsId == INDEX_NONE)
+        {
+            RailsManager = GameManager;
+            RailsId = GameManager->GetVehicleRails().AddVehicle(this, GetActorLocation());
+        }
+    }
 }
 
-void AWfVehicleBase::OnConstruction(const FTransform& Transform)
+void AWfVehicleBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
-    Super::OnConstruction(Transform);
+    if (AGameManager* GameManager = RailsManager.Get())
+        GameManager->GetVehicleRails().RemoveVehicle(RailsId);
+    RailsManager.Reset();
+    RailsId = INDEX_NONE;
+    Super::EndPlay(EndPlayReason);
+}
 
-    VehicleSeats.Empty(NumberOfSeats);
-    for (int i = 0; i < NumberOfSeats; ++i)
-    {
-        VehicleSeats.Add( FVehicleSeat(i) );
-    }
+/**
+ * \brief Seats are built once, by the server, before anything can be assigned to them.
+ *  Clients receive them through replication.
+ */
+void AWfVehicleBase::PostInitializeComponents()
+{
+    Super::PostInitializeComponents();
 
+    VehicleSeats.SetOwner(this);
+    if (HasAuthority())
+        VehicleSeats.Init(this, NumberOfSeats, SeatRoles);
 }
 
 void AWfVehicleBase::SetupMappingContexts()
@@ -78,6 +103,7 @@ void AWfVehicleBase::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLi
 {
     Super::GetLifetimeReplicatedProps(OutLifetimeProps);
     DOREPLIFETIME(AWfVehicleBase, VehicleSeats);
+    DOREPLIFETIME(AWfVehicleBase, RailMode);
 }
 
 void AWfVehicleBase::Tick(float DeltaTime)
@@ -113,38 +139,172 @@ void AWfVehicleBase::SetupPlayerInputComponent(UInputComponent* PlayerInputCompo
     }
 }
 
-void AWfVehicleBase::SetSeatOccupant(const int SeatNumber, AWfCharacterBase* SeatCharacter)
+bool AWfVehicleBase::SetSeatOccupant(const int SeatNumber, AWfCharacterBase* SeatCharacter)
 {
-    for (auto& VehicleSeat : VehicleSeats)
+    if (!HasAuthority() || !VehicleSeats.IsValidSeat(SeatNumber))
+        return false;
+
+    const AWfCharacterBase* OldOccupant = VehicleSeats.GetOccupant(SeatNumber);
+    if (!VehicleSeats.SetOccupant(SeatNumber, SeatCharacter))
     {
-        if (VehicleSeat.SeatNumber == SeatNumber)
-        {
-            if (IsValid(VehicleSeat.SeatOccupant) && IsValid(SeatCharacter))
-            {
-                FString OldOccupantName = IsValid(VehicleSeat.SeatOccupant) ? VehicleSeat.SeatOccupant->GetCharacterName() : "(nobody)";
-                UE_LOGFMT(LogTemp, Error, "{ThisName}({NetMode}): Seat #{SeatNumber} is already occupied by {OccupantName}"
-                    , GetName(), HasAuthority() ? "SRV" : "CLI", SeatNumber, OldOccupantName);
-                return;
-            }
-            FString NewOccupantName = IsValid(SeatCharacter) ? SeatCharacter->GetCharacterName() : "(nobody)";
-            UE_LOGFMT(LogTemp, Display, "{ThisName}({NetMode}): Seat #{SeatNumber} is now occupied by {OccupantName}"
-                , GetName(), HasAuthority() ? "SRV" : "CLI", SeatNumber, NewOccupantName);
-            VehicleSeats[SeatNumber].SeatOccupant = SeatCharacter;
-            return;
-        }
+        FString OldOccupantName = IsValid(OldOccupant) ? OldOccupant->GetCharacterName() : "(nobody)";
+        UE_LOGFMT(LogTemp, Error, "{ThisName}({NetMode}): Seat #{SeatNumber} is already occupied by {OccupantName}"
+            , GetName(), HasAuthority() ? "SRV" : "CLI", SeatNumber, OldOccupantName);
+        return false;
     }
+    FString NewOccupantName = IsValid(SeatCharacter) ? SeatCharacter->GetCharacterName() : "(nobody)";
+    UE_LOGFMT(LogTemp, Display, "{ThisName}({NetMode}): Seat #{SeatNumber} is now occupied by {OccupantName}"
+        , GetName(), HasAuthority() ? "SRV" : "CLI", SeatNumber, NewOccupantName);
+    return true;
 }
 
 AWfCharacterBase* AWfVehicleBase::GetSeatOccupant(const int SeatNumber) const
 {
-    for (auto& VehicleSeat : VehicleSeats)
+    return VehicleSeats.GetOccupant(SeatNumber);
+}
+
+bool AWfVehicleBase::ClearSeatOccupant(const AWfCharacterBase* SeatCharacter)
+{
+    return HasAuthority() && VehicleSeats.ClearOccupant(SeatCharacter);
+}
+
+int AWfVehicleBase::FindSeatForCharacter(const AWfCharacterBase* SeatCharacter) const
+{
+    const EWfSeatRole Role = IsValid(SeatCharacter) ? GetSeatRole(SeatCharacter->GetCharacterRole()) : EWfSeatRole::Passenger;
+    return VehicleSeats.FindSeatForRole(Role);
+}
+
+EWfSeatRole AWfVehicleBase::GetSeatRole(const FGameplayTag& CharacterRole)
+{
+    if (CharacterRole.MatchesTag(TAG_Role_Fire_Eng))
+        return EWfSeatRole::Driver;
+    if (CharacterRole.MatchesTag(TAG_Role_Fire_Cpt) || CharacterRole.MatchesTag(TAG_Role_Fire_Chief)
+        || CharacterRole.MatchesTag(TAG_Role_Fire_Div))
+        return EWfSeatRole::Officer;
+    if (CharacterRole.MatchesTag(TAG_Role_Fire))
+        return EWfSeatRole::Crew;
+    return EWfSeatRole::Passenger;
+}
+
+bool AWfVehicleBase::DriveTo(const FVector& Destination)
+{
+    AGameManager* GameManager = RailsManager.Get();
+    const AWfRoadManager* RoadManager = AWfRoadManager::GetInstance(this);
+    if (!HasAuthority() || !IsValid(GameManager) || !IsValid(RoadManager))
+        return false;
+
+    // Kilometers per hour to centimeters per second
+    const float OffRoadSpeed = RoadManager->OffRoadSpeedKph * 100000.0f / 3600.0f;
+
+    FWfVehicleRails& Rails = GameManager->GetVehicleRails();
+    if (RailMode != EWfRailMode::Kinematic)
+        Rails.SetLocation(RailsId, GetActorLocation());
+    if (!Rails.StartRoute(RailsId, RoadManager->GetRoadGraph(), Destination, OffRoadSpeed))
     {
-        if (VehicleSeat.SeatNumber == SeatNumber)
-        {
-            return VehicleSeat.SeatOccupant;
-        }
+        UE_LOGFMT(LogRails, Warning, "{ThisName}({NetMode}): No route to {Destination}"
+            , GetName(), HasAuthority() ? "SRV" : "CLI", Destination.ToString());
+        return false;
     }
-    return nullptr;
+
+    // Parked by the last route it finished
+    GetVehicleMovementComponent()->SetHandbrakeInput(false);
+    return true;
+}
+
+void AWfVehicleBase::StopDriving()
+{
+    if (AGameManager* GameManager = RailsManager.Get())
+        GameManager->GetVehicleRails().StopRoute(RailsId);
+}
+
+bool AWfVehicleBase::GetRouteEdges(const FWfRoadGraph& Graph, int32& OutEdge, int32& OutNextEdge) const
+{
+    OutEdge = INDEX_NONE;
+    OutNextEdge = INDEX_NONE;
+    const AGameManager* GameManager = RailsManager.Get();
+    return IsValid(GameManager) && GameManager->GetVehicleRails().GetRouteEdges(RailsId, Graph, OutEdge, OutNextEdge);
+}
+
+/**
+ * \brief Kinematic vehicles keep their collision but neither simulate nor tick, so the only cost
+ *  left is being placed by the rails. Going back to physics carries the speed along the route over,
+ *  so a vehicle that wakes up in front of a player is already moving.
+ */
+void AWfVehicleBase::SetRailMode(const EWfRailMode NewMode, const FVector& Velocity)
+{
+    if (NewMode == RailMode)
+        return;
+
+    const EWfRailMode OldMode = RailMode;
+    RailMode = NewMode;
+    UChaosWheeledVehicleMovementComponent* VehicleMovement =
+        CastChecked<UChaosWheeledVehicleMovementComponent>(GetVehicleMovement());
+
+    if (NewMode == EWfRailMode::Kinematic)
+    {
+        VehicleMovement->SetThrottleInput(0.0f);
+        VehicleMovement->SetSteeringInput(0.0f);
+        VehicleMovement->SetComponentTickEnabled(false);
+        GetMesh()->SetSimulatePhysics(false);
+        SetActorTickEnabled(false);
+        return;
+    }
+
+    if (OldMode == EWfRailMode::Kinematic)
+    {
+        GetMesh()->SetSimulatePhysics(true);
+        GetMesh()->SetPhysicsLinearVelocity(Velocity);
+        VehicleMovement->SetComponentTickEnabled(true);
+        SetActorTickEnabled(PrimaryActorTick.bStartWithTickEnabled);
+    }
+
+    if (NewMode == EWfRailMode::None)
+    {
+        VehicleMovement->SetThrottleInput(0.0f);
+        VehicleMovement->SetSteeringInput(0.0f);
+    }
+}
+
+void AWfVehicleBase::SetRailTransform(const FVector& Location, const float Yaw)
+{
+    SetActorLocationAndRotation(Location + FVector(0.0f, 0.0f, RailHeightOffset),
+        FRotator(0.0f, Yaw, 0.0f), false, nullptr, ETeleportType::TeleportPhysics);
+}
+
+/**
+ * \brief Steers at the target and holds the route's speed, slowing for sharp turns.
+ *  Inputs stay applied until the next call, so this only needs to run as often as the rails update.
+ *  A player at the wheel keeps control.
+ */
+void AWfVehicleBase::SteerTowards(const FVector& Target, const float TargetSpeed)
+{
+    if (IsPlayerControlled())
+        return;
+
+    UChaosVehicleMovementComponent* VehicleMovement = GetVehicleMovementComponent();
+    const FVector LocalTarget = GetActorTransform().InverseTransformPosition(Target);
+    const float Angle = FMath::RadiansToDegrees(FMath::Atan2(LocalTarget.Y, LocalTarget.X));
+    const float Steering = FMath::Clamp(Angle / FMath::Max(MaxSteeringAngle, 1.0f), -1.0f, 1.0f);
+
+    const float WantedSpeed = TargetSpeed * (1.0f - 0.5f * FMath::Abs(Steering));
+    const float Speed = VehicleMovement->GetForwardSpeed();
+    VehicleMovement->SetSteeringInput(Steering);
+    VehicleMovement->SetThrottleInput(Speed < WantedSpeed ? 1.0f : 0.0f);
+    VehicleMovement->SetBrakeInput(Speed > WantedSpeed * 1.2f ? 1.0f : 0.0f);
+}
+
+/**
+ * \brief Holds the brakes once the vehicle has arrived, so it stays where it stopped rather than
+ *  rolling on. The handbrake is let off by the next route.
+ */
+void AWfVehicleBase::FinishRoute()
+{
+    UChaosVehicleMovementComponent* VehicleMovement = GetVehicleMovementComponent();
+    VehicleMovement->SetThrottleInput(0.0f);
+    VehicleMovement->SetSteeringInput(0.0f);
+    VehicleMovement->SetBrakeInput(1.0f);
+    VehicleMovement->SetHandbrakeInput(true);
+    OnVehicleArrived.Broadcast();
 }
 
 void AWfVehicleBase::MoveForward(const FInputActionValue& Value)
@@ -168,18 +328,3 @@ void AWfVehicleBase::OnHandbrakeReleased()
 {
     GetVehicleMovementComponent()->SetHandbrakeInput(false);
 }
-
-void AWfVehicleBase::OnRep_VehicleSeatsUpdated_Implementation(const TArray<FVehicleSeat>& OldSeats)
-{
-    if (OnSeatOccupantChanged.IsBound())
-    {
-        for (int i = 0; i < NumberOfSeats; ++i)
-        {
-            if (OldSeats[i].SeatOccupant != VehicleSeats[i].SeatOccupant)
-            {
-                OnSeatOccupantChanged.Broadcast(
-                    OldSeats[i].SeatOccupant, VehicleSeats[i].SeatOccupant, i);
-            }
-        }
-    }
-}
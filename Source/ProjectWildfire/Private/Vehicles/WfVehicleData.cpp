@@ -3,14 +3,212 @@
 
 #include "Vehicles/WfVehicleData.h"
 
+#include "Vehicles/WfVehicleBase.h"
+
 FVehicleSeat::FVehicleSeat()
 	: SeatNumber(0)
+	, Role(EWfSeatRole::Crew)
 	, SeatOccupant(nullptr)
 {
 
 }
 
-FVehicleSeat::FVehicleSeat(const int NewSeatNumber)
+FVehicleSeat::FVehicleSeat(const int NewSeatNumber, const EWfSeatRole NewRole)
+	: Role(NewRole)
+	, SeatOccupant(nullptr)
 {
 	SeatNumber = FMath::Abs(NewSeatNumber);
 }
+
+void FVehicleSeat::PostReplicatedAdd(const FWfVehicleSeats& InArraySerializer)
+{
+	const_cast<FWfVehicleSeats&>(InArraySerializer).OnSeatReplicated(*this, false);
+}
+
+void FVehicleSeat::PostReplicatedChange(const FWfVehicleSeats& InArraySerializer)
+{
+	const_cast<FWfVehicleSeats&>(InArraySerializer).OnSeatReplicated(*this, false);
+}
+
+void FVehicleSeat::PreReplicatedRemove(const FWfVehicleSeats& InArraySerializer)
+{
+	const_cast<FWfVehicleSeats&>(InArraySerializer).OnSeatReplicated(*this, true);
+}
+
+FWfVehicleSeats::FWfVehicleSeats()
+{
+	FMemory::Memset(SeatItems, 0xFF);
+}
+
+void FWfVehicleSeats::Init(AWfVehicleBase* InOwner, const int32 NumSeats, TConstArrayView<EWfSeatRole> Roles)
+{
+	Owner = InOwner;
+	OccupiedMask = 0;
+	AllSeatsMask = 0;
+	FMemory::Memzero(RoleMasks);
+	OccupantSeats.Reset();
+	FMemory::Memset(SeatItems, 0xFF);
+
+	const int32 NewNumSeats = FMath::Clamp(NumSeats, 0, MaxSeats);
+	Items.Reset(NewNumSeats);
+	for (int32 SeatNumber = 0; SeatNumber < NewNumSeats; ++SeatNumber)
+	{
+		const EWfSeatRole Role = Roles.IsValidIndex(SeatNumber) ? Roles[SeatNumber] : EWfSeatRole::Crew;
+		Items.Emplace(SeatNumber, Role);
+		SeatItems[SeatNumber] = static_cast<int8>(SeatNumber);
+		AllSeatsMask |= SeatBit(SeatNumber);
+		RoleMasks[static_cast<int32>(Role)] |= SeatBit(SeatNumber);
+	}
+	MarkArrayDirty();
+}
+
+AWfCharacterBase* FWfVehicleSeats::GetOccupant(const int32 SeatNumber) const
+{
+	const FVehicleSeat* Seat = FindItem(SeatNumber);
+	return Seat != nullptr ? Seat->SeatOccupant : nullptr;
+}
+
+EWfSeatRole FWfVehicleSeats::GetRole(const int32 SeatNumber) const
+{
+	const FVehicleSeat* Seat = FindItem(SeatNumber);
+	return Seat != nullptr ? Seat->Role : EWfSeatRole::Num;
+}
+
+void FWfVehicleSeats::GetOccupants(TArray<AWfCharacterBase*>& OutOccupants) const
+{
+	OutOccupants.Reset();
+	for (uint64 Remaining = OccupiedMask; Remaining != 0; Remaining &= Remaining - 1)
+	{
+		if (AWfCharacterBase* Occupant = GetOccupant(FirstSeat(Remaining)))
+			OutOccupants.Add(Occupant);
+	}
+}
+
+int32 FWfVehicleSeats::FindSeatForRole(const EWfSeatRole Role) const
+{
+	int32 SeatNumber = Role < EWfSeatRole::Num ? FindFreeSeat(Role) : INDEX_NONE;
+	if (SeatNumber == INDEX_NONE)
+		SeatNumber = FindFreeSeat(EWfSeatRole::Crew);
+	if (SeatNumber == INDEX_NONE)
+		SeatNumber = FindFreeSeat(EWfSeatRole::Passenger);
+	if (SeatNumber == INDEX_NONE)
+		SeatNumber = FindAnyFreeSeat();
+	return SeatNumber;
+}
+
+int32 FWfVehicleSeats::FindSeat(const AWfCharacterBase* Character) const
+{
+	const int32* SeatNumber = OccupantSeats.Find(Character);
+	return SeatNumber != nullptr ? *SeatNumber : INDEX_NONE;
+}
+
+bool FWfVehicleSeats::SetOccupant(const int32 SeatNumber, AWfCharacterBase* Character)
+{
+	if (!IsValidSeat(SeatNumber))
+		return false;
+
+	FVehicleSeat& Seat = Items[SeatItems[SeatNumber]];
+	if (Seat.SeatOccupant == Character)
+		return true;
+	if (Character != nullptr && IsValid(Seat.SeatOccupant))
+		return false;
+
+	// Moving seats empties the old one first
+	if (Character != nullptr)
+	{
+		const int32 OldSeatNumber = FindSeat(Character);
+		if (OldSeatNumber != INDEX_NONE)
+			SetOccupant(OldSeatNumber, nullptr);
+	}
+
+	AWfCharacterBase* OldOccupant = Seat.SeatOccupant;
+	Seat.SeatOccupant = Character;
+	Seat.LastOccupant = Character;
+	SetOccupiedBit(SeatNumber, Character);
+	if (OldOccupant != nullptr)
+		OccupantSeats.Remove(OldOccupant);
+	MarkItemDirty(Seat);
+
+	if (IsValid(Owner))
+		Owner->OnSeatOccupantChanged.Broadcast(OldOccupant, Character, SeatNumber);
+	return true;
+}
+
+bool FWfVehicleSeats::ClearOccupant(const AWfCharacterBase* Character)
+{
+	const int32 SeatNumber = FindSeat(Character);
+	return SeatNumber != INDEX_NONE && SetOccupant(SeatNumber, nullptr);
+}
+
+/**
+ * \brief Seats can arrive in any order, so each one restores its own bits.
+ *  The delegate only fires when the occupant actually changed.
+ */
+void FWfVehicleSeats::OnSeatReplicated(FVehicleSeat& Seat, const bool bRemoved)
+{
+	const int32 SeatNumber = Seat.SeatNumber;
+	if (SeatNumber < 0 || SeatNumber >= MaxSeats)
+		return;
+
+	AWfCharacterBase* NewOccupant = bRemoved ? nullptr : Seat.SeatOccupant;
+	AWfCharacterBase* OldOccupant = Seat.LastOccupant.Get();
+	if (OldOccupant != nullptr)
+		OccupantSeats.Remove(OldOccupant);
+	SetOccupiedBit(SeatNumber, NewOccupant);
+
+	for (uint64& RoleMask : RoleMasks)
+		RoleMask &= ~SeatBit(SeatNumber);
+	if (bRemoved)
+	{
+		AllSeatsMask &= ~SeatBit(SeatNumber);
+	}
+	else
+	{
+		AllSeatsMask |= SeatBit(SeatNumber);
+		if (Seat.Role < EWfSeatRole::Num)
+			RoleMasks[static_cast<int32>(Seat.Role)] |= SeatBit(SeatNumber);
+	}
+
+	Seat.LastOccupant = NewOccupant;
+	if (!bRemoved)
+		RebuildSeatItems();
+	if (OldOccupant != NewOccupant && IsValid(Owner))
+		Owner->OnSeatOccupantChanged.Broadcast(OldOccupant, NewOccupant, SeatNumber);
+}
+
+void FWfVehicleSeats::PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters)
+{
+	RebuildSeatItems();
+}
+
+const FVehicleSeat* FWfVehicleSeats::FindItem(const int32 SeatNumber) const
+{
+	if (SeatNumber < 0 || SeatNumber >= MaxSeats)
+		return nullptr;
+	const int32 ItemIndex = SeatItems[SeatNumber];
+	return Items.IsValidIndex(ItemIndex) ? &Items[ItemIndex] : nullptr;
+}
+
+void FWfVehicleSeats::RebuildSeatItems()
+{
+	FMemory::Memset(SeatItems, 0xFF);
+	for (int32 ItemIndex = 0; ItemIndex < Items.Num(); ++ItemIndex)
+	{
+		const int32 SeatNumber = Items[ItemIndex].SeatNumber;
+		if (SeatNumber >= 0 && SeatNumber < MaxSeats)
+			SeatItems[SeatNumber] = static_cast<int8>(ItemIndex);
+	}
+}
+
+void FWfVehicleSeats::SetOccupiedBit(const int32 SeatNumber, AWfCharacterBase* Character)
+{
+	if (Character != nullptr)
+	{
+		OccupiedMask |= SeatBit(SeatNumber);
+		OccupantSeats.Add(Character, SeatNumber);
+	}
+	else
+	{
+		OccupiedMask &= ~SeatBit(SeatNumber);
+	}
+}
@@ -13,6 +13,7 @@ public class ProjectWildfire : ModuleRules
 	        "Core",
 	        "CoreUObject",
 	        "Engine",
+	        "NetCore",
 	        "InputCore",
 	        "NavigationSystem",
 	        "AIModule",
@@ -31,7 +32,8 @@ public class ProjectWildfire : ModuleRules
 	        "InputCore",
 	        "GameplayTags",
 	        "OnlineSubsystem",
-	        "OnlineSubsystemUtils"
+	        "OnlineSubsystemUtils",
+	        "Json"
         });
     }
 }
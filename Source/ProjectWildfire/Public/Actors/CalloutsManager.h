@@ -5,12 +5,15 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Engine/DataTable.h"
+#include "Lib/WfIncidentLifecycle.h"
 #include "CalloutsManager.generated.h"
 
+class AWfCalloutActor;
 struct FCalloutData;
 struct FCallouts;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCalloutExpired, const FCalloutData&, CalloutData);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnIncidentStateChanged, const int, IncidentNumber, const EWfIncidentState, NewState);
 
 UCLASS(Blueprintable, BlueprintType)
 class PROJECTWILDFIRE_API ACalloutsManager : public AActor
@@ -29,6 +32,28 @@ public:
 
 	void Multicast_CalloutExpired(const FCalloutData& CalloutData);
 
+	// Dispatches the incident now, rather than when SecondsToRespond runs out
+	UFUNCTION(BlueprintCallable, Category = "Incident Management")
+	void DispatchIncident(const int IncidentNumber);
+
+	// The state of the incident; Closed if there is no such incident
+	UFUNCTION(BlueprintPure, Category = "Incident Management")
+	EWfIncidentState GetIncidentState(const int IncidentNumber) const;
+
+	// The incident numbers of every incident that has not closed or expired
+	UFUNCTION(BlueprintPure, Category = "Incident Management")
+	TArray<int> GetActiveIncidents() const;
+
+	// The actor attached to the incident, if it has one yet
+	UFUNCTION(BlueprintPure, Category = "Incident Management")
+	AWfCalloutActor* GetIncidentActor(const int IncidentNumber) const;
+
+	/**
+	 * \brief Fires a lifecycle event for the incident. Most events are raised by the manager itself
+	 * \return False if the incident does not exist, or the event is not allowed in its current state
+	 */
+	bool TriggerIncident(const int IncidentNumber, const EWfIncidentEvent Event);
+
 
 	UFUNCTION(BlueprintCallable, Server, Reliable)
 	void Server_ForceCallout(const FName& CalloutType);
@@ -49,13 +74,52 @@ public:
 
 	UPROPERTY(BlueprintAssignable) FOnCalloutExpired OnCalloutExpired;
 
+	UPROPERTY(BlueprintAssignable) FOnIncidentStateChanged OnIncidentStateChanged;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Callouts Manager")
 	float SecondsToRespond = 30.0f;
 
+	// A player within this distance of a pre-alerted incident gets its actor attached early
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Callouts Manager")
+	float AttachRadius = 10000.0f;
+
+	// An assigned apparatus within this distance of the incident is on scene
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Callouts Manager")
+	float ArriveRadius = 5000.0f;
+
+	// How long a controlled incident stays open before it closes
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Callouts Manager")
+	float SecondsToClose = 60.0f;
+
 private:
 
 	FCallouts GetCalloutDataRow(const FName& CalloutType) const;
 
+	// Registers the lifecycle's transitions and hooks, and compiles them
+	void BuildLifecycle();
+
+	// Raises the time and distance driven events for every incident, then releases the finished ones
+	void UpdateIncidents();
+
+	bool TriggerIncidentAt(const int32 Index, const EWfIncidentEvent Event);
+
+	// Spawns the incident's actor if it does not have one. Returns true if it has one afterwards.
+	bool AttachCalloutActor(const int32 Index);
+
+	bool IsPlayerNearby(const FVector& Location, const float Radius) const;
+
+	void SpeakPreAlert(const FWfIncidentRecord& Record) const;
+
+	FWfIncidentStateMachine Lifecycle;
+	FWfIncidentPool Incidents;
+	TMap<int32, FWfIncidentHandle> IncidentLookup;
+	TArray<TPair<int32, EWfIncidentEvent>> PendingEvents;
+	TArray<int32> PendingAttachments;
+	int32 NextIncidentNumber = 1;
+
+	FTimerHandle IncidentTimerHandle;
+	float IncidentUpdateSeconds = 1.0f;
+
 	static ACalloutsManager* Instance;
 	FTimerHandle CalloutTimerHandle;
 };
@@ -6,6 +6,16 @@
 #include "Delegates/Delegate.h"
 #include "Engine/DirectionalLight.h"
 #include "Lib/AssignmentsData.h"
+#include "Lib/WfCalloutData.h"
+#include "Lib/WfCrowdLod.h"
+#include "Lib/WfDispatchRecommender.h"
+#include "Lib/WfHydraulics.h"
+#include "Lib/WfInteractionService.h"
+#include "Lib/WfInventory.h"
+#include "Lib/WfNeedsStore.h"
+#include "Lib/WfPatientStore.h"
+#include "Lib/WfUtilityBrain.h"
+#include "Lib/WfVehicleRails.h"
 
 #include "GameManager.generated.h"
 
@@ -91,7 +101,7 @@ public:
 	UFUNCTION(BlueprintPure)
 	TArray<FIncidentAssignments> GetAllIncidentAssignments() const;
 
-    // Incident Actor Destroyed: Delete the associated AssignedIncidents entry
+    // Incident Actor Destroyed: Release the units still on it and delete the associated AssignedIncidents entry
     void RemoveIncidentActor(AWfCalloutActor* IncidentActor);
 
     // Fire Station Added: Update existing AssignedFireStations or create a new one
@@ -149,6 +159,10 @@ public:
 	void AssignFirefighterToFireApparatus(
 		AWfFireApparatusBase* FireApparatus, AWfFfCharacterBase* Firefighter);
 
+	// Seats every crew in one pass, such as at shift change. Firefighters on another apparatus are moved.
+	UFUNCTION(BlueprintCallable, Category = "Apparatus Management")
+	void AssignCrewsToFireApparatus(const TArray<FWfApparatusCrew>& Crews);
+
 	UFUNCTION(BlueprintCallable, Category = "Firefighter Management")
 	void AssignFirefighterToFireStation(
 		AWfFfCharacterBase* Firefighter, AWfFireStationBase* FireStation);
@@ -173,6 +187,66 @@ public:
     void UnassignFirefighterFromApparatus(
     	AWfFireApparatusBase* FireApparatus, AWfFfCharacterBase* Firefighter);
 
+	// Out of service apparatus are never recommended for dispatch
+	UFUNCTION(BlueprintCallable, Category = "Apparatus Management")
+	void SetFireApparatusInService(AWfFireApparatusBase* FireApparatus, const bool bInService = true);
+
+	/**
+	 * \brief Recommends the available, staffed and in service apparatus with the shortest
+	 *  road travel time that satisfy the minimum units of the given incident, quickest first.
+	 * \param IncidentActor The incident needing units
+	 * \param bRequirementsMet True if every minimum unit requirement could be filled
+	 * \return The recommended apparatus, in the order they should be dispatched
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Incident Management")
+	TArray<AWfFireApparatusBase*> RecommendUnitsForIncident(
+		const AWfCalloutActor* IncidentActor, bool& bRequirementsMet);
+
+	const FWfDispatchRecommender& GetDispatchRecommender() const { return DispatchRecommender; }
+
+	// Every patient of every active incident. Server only.
+	FWfPatientStore& GetPatientStore() { return PatientStore; }
+	const FWfPatientStore& GetPatientStore() const { return PatientStore; }
+
+	// Hunger, thirst, fatigue and morale of every character. Server only.
+	FWfNeedsStore& GetNeedsStore() { return NeedsStore; }
+	const FWfNeedsStore& GetNeedsStore() const { return NeedsStore; }
+
+	// Slots, queues and timers of every interactive prop
+	FWfInteractionService& GetInteractions() { return Interactions; }
+	const FWfInteractionService& GetInteractions() const { return Interactions; }
+
+	// Decisions of every AI controlled character. Server only.
+	FWfUtilityBrain& GetUtilityBrain() { return UtilityBrain; }
+	const FWfUtilityBrain& GetUtilityBrain() const { return UtilityBrain; }
+
+	// Level of detail of every character. Server only.
+	FWfCrowdLod& GetCrowdLod() { return CrowdLod; }
+	const FWfCrowdLod& GetCrowdLod() const { return CrowdLod; }
+
+	// Routes and movement mode of every vehicle. Server only.
+	FWfVehicleRails& GetVehicleRails() { return VehicleRails; }
+	const FWfVehicleRails& GetVehicleRails() const { return VehicleRails; }
+
+	// True if the apparatus has every item the task uses in stock. See AWfCalloutActor::GetFireTaskId().
+	UFUNCTION(BlueprintPure, Category = "Apparatus Management")
+	bool CanFireApparatusPerform(const AWfFireApparatusBase* FireApparatus, const int32 TaskId) const;
+
+	/**
+	 * \brief Refills the apparatus from the fire station it is assigned to, as far as the station's stock allows
+	 * \return False if the apparatus has no station, or nothing could be moved
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Apparatus Management")
+	bool RestockFireApparatus(const AWfFireApparatusBase* FireApparatus);
+
+	// Equipment on every apparatus and at every station. Server only.
+	FWfInventory& GetInventory() { return Inventory; }
+	const FWfInventory& GetInventory() const { return Inventory; }
+
+	// Water supply networks of every active incident. Server only.
+	FWfHydraulics& GetHydraulics() { return Hydraulics; }
+	const FWfHydraulics& GetHydraulics() const { return Hydraulics; }
+
 protected:
 
 	void Initialize();
@@ -228,12 +302,106 @@ private:
 
 	void AdjustSunLight();
 
+	// Moves the recommender's copy of each apparatus location and staffing to where the apparatus currently is
+	void RefreshDispatchLocations();
+
+	// Advances every patient by the simulated time since the last step
+	void StepPatients();
+
+	// Advances every character's needs by the simulated time since the last step
+	void StepNeeds();
+
+	// Completes the interactions and expires the reservations that fell due since the last step
+	void StepInteractions();
+
+	// Feeds every AI character's needs, roster and interaction state to the utility brain
+	void RefreshBrainInputs();
+
+	// Runs the utility brain within its budget and hands changed decisions to the controllers
+	void StepBrain();
+
+	// Moves abstract characters along, and changes the level of detail of those players came near or left
+	void UpdateCrowdLod();
+
+	// Places kinematic vehicles along their routes, steers simulated ones, and switches those players came near or left
+	void StepVehicleRails();
+
+	// Fills ObserverLocations with where every player is looking from
+	void CollectObservers();
+
+	// Applies the equipment use queued since the last step
+	void ProcessEquipmentUse();
+
+	// Solves the water supply networks within the budget and moves the water
+	void StepHydraulics();
+
+	// Adds an inventory container for the actor, filled to its loadout
+	void AddInventory(const AActor* Owner, const TMap<TSubclassOf<UEquipmentDataAsset>, float>& Loadout);
+
+	// Staffed while any of the apparatus' crew is on duty
+	void UpdateApparatusStaffed(const FFireApparatusAssignments& ApparatusAssignment);
+
+	// Puts the firefighter in the apparatus' first free seat, leaving the previous apparatus if there was one
+	bool SeatFirefighter(FFireApparatusAssignments& ApparatusAssignment,
+		FFirefighterAssignments& FirefighterAssignment, FFireApparatusAssignments* PreviousAssignment);
+
 	// The last time the server synchronized, in UTC
 	UPROPERTY(ReplicatedUsing=OnRep_SynchronizedTime) FSimDateTime SynchronizedTime;
 	FSimDateTime CurrentSimTime;
 
 	FTimerHandle SimTimerHandle;
 
+	FTimerHandle DispatchTimerHandle;
+
+	FTimerHandle PatientTimerHandle;
+
+	FTimerHandle NeedsTimerHandle;
+
+	FTimerHandle InteractionTimerHandle;
+
+	FTimerHandle BrainInputTimerHandle;
+
+	FTimerHandle BrainTimerHandle;
+
+	FTimerHandle CrowdLodTimerHandle;
+
+	FTimerHandle VehicleRailsTimerHandle;
+
+	FTimerHandle InventoryTimerHandle;
+
+	FTimerHandle HydraulicsTimerHandle;
+
+	// Server only; mirrors AssignedFireApparatuses as availability bitsets
+	FWfDispatchRecommender DispatchRecommender;
+	TArray<FWfDispatchCandidate> DispatchCandidates;
+	TArray<FWfUnitRequirement> DispatchRequirements;
+
+	// Server only; patients are stepped here in one batch rather than by their callouts
+	FWfPatientStore PatientStore;
+
+	// Server only; replaces a repeating timer on every character's ability component
+	FWfNeedsStore NeedsStore;
+
+	// Server and clients; replaces the timer and single interacting actor of every prop
+	FWfInteractionService Interactions;
+
+	// Server only; scores the decisions of every AI controller in budgeted slices
+	FWfUtilityBrain UtilityBrain;
+
+	// Server only; characters far from every player are simulated here instead of by their pawns
+	FWfCrowdLod CrowdLod;
+
+	// Server only; vehicles far from every player drive their routes here instead of in physics
+	FWfVehicleRails VehicleRails;
+
+	TArray<FVector> ObserverLocations;
+
+	// Server only; one container per apparatus and station
+	FWfInventory Inventory;
+
+	// Server only; one network per incident with hose laid
+	FWfHydraulics Hydraulics;
+
 	UPROPERTY() ADirectionalLight* DirectionalLight;
 
 	// The singleton instance
@@ -241,6 +409,18 @@ private:
 
 	float SyncSeconds = 10.0f;
 	float MaxSimRate  = 3600.0f;
+	float DispatchRefreshSeconds = 1.0f;
+	float PatientStepSeconds = 1.0f;
+	float NeedsStepSeconds = 0.5f;
+	float InteractionStepSeconds = 0.1f;
+	float BrainInputSeconds = 1.0f;
+	float BrainStepSeconds = 0.1f;
+	double BrainBudgetSeconds = 0.0005;
+	float CrowdLodStepSeconds = 0.25f;
+	float VehicleRailsStepSeconds = 0.1f;
+	float InventoryStepSeconds = 1.0f;
+	float HydraulicsStepSeconds = 0.25f;
+	double HydraulicsBudgetSeconds = 0.001;
 
 	UPROPERTY(ReplicatedUsing=OnRep_AssignedFireApparatuses) TArray<FFireApparatusAssignments> AssignedFireApparatuses;
 	UPROPERTY(ReplicatedUsing=OnRep_AssignedFirePersonnel) TArray<FFirefighterAssignments>   AssignedFirePersonnel;
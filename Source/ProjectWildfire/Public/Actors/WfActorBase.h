@@ -8,12 +8,17 @@
 #include "GameplayTagContainer.h"
 #include "Components/BoxComponent.h"
 #include "GameFramework/Actor.h"
+#include "Gas/WfInteractionEffects.h"
 #include "Statics/WfGlobalEnums.h"
 #include "WfActorBase.generated.h"
 
+class AGameManager;
 class AWfCharacterBase;
+class FWfInteractionService;
 class UArrowComponent;
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnInteractionSlotGranted, AWfActorBase*, Prop, AActor*, InteractiveActor);
+
 UCLASS(Blueprintable, BlueprintType)
 class PROJECTWILDFIRE_API AWfActorBase : public AActor
 {
@@ -37,21 +42,49 @@ public:
 	UFUNCTION(BlueprintCallable)
 	float StartInteraction(AActor* InteractiveActor);
 
+	// Stops the actor's interaction, or everyone's if no actor is given
+	UFUNCTION(BlueprintCallable)
+	void StopInteraction(AActor* InteractiveActor = nullptr);
+
+	// Reserves a slot, or queues for the next free one. True if a slot was reserved now; otherwise OnSlotGranted follows.
+	UFUNCTION(BlueprintCallable)
+	bool ReserveInteraction(AActor* InteractiveActor);
+
+	// Reserves a slot on the closest prop of the class that has one free near the actor. Returns the prop, or nullptr.
+	UFUNCTION(BlueprintCallable, meta = (DefaultToSelf = "InteractiveActor"))
+	static AWfActorBase* ClaimNearestInteraction(AActor* InteractiveActor, TSubclassOf<AWfActorBase> PropClass);
+
+	// Called by the interaction service once SecondsToComplete has passed
+	void CompleteInteraction(AActor* InteractiveActor);
+
+	// Called by the interaction service when a queued actor is given a slot
+	void NotifySlotGranted(AActor* InteractiveActor);
+
+	// Rebuilds the effect bundles after the effect arrays were changed at runtime
 	UFUNCTION(BlueprintCallable)
-	void StopInteraction();
+	void RefreshInteractionEffects();
 
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 private:
 
-	UFUNCTION()
-	void DoInteraction();
+	FWfInteractionService* GetInteractions() const;
+
+	// Keeps the interaction service's copy of a movable prop's location current
+	void OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
 
-	void RemoveEffects(UAbilitySystemComponent* AbilityComponent, TArray<TSubclassOf<UGameplayEffect>> EffectsArray);
+	void ExecuteEffects(UAbilitySystemComponent* AbilityComponent, const EWfInteractionPhase Phase);
 
-	void AddEffects(UAbilitySystemComponent* AbilityComponent, TArray<TSubclassOf<UGameplayEffect>> EffectsArray);
+	// Shared with every other instance of the class unless this one's effect arrays were edited
+	TSharedPtr<const FWfInteractionEffects> InteractionEffects;
+
+	TWeakObjectPtr<AGameManager> InteractionManager;
+	int32 PropId = INDEX_NONE;
+	FDelegateHandle TransformUpdatedHandle;
 
 public:
 
@@ -65,6 +98,10 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Actor Settings")
 	float CooldownTime;
 
+	// How many actors can interact at once
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Actor Settings", meta = (ClampMin = "1", ClampMax = "32"))
+	int32 NumSlots;
+
 	// Which roles can interact with this actor. If none, the actor will never be used.
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Actor Settings")
 	FGameplayTagContainer RolesAllowed;
@@ -119,10 +156,6 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Actor Settings")
 	TArray< TSubclassOf<UGameplayEffect> > EffectsRemovedOnStop;
 
-protected:
-
-	FTimerHandle TimerInteraction;
-
-	UPROPERTY() AWfCharacterBase* ActorInteracting;
+	UPROPERTY(BlueprintAssignable) FOnInteractionSlotGranted OnSlotGranted;
 
 };
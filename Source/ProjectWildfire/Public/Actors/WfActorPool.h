@@ -0,0 +1,94 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+
+#include "WfActorPool.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogActorPool, Log, All);
+
+
+/**
+ * \brief Keeps transient actors (callouts, and anything else incidents spawn in numbers) alive
+ *  between uses. A released actor is hidden, stops ticking and colliding, and goes dormant rather
+ *  than being destroyed, so clients keep their copy and the next acquire only has to wake it.
+ *  Actors implementing IWfPoolableInterface are told when they are handed out and taken back.
+ */
+UCLASS(BlueprintType)
+class PROJECTWILDFIRE_API AWfActorPool : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	AWfActorPool();
+
+	UFUNCTION(BlueprintCallable, Category = "Actor Pool Singleton", meta = (WorldContext = "WorldContextObject"))
+	static AWfActorPool* GetInstance(UObject* WorldContext);
+
+	/**
+	 * \brief Hands out a free actor of the class moved to the transform, spawning one if none are free
+	 * \return The actor, or nullptr if it could not be spawned
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Actor Pool")
+	AActor* AcquireActor(TSubclassOf<AActor> ActorClass, const FTransform& Transform, AActor* NewOwner = nullptr);
+
+	template <typename ActorType>
+	ActorType* Acquire(TSubclassOf<ActorType> ActorClass, const FTransform& Transform, AActor* NewOwner = nullptr)
+	{
+		return Cast<ActorType>(AcquireActor(ActorClass, Transform, NewOwner));
+	}
+
+	// Takes the actor back for reuse. Destroys it instead if its class already has MaxFreePerClass waiting.
+	UFUNCTION(BlueprintCallable, Category = "Actor Pool")
+	void ReleaseActor(AActor* Actor);
+
+	// Spawns actors of the class until that many are free, so the first incidents don't pay for spawning
+	UFUNCTION(BlueprintCallable, Category = "Actor Pool")
+	void Prewarm(TSubclassOf<AActor> ActorClass, const int32 NumFree);
+
+	// Fraction of acquires of the class served from the pool, from 0 to 1
+	UFUNCTION(BlueprintPure, Category = "Actor Pool")
+	float GetHitRate(TSubclassOf<AActor> ActorClass) const;
+
+	UFUNCTION(BlueprintPure, Category = "Actor Pool")
+	int32 GetNumFree(TSubclassOf<AActor> ActorClass) const;
+
+	// Writes the size and hit rate of every class's pool to the log
+	void LogStats() const;
+
+protected:
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+public:
+
+	// Most actors of one class kept waiting; releases beyond this are destroyed
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Pool")
+	int32 MaxFreePerClass = 64;
+
+private:
+
+	AActor* SpawnPooledActor(UClass* ActorClass, const FTransform& Transform, AActor* NewOwner);
+
+	static void Deactivate(AActor* Actor);
+	static void Activate(AActor* Actor, const FTransform& Transform, AActor* NewOwner);
+
+	struct FClassPool
+	{
+		TArray<TWeakObjectPtr<AActor>> Free;
+		int32 NumSpawned = 0;
+		int32 NumAcquired = 0;
+		int32 NumHits = 0;
+		int32 NumReleased = 0;
+		int32 NumDestroyed = 0;
+	};
+
+	TMap<const UClass*, FClassPool> Pools;
+
+	static AWfActorPool* Instance;
+};
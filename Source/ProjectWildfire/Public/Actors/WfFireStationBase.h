@@ -6,6 +6,7 @@
 #include "Components/ArrowComponent.h"
 #include "Components/BoxComponent.h"
 #include "GameFramework/Actor.h"
+#include "Lib/WfEquipmentData.h"
 #include "WfFireStationBase.generated.h"
 
 class AWfPlayerStateBase;
@@ -82,6 +83,10 @@ public:
 		VisibleAnywhere, BlueprintReadWrite, Category = "Fire Station Settings")
 	int FireStationNumber;
 
+	// Equipment stored at this station for restocking its apparatus, and the most of each it can hold
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Fire Station Settings")
+	TMap<TSubclassOf<UEquipmentDataAsset>, float> EquipmentLoadout;
+
 	UPROPERTY(BlueprintAssignable) FOnFireStationNumberChanged OnFireStationNumberChanged;
 	UPROPERTY(BlueprintAssignable) FOnFireStationNameChanged OnFireStationNameChanged;
 
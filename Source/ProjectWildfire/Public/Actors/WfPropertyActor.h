@@ -26,14 +26,30 @@ public:
 	UFUNCTION(BlueprintPure) FString GetStreetAddressAsString() const;
 	UFUNCTION(BlueprintPure) FString GetStreetAddressForVox() const;
 
+	// Replaces the address and invalidates the cached display and vox forms
+	void SetStreetAddress(const FStreetAddress& NewAddress);
+
+	// Cached forms of the address, built on first use after the address changes
+	const FString& GetCachedAddressString() const;
+	const FString& GetCachedAddressForVox() const;
+	const TArray<FName>& GetStreetAddressVoxTokens() const;
+
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void OnConstruction(const FTransform& Transform) override;
 
 	virtual void DetermineAddress();
 
+private:
+
+	void UpdateAddressCache() const;
+
+	void OnPropertyMoved(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateFlags, ETeleportType Teleport);
+
 public:
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
@@ -47,4 +63,14 @@ public:
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Real Estate")
 	FStreetAddress PropertyAddress;
+
+private:
+
+	mutable FString CachedAddressString;
+	mutable FString CachedAddressForVox;
+	mutable TArray<FName> CachedVoxTokens;
+	mutable bool bAddressCacheValid = false;
+
+	// Where the address was last determined; small nudges don't re-geocode the property
+	FVector AddressLocation = FVector::ZeroVector;
 };
@@ -0,0 +1,213 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Landscapes/WfCoverageRaster.h"
+#include "Landscapes/WfRoadGraph.h"
+#include "Landscapes/WfTrafficSim.h"
+#include "Lib/WfAddressIndex.h"
+
+#include "WfRoadManager.generated.h"
+
+class AWfFireStationBase;
+class AWfPropertyActor;
+class AWfRoadSplineBase;
+class UInstancedStaticMeshComponent;
+class UStaticMesh;
+struct FStreetAddress;
+
+
+/**
+ * \brief Owns the road graph built from every AWfRoadSplineBase in the world, and answers
+ *  travel time and route queries for dispatch and AI driving. Also owns the street index,
+ *  which assigns property addresses from the nearest road and finds properties by address,
+ *  and the civilian traffic driving the roads (see FWfTrafficSim). Traffic is cosmetic and local:
+ *  every client runs its own, which is not kept in step with anyone else's, and only draws the cars
+ *  near its local players. A dedicated server runs none.
+ */
+UCLASS(BlueprintType)
+class PROJECTWILDFIRE_API AWfRoadManager : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	AWfRoadManager();
+
+	UFUNCTION(BlueprintCallable, Category = "Road Manager Singleton", meta = (WorldContext = "WorldContextObject"))
+	static AWfRoadManager* GetInstance(UObject* WorldContext);
+
+	// Adds the road to the graph. The graph is rebuilt once on the next tick, however many roads register.
+	void RegisterRoad(AWfRoadSplineBase* Road);
+
+	void UnregisterRoad(AWfRoadSplineBase* Road);
+
+	// Closes or reopens the road, invalidating only the cached station routes that used it
+	void SetRoadClosed(const AWfRoadSplineBase* Road, const bool bClosed);
+
+	/**
+	 * \brief Estimated driving time between two world locations, including the drive to and from the road
+	 * \return The time in seconds, or -1 if there is no open route
+	 */
+	UFUNCTION(BlueprintPure, Category = "Road Manager")
+	float GetTravelTime(const FVector& FromLocation, const FVector& ToLocation) const;
+
+	/**
+	 * \brief Estimated driving time from the fire station to the location, from the station's cached routes
+	 * \return The time in seconds, or -1 if there is no open route
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Road Manager")
+	float GetStationTravelTime(const AWfFireStationBase* FireStation, const FVector& ToLocation);
+
+	// Returns the route as world locations, starting and ending on the road nearest each location
+	UFUNCTION(BlueprintCallable, Category = "Road Manager")
+	bool FindRoute(const FVector& FromLocation, const FVector& ToLocation, TArray<FVector>& OutRoute) const;
+
+	/**
+	 * \brief Builds the street address of a location from the nearest road.
+	 *  Houses are numbered by distance along the road, 100 per block, odd on one side and even on the other.
+	 * \return False if there is no road network
+	 */
+	bool GeocodeLocation(const FVector& Location, FStreetAddress& OutAddress) const;
+
+	// Adds the property to the street index, assigning its address once the road graph is built
+	void RegisterProperty(AWfPropertyActor* Property);
+
+	void UnregisterProperty(AWfPropertyActor* Property);
+
+	// Re-geocodes a property that moved, and updates its entry in the street index
+	void UpdateProperty(AWfPropertyActor* Property);
+
+	// Finds the property at the address, ignoring case and punctuation ("123 first st" matches "123 First St.")
+	UFUNCTION(BlueprintPure, Category = "Road Manager")
+	AWfPropertyActor* FindPropertyByAddress(const FString& Address) const;
+
+	// Properties whose address starts with the search text, in address order
+	UFUNCTION(BlueprintCallable, Category = "Road Manager")
+	TArray<AWfPropertyActor*> SearchAddresses(const FString& SearchText, const int32 MaxResults = 10) const;
+
+	/**
+	 * \brief Driving time to the location from the nearest staffed fire station, from the coverage raster
+	 * \param ApparatusType The apparatus identity type ("Engine", "Medic", ...), or None for any apparatus
+	 * \return The time in seconds, or -1 if no staffed station covers the location
+	 */
+	UFUNCTION(BlueprintPure, Category = "Road Manager")
+	float GetCoverageTime(const FVector& Location, const FName ApparatusType = NAME_None) const;
+
+	const FWfRoadGraph& GetRoadGraph() const { return RoadGraph; }
+
+	const FWfCoverageRaster& GetCoverageRaster() const { return CoverageRaster; }
+
+	const FWfTrafficSim& GetTraffic() const { return Traffic; }
+
+	// Places the instances of the cars near the local players between traffic steps
+	virtual void Tick(float DeltaSeconds) override;
+
+	// Index of the road in the graph, used by the graph to identify the road's edges
+	int32 GetRoadIndex(const AWfRoadSplineBase* Road) const { return Roads.IndexOfByKey(Road); }
+
+	AWfRoadSplineBase* GetRoad(const int32 RoadIndex) const { return Roads.IsValidIndex(RoadIndex) ? Roads[RoadIndex] : nullptr; }
+
+protected:
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	void RequestRebuild();
+
+	void RebuildRoadGraph();
+
+	int32 FindOrAddStationSource(const AWfFireStationBase* FireStation);
+
+	// Detects stations whose staffed apparatus, location or routes changed, and queues them for the raster
+	void RefreshCoverage();
+
+	// Time to cover the distance between a location and the road, in seconds
+	float GetOffRoadTime(const FVector& Location, const int32 NodeIndex) const;
+
+	// Moves the traffic on, yielding to every apparatus that is responding
+	void StepTraffic();
+
+public:
+
+	// Length of a block along a road, in centimeters. Each block holds house numbers 0-99.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Manager")
+	float BlockLength = 10000.0f;
+
+	// Speed used between a location and its nearest road node (driveways, parking lots, fields)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Manager")
+	float OffRoadSpeedKph = 15.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Manager")
+	int32 NumLandmarks = 8;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Manager")
+	float CoverageCellSize = 5000.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Manager")
+	float CoverageRefreshSeconds = 1.0f;
+
+	// Civilian cars spread over the roads whenever the road graph is built
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Traffic")
+	int32 NumTrafficCars = 2000;
+
+	// Where each client's cars start out; traffic is local to each client, so nothing depends on it matching
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Traffic")
+	int32 TrafficSeed = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Traffic")
+	float TrafficStepSeconds = 0.1f;
+
+	// Cars further than this from every local player are not drawn
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Traffic")
+	float TrafficDrawRadius = 20000.0f;
+
+	// Cars are drawn with these meshes in turn. No meshes, no cars drawn.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Traffic")
+	TArray<TObjectPtr<UStaticMesh>> TrafficCarMeshes;
+
+private:
+
+	static AWfRoadManager* Instance;
+
+	FWfRoadGraph RoadGraph;
+
+	// Indices are stable; unregistered roads leave a null entry until the next rebuild
+	UPROPERTY() TArray<AWfRoadSplineBase*> Roads;
+
+	TMap<const AWfFireStationBase*, int32> StationSources;
+
+	struct FStationCoverage
+	{
+		uint32 LayerMask = 0;
+		uint32 SourceVersion = 0;
+		FVector Location = FVector::ZeroVector;
+	};
+
+	FWfCoverageRaster CoverageRaster;
+	TMap<const AWfFireStationBase*, FStationCoverage> CoverageStations;
+	FTimerHandle CoverageTimerHandle;
+
+	UPROPERTY() TArray<AWfPropertyActor*> Properties;
+
+	FWfAddressIndex AddressIndex;
+
+	FTimerHandle RebuildTimerHandle;
+
+	FWfTrafficSim Traffic;
+	FTimerHandle TrafficTimerHandle;
+	double LastTrafficStepTime = 0.0;
+
+	// One per traffic car mesh, with an instance per car drawn
+	UPROPERTY() TArray<UInstancedStaticMeshComponent*> TrafficProxies;
+
+	// Reused every tick
+	TArray<FVector> TrafficObservers;
+	TArray<int32> VisibleCars;
+	TArray<TArray<FTransform>> ProxyTransforms;
+};
@@ -7,17 +7,21 @@
 #include "Delegates/Delegate.h"
 #include "GameFramework/Character.h"
 #include "Interfaces/WfClickableInterface.h"
+#include "Lib/WfCrowdLod.h"
 
 #include "WfCharacterBase.generated.h"
 
+class AGameManager;
 class UWfAttributeSet;
 class UWfAbilityComponent;
 class USaveGame;
+enum class EVisibilityBasedAnimTickOption : uint8;
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterGenderSet, const FGameplayTag&, NewGender);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterAgeSet,		const int8,			 NewAge);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterRaceSet,	const FGameplayTag&, NewRace);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterRoleSet,	const FGameplayTag&, NewRole);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCharacterNameSet,	const FString&,		 NewName);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnLodLevelChanged, const EWfLodLevel, OldLevel, const EWfLodLevel, NewLevel);
 
 
 UCLASS(BlueprintType, Blueprintable)
@@ -78,11 +82,25 @@ public:
 
 	virtual void NewCharacter(const FGameplayTag& NewPrimaryRole);
 
+	UFUNCTION(BlueprintPure, Category = "Level Of Detail")
+	EWfLodLevel GetLodLevel() const { return LodLevel; }
+
+	// Called by the game manager for the crowd LOD's transitions. Server only.
+	void SetLodLevel(const EWfLodLevel NewLevel);
+
+	// Hands the controller's current move to the crowd LOD while Abstract; see AWfAiControllerBase::MoveTo
+	void BeginAbstractTravel();
+
+	// Places the character at the end of its abstract route and lets its move complete
+	void FinishAbstractTravel();
+
 
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void GetLifetimeReplicatedProps(
 		TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
@@ -112,6 +130,16 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character Data")
 	FGameplayTagContainer PossibleRoles;
 
+	UPROPERTY(BlueprintAssignable) FOnLodLevelChanged OnLodLevelChanged;
+
+	// Seconds between ticks of the character and its movement while Reduced
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Level Of Detail")
+	float ReducedTickInterval;
+
+	// Replication rate while Abstract. Abstract pawns are also net dormant, so this only paces the flushes.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Level Of Detail")
+	float AbstractNetUpdateFrequency;
+
 private:
 
 	UPROPERTY(ReplicatedUsing = OnRep_NameFirst)		FString NameFirst;
@@ -124,4 +152,18 @@ private:
 
 	UPROPERTY() UWfAttributeSet* CharacterAttributes;
 
+	// Moves the character to where the crowd LOD has it
+	void TeleportToLodLocation();
+
+	EWfLodLevel LodLevel;
+
+	// Full detail settings, restored on rehydration
+	float DefaultTickInterval;
+	float DefaultNetUpdateFrequency;
+	EVisibilityBasedAnimTickOption DefaultAnimTickOption;
+
+	// Where this character's level of detail is decided, and its id there
+	TWeakObjectPtr<AGameManager> LodManager;
+	int32 LodId = INDEX_NONE;
+
 };
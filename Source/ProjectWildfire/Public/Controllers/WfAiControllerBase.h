@@ -4,8 +4,13 @@
 
 #include "CoreMinimal.h"
 #include "AIController.h"
+#include "Lib/WfUtilityBrain.h"
 #include "WfAiControllerBase.generated.h"
 
+class AGameManager;
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnDecisionChanged, const EWfUtilityAction, OldAction, const EWfUtilityAction, NewAction);
+
 UCLASS()
 class PROJECTWILDFIRE_API AWfAiControllerBase : public AAIController
 {
@@ -15,11 +20,55 @@ public:
 
 	AWfAiControllerBase();
 
+	// What the utility brain last decided the pawn should do
+	UFUNCTION(BlueprintPure)
+	EWfUtilityAction GetDecision() const { return Decision; }
+
+	// Asks the brain for a new decision on its next update, such as after finishing the current action
+	UFUNCTION(BlueprintCallable)
+	void RequestDecision();
+
+	// Called by the game manager when the brain changes its mind
+	void SetDecision(const EWfUtilityAction NewDecision);
+
+	// Hands moves made while the pawn is Abstract to the crowd LOD instead of the movement component
+	virtual FPathFollowingRequestResult MoveTo(const FAIMoveRequest& MoveRequest, FNavPathSharedPtr* OutPath = nullptr) override;
+
+	/**
+	 * \brief Pauses the move in progress, keeping its request alive for ResumeSuspendedMove()
+	 * \param OutRoute The pawn's location followed by the path points still ahead, at the pawn's height
+	 * \return False if the pawn was not following a path
+	 */
+	bool SuspendMove(TArray<FVector>& OutRoute);
+
+	void ResumeSuspendedMove();
+
+	UPROPERTY(BlueprintAssignable) FOnDecisionChanged OnDecisionChanged;
+
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Server only. Registers the pawn with the game manager's utility brain.
+	virtual void OnPossess(APawn* InPawn) override;
+
+	virtual void OnUnPossess() override;
+
 public:
 
 	virtual void Tick(float DeltaTime) override;
+
+private:
+
+	void RemoveFromBrain();
+
+	EWfUtilityAction Decision = EWfUtilityAction::Idle;
+
+	FAIRequestID SuspendedMoveId = FAIRequestID::InvalidRequest;
+
+	// Where this pawn's decisions are made, and its id there
+	TWeakObjectPtr<AGameManager> BrainManager;
+	int32 AgentId = INDEX_NONE;
 };
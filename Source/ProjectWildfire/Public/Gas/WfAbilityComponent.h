@@ -4,14 +4,43 @@
 
 #include "CoreMinimal.h"
 #include "AbilitySystemComponent.h"
+#include "Containers/StaticArray.h"
 #include "Delegates/Delegate.h"
+#include "Gas/WfAttributeSet.h"
 
 #include "WfAbilityComponent.generated.h"
 
+USTRUCT(BlueprintType)
+struct PROJECTWILDFIRE_API FWfAttributeChange
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly) FGameplayAttribute Attribute;
+	UPROPERTY(BlueprintReadOnly) float OldValue = 0.0f;
+	UPROPERTY(BlueprintReadOnly) float NewValue = 0.0f;
+};
+
+// Every attribute of one character that changed in a frame, from its value before the first change to its value after the last
+USTRUCT(BlueprintType)
+struct PROJECTWILDFIRE_API FWfAttributeChanges
+{
+	GENERATED_BODY()
+
+	// One bit per changed attribute, see UWfAbilityComponent::GetAttributeMask()
+	UPROPERTY(BlueprintReadOnly) int32 ChangedMask = 0;
+
+	UPROPERTY(BlueprintReadOnly) TArray<FWfAttributeChange> Changes;
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnAttributeChanged,
 	const FGameplayAttribute&, GameAttribute, const float, OldValue,   const float, NewValue );
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnAttributesChanged, const FWfAttributeChanges&, AttributeChanges);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnAttributesChangedEvent, const FWfAttributeChanges&, AttributeChanges);
+DECLARE_DELEGATE_OneParam(FOnAttributesChangedNative, const FWfAttributeChanges&);
 
+
+class AGameManager;
 class UWfAttributeSet;
 
 UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent), BlueprintType)
@@ -23,16 +52,43 @@ public:
 
 	UWfAbilityComponent();
 
+	// Server only. Registers the attributes with the game manager's needs store, which advances them from then on.
 	void InitializeAttributes(UWfAttributeSet* AttributeSet);
 
-	virtual void TimerTick();
-
+	// Sets the interval the reduction rates are given per, and passes the new rates on to the needs store
 	void SetNewTimerRate(const float NewTimeRate = 1.0f);
 
+	// Passes the reduction rates on to the needs store; call after changing them at runtime
+	UFUNCTION(BlueprintCallable)
+	void UpdateNeedRates();
+
+	// This character's id in the needs store, or INDEX_NONE if its needs are not simulated
+	int32 GetNeedsId() const { return NeedsId; }
+
+	/**
+	 * \brief Calls the delegate once per frame in which any attribute in the mask changed
+	 * \param AttributeMask Bits of the attributes to listen for; see WfAttributeBit() and GetAttributeMask()
+	 * \return Handle for UnsubscribeFromAttributes()
+	 */
+	FDelegateHandle SubscribeToAttributes(const uint32 AttributeMask, FOnAttributesChangedNative&& Delegate);
+	void UnsubscribeFromAttributes(const FDelegateHandle Handle);
+
+	UFUNCTION(BlueprintCallable, DisplayName = "Subscribe To Attributes")
+	void K2_SubscribeToAttributes(const int32 AttributeMask, FOnAttributesChangedEvent Event);
+
+	UFUNCTION(BlueprintCallable, DisplayName = "Unsubscribe From Attributes")
+	void K2_UnsubscribeFromAttributes(FOnAttributesChangedEvent Event);
+
+	// The attribute's bit for an attribute mask; 0 if it is not a character attribute
+	UFUNCTION(BlueprintPure)
+	static int32 GetAttributeMask(const FGameplayAttribute& GameAttribute);
+
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void GetLifetimeReplicatedProps(
 		TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
@@ -51,24 +107,49 @@ protected:
 
 public:
 
+	// Collects the change for the end of the frame, rather than passing it on straight away
 	UFUNCTION()
 	void AttributeUpdated(const FGameplayAttribute& GameAttribute,
 						  const float OldValue, const float NewValue);
 
+	// Once per changed attribute per frame, with its value before the frame's first change
 	UPROPERTY(BlueprintAssignable) FOnAttributeChanged OnAttributeChanged;
 
+	// Once per frame in which any attribute changed
+	UPROPERTY(BlueprintAssignable) FOnAttributesChanged OnAttributesChanged;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float StatReduction;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float ReductionFatigue;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float ReductionMorale;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float ReductionThirst;
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float ReductionHunger;
 
+	// Seconds the reductions above are given per
 	UPROPERTY(BlueprintReadWrite, EditAnywhere) float AttributeTimeRate;
 
 private:
 
-	FTimerHandle AttributeTimer;
+	// Delivers the changes collected since the last flush to every listener
+	void FlushAttributeChanges();
 
 	UPROPERTY() UWfAttributeSet* CharacterAttributes;
 
+	struct FAttributeSubscriber
+	{
+		uint32 AttributeMask;
+		FDelegateHandle Handle;
+		FOnAttributesChangedNative Native;
+		FOnAttributesChangedEvent Event;
+	};
+	TArray<FAttributeSubscriber> AttributeSubscribers;
+
+	// Attributes changed since the last flush, with their values before the first change and after the last
+	uint32 DirtyMask = 0;
+	TStaticArray<float, static_cast<int32>(EWfAttribute::Num)> DirtyOldValues;
+	TStaticArray<float, static_cast<int32>(EWfAttribute::Num)> DirtyNewValues;
+
+	// Where this character's needs are simulated, and its id there
+	TWeakObjectPtr<AGameManager> NeedsManager;
+	int32 NeedsId = INDEX_NONE;
+
 };
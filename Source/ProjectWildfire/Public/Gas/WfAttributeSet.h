@@ -15,6 +15,39 @@
 	GAMEPLAYATTRIBUTE_VALUE_SETTER(PropertyName) \
 	GAMEPLAYATTRIBUTE_VALUE_INITTER(PropertyName)
 
+// Every attribute of UWfAttributeSet, in index order. Adding one here adds it to EWfAttribute and the index table.
+#define WF_ATTRIBUTE_LIST(Op) \
+	Op(Health) \
+	Op(Fatigue) \
+	Op(Morale) \
+	Op(Thirst) \
+	Op(Hunger)
+
+enum class EWfAttribute : uint8
+{
+#define WF_ATTRIBUTE_ENUM(PropertyName) PropertyName,
+	WF_ATTRIBUTE_LIST(WF_ATTRIBUTE_ENUM)
+#undef WF_ATTRIBUTE_ENUM
+	Num
+};
+static_assert(static_cast<int32>(EWfAttribute::Num) <= 32, "Attribute masks are 32 bits");
+
+// The attribute's bit in an attribute mask
+constexpr uint32 WfAttributeBit(const EWfAttribute Attribute)
+{
+	return 1u << static_cast<uint32>(Attribute);
+}
+
+class UWfAttributeSet;
+
+// One change for UWfAttributeSet::ApplyAttributeDeltas()
+struct PROJECTWILDFIRE_API FWfAttributeDelta
+{
+	UWfAttributeSet* AttributeSet = nullptr;
+	EWfAttribute Attribute = EWfAttribute::Num;
+	float Delta = 0.0f;
+};
+
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnAttributeUpdated,
 	const FGameplayAttribute&, GameAttribute, const float, OldValue,   const float, NewValue );
 
@@ -50,6 +83,20 @@ public:
 	float ModifyAttributePercent(const FGameplayAttribute&  GameAttribute, float PercentChange);
 	float GetAttributeValue(const FGameplayAttribute&  GameAttribute) const;
 
+	// Resolves a gameplay attribute to its index once, so the calls below skip the lookup. EWfAttribute::Num if it is not in this set.
+	static EWfAttribute FindAttribute(const FGameplayAttribute& GameAttribute);
+	static FGameplayAttribute GetAttribute(const EWfAttribute Attribute);
+
+	bool SetAttributeValue(const EWfAttribute Attribute, float NewValue);
+	float GetAttributeValue(const EWfAttribute Attribute) const;
+
+	/**
+	 * \brief Applies any number of deltas to any number of attribute sets in one call.
+	 *  Each is clamped, set and broadcast on OnAttributeUpdated exactly as SetAttributeValue() would.
+	 * \return The number of attributes that changed
+	 */
+	static int32 ApplyAttributeDeltas(TConstArrayView<FWfAttributeDelta> Deltas);
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, ReplicatedUsing=OnRep_Health, Category = "Attributes")
 	FGameplayAttributeData Health;
 	ATTRIBUTE_ACCESSORS(UWfAttributeSet, Health)
@@ -94,6 +141,11 @@ protected:
 	virtual void GetLifetimeReplicatedProps(
 		TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
+	virtual bool PreGameplayEffectExecute(FGameplayEffectModCallbackData& Data) override;
+
+	// Gameplay effects write the attribute directly, so this clamps and broadcasts it as SetAttributeValue() would
+	virtual void PostGameplayEffectExecute(const FGameplayEffectModCallbackData& Data) override;
+
 	UFUNCTION()
 	virtual void OnRep_Health(const FGameplayAttributeData& OldHealth);
 
@@ -109,4 +161,9 @@ protected:
 	UFUNCTION()
 	virtual void OnRep_Hunger(const FGameplayAttributeData& OldHunger);
 
+private:
+
+	// The executing effect's attribute value before it was applied
+	float PreEffectValue = 0.0f;
+
 };
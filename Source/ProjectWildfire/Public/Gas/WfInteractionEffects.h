@@ -0,0 +1,62 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameplayEffect.h"
+
+class AWfActorBase;
+class UAbilitySystemComponent;
+
+
+// When an interactive actor applies and removes its effects
+enum class EWfInteractionPhase : uint8
+{
+	Start = 0,
+	Success,
+	Failure,
+	Stop,
+	Num
+};
+
+// The effects of one interaction phase, resolved ahead of time
+struct PROJECTWILDFIRE_API FWfEffectBundle
+{
+	// Applies every spec to the component as one aggregator batch, then removes the whole remove set in one query
+	void Execute(UAbilitySystemComponent* AbilityComponent) const;
+
+	bool IsEmpty() const { return Specs.IsEmpty() && Removed.IsEmpty(); }
+
+	// Built without a context; the instigator's context is set on each copy when applied
+	TArray<FGameplayEffectSpec> Specs;
+
+	TArray<TSubclassOf<UGameplayEffect>> Removed;
+
+	// Matches an active effect of any class in Removed
+	FGameplayEffectQuery RemoveQuery;
+};
+
+
+/**
+ * \brief The effect bundles of every interaction phase of an interactive actor.
+ *  Built once per actor class from its class defaults and shared by every instance of the class.
+ *  Placed instances whose effect arrays were edited away from the defaults get a bundle of their own.
+ */
+struct PROJECTWILDFIRE_API FWfInteractionEffects
+{
+	// The shared bundles of the actor's class, or its own if the actor's effect arrays differ from the defaults
+	static TSharedRef<const FWfInteractionEffects> FindOrBuild(const AWfActorBase* Actor);
+
+	static TSharedRef<const FWfInteractionEffects> Build(const AWfActorBase* Actor);
+
+	// Drops every cached class bundle, so the next lookup rebuilds them. Done on every world cleanup and Blueprint reinstance.
+	static void ResetCache();
+
+	const FWfEffectBundle& Get(const EWfInteractionPhase Phase) const { return Phases[static_cast<int32>(Phase)]; }
+
+	FWfEffectBundle Phases[static_cast<int32>(EWfInteractionPhase::Num)];
+
+private:
+
+	static TSharedRef<FWfInteractionEffects> BuildMutable(const AWfActorBase* Actor);
+};
@@ -0,0 +1,35 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "WfPoolableInterface.generated.h"
+
+// This class does not need to be modified.
+UINTERFACE()
+class UWfPoolableInterface : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * \interface IWfPoolableInterface
+ *
+ * \brief Implemented by actors that AWfActorPool reuses instead of destroying.
+ * A pooled actor does not begin play again when it is reused, so anything BeginPlay or
+ * EndPlay would normally set up or tear down has to be done in these instead.
+ */
+class PROJECTWILDFIRE_API IWfPoolableInterface
+{
+	GENERATED_BODY()
+
+	// Add interface functions to this class. This is the class that will be inherited to implement this interface.
+public:
+
+	// Called after the actor has been moved into place and shown, before it is handed out
+	virtual void OnAcquiredFromPool() {}
+
+	// Called before the actor is hidden; must leave it as it was when first spawned
+	virtual void OnReturnedToPool() {}
+};
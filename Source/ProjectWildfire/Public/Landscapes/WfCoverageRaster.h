@@ -0,0 +1,107 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+class FWfRoadGraph;
+
+
+/**
+ * \brief Grid over the road network holding, per cell, the driving time from the nearest staffed
+ *  fire station for each apparatus type. Layer 0 covers every apparatus type.
+ *  Each station keeps its own raster, so a change to one station recomputes that station and
+ *  re-reduces only the layers it affects. The work runs as a background task spread across cores;
+ *  finished results are swapped in on the game thread, so queries never wait and are O(1).
+ */
+class PROJECTWILDFIRE_API FWfCoverageRaster
+{
+public:
+
+	// Cells no staffed station can reach
+	static constexpr uint16 Uncovered = MAX_uint16;
+
+	static constexpr int32 MaxLayers = 32;
+
+	FWfCoverageRaster();
+	~FWfCoverageRaster();
+
+	// Lays the grid over the graph's bounds and maps every cell to its nearest road node
+	void Initialize(const FWfRoadGraph& RoadGraph, const float InCellSize, const float OffRoadSpeedKph);
+
+	void Reset();
+
+	bool IsInitialized() const { return Grid.IsValid(); }
+
+	// Returns the layer for the apparatus type, adding it if needed. INDEX_NONE once every layer is in use.
+	int32 FindOrAddLayer(const FName ApparatusType);
+
+	int32 FindLayer(const FName ApparatusType) const;
+
+	/**
+	 * \brief Updates a station's contribution to the raster
+	 * \param StationKey Identifies the station between calls
+	 * \param NodeTravelTimes Travel time from the station to every road node
+	 * \param LayerMask One bit per layer the station can respond with; zero removes its coverage
+	 */
+	void SetStation(const void* StationKey, TArray<float>&& NodeTravelTimes, const uint32 LayerMask);
+
+	void RemoveStation(const void* StationKey);
+
+	// Collects finished work and starts the next job when stations have changed. Game thread only.
+	void Update();
+
+	// Blocks until the current job, if any, has finished and been collected
+	void Flush();
+
+	bool HasPendingWork() const { return bJobRunning || !DirtyStations.IsEmpty() || bLayersDirty; }
+
+	// Travel time in seconds from the nearest staffed station to the location, or -1 if uncovered
+	float GetTravelTime(const FVector& Location, const int32 LayerIndex = 0) const;
+
+	int32 GetNumCells() const { return Grid.IsValid() ? Grid->NumX * Grid->NumY : 0; }
+
+private:
+
+	// Immutable once built, shared with running jobs
+	struct FGrid
+	{
+		FVector2D Origin;
+		float CellSize;
+		int32 NumX;
+		int32 NumY;
+		TArray<int32> CellNodes;
+		TArray<float> CellOffRoadTimes;
+	};
+
+	struct FStationState
+	{
+		uint32 LayerMask = 0;
+		TSharedPtr<const TArray<float>, ESPMode::ThreadSafe> NodeTravelTimes;
+		TSharedPtr<const TArray<uint16>, ESPMode::ThreadSafe> Raster;
+	};
+
+	struct FJobResult
+	{
+		TMap<const void*, TSharedPtr<const TArray<uint16>, ESPMode::ThreadSafe>> StationRasters;
+		TSharedPtr<const TArray<TArray<uint16>>, ESPMode::ThreadSafe> Layers;
+	};
+
+	void LaunchJob();
+	void CollectJob();
+
+	TSharedPtr<const FGrid, ESPMode::ThreadSafe> Grid;
+
+	TMap<const void*, FStationState> Stations;
+	TSet<const void*> DirtyStations;
+	bool bLayersDirty;
+
+	TArray<FName> LayerTypes;
+
+	// The published result that queries read from
+	TSharedPtr<const TArray<TArray<uint16>>, ESPMode::ThreadSafe> Layers;
+
+	UE::Tasks::TTask<FJobResult> Job;
+	bool bJobRunning;
+};
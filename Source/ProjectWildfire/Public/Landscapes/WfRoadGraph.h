@@ -0,0 +1,190 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogRoads, Log, All);
+
+
+/**
+ * \brief Compact road network extracted from the road splines.
+ *  Nodes are spline sample points, snapped together where roads meet. Edges are stored in
+ *  CSR (compressed sparse row) form: the outgoing edges of node N are EdgeOffsets[N] to EdgeOffsets[N+1].
+ *  Point-to-point queries use A* with landmarks (ALT). Landmark tables are computed with every road
+ *  open, so closing a road only loosens the bounds and never requires rebuilding them.
+ *  Travel times from registered sources (fire stations) are cached as full shortest-path trees,
+ *  and only the trees actually affected by a closure or reopening are recomputed.
+ */
+class PROJECTWILDFIRE_API FWfRoadGraph
+{
+public:
+
+	static constexpr float UnreachableTime = TNumericLimits<float>::Max();
+
+	FWfRoadGraph();
+
+	/**
+	 * \brief Adds a road to be included in the next Build()
+	 * \param RoadIndex Caller defined identifier, used to open and close the road later
+	 * \param Points The centerline of the road, in order
+	 * \param SpeedLimitKph The speed used to convert distance to travel time
+	 * \param bOneWay If true, the road can only be driven from the first point to the last
+	 */
+	void AddRoad(const int32 RoadIndex, TConstArrayView<FVector> Points, const float SpeedLimitKph, const bool bOneWay);
+
+	// Builds the CSR arrays, the spatial index and the landmark tables from the added roads
+	void Build(const int32 NumLandmarks = 8);
+
+	void Reset();
+
+	bool IsBuilt() const { return bBuilt; }
+	int32 GetNumNodes() const { return NodeLocations.Num(); }
+	int32 GetNumEdges() const { return EdgeTargets.Num(); }
+
+	const FVector& GetNodeLocation(const int32 NodeIndex) const { return NodeLocations[NodeIndex]; }
+
+	// Returns the node closest to the location, or INDEX_NONE if the graph is empty
+	int32 FindNearestNode(const FVector& Location) const;
+
+	/**
+	 * \brief Finds the road edge closest to the location, searching the edges around the nearest node
+	 * \param OutClosestPoint Receives the point on the edge closest to the location
+	 * \return The edge index, or INDEX_NONE if the graph has no edges
+	 */
+	int32 FindNearestEdge(const FVector& Location, FVector& OutClosestPoint) const;
+
+	int32 GetEdgeRoad(const int32 EdgeIndex) const { return EdgeRoads[EdgeIndex]; }
+	int32 GetEdgeTarget(const int32 EdgeIndex) const { return EdgeTargets[EdgeIndex]; }
+	int32 GetEdgeSource(const int32 EdgeIndex) const;
+	float GetEdgeTravelTime(const int32 EdgeIndex) const { return EdgeTimes[EdgeIndex]; }
+
+	// The outgoing edges of the node are GetEdgeOffset(Node) to GetEdgeOffset(Node + 1)
+	int32 GetEdgeOffset(const int32 NodeIndex) const { return EdgeOffsets[NodeIndex]; }
+
+	bool IsEdgeOpen(const int32 EdgeIndex) const
+	{
+		return (ClosedEdges[EdgeIndex >> 6] & (1ull << (EdgeIndex & 63))) == 0;
+	}
+
+	// The fastest open edge from one node to the other, or INDEX_NONE if they are not adjacent
+	int32 FindEdge(const int32 FromNode, const int32 ToNode) const;
+
+	// Incremented whenever a build or a closure changes the routes, so callers can tell their cached routes are stale
+	uint32 GetVersion() const { return Version; }
+
+	/**
+	 * \brief Finds the fastest path between two nodes, avoiding closed roads
+	 * \param OutNodes If given, receives the nodes of the path from start to goal
+	 * \return The travel time in seconds, or UnreachableTime
+	 */
+	float FindPath(const int32 FromNode, const int32 ToNode, TArray<int32>* OutNodes = nullptr) const;
+
+	// Closes or reopens every edge belonging to the road. Returns false if nothing changed.
+	bool SetRoadClosed(const int32 RoadIndex, const bool bClosed);
+
+	bool IsRoadClosed(const int32 RoadIndex) const { return ClosedRoads.Contains(RoadIndex); }
+
+	// Registers a node whose travel time to every other node should be cached, returning the source index
+	int32 AddSource(const int32 NodeIndex);
+
+	void RemoveSource(const int32 SourceIndex);
+
+	// Travel time from the source to the node, recomputing the source's tree first if it was invalidated
+	float GetSourceTravelTime(const int32 SourceIndex, const int32 NodeIndex) const;
+
+	// Travel times from the source to every node, recomputing the source's tree first if it was invalidated
+	const TArray<float>& GetSourceTravelTimes(const int32 SourceIndex) const;
+
+	bool IsSourceDirty(const int32 SourceIndex) const { return !Sources.IsValidIndex(SourceIndex) || Sources[SourceIndex].bDirty; }
+
+	// Incremented every time the source's tree is recomputed, so callers can tell their copy is stale
+	uint32 GetSourceVersion(const int32 SourceIndex) const { return Sources.IsValidIndex(SourceIndex) ? Sources[SourceIndex].Version : 0; }
+
+	// Nodes from the source to the given node, using the cached tree
+	bool GetSourcePath(const int32 SourceIndex, const int32 NodeIndex, TArray<int32>& OutNodes) const;
+
+	int32 GetNumDirtySources() const;
+
+private:
+
+	struct FPendingEdge
+	{
+		int32 FromNode;
+		int32 ToNode;
+		float TravelTime;
+		int32 RoadIndex;
+	};
+
+	struct FSourceTree
+	{
+		int32 RootNode = INDEX_NONE;
+		bool bDirty = true;
+		uint32 Version = 0;
+		TArray<float> TravelTimes;
+		TArray<int32> ParentEdges;
+	};
+
+	int32 FindOrAddNode(const FVector& Location);
+
+	// Connects roads that meet or cross away from a shared point, by splitting their pending edges there
+	void SplitJunctions();
+	FIntPoint GetCell(const FVector& Location, const float CellSize) const;
+
+	/**
+	 * \brief Single source Dijkstra over the forward or reverse adjacency.
+	 * \param bRespectClosures False when building landmarks, so their bounds hold for any set of closures
+	 */
+	void RunDijkstra(const int32 RootNode, const bool bReverse, const bool bRespectClosures,
+		TArray<float>& OutTimes, TArray<int32>* OutParentEdges) const;
+
+	void SelectLandmarks(const int32 NumLandmarks);
+	float GetHeuristic(const int32 NodeIndex, const int32 GoalNode) const;
+
+	void RebuildSource(FSourceTree& Source) const;
+	void InvalidateSourcesForEdge(const int32 EdgeIndex, const bool bClosed);
+
+	// Node data
+	TArray<FVector> NodeLocations;
+
+	// Forward CSR
+	TArray<int32> EdgeOffsets;
+	TArray<int32> EdgeTargets;
+	TArray<float> EdgeTimes;
+	TArray<int32> EdgeRoads;
+
+	// Reverse CSR, referencing forward edge indices so closures apply to both
+	TArray<int32> ReverseOffsets;
+	TArray<int32> ReverseSources;
+	TArray<int32> ReverseEdges;
+
+	// One bit per forward edge
+	TArray<uint64> ClosedEdges;
+	TSet<int32> ClosedRoads;
+	TMap<int32, TArray<int32>> RoadEdges;
+
+	// Landmark-major tables: LandmarkFrom[L * NumNodes + N] is the time from landmark L to node N
+	int32 NumLandmarksBuilt;
+	TArray<float> LandmarkFrom;
+	TArray<float> LandmarkTo;
+
+	// Spatial hash of nodes, for snapping during the build and for nearest node lookups
+	TMap<FIntPoint, TArray<int32>> NodeCells;
+	float NodeCellSize;
+	float SnapTolerance;
+
+	TArray<FPendingEdge> PendingEdges;
+
+	// Sources are sparse so indices stay stable as stations come and go
+	mutable TSparseArray<FSourceTree> Sources;
+
+	// A* scratch, stamped per search so it never needs clearing
+	mutable TArray<float> SearchTimes;
+	mutable TArray<int32> SearchParents;
+	mutable TArray<uint32> SearchStamps;
+	mutable uint32 SearchStamp;
+
+	uint32 Version;
+
+	bool bBuilt;
+};
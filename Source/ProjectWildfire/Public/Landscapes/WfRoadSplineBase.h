@@ -3,11 +3,16 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Components/SplineComponent.h"
 #include "LandscapeSplineActor.h"
 
 #include "WfRoadSplineBase.generated.h"
 
 
+/**
+ * \brief A drivable road. The spline is the road's centerline; the road manager samples it
+ *  into the road graph, snapping points that meet other roads into intersections.
+ */
 UCLASS(BlueprintType, Blueprintable)
 class PROJECTWILDFIRE_API AWfRoadSplineBase : public AActor
 {
@@ -17,11 +22,43 @@ public:
 
 	AWfRoadSplineBase();
 
+	// Samples the centerline in world space, always including every spline point
+	void GetRoadPoints(TArray<FVector>& OutPoints, const float SampleSpacing = 2000.0f) const;
+
+	UFUNCTION(BlueprintPure)
+	bool IsRoadClosed() const { return bRoadClosed; }
+
+	// Closes or reopens the road for routing. Server only.
+	UFUNCTION(BlueprintCallable)
+	void SetRoadClosed(const bool bClosed);
+
 protected:
 
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:
 
 	virtual void Tick(float DeltaTime) override;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadWrite, Category = "Road Settings")
+	USplineComponent* RoadSpline;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Settings")
+	FString StreetName = "First";
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Settings")
+	FString StreetType = "Street";
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Settings")
+	float SpeedLimitKph = 50.0f;
+
+	// If true, the road can only be driven from the first spline point towards the last
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Road Settings")
+	bool bOneWay = false;
+
+private:
+
+	bool bRoadClosed = false;
 };
@@ -0,0 +1,141 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FWfRoadGraph;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogTraffic, Log, All);
+
+
+// An apparatus running with lights and sirens, which the cars in front of it pull over for
+struct FWfTrafficEmergency
+{
+	FVector Location;
+	// Which way it is going; cars behind it do not yield
+	FVector Direction;
+	// The lane it is driving and the one it turns onto next; only cars on these yield
+	int32 Lane = INDEX_NONE;
+	int32 NextLane = INDEX_NONE;
+};
+
+
+/**
+ * \brief Civilian traffic over the road graph, one lane per directed edge, with no actors.
+ *  Cars are kept as structure of arrays and follow the car ahead with the intelligent driver model
+ *  (IDM): each accelerates toward its desired speed and brakes for the gap and closing speed to its
+ *  leader, including the last car on the lane it turns onto next. Every step sorts the cars by lane,
+ *  then works out accelerations per chunk of lanes and integrates per chunk of cars in parallel, as
+ *  each only reads the previous step. Only cars moving onto another lane are handled one at a time.
+ *  Cars ahead of an emergency vehicle, on its lane or the next one, and within YieldRadius pull onto the
+ *  shoulder and stop; oncoming and cross traffic carries on.
+ *  Owned by AWfRoadManager, which draws the cars near its local players as instances.
+ */
+class PROJECTWILDFIRE_API FWfTrafficSim
+{
+public:
+
+	FWfTrafficSim();
+
+	// Makes a lane of every road graph edge and removes every car. The graph must outlive the sim.
+	void Initialize(const FWfRoadGraph& InGraph);
+
+	void Reset();
+
+	bool IsInitialized() const { return Graph != nullptr; }
+
+	// Scatters cars over the lanes, in proportion to their length, at a random fraction of the speed limit
+	void SpawnCars(const int32 NumCars, const int32 Seed);
+
+	void RemoveAllCars();
+
+	int32 GetNumCars() const { return CarLanes.Num(); }
+	int32 GetNumLanes() const { return LaneLengths.Num(); }
+	int32 GetNumYielding() const;
+
+	/**
+	 * \brief Moves every car forward
+	 * \param Emergencies Apparatus the cars should yield to; usually a handful
+	 */
+	void Step(const float DeltaSeconds, TConstArrayView<FWfTrafficEmergency> Emergencies);
+
+	// Fills in the lanes of an emergency vehicle whose route is not known, from where it is and which way it is going
+	void FindEmergencyLanes(FWfTrafficEmergency& Emergency) const;
+
+	// Where the car is, extrapolated the given seconds past the last step along its lane
+	FTransform GetCarTransform(const int32 CarIndex, const float SecondsSinceStep = 0.0f) const;
+
+	/**
+	 * \brief Collects the cars within the radius of any observer
+	 * \param OutCars Receives the index of every car in range, in car order
+	 */
+	void FindCarsNear(TConstArrayView<FVector> Observers, const float Radius, TArray<int32>& OutCars) const;
+
+	// Free road acceleration (cm/s^2)
+	float MaxAcceleration;
+
+	// Deceleration drivers are comfortable with (cm/s^2)
+	float ComfortDeceleration;
+
+	// Hardest a car can brake (cm/s^2)
+	float MaxDeceleration;
+
+	// Gap kept to the car ahead when stopped (cm)
+	float MinGap;
+
+	// Seconds kept to the car ahead when moving
+	float TimeHeadway;
+
+	float CarLength;
+
+	// Distance from the centerline to the middle of the lane, and on to the shoulder when yielding (cm)
+	float LaneOffset;
+	float ShoulderOffset;
+
+	// Cars within this of an emergency vehicle behind them, on its lanes, yield (cm)
+	float YieldRadius;
+
+	// Lanes, or cars, per parallel chunk
+	int32 ChunkSize;
+
+private:
+
+	void SortCarsByLane();
+
+	// Acceleration of every car on the lane, from the car ahead of each
+	void ComputeLaneAccelerations(const int32 Lane);
+
+	// The car's leader beyond the end of its lane: gap in cm and speed, or false if the road ahead is free
+	bool FindNextLaneLeader(const int32 CarIndex, float& OutGap, float& OutSpeed) const;
+
+	// Picks the lane a car on the lane turns onto at its end, avoiding U-turns where there is a choice
+	int32 PickNextLane(const int32 Lane, uint32& Seed) const;
+
+	FVector GetCarLocation(const int32 CarIndex, const float Position) const;
+
+	const FWfRoadGraph* Graph;
+
+	// Lanes, indexed by road graph edge
+	TArray<FVector> LaneStarts;
+	TArray<FVector> LaneDirections;
+	TArray<float> LaneLengths;
+	TArray<float> LaneSpeeds;
+	TArray<int32> LaneStartNodes;
+	TArray<int32> LaneEndNodes;
+
+	// Cars, structure of arrays
+	TArray<int32> CarLanes;
+	TArray<int32> CarNextLanes;
+	TArray<float> CarPositions;
+	TArray<float> CarSpeeds;
+	// Fraction of the speed limit each driver wants to go
+	TArray<float> CarSpeedFactors;
+	TArray<float> CarAccelerations;
+	TArray<uint8> CarYielding;
+	TArray<uint32> CarSeeds;
+
+	// Cars on lane L are LaneCars[LaneOffsets[L]] to LaneCars[LaneOffsets[L + 1]], front first
+	TArray<int32> LaneOffsets;
+	TArray<int32> LaneCars;
+};
@@ -0,0 +1,208 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogWildfire, Log, All);
+
+
+// Fuel models, loosely following the Anderson (1982) set. None does not burn (roads, water, rock).
+enum class EWfFuelModel : uint8
+{
+	None = 0,
+	ShortGrass,
+	Chaparral,
+	TimberLitter,
+	HeavyTimber,
+	Num
+};
+
+// Spread parameters of a fuel model, fed into the Rothermel-style spread equation
+struct PROJECTWILDFIRE_API FWfFuelModel
+{
+	// Spread rate on flat ground with no wind and dry fuel, in meters per second
+	float BaseSpreadRate;
+
+	// Wind factor is WindCoefficient * (midflame wind in m/s) ^ WindExponent
+	float WindCoefficient;
+	float WindExponent;
+
+	// Fuel bed packing ratio; looser beds respond more to slope
+	float PackingRatio;
+
+	// Fuel moisture fraction at which the fire no longer spreads
+	float MoistureOfExtinction;
+
+	// How long a cell burns once ignited, in seconds
+	float ResidenceSeconds;
+
+	// Likelihood a burning cell throws embers ahead of the front, per second at 10 m/s wind
+	float SpottingChance;
+
+	static const FWfFuelModel& Get(const EWfFuelModel FuelModel);
+};
+
+// What the fire needs to know about a patch of ground
+struct PROJECTWILDFIRE_API FWfWildfireCellSample
+{
+	EWfFuelModel FuelModel = EWfFuelModel::None;
+
+	// Meters
+	float Elevation = 0.0f;
+
+	// Dead fuel moisture as a fraction of dry weight
+	float FuelMoisture = 0.08f;
+};
+
+
+/**
+ * \brief Source of fuel and terrain data for FWfWildfire.
+ *  Sample() is called from worker threads and must be thread-safe and deterministic.
+ */
+class PROJECTWILDFIRE_API FWfWildfireTerrain
+{
+public:
+	virtual ~FWfWildfireTerrain() = default;
+	virtual FWfWildfireCellSample Sample(const FIntPoint& Cell) const = 0;
+};
+
+// Seeded value-noise hills with patches of grass, brush and timber, and the odd bare outcrop
+class PROJECTWILDFIRE_API FWfProceduralWildfireTerrain : public FWfWildfireTerrain
+{
+public:
+	FWfProceduralWildfireTerrain(const int32 InSeed, const float InReliefMeters = 80.0f, const float InFeatureCells = 60.0f);
+
+	virtual FWfWildfireCellSample Sample(const FIntPoint& Cell) const override;
+
+private:
+	float Noise(const float X, const float Y, const uint32 Channel) const;
+
+	uint32 Seed;
+	float ReliefMeters;
+	float FeatureCells;
+};
+
+
+// Game thread copy of the fire, published by the simulation task after each job
+struct PROJECTWILDFIRE_API FWfWildfireSnapshot
+{
+	double SimSeconds = 0.0;
+	int32 NumSteps = 0;
+
+	TArray<FIntPoint> BurningCells;
+
+	// Fireline intensity of each burning cell, from 0 to 1
+	TArray<float> BurningIntensity;
+
+	int32 NumFrontCells = 0;
+	int32 NumBurntCells = 0;
+
+	// Order dependent hash of every ignition, for checking runs are identical
+	uint32 Checksum = 0;
+};
+
+
+/**
+ * \brief Vegetation fire spread over an unbounded, sparse grid of cells.
+ *  Only burning cells and the unburnt cells they are heating (the front) are kept in hash maps;
+ *  burnt ground is a set of 64x64 bit chunks. Each step costs work proportional to the perimeter,
+ *  no matter how much ground has burnt or how large the map is.
+ *  Spread towards each neighbour uses a Rothermel-style rate: the fuel model's base rate, damped
+ *  by moisture and raised by the wind and slope components along that direction.
+ *  Steps run in a background task at a fixed step length. The task publishes into a back snapshot
+ *  which is swapped in on the game thread, so readers never wait on the simulation.
+ *  Given the same seed, terrain and sequence of calls, every run produces the same fire.
+ */
+class PROJECTWILDFIRE_API FWfWildfire
+{
+public:
+
+	UE_NONCOPYABLE(FWfWildfire);
+
+	FWfWildfire();
+	~FWfWildfire();
+
+	/**
+	 * \brief Clears any previous fire and prepares a new one
+	 * \param InTerrain Fuel and elevation source, shared with the simulation task
+	 * \param InOrigin World location of cell (0,0)
+	 * \param InCellSize Size of each cell, in centimeters
+	 * \param InSeed Seed for spotting; the same seed gives the same fire
+	 */
+	void Initialize(const TSharedRef<const FWfWildfireTerrain, ESPMode::ThreadSafe>& InTerrain,
+		const FVector2D& InOrigin, const float InCellSize, const int32 InSeed);
+
+	void Reset();
+
+	bool IsInitialized() const { return State.IsValid(); }
+
+	// Starts a fire at the location, applied at the start of the next step
+	void Ignite(const FVector& Location);
+
+	// Removes the fuel within the radius (dozer line, retardant drop), applied at the start of the next step
+	void AddFireBreak(const FVector& Location, const float Radius);
+
+	// 20 foot wind, in meters per second, blowing towards the given direction
+	void SetWind(const FVector2D& InWindVelocity) { WindVelocity = InWindVelocity; }
+	const FVector2D& GetWind() const { return WindVelocity; }
+
+	/**
+	 * \brief Collects a finished job, then starts the next one covering the time accumulated so far.
+	 *  Game thread only.
+	 * \param DeltaSimSeconds Simulated seconds since the last update
+	 */
+	void Update(const float DeltaSimSeconds);
+
+	// Blocks until the current job, if any, has finished and been published
+	void Flush();
+
+	bool IsJobRunning() const { return bJobRunning; }
+
+	// True once the fire has been lit and nothing is burning any more
+	bool IsOut() const;
+
+	const FWfWildfireSnapshot& GetSnapshot() const { return Snapshots[FrontSnapshot]; }
+
+	FIntPoint GetCellAtLocation(const FVector& Location) const;
+	FVector GetCellLocation(const FIntPoint& Cell) const;
+	float GetCellSize() const { return CellSize; }
+
+	// Fixed simulated step length; time is carried over between updates until a whole step is available
+	float StepSeconds;
+
+	// Upper bound on the steps a single job runs, so a burst of sim time can't stall publishing
+	int32 MaxStepsPerJob;
+
+private:
+
+	struct FCommand
+	{
+		FIntPoint Cell;
+		int32 RadiusCells;
+		bool bFireBreak;
+	};
+
+	struct FState;
+
+	void LaunchJob();
+	void CollectJob();
+
+	TSharedPtr<FState, ESPMode::ThreadSafe> State;
+
+	FVector2D Origin;
+	float CellSize;
+	FVector2D WindVelocity;
+
+	// Time and commands waiting for the next job
+	double PendingSeconds;
+	TArray<FCommand> PendingCommands;
+	bool bEverIgnited;
+
+	FWfWildfireSnapshot Snapshots[2];
+	int32 FrontSnapshot;
+
+	UE::Tasks::TTask<void> Job;
+	bool bJobRunning;
+};
@@ -50,7 +50,7 @@ struct PROJECTWILDFIRE_API FFireApparatusAssignments
 	bool operator==(const FFireApparatusAssignments& CompareAssignment) const;
 	bool operator==(const AWfFireApparatusBase* CompareActor) const;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") AWfFireApparatusBase* FireApparatus = nullptr;
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") TArray<AWfFfCharacterBase*> Firefighters;
+	// The crew is whoever is in the apparatus' seats; see AWfFireApparatusBase::GetSeatedFirefighters()
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") AWfFireStationBase* FireStation;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") AWfCalloutActor* Incident;
 };
@@ -68,3 +68,12 @@ struct PROJECTWILDFIRE_API FIncidentAssignments
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Incident") TArray<AWfFfCharacterBase*> Firefighters;
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Incident") TArray<AWfFireStationBase*> FireStations;
 };
+
+// One apparatus and the firefighters to seat in it, in seat order
+USTRUCT(BlueprintType)
+struct PROJECTWILDFIRE_API FWfApparatusCrew
+{
+	GENERATED_BODY()
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") AWfFireApparatusBase* FireApparatus = nullptr;
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Fire Apparatus") TArray<AWfFfCharacterBase*> Firefighters;
+};
@@ -0,0 +1,90 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AWfPropertyActor;
+
+
+/**
+ * \brief Append-only pool of interned strings stored back to back in one buffer.
+ *  Strings are referenced by index, so an entry costs two integers instead of an FString allocation.
+ */
+class PROJECTWILDFIRE_API FWfStringPool
+{
+public:
+
+	// Returns the index of the string, adding it if it isn't pooled yet
+	int32 Intern(const FStringView String);
+
+	// Returns the index of the string, or INDEX_NONE if it isn't pooled
+	int32 Find(const FStringView String) const;
+
+	FStringView Get(const int32 StringIndex) const
+	{
+		return FStringView(&Characters[Offsets[StringIndex]], Lengths[StringIndex]);
+	}
+
+	int32 Num() const { return Offsets.Num(); }
+
+	SIZE_T GetAllocatedSize() const;
+
+	void Reset();
+
+private:
+
+	TArray<TCHAR> Characters;
+	TArray<int32> Offsets;
+	TArray<int32> Lengths;
+
+	// Hash to the first string index with that hash; collisions chain through NextInBucket
+	TMap<uint32, int32> Buckets;
+	TArray<int32> NextInBucket;
+};
+
+
+/**
+ * \brief Sorted index of property addresses for reverse lookup and search by address string.
+ *  Keys are normalized (lowercase, single spaces, no punctuation, street types abbreviated) so
+ *  "123 First St." and "123 first street" both match. Lookups are binary searches over the sorted key list.
+ */
+class PROJECTWILDFIRE_API FWfAddressIndex
+{
+public:
+
+	void AddProperty(const AWfPropertyActor* Property, const FStringView Address);
+
+	void RemoveProperty(const AWfPropertyActor* Property);
+
+	// Returns the property with exactly this address, or nullptr
+	const AWfPropertyActor* FindProperty(const FStringView Address) const;
+
+	// Returns properties whose address starts with the given text, in address order
+	void FindPropertiesWithPrefix(const FStringView Prefix, const int32 MaxResults,
+		TArray<const AWfPropertyActor*>& OutProperties) const;
+
+	int32 Num() const { return Entries.Num(); }
+
+	void Reset();
+
+	static void NormalizeAddress(const FStringView Address, FString& OutKey);
+
+private:
+
+	struct FAddressEntry
+	{
+		int32 KeyIndex;
+		const AWfPropertyActor* Property;
+	};
+
+	int32 LowerBound(const FStringView Key) const;
+
+	// Sorted by key
+	TArray<FAddressEntry> Entries;
+	TMap<const AWfPropertyActor*, int32> PropertyKeys;
+	FWfStringPool KeyPool;
+
+	// Reused to normalize input without allocating per lookup
+	mutable FString ScratchKey;
+};
@@ -0,0 +1,66 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+// Total and worst of a call timed over and over
+struct PROJECTWILDFIRE_API FWfBenchTiming
+{
+	double TotalSeconds = 0.0;
+	double WorstSeconds = 0.0;
+	int32 NumTimed = 0;
+
+	template <typename FunctionType>
+	void Time(FunctionType&& Function)
+	{
+		const double Start = FPlatformTime::Seconds();
+		Function();
+		const double Seconds = FPlatformTime::Seconds() - Start;
+		TotalSeconds += Seconds;
+		WorstSeconds = FMath::Max(WorstSeconds, Seconds);
+		++NumTimed;
+	}
+
+	// "Average 12.3 us, Worst 45.6 us", for the benchmark's log line
+	FString ToString() const;
+};
+
+
+/**
+ * \brief What the Wf.Bench.* console commands share: their arguments, the same random seed
+ *  every run, and a step timed over and over. A command builds its store from Random, calls Run()
+ *  with what to do between steps and the step itself, and logs Timing with its own figures.
+ *  Wf.Bench.Wildfire does not use it: its seed is an argument, and it times two whole burns to check they match.
+ */
+class PROJECTWILDFIRE_API FWfBench
+{
+public:
+
+	explicit FWfBench(const TArray<FString>& InArgs);
+
+	// The argument at Index, or Default if it was not given; never below Min
+	int32 GetArg(const int32 Index, const int32 Default, const int32 Min = 1) const;
+	float GetFloatArg(const int32 Index, const float Default, const float Min) const;
+
+	/**
+	 * \brief Calls Setup(StepIndex), untimed, then Step(StepIndex), timed, NumSteps times
+	 */
+	template <typename SetupType, typename StepType>
+	void Run(const int32 NumSteps, SetupType&& Setup, StepType&& Step)
+	{
+		for (int32 StepIndex = 0; StepIndex < NumSteps; ++StepIndex)
+		{
+			Setup(StepIndex);
+			Timing.Time([&Step, StepIndex]() { Step(StepIndex); });
+		}
+	}
+
+	FRandomStream Random;
+	FWfBenchTiming Timing;
+
+private:
+
+	const TArray<FString>& Args;
+};
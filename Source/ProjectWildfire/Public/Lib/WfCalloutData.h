@@ -4,6 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "WfEquipmentData.h"
+#include "Engine/DataTable.h"
+#include "Engine/NetSerialization.h"
+#include "Interfaces/WfPoolableInterface.h"
+#include "Landscapes/WfWildfire.h"
+#include "Lib/WfFireGrid.h"
 #include "UObject/Object.h"
 #include "WfCalloutData.generated.h"
 
@@ -18,6 +23,7 @@ DECLARE_LOG_CATEGORY_EXTERN(LogCallouts, Log, All);
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCalloutDispatchInitial, const AWfCalloutActor*, CalloutActor);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCalloutDispatchFull, const AWfCalloutActor*, CalloutActor);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnCalloutSnapshotUpdated, const AWfCalloutActor*, CalloutActor);
 
 UENUM(BlueprintType)
 enum class EIncidentType : uint8
@@ -83,6 +89,10 @@ struct PROJECTWILDFIRE_API FCalloutDataFire
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Callout Fire Data")
 	TArray<FCalloutEquipmentUse> EquipmentUsage;
 
+	// Where the fire spot started, relative to the incident location
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Callout Fire Data")
+	FVector RelativeLocation;
+
 };
 
 
@@ -208,12 +218,8 @@ struct PROJECTWILDFIRE_API FCalloutData : public FTableRowBase
 	FCalloutData();
 	explicit FCalloutData(const FCallouts& NewCallout);
 
-	// An array of messages containing any failures or notices while generating the callout
-	// Each string starts with "E", "L", or "N" - Error, Log Only, or Notice.
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Callouts") TSubclassOf<AWfCalloutActor> CalloutActor;
 
-	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Callouts") TArray<FString> CallLogging;
-
 	// The UTC time on the server that the call was officially dispatched (for sync)
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Callouts") FDateTime ServerTimeStart;
 
@@ -227,15 +233,78 @@ struct PROJECTWILDFIRE_API FCalloutData : public FTableRowBase
 
 	// The deadline for the call to be satisfied
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Callouts") FDateTime ResolutionDeadline;
+
+	// The fire spots of the incident. TaskProgress follows the fire grid once the callout is running.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Callouts") TArray<FCalloutDataFire> Fires;
+
+	// The patients of the incident. TaskProgress follows the patient store once the callout is running.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Callouts") TArray<FCalloutDataMedical> Patients;
+};
+
+/**
+ * \brief What clients know of an active callout. FCalloutData stays on the server; this is all that replicates.
+ *  Static data is referenced by its row in the callouts table, which clients load themselves, and the
+ *  rest is quantized: the location to whole centimeters, times to whole seconds and progress to a byte,
+ *  so a running incident costs tens of bytes rather than the kilobytes of its full data.
+ */
+USTRUCT(BlueprintType)
+struct PROJECTWILDFIRE_API FCalloutSnapshot
+{
+	GENERATED_BODY()
+
+	FCalloutSnapshot();
+
+	// The callout's row; resolve it with GetCalloutRow()
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") FDataTableRowHandle CalloutRow;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") int32 IncidentNumber;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") EIncidentType TypeOfIncident;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") FVector_NetQuantize Location;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") AWfPropertyActor* PropertyActor;
+
+	// Simulated times the call started and must be resolved by
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") FDateTime ServerTimeStart;
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") FDateTime ResolutionDeadline;
+
+	// Fires and patients past this many are left out of the snapshot; mass casualty incidents stay well under it
+	static constexpr int32 MaxProgressEntries = 2048;
+
+	// TaskProgress of each fire spot and patient, from 0 to 255
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") TArray<uint8> FireProgress;
+	UPROPERTY(BlueprintReadOnly, Category = "Callouts") TArray<uint8> PatientProgress;
+
+	// The static data of the callout, or nullptr if the table is not loaded or has no such row
+	const FCallouts* GetCalloutRow() const;
+
+	static uint8 QuantizeProgress(const float Progress) { return static_cast<uint8>(FMath::RoundToInt(FMath::Clamp(Progress, 0.0f, 1.0f) * 255.0f)); }
+	static float DequantizeProgress(const uint8 Progress) { return Progress / 255.0f; }
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+
+	bool operator==(const FCalloutSnapshot& Other) const;
+};
+
+template<>
+struct TStructOpsTypeTraits<FCalloutSnapshot> : TStructOpsTypeTraitsBase2<FCalloutSnapshot>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithIdenticalViaEquality = true
+	};
 };
 
 
 /**
- * \brief Spawned when a callout is created, and manages all further actions of the callout.
+ * \brief Taken from the actor pool when a callout is attached, and manages all further actions of the callout.
  * The AWfCalloutsManager just handles generating callouts. This handles the callout itself.
+ * Returned to the pool when the incident closes or expires, so one actor serves many incidents.
  */
 UCLASS(Blueprintable, BlueprintType)
-class PROJECTWILDFIRE_API AWfCalloutActor : public AActor
+class PROJECTWILDFIRE_API AWfCalloutActor : public AActor, public IWfPoolableInterface
 {
 	GENERATED_BODY()
 
@@ -246,9 +315,15 @@ public:
 	UFUNCTION(BlueprintPure)
 	int GetIncidentNumber() const { return IncidentNumber; }
 
-	void SetIncidentNumber(const int NewNumber) { IncidentNumber = NewNumber; }
+	void SetIncidentNumber(const int NewNumber) { IncidentNumber = NewNumber; UpdateSnapshot(); }
+
+	// The incident's journal, from FWfIncidentJournal::OpenIncident()
+	void SetJournalId(const int32 NewJournalId) { JournalId = NewJournalId; }
+
+	void SetCalloutData(FCallouts& NewCallout, const float SecondsToStart = 30.0f, AWfPropertyActor* PropertyActor = nullptr);
 
-	void SetCalloutData(FCallouts& NewCallout, const float SecondsToStart = 30.0f);
+	// Replaces the deadline SetCalloutData() worked out, for an incident that was created earlier
+	void SetResolutionDeadline(const FDateTime& NewDeadline) { CalloutData.ResolutionDeadline = NewDeadline; UpdateSnapshot(); }
 
 	UFUNCTION(BlueprintCallable)
 	bool StartCallout();
@@ -261,28 +336,141 @@ public:
 	UFUNCTION(BlueprintPure)
 	TArray<FCalloutAssignment> GetAssignedUnits() const { return AssignedUnits; }
 
+	// The full callout data. Server only; clients have the snapshot.
 	UFUNCTION(BlueprintPure)
 	FCalloutData GetCalloutData() const { return CalloutData; }
 
+	UFUNCTION(BlueprintPure)
+	FCalloutSnapshot GetSnapshot() const { return Snapshot; }
+
+	// Looks up the callout's static data in the callouts table. Works on clients.
+	UFUNCTION(BlueprintPure)
+	bool GetCalloutRow(FCallouts& CalloutRow) const;
+
+	// The table and row the callout was made from, sent to clients in place of the static data
+	void SetCalloutRow(const UDataTable* CalloutsTable, const FName& RowName);
+
+	// The location of the incident; the property if there is one, otherwise this actor
+	UFUNCTION(BlueprintPure)
+	FVector GetIncidentLocation() const;
+
+	const TArray<FCalloutUnits>& GetMinimumUnits() const { return CalloutData.CalloutData.MinimumUnits; }
+
+	/**
+	 * \brief Puts water on the fire, to be applied on the next callout tick
+	 * \param Location Where the water lands
+	 * \param Radius The area the water is spread over, in centimeters
+	 * \param Gallons The amount of water used
+	 * \return The number of fire cells that received water
+	 */
+	UFUNCTION(BlueprintCallable)
+	int ApplyWater(const FVector& Location, const float Radius, const float Gallons);
+
+	// The fire spot's equipment list, compiled in the game manager's inventory the first time it is asked for
+	UFUNCTION(BlueprintCallable)
+	int32 GetFireTaskId(const int FireIndex);
+
+	// The patient's equipment list, compiled in the game manager's inventory the first time it is asked for
+	UFUNCTION(BlueprintCallable)
+	int32 GetPatientTaskId(const int PatientIndex);
+
+	UFUNCTION(BlueprintPure)
+	bool IsFireExtinguished() const;
+
+	// True once the fire is out and no patient is still deteriorating
+	UFUNCTION(BlueprintPure)
+	bool IsIncidentControlled() const;
+
+	// Perform the full dispatch (handles auto-dispatching). Called by the callouts manager.
+	virtual void DispatchCallout();
+
+	// Ends the incident successfully. Called by the callouts manager when the incident closes.
+	virtual void CloseCallout();
+
+	// Ends the incident after its deadline, penalizing the players. Called by the callouts manager.
+	virtual void ExpireCallout();
+
+	// Wind over a vegetation fire, in meters per second, blowing towards the given direction
+	UFUNCTION(BlueprintCallable)
+	void SetWildfireWind(const FVector2D& WindVelocity) { Wildfire.SetWind(WindVelocity); }
+
+	/**
+	 * \brief Sets the treatment a patient is receiving, replacing any previous treatment
+	 * \param PatientIndex The patient, as ordered in the callout data
+	 * \param TreatmentPerSecond Illness removed per simulated second; zero stops treatment
+	 */
+	UFUNCTION(BlueprintCallable)
+	void TreatPatient(const int PatientIndex, const float TreatmentPerSecond);
+
+	/**
+	 * \brief Lays an attack line off the apparatus' pump, flowing onto the fire as soon as it is charged
+	 * \param FireApparatus Supplies the line. Its tank and pump join the incident's water supply the first time.
+	 * \param NozzleLocation Where the water lands
+	 * \return The attack line's index, or -1 if the apparatus has no pump
+	 */
+	UFUNCTION(BlueprintCallable)
+	int LayAttackLine(const AWfFireApparatusBase* FireApparatus, const FVector& NozzleLocation,
+		const float LengthFeet = 200.0f, const float DiameterInches = 1.75f, const float NozzleGpm = 150.0f);
+
+	// Opens or shuts the nozzle of an attack line
+	UFUNCTION(BlueprintCallable)
+	void SetAttackLineFlowing(const int AttackLine, const bool bFlowing);
+
+	// Lays a supply line from a hydrant into the apparatus' tank
+	UFUNCTION(BlueprintCallable)
+	void ConnectHydrant(const AWfFireApparatusBase* FireApparatus, const float StaticPsi = 80.0f,
+		const float ResidualPsi = 50.0f, const float ResidualGpm = 1000.0f, const float LengthFeet = 300.0f);
+
+	const FWfFireGrid& GetFireGrid() const { return FireGrid; }
+	const FWfWildfire& GetWildfire() const { return Wildfire; }
+
 protected:
 
 	virtual void GetLifetimeReplicatedProps(
 		TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Clears the incident so the next one can reuse this actor
+	virtual void OnReturnedToPool() override;
+
 	// Penalize the players (assigned, but resolution time has passed)
 	virtual void ApplyExpiredPenalty();
 
 	// Perform the initial dispatch (pre-alert and unit assignment)
 	virtual void DispatchInitial();
 
-	// Perform the full dispatch (handles auto-dispatching)
-	virtual void DispatchCallout();
+	// Builds the fire grid around the incident and lights the fire spots
+	virtual void InitializeFireGrid();
+
+	// Starts the wildfire simulation for vegetation incidents, lighting the fire spots
+	virtual void InitializeWildfire();
+
+	// Size of each fire grid cell, in centimeters
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Callouts")
+	float FireGridCellSize = 200.0f;
+
+	// Number of cells along each side of the fire grid, centered on the incident
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Callouts")
+	int FireGridCells = 128;
+
+	// How far from the incident location the initial fire spots may start
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Callouts")
+	float FireSpotRadius = 1000.0f;
+
+	// Size of each wildfire cell, in centimeters
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Callouts")
+	float WildfireCellSize = 1000.0f;
+
+	// Water it takes to wet one wildfire cell enough that the fire no longer spreads through it
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Callouts")
+	float WildfireGallonsPerCell = 100.0f;
 
 
 private:
 
-	UFUNCTION() void CheckCalloutExpired();
 	UFUNCTION() void CalloutTick();
+	UFUNCTION() void OnRep_Snapshot();
 	UFUNCTION(NetMulticast, Reliable) void Multicast_DispatchPreAlert();
 	UFUNCTION(NetMulticast, Reliable) void Multicast_DispatchCallout();
 
@@ -291,17 +479,69 @@ public:
 	UPROPERTY(BlueprintAssignable) FOnCalloutDispatchInitial OnCalloutDispatchInitial;
 	UPROPERTY(BlueprintAssignable) FOnCalloutDispatchFull OnCalloutDispatchFull;
 
+	// Clients only; the snapshot changed
+	UPROPERTY(BlueprintAssignable) FOnCalloutSnapshotUpdated OnCalloutSnapshotUpdated;
+
 private:
 
-	// Data pertinent to this callout
-	UPROPERTY(Replicated) FCalloutData CalloutData;
+	// Copies what clients need out of the callout data. Server only.
+	void UpdateSnapshot();
+
+	// Data pertinent to this callout. Server only, along with its logging.
+	UPROPERTY() FCalloutData CalloutData;
+
+	UPROPERTY(ReplicatedUsing=OnRep_Snapshot) FCalloutSnapshot Snapshot;
 
 	FTimerHandle CalloutTimer;
 
-	FTimerHandle ExpirationTimer;
+	// Server only; the fire spots in CalloutData are what clients see
+	FWfFireGrid FireGrid;
+
+	// Server only; vegetation incidents burn here instead of the fire grid
+	FWfWildfire Wildfire;
+
+	// Gallons applied to each wildfire cell that have not wet enough ground to make a break yet
+	TMap<FIntPoint, float> WildfireWater;
+
+	// This callout's patients in the game manager's patient store
+	int32 PatientIncidentId = INDEX_NONE;
+
+	// Unassigns every apparatus and firefighter on this callout, making them available for dispatch again
+	void ReleaseAssignments();
+
+	// Removes the incident from the game manager's simulations and forgets its ids
+	void ReleaseIncident();
+
+	// Hands the actor back to the actor pool, or destroys it if there is no pool
+	void ReturnToPool();
+
+	// Returns the apparatus' tank and pump in the water supply, adding them if needed
+	bool FindOrAddApparatusPump(const AWfFireApparatusBase* FireApparatus, int32& OutTank, int32& OutDischarge);
+
+	struct FAttackLine
+	{
+		int32 Nozzle;
+		FVector Location;
+		// The supplying apparatus' container in the game manager's inventory
+		int32 ContainerId;
+	};
+
+	// Fire spot the water landing at the location works on, or INDEX_NONE if there are none
+	int32 FindNearestFire(const FVector& Location) const;
+
+	// Inventory task ids, by fire spot and by patient. Empty until first asked for.
+	TArray<int32> FireTaskIds;
+	TArray<int32> PatientTaskIds;
+
+	// This callout's network in the game manager's hydraulics, and where its lines are
+	int32 HydraulicNetworkId = INDEX_NONE;
+	TMap<const AWfFireApparatusBase*, TPair<int32, int32>> ApparatusPumps;
+	TArray<FAttackLine> AttackLines;
 
 	int IncidentNumber;
 
+	int32 JournalId = INDEX_NONE;
+
 	// Once set to true, the callout cannot be modified.
 	bool bCalloutReady = false;
 
@@ -0,0 +1,142 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Lib/WfDenseIdMap.h"
+#include "UObject/ObjectKey.h"
+
+#include "WfCrowdLod.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogCrowdLod, Log, All);
+
+
+// How much of a character the server simulates
+UENUM(BlueprintType)
+enum class EWfLodLevel : uint8
+{
+	Full = 0,		// Ticking, moving and animating like any pawn
+	Reduced,		// Ticking and moving at an interval, animation only for montages
+	Abstract,		// No ticking or movement; the crowd LOD moves it along its route
+	Num UMETA(Hidden)
+};
+
+struct FWfLodTransition
+{
+	int32 AgentId;
+	EWfLodLevel From;
+	EWfLodLevel To;
+};
+
+
+/**
+ * \brief Level of detail of every character, decided by its distance to the nearest observer.
+ *  Characters near a player are Full, those further out Reduced, and the rest Abstract. Leaving a
+ *  level takes Hysteresis further than entering it, so characters at a boundary do not flicker.
+ *  Abstract characters that were walking somewhere carry on along their route here, as a polyline
+ *  advanced at their walking speed, and the store holds their location until they are rehydrated.
+ *  At most MaxTransitionsPerUpdate characters change level per update, closest to an observer first
+ *  for rehydration, so a player arriving at a busy station does not rebuild everyone in one frame.
+ *  Owned by AGameManager, server only; the characters apply their own transitions.
+ */
+class PROJECTWILDFIRE_API FWfCrowdLod
+{
+public:
+
+	FWfCrowdLod();
+
+	// Adds a character at Full detail. Returns its agent id.
+	int32 AddAgent(AActor* Agent, const FVector& Location);
+
+	// Swaps the last agent into the removed one's place; ids of other agents stay valid
+	void RemoveAgent(const int32 AgentId);
+
+	bool IsValidAgent(const int32 AgentId) const { return Ids.IsValidId(AgentId); }
+
+	AActor* GetAgent(const int32 AgentId) const;
+
+	EWfLodLevel GetLevel(const int32 AgentId) const;
+
+	// Where the agent is; kept by the store while the agent is Abstract
+	FVector GetLocation(const int32 AgentId) const;
+	void SetLocation(const int32 AgentId, const FVector& Location);
+
+	// Moves the abstract agent along the route, which starts at its location, at the given speed in cm/s
+	void StartTravel(const int32 AgentId, TArray<FVector>&& Route, const float Speed);
+
+	void StopTravel(const int32 AgentId);
+
+	bool IsTravelling(const int32 AgentId) const;
+
+	// Calls Function(AgentId, Agent, Level) for every agent; the agent is nullptr if it was destroyed
+	template <typename FunctionType>
+	void ForEachAgent(FunctionType&& Function) const
+	{
+		for (int32 Index = 0; Index < Agents.Num(); ++Index)
+			Function(Ids.IdOf(Index), Agents[Index].ResolveObjectPtr(), Levels[Index]);
+	}
+
+	/**
+	 * \brief Advances abstract travel, then picks each agent's level from its distance to the nearest observer
+	 * \param Observers Where the players are looking from; with none, every agent goes Abstract
+	 * \param DeltaSeconds Seconds since the last update
+	 */
+	void Update(TConstArrayView<FVector> Observers, const float DeltaSeconds);
+
+	// Level changes made by the last update
+	TConstArrayView<FWfLodTransition> GetTransitions() const { return Transitions; }
+
+	// Abstract agents that reached the end of their route during the last update
+	TConstArrayView<int32> GetArrivals() const { return Arrivals; }
+
+	int32 GetNumAgents() const { return Agents.Num(); }
+	int32 GetNumAtLevel(const EWfLodLevel Level) const;
+
+	void Reset();
+
+	// Within this of an observer, agents are Full
+	float FullRadius;
+
+	// Within this of an observer, agents are at least Reduced
+	float ReducedRadius;
+
+	// Fraction past a radius an agent must be to drop to a lower level
+	float Hysteresis;
+
+	int32 MaxTransitionsPerUpdate;
+
+private:
+
+	struct FTravel
+	{
+		TArray<FVector> Route;
+		int32 Segment = 0;
+		float SegmentOffset = 0.0f;
+		float Speed = 0.0f;
+	};
+
+	// Returns true once the end of the route is reached
+	bool AdvanceTravel(const int32 Index, const float DeltaSeconds);
+
+	EWfLodLevel PickLevel(const EWfLodLevel Current, const float DistSq) const;
+
+	// Structure of arrays, indexed by dense index
+	TArray<TObjectKey<AActor>> Agents;
+	TArray<FVector> Locations;
+	TArray<EWfLodLevel> Levels;
+	TArray<FTravel> Travels;
+
+	// Agent ids, and the dense index of each
+	TWfDenseIdMap<> Ids;
+
+	struct FCandidate
+	{
+		int32 Index;
+		EWfLodLevel To;
+		float DistSq;
+	};
+	TArray<FCandidate> Candidates;
+
+	TArray<FWfLodTransition> Transitions;
+	TArray<int32> Arrivals;
+};
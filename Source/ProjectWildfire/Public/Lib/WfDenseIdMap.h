@@ -0,0 +1,61 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+ * \brief Stable ids for the rows of a structure of arrays store, which removes a row by swapping the last
+ *  one into its place. The store keeps its rows at dense indices 0 to Num() - 1 and hands out ids; this
+ *  maps between the two both ways, and reuses the ids of removed rows.
+ *  Add() and Remove() must be paired with adding and swap-removing the store's own rows.
+ */
+template <typename IndexType = int32>
+class TWfDenseIdMap
+{
+public:
+
+	// Gives the row just added at index Num() an id
+	IndexType Add()
+	{
+		const IndexType Id = FreeIds.IsEmpty() ? IdToIndex.Add(INDEX_NONE) : FreeIds.Pop(EAllowShrinking::No);
+		IdToIndex[Id] = IndexToId.Num();
+		IndexToId.Add(Id);
+		return Id;
+	}
+
+	// The row at IndexOf(Id) must be swap-removed from the store alongside
+	void Remove(const IndexType Id)
+	{
+		const IndexType Index = IdToIndex[Id];
+		IndexToId.RemoveAtSwap(Index, 1, EAllowShrinking::No);
+		if (Index != IndexToId.Num())
+			IdToIndex[IndexToId[Index]] = Index;
+		IdToIndex[Id] = INDEX_NONE;
+		FreeIds.Add(Id);
+	}
+
+	bool IsValidId(const IndexType Id) const { return IdToIndex.IsValidIndex(Id) && IdToIndex[Id] != INDEX_NONE; }
+
+	// Only for valid ids
+	IndexType IndexOf(const IndexType Id) const { return IdToIndex[Id]; }
+	IndexType IdOf(const IndexType Index) const { return IndexToId[Index]; }
+
+	int32 Num() const { return IndexToId.Num(); }
+
+	void Reset()
+	{
+		IndexToId.Reset();
+		IdToIndex.Reset();
+		FreeIds.Reset();
+	}
+
+private:
+
+	TArray<IndexType> IndexToId;
+
+	// INDEX_NONE for removed ids
+	TArray<IndexType> IdToIndex;
+	TArray<IndexType> FreeIds;
+};
@@ -0,0 +1,149 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class AWfFireApparatusBase;
+struct FCalloutUnits;
+struct FResourceNeeds;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogDispatch, Log, All);
+
+
+// A single "send N of this type" requirement, built from FCalloutUnits or FResourceNeeds
+struct PROJECTWILDFIRE_API FWfUnitRequirement
+{
+	FWfUnitRequirement();
+	explicit FWfUnitRequirement(const FCalloutUnits& CalloutUnits);
+	explicit FWfUnitRequirement(const FResourceNeeds& ResourceNeeds);
+
+	const UClass* UnitClass;
+	int32 Quantity;
+
+	// If false, the recommendation is still considered complete when this requirement can't be met
+	bool bIsRequired;
+};
+
+// A unit chosen by the recommender, in the order it should be dispatched
+struct PROJECTWILDFIRE_API FWfDispatchCandidate
+{
+	int32 UnitIndex;
+	int32 RequirementIndex;
+	float DistanceSquared;
+
+	// Road travel time in seconds; zero when ranked by straight line only, and Max when there is no route
+	float TravelTime;
+};
+
+
+/**
+ * \brief Dense, incrementally maintained table of every fire apparatus that can respond to incidents.
+ *  Availability is kept as bitsets which are updated when the assignment registry changes,
+ *  so a recommendation only walks the set bits of units that can actually respond.
+ *  Owned by AGameManager; has no knowledge of actors beyond the pointer used as the key.
+ */
+class PROJECTWILDFIRE_API FWfDispatchRecommender
+{
+public:
+
+	FWfDispatchRecommender();
+
+	// Registers a unit, returning its unit index. Re-registering returns the existing index.
+	int32 RegisterUnit(const AWfFireApparatusBase* Apparatus, const UClass* UnitClass, const FVector& Location);
+
+	void UnregisterUnit(const AWfFireApparatusBase* Apparatus);
+	void UnregisterUnit(const int32 UnitIndex);
+
+	int32 FindUnit(const AWfFireApparatusBase* Apparatus) const;
+
+	const AWfFireApparatusBase* GetUnitApparatus(const int32 UnitIndex) const;
+
+	// True when the unit is not committed to an incident
+	void SetUnitAvailable(const int32 UnitIndex, const bool bAvailable);
+
+	// True when the unit has at least one firefighter assigned to it
+	void SetUnitStaffed(const int32 UnitIndex, const bool bStaffed);
+
+	// True when the unit is on duty and in service (not out for maintenance, off-shift, etc.)
+	void SetUnitInService(const int32 UnitIndex, const bool bInService);
+
+	void SetUnitLocation(const int32 UnitIndex, const FVector& Location);
+
+	bool IsUnitReady(const int32 UnitIndex) const;
+
+	int32 GetNumUnits() const { return NumUnits; }
+	int32 GetNumReadyUnits() const;
+
+	/**
+	 * \brief Picks the closest ready units satisfying each requirement, closest first.
+	 *  A unit is never picked twice, even if it satisfies more than one requirement.
+	 * \param Location The location of the incident
+	 * \param Requirements The unit types and quantities needed
+	 * \param OutCandidates Receives the ranked units. Cleared before use; capacity is kept between calls.
+	 * \return True if every required requirement was fully satisfied
+	 */
+	bool Recommend(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+		TArray<FWfDispatchCandidate>& OutCandidates) const;
+
+	// Road travel time from the unit to the incident in seconds, or negative if the unit has no route
+	using FTravelTimeFunction = TFunctionRef<float(const int32 UnitIndex)>;
+
+	/**
+	 * \brief Picks the ready units satisfying each requirement with the shortest road travel time, quickest first.
+	 *  Each requirement shortlists ShortlistFactor times its quantity of the closest units by straight line,
+	 *  then keeps the quickest of those, so GetTravelTime is only asked about a handful of units.
+	 *  Units without a route rank after every unit with one.
+	 * \param GetTravelTime Called once per shortlisted unit
+	 * \param ShortlistFactor How many units are considered for every one picked
+	 */
+	bool Recommend(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+		TArray<FWfDispatchCandidate>& OutCandidates, FTravelTimeFunction GetTravelTime, const int32 ShortlistFactor = 4) const;
+
+	void Reset();
+
+private:
+
+	enum EUnitFlags : uint8
+	{
+		Flag_Registered = 1 << 0,
+		Flag_Available  = 1 << 1,
+		Flag_Staffed    = 1 << 2,
+		Flag_InService  = 1 << 3,
+		Flag_Ready      = Flag_Registered | Flag_Available | Flag_Staffed | Flag_InService
+	};
+
+	void SetUnitFlag(const int32 UnitIndex, const uint8 Flag, const bool bValue);
+	void UpdateReadyBit(const int32 UnitIndex);
+	void SetMaskBit(TArray<uint64>& Mask, const int32 UnitIndex, const bool bValue) const;
+	const TArray<uint64>& GetClassMask(const UClass* UnitClass) const;
+
+	// Shared by both Recommend()s; ranks by straight line distance when GetTravelTime is null
+	bool RecommendRanked(const FVector& Location, TConstArrayView<FWfUnitRequirement> Requirements,
+		TArray<FWfDispatchCandidate>& OutCandidates, const FTravelTimeFunction* GetTravelTime, const int32 ShortlistFactor) const;
+
+	// Fills OutClosest with up to MaxCount of the closest ready, unpicked units of the requirement's class, closest first
+	void FindClosest(const FVector& Location, const FWfUnitRequirement& Requirement, const int32 RequirementIndex,
+		const int32 MaxCount, TArray<FWfDispatchCandidate>& OutClosest) const;
+
+	// Structure-of-arrays unit table, indexed by unit index
+	TArray<const AWfFireApparatusBase*> UnitApparatus;
+	TArray<const UClass*> UnitClasses;
+	TArray<float> UnitX;
+	TArray<float> UnitY;
+	TArray<uint8> UnitFlags;
+
+	// One bit per unit; a unit is ready when it is registered, available, staffed and in service
+	TArray<uint64> ReadyMask;
+
+	// Units matching a requirement class (including subclasses), built on first use and kept current
+	mutable TMap<const UClass*, TArray<uint64>> ClassMasks;
+
+	// Scratch mask used while recommending, so a query never allocates once warmed up
+	mutable TArray<uint64> PickedMask;
+	mutable TArray<FWfDispatchCandidate> Shortlist;
+
+	TMap<const AWfFireApparatusBase*, int32> UnitLookup;
+	TArray<int32> FreeUnitIndices;
+	int32 NumUnits;
+};
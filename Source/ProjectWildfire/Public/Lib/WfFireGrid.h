@@ -0,0 +1,163 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogFire, Log, All);
+
+
+// Tuning for FWfFireGrid. Rates are per simulated second.
+struct PROJECTWILDFIRE_API FWfFireGridSettings
+{
+	FWfFireGridSettings();
+
+	// Fraction of the neighbouring heat a cell picks up each second, scaled by how dry it is
+	float SpreadRate;
+
+	// Growth of a burning cell towards full intensity at difficulty 1. Difficulty 0 does not regenerate.
+	float RegenerationRate;
+
+	// Fuel consumed each second by a cell burning at full intensity
+	float BurnRate;
+
+	// Moisture removed each second by full neighbouring heat
+	float DryingRate;
+
+	// Intensity lost each second per unit of moisture
+	float MoistureDamping;
+
+	// Gallons needed to take a cell of difficulty 0 from intensity 1 to 0. Doubled at difficulty 1.
+	float WaterUsage;
+
+	// Moisture gained per gallon of water left over after knocking down the flames
+	float WaterSoak;
+
+	// Cells below this intensity go out
+	float ExtinguishThreshold;
+
+	// Larger steps are split into substeps, keeping the stencil stable at high sim rates
+	float MaxSubstepSeconds;
+	int32 MaxSubsteps;
+};
+
+
+/**
+ * \brief Grid of fire cells stored as a structure of arrays (intensity, fuel, moisture, difficulty).
+ *  Each step runs a 4-neighbour stencil over fixed size tiles, with the tiles spread across
+ *  worker threads. Only tiles that are burning, next to a burning tile, or were just hit with
+ *  water are visited, so a small fire on a large grid costs almost nothing.
+ *  Intensity is double buffered and padded with a border of cold cells, so the inner loops
+ *  have no bounds checks or branches. Everything else is only touched by its own cell.
+ */
+class PROJECTWILDFIRE_API FWfFireGrid
+{
+public:
+
+	static constexpr int32 TileSize = 64;
+
+	FWfFireGrid();
+
+	/**
+	 * \brief Allocates the grid, clearing anything that was burning
+	 * \param InNumX Number of cells along X
+	 * \param InNumY Number of cells along Y
+	 * \param InOrigin World location of the minimum corner of the grid
+	 * \param InCellSize Size of each cell, in centimeters
+	 * \param DefaultFuel Fuel given to every cell, from 0 to 1
+	 */
+	void Initialize(const int32 InNumX, const int32 InNumY, const FVector2D& InOrigin, const float InCellSize,
+		const float DefaultFuel = 1.0f);
+
+	void Reset();
+
+	bool IsInitialized() const { return NumX > 0; }
+	int32 GetNumX() const { return NumX; }
+	int32 GetNumY() const { return NumY; }
+	int32 GetNumCells() const { return NumX * NumY; }
+	float GetCellSize() const { return CellSize; }
+
+	FWfFireGridSettings& GetSettings() { return Settings; }
+	const FWfFireGridSettings& GetSettings() const { return Settings; }
+
+	// Returns the cell containing the location, or INDEX_NONE if it is off the grid
+	int32 GetCellAtLocation(const FVector& Location) const;
+
+	int32 GetCellIndex(const int32 X, const int32 Y) const { return (Y + 1) * Stride + X + 1; }
+	FVector GetCellLocation(const int32 CellIndex) const;
+
+	// Sets the burnable properties of a cell; all values are clamped to 0..1
+	void SetCell(const int32 CellIndex, const float Fuel, const float Moisture, const float Difficulty);
+
+	// Sets the cell on fire. Has no effect on a cell without fuel.
+	void Ignite(const int32 CellIndex, const float Intensity, const float Difficulty);
+
+	/**
+	 * \brief Spreads water evenly over every cell within the radius. Applied on the next step.
+	 * \return The number of cells that received water
+	 */
+	int32 ApplyWater(const FVector& Location, const float Radius, const float Gallons);
+
+	/**
+	 * \brief Advances the simulation, splitting the time into substeps when needed
+	 * \param DeltaSeconds Simulated seconds, already scaled by the sim rate
+	 * \return The number of substeps taken
+	 */
+	int32 Advance(const float DeltaSeconds);
+
+	// Runs a single step of the stencil. Prefer Advance(), which keeps the step size stable.
+	void Step(const float DeltaSeconds);
+
+	float GetIntensity(const int32 CellIndex) const { return Intensity[CellIndex]; }
+	float GetFuel(const int32 CellIndex) const { return Fuel[CellIndex]; }
+	float GetMoisture(const int32 CellIndex) const { return Moisture[CellIndex]; }
+
+	// Highest intensity within the radius, used to sync the fire spots with the grid
+	float GetMaxIntensity(const FVector& Location, const float Radius) const;
+
+	int32 GetNumBurningCells() const { return NumBurningCells; }
+	float GetTotalIntensity() const { return TotalIntensity; }
+	int32 GetNumActiveTiles() const { return ActiveTiles.Num(); }
+	bool IsExtinguished() const { return NumBurningCells == 0 && NumPendingTiles == 0; }
+
+private:
+
+	void StepTile(const int32 TileIndex, const float DeltaSeconds);
+	void GatherActiveTiles();
+	void ZeroTile(TArray<float>& Buffer, const int32 TileIndex);
+	void MarkTilePending(const int32 CellIndex);
+	int32 GetCellTile(const int32 CellIndex) const;
+
+	FWfFireGridSettings Settings;
+
+	int32 NumX;
+	int32 NumY;
+	FVector2D Origin;
+	float CellSize;
+
+	// Row stride of the padded arrays (NumX plus a cold cell at either end)
+	int32 Stride;
+
+	// Structure of arrays, indexed by padded cell index. Intensity is read by neighbours, so it is double buffered.
+	TArray<float> Intensity;
+	TArray<float> NextIntensity;
+	TArray<float> Fuel;
+	TArray<float> Moisture;
+	TArray<float> Difficulty;
+	TArray<float> Water;
+
+	// Per tile results of the last step, written by the tile's own task
+	int32 NumTilesX;
+	int32 NumTilesY;
+	TArray<int32> TileBurningCells;
+	TArray<float> TileIntensity;
+	TArray<uint8> TileWasActive;
+
+	// Tiles visited by the next step, and tiles that were ignited or watered since the last one
+	TArray<int32> ActiveTiles;
+	TArray<uint8> TilePending;
+	int32 NumPendingTiles;
+
+	int32 NumBurningCells;
+	float TotalIntensity;
+};
@@ -0,0 +1,165 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogHydraulics, Log, All);
+
+
+// Tuning for FWfHydraulics
+struct PROJECTWILDFIRE_API FWfHydraulicsSettings
+{
+	FWfHydraulicsSettings();
+
+	// A network has converged once no line's flow changes by more than this between iterations, in gpm
+	float FlowTolerance;
+
+	// Newton iterations given to one network per Update() before moving on to the next
+	int32 MaxIterationsPerUpdate;
+
+	// Gauss-Seidel sweeps over the pressures inside each iteration
+	int32 PressureSweeps;
+
+	// Lines flowing less than this are linearized around it, so a closed or idle line stays solvable
+	float MinLinearFlow;
+};
+
+
+/**
+ * \brief Water supply for every incident, as one small pipe network per incident.
+ *  Tanks, hydrants and pumps feed hose lines that end in nozzles. Each line obeys
+ *  (pressure in) + (pump gain) - (pressure out) = R * Q * |Q|, and every junction has to balance.
+ *  Networks are solved with linearized Newton iterations, where each iteration is a few
+ *  Gauss-Seidel sweeps over the junction pressures along a compressed adjacency list. The last
+ *  solution is kept as the starting point, so an unchanged network converges in an iteration or two.
+ *  Update() works through the networks round-robin until its time budget runs out; a network it
+ *  does not reach keeps flowing at its last solution. Pressures are in psi, flows in gpm.
+ *  Owned by AGameManager, server only.
+ */
+class PROJECTWILDFIRE_API FWfHydraulics
+{
+public:
+
+	FWfHydraulics();
+
+	// Adds an empty network, returning the network id used for every other call
+	int32 AddNetwork();
+
+	void RemoveNetwork(const int32 NetworkId);
+
+	bool IsValidNetwork(const int32 NetworkId) const { return Networks.IsValidIndex(NetworkId); }
+
+	/**
+	 * \brief Adds a junction where lines can be joined (a wye, a manifold, a pump's discharge)
+	 * \return The node id, local to the network
+	 */
+	int32 AddJunction(const int32 NetworkId);
+
+	// Adds a water tank. Pumps draft from it at atmospheric pressure until it runs dry.
+	int32 AddTank(const int32 NetworkId, const float Gallons);
+
+	/**
+	 * \brief Adds a hydrant on a water main
+	 * \param StaticPsi Pressure with nothing flowing
+	 * \param ResidualPsi Pressure remaining while flowing ResidualGpm, which sets how much the main can supply
+	 * \return The node id of the hydrant outlet
+	 */
+	int32 AddHydrant(const int32 NetworkId, const float StaticPsi, const float ResidualPsi, const float ResidualGpm);
+
+	/**
+	 * \brief Adds a fire pump between two nodes, with a check valve stopping it flowing backwards
+	 * \param ShutoffPsi Pressure the pump adds when no water is flowing
+	 * \param RatedGpm, RatedPsi One point on the pump curve
+	 * \return The line id, local to the network
+	 */
+	int32 AddPump(const int32 NetworkId, const int32 FromNode, const int32 ToNode,
+		const float ShutoffPsi, const float RatedGpm, const float RatedPsi);
+
+	// Adds a hose line. Friction loss follows the fireground formula, scaled by diameter.
+	int32 AddHoseLine(const int32 NetworkId, const int32 FromNode, const int32 ToNode,
+		const float DiameterInches, const float LengthFeet);
+
+	// Adds a nozzle discharging the node to atmosphere, flowing RatedGpm at RatedPsi
+	int32 AddNozzle(const int32 NetworkId, const int32 Node, const float RatedGpm, const float RatedPsi);
+
+	// Opens or shuts a line (a nozzle bail, a discharge gate)
+	void SetLineOpen(const int32 NetworkId, const int32 Line, const bool bOpen);
+
+	void RefillTank(const int32 NetworkId, const int32 Node, const float Gallons);
+
+	/**
+	 * \brief Solves as many networks as fit in the budget, then moves the water for the simulated time
+	 * \param SimSeconds Simulated seconds, already scaled by the sim rate
+	 * \param BudgetSeconds Real time the solver may spend before the remaining networks wait for the next update
+	 * \return The number of networks solved
+	 */
+	int32 Update(const float SimSeconds, const double BudgetSeconds);
+
+	float GetPressure(const int32 NetworkId, const int32 Node) const;
+	float GetFlow(const int32 NetworkId, const int32 Line) const;
+	float GetTankGallons(const int32 NetworkId, const int32 Node) const;
+
+	// Returns the gallons the nozzle has discharged since the last call, for the caller to put on the fire
+	float TakeDischargedGallons(const int32 NetworkId, const int32 Line);
+
+	bool IsConverged(const int32 NetworkId) const;
+
+	int32 GetNumNetworks() const { return Networks.Num(); }
+
+	void Reset();
+
+	FWfHydraulicsSettings& GetSettings() { return Settings; }
+	const FWfHydraulicsSettings& GetSettings() const { return Settings; }
+
+private:
+
+	enum class ENodeKind : uint8
+	{
+		Junction,
+		Fixed,
+		Tank
+	};
+
+	// Structure of arrays, indexed by node id and line id. Node 0 is the atmosphere.
+	struct FNetwork
+	{
+		TArray<float> Pressure;
+		TArray<float> TankGallons;
+		TArray<ENodeKind> NodeKind;
+
+		TArray<int32> LineFrom;
+		TArray<int32> LineTo;
+		TArray<float> Resistance;
+		TArray<float> Gain;
+		TArray<float> Flow;
+		TArray<float> Conductance;
+		TArray<float> Discharged;
+		TArray<uint8> LineOpen;
+		TArray<uint8> CheckValve;
+
+		// Lines touching each node, as offsets into AdjacentLines. Rebuilt when lines are added.
+		TArray<int32> AdjacencyStart;
+		TArray<int32> AdjacentLines;
+
+		bool bTopologyDirty = true;
+		bool bConverged = false;
+	};
+
+	int32 AddNode(FNetwork& Network, const ENodeKind Kind, const float Pressure);
+	int32 AddLine(FNetwork& Network, const int32 FromNode, const int32 ToNode, const float Resistance, const float Gain);
+	bool IsLineFlowing(const FNetwork& Network, const int32 Line) const;
+	void BuildAdjacency(FNetwork& Network);
+
+	// Runs up to MaxIterationsPerUpdate Newton iterations, returning true once the flows settle
+	bool Solve(FNetwork& Network);
+
+	void Integrate(FNetwork& Network, const float SimSeconds);
+
+	FWfHydraulicsSettings Settings;
+
+	TSparseArray<FNetwork> Networks;
+
+	// Where the next Update() starts, so every network gets its turn when the budget is tight
+	int32 NextNetwork;
+};
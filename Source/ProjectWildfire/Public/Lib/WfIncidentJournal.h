@@ -0,0 +1,174 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Tasks/Task.h"
+
+#include <atomic>
+
+class IFileHandle;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogJournal, Log, All);
+
+
+// Everything the journal can record. Append only; the decoder reads old files by these values.
+enum class EWfJournalEvent : uint8
+{
+	CalloutRejected = 0,	// Name reason
+	IncidentCreated,		// Name callout row, Name property
+	StateChanged,			// Int from state, Int to state
+	ActorAttached,			// Name callout actor
+	ActorReleased,			// Name callout actor
+	UnitAssigned,			// Name apparatus, Name firefighter
+	AttackLineLaid,			// Int attack line, Float nozzle gpm
+	HydrantConnected,		// Float static psi, Float residual psi
+	WaterApplied,			// Float gallons, Int cells wetted
+	PatientTreated,			// Int patient, Float treatment per second
+	FireGridStarted,		// Int cells, Int fire spots
+	WildfireStarted,		// Int fire spots
+	FireOut,
+	Num
+};
+
+// One argument of a journal event. Names are stored by their index, and only written out once per file.
+struct PROJECTWILDFIRE_API FWfJournalArg
+{
+	enum class EType : uint8 { None = 0, Int, Float, Name };
+
+	FWfJournalArg() : Type(EType::None), Bits(0) {}
+	FWfJournalArg(const int32 Value) : Type(EType::Int), Bits(static_cast<uint64>(static_cast<int64>(Value))) {}
+	FWfJournalArg(const float Value) : Type(EType::Float), Bits(0) { const double Wide = Value; FMemory::Memcpy(&Bits, &Wide, sizeof(Bits)); }
+	FWfJournalArg(const FName Value)
+		: Type(EType::Name)
+		, Bits(static_cast<uint64>(Value.GetDisplayIndex().ToUnstableInt()) << 32 | static_cast<uint32>(Value.GetNumber()))
+	{
+	}
+
+	EType Type;
+	uint64 Bits;
+};
+
+// As written to the ring and to disk
+struct FWfJournalEntry
+{
+	uint64 Cycles;
+	int32 IncidentNumber;
+	uint8 Event;
+	uint8 ArgTypes;		// Two bits per argument
+	uint16 Reserved;
+	uint64 Args[2];
+};
+static_assert(sizeof(FWfJournalEntry) == 32, "Journal entries are written to disk as-is");
+
+
+/**
+ * \brief Binary, per-incident event journal. Server only.
+ *  Each incident records into its own fixed ring of 32 byte entries: a cycle counter timestamp, the
+ *  event and two typed arguments. Recording is a handful of stores and an atomic publish, with no
+ *  formatting and no allocation; a full ring drops the event and counts the drop.
+ *  Flush() launches a background task that drains the rings and appends them to the journal file,
+ *  along with the names used since the last flush. The game thread is the only producer and the
+ *  flush task the only consumer of each ring, so neither side locks.
+ *  Decode() turns a journal file back into text; see the WfJournalDecode commandlet.
+ */
+class PROJECTWILDFIRE_API FWfIncidentJournal
+{
+public:
+
+	// Journal for events that belong to no incident, such as callouts rejected before they were created
+	static constexpr int32 ServerJournalId = 0;
+
+	static FWfIncidentJournal& Get();
+
+	UE_NONCOPYABLE(FWfIncidentJournal);
+
+	FWfIncidentJournal();
+	~FWfIncidentJournal();
+
+	/**
+	 * \brief Opens the journal file and allocates the rings
+	 * \param Path The file to write; replaced if it exists
+	 * \param MaxIncidents Incidents that can be journaled at once; more are not journaled
+	 * \param EntriesPerIncident Events each incident can hold between flushes, rounded up to a power of two
+	 */
+	bool Start(const FString& Path, const int32 MaxIncidents = 256, const int32 EntriesPerIncident = 256);
+
+	// Flushes everything left and closes the file
+	void Stop();
+
+	bool IsStarted() const { return FileHandle.IsValid(); }
+
+	// Gives the incident a ring. Returns its journal id, or INDEX_NONE if every ring is in use.
+	int32 OpenIncident(const int32 IncidentNumber);
+
+	// The ring is flushed and then reused; the id must not be recorded to afterwards
+	void CloseIncident(const int32 JournalId);
+
+	// Game thread only. Does nothing if the id is INDEX_NONE, so unjournaled incidents can call it freely.
+	void Record(const int32 JournalId, const EWfJournalEvent Event,
+		const FWfJournalArg& First = FWfJournalArg(), const FWfJournalArg& Second = FWfJournalArg())
+	{
+		if (JournalId >= 0 && JournalId < Rings.Num())
+			Rings[JournalId].Push(Event, First, Second);
+	}
+
+	// Starts a flush in the background, unless the last one is still running
+	void Flush();
+
+	// Converts a journal file to one line of text per event
+	static bool Decode(const FString& Path, FString& OutText);
+
+private:
+
+	struct FRing
+	{
+		enum EState : uint8 { Free = 0, Open, Closing };
+
+		void Push(const EWfJournalEvent Event, const FWfJournalArg& First, const FWfJournalArg& Second)
+		{
+			if (State.load(std::memory_order_relaxed) != Open)
+				return;
+
+			const uint32 Index = Head.load(std::memory_order_relaxed);
+			if (Index - Tail.load(std::memory_order_acquire) > Mask)
+			{
+				NumDropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			FWfJournalEntry& Entry = Entries.GetData()[Index & Mask];
+			Entry.Cycles = FPlatformTime::Cycles64();
+			Entry.IncidentNumber = IncidentNumber;
+			Entry.Event = static_cast<uint8>(Event);
+			Entry.ArgTypes = static_cast<uint8>(First.Type) | static_cast<uint8>(Second.Type) << 2;
+			Entry.Reserved = 0;
+			Entry.Args[0] = First.Bits;
+			Entry.Args[1] = Second.Bits;
+			Head.store(Index + 1, std::memory_order_release);
+		}
+
+		TArray<FWfJournalEntry> Entries;
+		uint32 Mask = 0;
+		int32 IncidentNumber = 0;
+
+		std::atomic<uint32> Head { 0 };
+		std::atomic<uint32> Tail { 0 };
+		std::atomic<uint32> NumDropped { 0 };
+		std::atomic<uint8> State { Free };
+	};
+
+	// Runs on the flush task: drains every ring into one write
+	void DrainRings();
+
+	void WaitForFlush();
+
+	TArray<FRing> Rings;
+	TUniquePtr<IFileHandle> FileHandle;
+	UE::Tasks::TTask<void> FlushJob;
+
+	// Only touched by the flush task
+	TArray<uint8> WriteBuffer;
+	TArray<FWfJournalEntry> DrainBuffer;
+	TSet<uint32> WrittenNames;
+};
@@ -0,0 +1,182 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "WfIncidentLifecycle.generated.h"
+
+class AWfCalloutActor;
+class AWfPropertyActor;
+
+
+UENUM(BlueprintType)
+enum class EWfIncidentState : uint8
+{
+	Pending = 0,
+	PreAlert,
+	Dispatched,
+	EnRoute,
+	OnScene,
+	Controlled,
+	Closed,
+	Expired,
+	Num UMETA(Hidden)
+};
+
+UENUM(BlueprintType)
+enum class EWfIncidentEvent : uint8
+{
+	Alert = 0,		// The call has been received and toned out
+	Dispatch,		// Units have been sent
+	Respond,		// A unit is responding
+	Arrive,			// A unit is on scene
+	Control,		// The fire is out and the patients are stable
+	Close,			// The incident is over
+	Expire,			// The resolution deadline passed
+	Num UMETA(Hidden)
+};
+
+
+/**
+ * \brief The incident lifecycle as a transition table.
+ *  Transitions and hooks are registered up front, then Compile() flattens them: the next state is a
+ *  lookup in a [state][event] table, and the hooks for each (from, to) pair (exit, transition,
+ *  any-transition, then enter) are laid out contiguously, so firing an event is one lookup and
+ *  a straight walk over the hooks for that edge.
+ */
+class PROJECTWILDFIRE_API FWfIncidentStateMachine
+{
+public:
+
+	// Called with the id the event was fired for, and the edge taken
+	using FHook = TFunction<void(const int32 Id, const EWfIncidentState From, const EWfIncidentState To)>;
+
+	static constexpr int32 NumStates = static_cast<int32>(EWfIncidentState::Num);
+	static constexpr int32 NumEvents = static_cast<int32>(EWfIncidentEvent::Num);
+
+	FWfIncidentStateMachine();
+
+	void AddTransition(const EWfIncidentState From, const EWfIncidentEvent Event, const EWfIncidentState To);
+
+	void AddEnterHook(const EWfIncidentState State, FHook Hook);
+	void AddExitHook(const EWfIncidentState State, FHook Hook);
+	void AddTransitionHook(const EWfIncidentState From, const EWfIncidentState To, FHook Hook);
+
+	// Runs on every transition, between the exit and enter hooks
+	void AddAnyTransitionHook(FHook Hook);
+
+	// Builds the dispatch tables. Must be called after the last Add, and before Fire().
+	void Compile();
+
+	bool IsCompiled() const { return bCompiled; }
+
+	// The state the event leads to, or Num if the event is not allowed in that state
+	EWfIncidentState GetNextState(const EWfIncidentState From, const EWfIncidentEvent Event) const;
+
+	/**
+	 * \brief Moves State along the event's transition and runs the hooks for the edge
+	 * \return False (and State is untouched) if the event is not allowed in the current state
+	 */
+	bool Fire(const int32 Id, EWfIncidentState& State, const EWfIncidentEvent Event) const;
+
+private:
+
+	static int32 GetEdgeIndex(const EWfIncidentState From, const EWfIncidentState To)
+	{
+		return static_cast<int32>(From) * NumStates + static_cast<int32>(To);
+	}
+
+	// Registered hooks, before compiling
+	TArray<FHook> EnterHooks[NumStates];
+	TArray<FHook> ExitHooks[NumStates];
+	TMultiMap<int32, FHook> EdgeHooks;
+	TArray<FHook> AnyHooks;
+
+	// Compiled tables. NextState is indexed by [state * NumEvents + event].
+	uint8 NextState[NumStates * NumEvents];
+	TArray<FHook> CompiledHooks;
+	TArray<int32> EdgeHookStart;
+
+	bool bCompiled;
+};
+
+
+// Identifies a record in FWfIncidentPool. Stale once the record is released, even if the slot is reused.
+struct PROJECTWILDFIRE_API FWfIncidentHandle
+{
+	int32 Index = INDEX_NONE;
+	uint32 Generation = 0;
+
+	bool IsSet() const { return Index != INDEX_NONE; }
+};
+
+// A live incident, before or after it has an actor
+struct PROJECTWILDFIRE_API FWfIncidentRecord
+{
+	int32 IncidentNumber = 0;
+	EWfIncidentState State = EWfIncidentState::Pending;
+
+	// The row of the callouts data table this incident was made from
+	FName CalloutType;
+
+	FVector Location = FVector::ZeroVector;
+	TWeakObjectPtr<AWfPropertyActor> PropertyActor;
+
+	// Class of AWfCalloutActor spawned when the incident is attached
+	UClass* CalloutActorClass = nullptr;
+
+	// Simulated time the deadline passes, and world time the current state was entered
+	FDateTime ResolutionDeadline;
+	double StateEnteredSeconds = 0.0;
+
+	// Only set while a player is nearby or units have been dispatched
+	TWeakObjectPtr<AWfCalloutActor> CalloutActor;
+
+	// The incident's ring in FWfIncidentJournal, if it got one
+	int32 JournalId = INDEX_NONE;
+
+	uint32 Generation = 0;
+	bool bInUse = false;
+};
+
+
+/**
+ * \brief Fixed slots of incident records, reused through a free list, so creating and
+ *  closing incidents does not allocate once the pool has grown to the busiest it has been.
+ */
+class PROJECTWILDFIRE_API FWfIncidentPool
+{
+public:
+
+	FWfIncidentHandle Acquire();
+
+	void Release(const FWfIncidentHandle Handle);
+
+	// Null if the handle is stale
+	FWfIncidentRecord* Get(const FWfIncidentHandle Handle);
+	const FWfIncidentRecord* Get(const FWfIncidentHandle Handle) const;
+
+	FWfIncidentHandle GetHandle(const int32 Index) const;
+
+	// Slots in use are visited in slot order; the function may not acquire or release
+	template <typename FunctionType>
+	void ForEachActive(FunctionType&& Function)
+	{
+		for (int32 Index = 0; Index < Records.Num(); ++Index)
+		{
+			if (Records[Index].bInUse)
+				Function(Index, Records[Index]);
+		}
+	}
+
+	int32 GetNumActive() const { return Records.Num() - FreeSlots.Num(); }
+	int32 GetNumSlots() const { return Records.Num(); }
+
+	void Reset();
+
+private:
+
+	TArray<FWfIncidentRecord> Records;
+	TArray<int32> FreeSlots;
+};
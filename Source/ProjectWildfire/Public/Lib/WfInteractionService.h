@@ -0,0 +1,174 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class AWfActorBase;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogInteraction, Log, All);
+
+
+enum class EWfSlotState : uint8
+{
+	Free = 0,
+	Reserved,		// Claimed, but the interaction has not started; expires after ReserveSeconds
+	Running,		// Interacting until the wheel completes it
+	Holding			// Completed or instant, still in use until the character stops
+};
+
+// A slot of one prop
+struct FWfInteractionSlot
+{
+	int32 PropId = INDEX_NONE;
+	int32 Slot = INDEX_NONE;
+
+	bool IsValid() const { return PropId != INDEX_NONE && Slot != INDEX_NONE; }
+};
+
+
+/**
+ * \brief Slot reservations, FIFO queues and timing for every interactive prop.
+ *  Each prop has up to 32 slots, tracked as a free mask, and characters hold at most one slot
+ *  or one place in a queue at a time. Freed slots pass straight to the head of the prop's queue,
+ *  so characters waiting on a busy prop are told when it is their turn instead of retrying.
+ *  Props are bucketed into a grid of CellSize cells; FindNearestFree() only looks at the cell of the
+ *  location and its eight neighbours, so its cost does not grow with the number of props.
+ *  Running interactions and reservations time out on one timer wheel of TickSeconds resolution,
+ *  stepped by AGameManager, rather than on a timer per prop.
+ */
+class PROJECTWILDFIRE_API FWfInteractionService
+{
+public:
+
+	FWfInteractionService();
+
+	// Registers the prop at its current location. Returns its prop id.
+	int32 AddProp(AWfActorBase* Prop, const int32 NumSlots);
+
+	// Moves the prop to the location, and to the location's cell if it changed. Called by movable props as they move.
+	void MoveProp(const int32 PropId, const FVector& Location);
+
+	// Frees every slot and queue of the prop without completing anything
+	void RemoveProp(const int32 PropId);
+
+	bool IsValidProp(const int32 PropId) const { return Props.IsValidIndex(PropId); }
+
+	AWfActorBase* GetProp(const int32 PropId) const;
+
+	// Reserves a free slot for the character. Returns the slot, or INDEX_NONE if every slot is taken.
+	int32 Reserve(const int32 PropId, AActor* Character);
+
+	// Reserves a slot if one is free, otherwise joins the back of the prop's queue. True if reserved now.
+	bool ReserveOrQueue(const int32 PropId, AActor* Character);
+
+	// Frees the character's slot, passing it to the head of the queue, or takes the character out of the queue
+	void Release(AActor* Character);
+
+	// The closest prop of the class with a free slot, in the location's cell or its neighbours. INDEX_NONE if none.
+	int32 FindNearestFree(const UClass* PropClass, const FVector& Location) const;
+
+	// Reserves a slot on the closest free prop of the class, releasing whatever the character held before
+	FWfInteractionSlot ClaimNearest(AActor* Character, const UClass* PropClass, const FVector& Location);
+
+	FWfInteractionSlot FindClaim(const AActor* Character) const;
+
+	// The prop whose queue the character is waiting in, or INDEX_NONE
+	int32 FindQueue(const AActor* Character) const;
+
+	EWfSlotState GetSlotState(const FWfInteractionSlot& Claim) const;
+
+	AActor* GetOccupant(const FWfInteractionSlot& Claim) const;
+
+	// Everyone holding a slot of the prop
+	void GetOccupants(const int32 PropId, TArray<AActor*>& OutCharacters) const;
+
+	// Runs the character's slot; the prop completes it after Seconds, unless it is released first
+	bool StartTimer(AActor* Character, const float Seconds);
+
+	// Marks the character's slot in use with nothing left to time
+	bool Hold(AActor* Character);
+
+	// Advances the wheel, completing interactions and expiring reservations that fall due
+	void Step(const float DeltaSeconds);
+
+	int32 GetNumProps() const { return Props.Num(); }
+
+	// Timers on the wheel, including cancelled ones that have not fallen due yet
+	int32 GetNumTimers() const { return NumTimers; }
+
+	void Reset();
+
+	// Seconds per wheel tick; timers fire on the first step after they fall due
+	float TickSeconds;
+
+	// Seconds a reservation is kept without its interaction starting
+	float ReserveSeconds;
+
+	// Size of the grid cells props are bucketed in, in cm
+	float CellSize;
+
+private:
+
+	static constexpr int32 NumBuckets = 256;
+
+	enum class ETimerKind : uint8 { Complete, Expire };
+
+	struct FSlot
+	{
+		TObjectKey<AActor> Occupant;
+		uint32 TimerId = 0;
+		EWfSlotState State = EWfSlotState::Free;
+	};
+
+	struct FProp
+	{
+		TWeakObjectPtr<AWfActorBase> Actor;
+		const UClass* Class = nullptr;
+		FVector Location = FVector::ZeroVector;
+		FIntPoint Cell = FIntPoint::ZeroValue;
+		uint32 FreeMask = 0;
+		TArray<FSlot, TInlineAllocator<4>> Slots;
+		TArray<TObjectKey<AActor>> Queue;
+	};
+
+	struct FTimer
+	{
+		uint64 DueTick;
+		uint32 TimerId;
+		int32 PropId;
+		int32 Slot;
+		ETimerKind Kind;
+	};
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	int32 TakeSlot(const int32 PropId, AActor* Character, const EWfSlotState State);
+
+	void FreeSlot(const int32 PropId, const int32 Slot);
+
+	void ReclaimAbandoned(const int32 PropId);
+
+	// Gives the freed slots of the prop to the characters at the head of its queue
+	void GrantQueued(const int32 PropId);
+
+	void Schedule(const int32 PropId, const int32 Slot, const ETimerKind Kind, const float Seconds);
+
+	void CollectBucket(const int32 BucketIndex);
+
+	void Fire(const FTimer& Timer);
+
+	TSparseArray<FProp> Props;
+	TMap<FIntPoint, TArray<int32>> Cells;
+
+	TMap<TObjectKey<AActor>, FWfInteractionSlot> Claims;
+	TMap<TObjectKey<AActor>, int32> Queued;
+
+	TArray<FTimer> Buckets[NumBuckets];
+	TArray<FTimer> Fired;
+	uint64 CurrentTick;
+	uint32 NextTimerId;
+	int32 NumTimers;
+	float Accumulated;
+};
@@ -0,0 +1,193 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCalloutEquipmentUse;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogInventory, Log, All);
+
+
+// One bit per interned equipment type
+struct PROJECTWILDFIRE_API FWfEquipmentMask
+{
+	static constexpr int32 NumWords = 4;
+
+	uint64 Words[NumWords] = {};
+
+	void Set(const int32 EquipmentId) { Words[EquipmentId >> 6] |= 1ull << (EquipmentId & 63); }
+	void Clear(const int32 EquipmentId) { Words[EquipmentId >> 6] &= ~(1ull << (EquipmentId & 63)); }
+	bool IsSet(const int32 EquipmentId) const { return (Words[EquipmentId >> 6] & (1ull << (EquipmentId & 63))) != 0; }
+
+	bool IsEmpty() const;
+
+	// True when every bit set in Other is also set here
+	bool ContainsAll(const FWfEquipmentMask& Other) const;
+
+	FWfEquipmentMask& operator|=(const FWfEquipmentMask& Other);
+
+	// Bits set in this mask but not in Other
+	FWfEquipmentMask Without(const FWfEquipmentMask& Other) const;
+};
+
+// A set of quantity changes that is applied completely or not at all
+class PROJECTWILDFIRE_API FWfInventoryTransaction
+{
+public:
+
+	// Adds (or with a negative amount, removes) equipment from a container
+	void Add(const int32 ContainerId, const int32 EquipmentId, const float Amount);
+
+	void Transfer(const int32 FromContainerId, const int32 ToContainerId, const int32 EquipmentId, const float Amount);
+
+	bool IsEmpty() const { return Deltas.IsEmpty(); }
+
+private:
+
+	friend class FWfInventory;
+
+	struct FDelta
+	{
+		int32 ContainerId;
+		int32 EquipmentId;
+		float Amount;
+	};
+
+	TArray<FDelta> Deltas;
+};
+
+
+/**
+ * \brief Equipment carried by apparatus and stored at stations.
+ *  Equipment classes are interned to small ids, and each container holds dense quantity and
+ *  capacity arrays indexed by id, plus a mask of what it has in stock. Tasks (the equipment a
+ *  fire spot or patient needs) are compiled once into a required mask and a consumable list,
+ *  so "can this unit do this task" is a handful of word compares.
+ *  Consumption is queued and applied in one batch per sim step; restocks and transfers go
+ *  through transactions that either fully apply or leave everything untouched.
+ *  Owned by AGameManager, server only.
+ */
+class PROJECTWILDFIRE_API FWfInventory
+{
+public:
+
+	static constexpr int32 MaxEquipmentTypes = FWfEquipmentMask::NumWords * 64;
+
+	FWfInventory();
+
+	// Returns the id of the equipment class, interning it if needed. INDEX_NONE if null or out of ids.
+	int32 InternEquipment(const UClass* EquipmentClass);
+
+	int32 FindEquipment(const UClass* EquipmentClass) const;
+
+	const UClass* GetEquipmentClass(const int32 EquipmentId) const;
+
+	int32 GetNumEquipmentTypes() const { return EquipmentClasses.Num(); }
+
+	// Adds a container for the owner, or returns the existing one
+	int32 AddContainer(const UObject* Owner);
+
+	void RemoveContainer(const int32 ContainerId);
+
+	int32 FindContainer(const UObject* Owner) const;
+
+	bool IsValidContainer(const int32 ContainerId) const { return Containers.IsValidIndex(ContainerId); }
+
+	// The most the container can hold of the equipment. Containers have no limit until one is set.
+	void SetCapacity(const int32 ContainerId, const int32 EquipmentId, const float Capacity);
+
+	float GetQuantity(const int32 ContainerId, const int32 EquipmentId) const;
+
+	float GetCapacity(const int32 ContainerId, const int32 EquipmentId) const;
+
+	const FWfEquipmentMask& GetStockMask(const int32 ContainerId) const;
+
+	/**
+	 * \brief Compiles the equipment used by a task. Identical equipment lists share a task id.
+	 * \return The task id, or INDEX_NONE if the equipment could not be interned
+	 */
+	int32 CompileTask(TConstArrayView<FCalloutEquipmentUse> EquipmentUsage);
+
+	const FWfEquipmentMask& GetTaskMask(const int32 TaskId) const;
+
+	// True when the container has every item the task uses in stock
+	bool CanPerform(const int32 ContainerId, const int32 TaskId) const;
+
+	// Equipment the task needs that none of the containers have in stock. Empty if together they can do it.
+	FWfEquipmentMask GetMissingEquipment(const int32 TaskId, TConstArrayView<int32> ContainerIds) const;
+
+	// Adds each container that can perform the task on its own to OutContainerIds
+	void FindCapableContainers(const int32 TaskId, TConstArrayView<int32> ContainerIds, TArray<int32>& OutContainerIds) const;
+
+	/**
+	 * \brief Queues consumption for the next ProcessConsumption()
+	 * \param Progress The fraction of the task being performed; consumes TotalUsageValue times this of each consumable
+	 * \return Index of the request, used to read back the progress actually made
+	 */
+	int32 QueueConsumption(const int32 ContainerId, const int32 TaskId, const float Progress);
+
+	/**
+	 * \brief Applies all queued consumption. A request that runs short of any consumable makes
+	 *  proportionally less progress, and uses proportionally less of everything.
+	 * \param OutProgress If given, receives the progress each request actually made, by request index
+	 */
+	void ProcessConsumption(TArray<float>* OutProgress = nullptr);
+
+	int32 GetNumQueuedConsumption() const { return QueuedConsumption.Num(); }
+
+	// Applies the transaction if no quantity would go below zero or above capacity. Otherwise nothing changes.
+	bool Commit(const FWfInventoryTransaction& Transaction);
+
+	bool Restock(const int32 ContainerId, const int32 EquipmentId, const float Amount);
+
+	// Fills every capped item in the container up to its capacity
+	bool RestockToCapacity(const int32 ContainerId);
+
+	bool Transfer(const int32 FromContainerId, const int32 ToContainerId, const int32 EquipmentId, const float Amount);
+
+	void Reset();
+
+private:
+
+	struct FContainer
+	{
+		const UObject* Owner = nullptr;
+		TArray<float> Quantities;
+		TArray<float> Capacities;
+		FWfEquipmentMask StockMask;
+	};
+
+	struct FTask
+	{
+		FWfEquipmentMask RequiredMask;
+		TArray<int32> ConsumableIds;
+		TArray<float> ConsumableRates;
+		uint32 Hash = 0;
+	};
+
+	struct FConsumption
+	{
+		int32 ContainerId;
+		int32 TaskId;
+		float Progress;
+	};
+
+	// Grows the container's arrays to cover every interned equipment type
+	void EnsureSized(FContainer& Container) const;
+	void UpdateStockBit(FContainer& Container, const int32 EquipmentId) const;
+
+	TArray<const UClass*> EquipmentClasses;
+	TMap<const UClass*, int32> EquipmentLookup;
+
+	TSparseArray<FContainer> Containers;
+	TMap<const UObject*, int32> ContainerLookup;
+
+	TArray<FTask> Tasks;
+	TMultiMap<uint32, int32> TaskLookup;
+
+	TArray<FConsumption> QueuedConsumption;
+
+	// Scratch for Commit, keyed by container and equipment, so a transaction never allocates once warmed up
+	TMap<TPair<int32, int32>, float> CommitTotals;
+};
@@ -0,0 +1,99 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Gas/WfAttributeSet.h"
+#include "Lib/WfDenseIdMap.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogNeeds, Log, All);
+
+
+// The attributes the needs simulation advances on its own. Each is a UWfAttributeSet attribute.
+enum class EWfNeed : uint8
+{
+	Hunger = 0,
+	Thirst,
+	Fatigue,
+	Morale,
+	Num
+};
+
+
+/**
+ * \brief Hunger, thirst, fatigue and morale of every character, in flat structure-of-arrays.
+ *  Step() advances each need for all characters in one branch-free pass per need, by simulated time.
+ *  The store owns the running values; attribute sets are only written when a value crosses a multiple
+ *  of ThresholdStep, or every WriteBackSeconds for values that moved by at least WriteBackTolerance,
+ *  so the attribute delegates and replication only see changes worth sending.
+ *  Anything that changes one of these attributes directly must call SetValue() to keep the store in step.
+ *  Owned by AGameManager, server only.
+ */
+class PROJECTWILDFIRE_API FWfNeedsStore
+{
+public:
+
+	FWfNeedsStore();
+
+	// Adds a character, starting from the attribute set's current values. Returns its needs id.
+	int32 AddCharacter(UWfAttributeSet* AttributeSet);
+
+	// Swaps the last character into the removed one's place; ids of other characters stay valid
+	void RemoveCharacter(const int32 NeedsId);
+
+	bool IsValidCharacter(const int32 NeedsId) const { return Ids.IsValidId(NeedsId); }
+
+	// Change per simulated second; negative rates drain the need
+	void SetRate(const int32 NeedsId, const EWfNeed Need, const float PerSecond);
+
+	// Takes a value already set on the attribute set, so the next write back does not undo it
+	void SetValue(const int32 NeedsId, const EWfNeed Need, const float Value);
+
+	float GetValue(const int32 NeedsId, const EWfNeed Need) const;
+
+	/**
+	 * \brief Advances every need of every character, then writes back what crossed a threshold or is due
+	 * \param SimSeconds Simulated seconds since the last step
+	 * \param WallSeconds Real seconds since the last step, for throttling the write back
+	 */
+	void Step(const float SimSeconds, const float WallSeconds);
+
+	int32 GetNumCharacters() const { return AttributeSets.Num(); }
+
+	// Attribute values written to attribute sets by the last step
+	int32 GetNumWritten() const { return NumWritten; }
+
+	void Reset();
+
+	static EWfAttribute GetAttribute(const EWfNeed Need);
+
+	// EWfNeed::Num if the attribute is not one of the needs
+	static EWfNeed FindNeed(const FGameplayAttribute& GameAttribute);
+
+	// Values are written back whenever they cross a multiple of this
+	float ThresholdStep;
+
+	// Real seconds between writing back values that moved without crossing a threshold
+	float WriteBackSeconds;
+
+	// Smallest change the throttled write back bothers sending
+	float WriteBackTolerance;
+
+private:
+
+	static constexpr int32 NumNeeds = static_cast<int32>(EWfNeed::Num);
+
+	void WriteBack(const int32 Index, const int32 NeedIndex);
+
+	// Structure of arrays, indexed by dense index
+	TArray<float> Values[NumNeeds];
+	TArray<float> Rates[NumNeeds];
+	TArray<float> Written[NumNeeds];
+	TArray<TWeakObjectPtr<UWfAttributeSet>> AttributeSets;
+
+	// Needs ids, and the dense index of each
+	TWfDenseIdMap<> Ids;
+
+	float SecondsSinceWriteBack;
+	int32 NumWritten;
+};
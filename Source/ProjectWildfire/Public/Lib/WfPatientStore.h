@@ -0,0 +1,118 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FCalloutDataMedical;
+
+
+enum class EWfPatientState : uint8
+{
+	Deteriorating = 0,
+	Stabilized,
+	Deceased
+};
+
+// Vital signs of a patient, derived from their condition every step
+struct PROJECTWILDFIRE_API FWfPatientVitals
+{
+	float HeartRate = 0.0f;
+	float SystolicPressure = 0.0f;
+	float RespiratoryRate = 0.0f;
+	float OxygenSaturation = 0.0f;
+};
+
+// The patients of one incident, as a contiguous run of store indices. Invalidated when incidents are removed.
+struct PROJECTWILDFIRE_API FWfPatientView
+{
+	int32 Start = 0;
+	int32 Num = 0;
+
+	int32 GetStoreIndex(const int32 PatientIndex) const { return Start + PatientIndex; }
+	bool IsValidIndex(const int32 PatientIndex) const { return PatientIndex >= 0 && PatientIndex < Num; }
+};
+
+
+/**
+ * \brief Every active patient from every incident, in flat structure-of-arrays.
+ *  Patients of an incident are kept contiguous, so an incident is a view (start and count) into the store.
+ *  Step() advances deterioration, treatment and vitals for all patients in a single branch-free loop;
+ *  a mass casualty incident adds array entries, not actors or timers.
+ *  Owned by AGameManager, server only.
+ */
+class PROJECTWILDFIRE_API FWfPatientStore
+{
+public:
+
+	FWfPatientStore();
+
+	// Adds the patients of an incident, returning the incident id used for every other call
+	int32 AddIncident(TConstArrayView<FCalloutDataMedical> Patients);
+
+	// Removes the incident's patients, moving later incidents down to keep the arrays packed
+	void RemoveIncident(const int32 IncidentId);
+
+	bool IsValidIncident(const int32 IncidentId) const { return Incidents.IsValidIndex(IncidentId); }
+
+	FWfPatientView GetIncidentView(const int32 IncidentId) const;
+
+	/**
+	 * \brief Sets the treatment a patient is receiving, replacing any previous treatment
+	 * \param TreatmentPerSecond Condition removed per simulated second at difficulty 0; zero stops treatment
+	 */
+	void SetTreatment(const int32 IncidentId, const int32 PatientIndex, const float TreatmentPerSecond);
+
+	// Advances every patient by the simulated time
+	void Step(const float DeltaSeconds);
+
+	// Copies each patient's condition back into TaskProgress
+	void CopyToCallout(const int32 IncidentId, TArrayView<FCalloutDataMedical> OutPatients) const;
+
+	float GetCondition(const int32 StoreIndex) const { return Condition[StoreIndex]; }
+	float GetRefusalChance(const int32 StoreIndex) const { return RefusalChance[StoreIndex]; }
+	EWfPatientState GetState(const int32 StoreIndex) const;
+	FWfPatientVitals GetVitals(const int32 StoreIndex) const;
+
+	int32 GetNumPatients() const { return Condition.Num(); }
+	int32 GetNumIncidents() const { return Incidents.Num(); }
+
+	// Patients still getting worse as of the last step
+	int32 GetNumDeteriorating() const { return NumDeteriorating; }
+
+	void Reset();
+
+	// Condition gained per simulated second at difficulty 0; difficulty 1 deteriorates five times faster
+	float DeteriorationRate;
+
+	// How long a patient survives at critical condition
+	float CriticalSeconds;
+
+private:
+
+	struct FIncidentRange
+	{
+		int32 Start;
+		int32 Num;
+	};
+
+	TSparseArray<FIncidentRange> Incidents;
+
+	// Structure of arrays, indexed by store index
+	TArray<float> Condition;
+	TArray<float> Difficulty;
+	TArray<float> RefusalChance;
+	TArray<float> Treatment;
+	TArray<float> CriticalTime;
+
+	// 1 or 0, so the step can mask with a multiply instead of branching
+	TArray<float> Active;
+	TArray<float> Alive;
+
+	TArray<float> HeartRate;
+	TArray<float> SystolicPressure;
+	TArray<float> RespiratoryRate;
+	TArray<float> OxygenSaturation;
+
+	int32 NumDeteriorating;
+};
@@ -0,0 +1,158 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "Stats/Stats.h"
+#include "Trace/Trace.h"
+
+class FJsonObject;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSimTimings, Log, All);
+
+// "stat Wildfire" in the console; each cycle stat below is a WF_SCOPE_CYCLE somewhere on the server
+DECLARE_STATS_GROUP(TEXT("Wildfire"), STATGROUP_Wildfire, STATCAT_Advanced);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Assignments"),        STAT_WfAssignments,        STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Callout Generation"), STAT_WfCalloutGeneration,  STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Vox Resolution"),     STAT_WfVoxResolution,      STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Name Generation"),    STAT_WfNameGeneration,     STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Save I/O"),           STAT_WfSaveIO,             STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Assignments Made"),   STAT_WfNumAssignments,  STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Callouts Generated"), STAT_WfNumCallouts,     STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vox Phrases"),        STAT_WfNumVoxPhrases,   STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Names Generated"),    STAT_WfNumNames,        STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Saves Read/Written"), STAT_WfNumSaves,        STATGROUP_Wildfire, PROJECTWILDFIRE_API);
+
+// Every WF_SCOPE_ macro is a CPU event on this channel. Enable it in Unreal Insights, or with -trace=cpu,Wildfire
+UE_TRACE_CHANNEL_EXTERN(WildfireChannel, PROJECTWILDFIRE_API);
+
+// Wf.Stats.Enabled
+extern PROJECTWILDFIRE_API bool GWfStatsEnabled;
+
+
+// Time spent in one simulation system since the timings were last reset
+struct PROJECTWILDFIRE_API FWfSimTiming
+{
+	double TotalSeconds = 0.0;
+	double MaxSeconds = 0.0;
+	int32 NumCalls = 0;
+};
+
+/**
+ * \brief Wall time spent in each of the server's simulation systems (patients, hydraulics, fire, ...),
+ *  accumulated by WF_SCOPE_SIM_TIMING at the top of each step, and named event counts added by WF_COUNT.
+ *  Game thread only. Nothing is accumulated unless Wf.Stats.Enabled is set, so a scope costs one
+ *  branch when it is off; the stat and trace halves of the macros are free until "stat Wildfire" or the trace channel is on.
+ *  Read by the stress harness and by Wf.Stats.Dump, so a run can say which system a slow frame went to.
+ */
+class PROJECTWILDFIRE_API FWfSimTimings
+{
+public:
+
+	static FWfSimTimings& Get();
+
+	static bool IsEnabled() { return GWfStatsEnabled; }
+
+	static void SetEnabled(const bool bNewEnabled) { GWfStatsEnabled = bNewEnabled; }
+
+	void Add(const FName System, const double Seconds);
+
+	void AddCount(const FName Counter, const int64 Amount);
+
+	const TMap<FName, FWfSimTiming>& GetTimings() const { return Timings; }
+
+	const TMap<FName, int64>& GetCounters() const { return Counters; }
+
+	// Seconds since the last Reset(), as FPlatformTime::Seconds() measures them
+	double GetSecondsSinceReset() const;
+
+	void Reset();
+
+	// Adds "systems" and "counters" objects to the given JSON object
+	void WriteJson(FJsonObject& Root, const double WallSeconds) const;
+
+	// Opens a WF_SCOPE_CYCLE system. False if it is already open further up the stack.
+	bool EnterCycle(const FName System);
+
+	void ExitCycle();
+
+private:
+
+	TMap<FName, FWfSimTiming> Timings;
+	TMap<FName, int64> Counters;
+	double ResetSeconds = 0.0;
+
+	// WF_SCOPE_CYCLE systems open on the game thread, innermost last
+	TArray<FName, TInlineAllocator<8>> OpenCycles;
+};
+
+struct PROJECTWILDFIRE_API FWfScopedSimTiming
+{
+	explicit FWfScopedSimTiming(const FName InSystem, const bool bTimed = true)
+		: System(InSystem), StartSeconds(bTimed && FWfSimTimings::IsEnabled() ? FPlatformTime::Seconds() : -1.0)
+	{
+	}
+
+	~FWfScopedSimTiming()
+	{
+		if (StartSeconds >= 0.0)
+			FWfSimTimings::Get().Add(System, FPlatformTime::Seconds() - StartSeconds);
+	}
+
+private:
+
+	FName System;
+	double StartSeconds;
+};
+
+/**
+ * \brief Keeps a WF_SCOPE_CYCLE system open for its lifetime. A system entered again from inside itself
+ *  (an assignment made by a Blueprint hook that an assignment broadcast, ...) is only timed by its outermost scope.
+ */
+struct PROJECTWILDFIRE_API FWfScopedCycle
+{
+	explicit FWfScopedCycle(const FName System)
+		: bOutermost(FWfSimTimings::Get().EnterCycle(System))
+	{
+	}
+
+	~FWfScopedCycle()
+	{
+		FWfSimTimings::Get().ExitCycle();
+	}
+
+	bool IsOutermost() const { return bOutermost; }
+
+private:
+
+	bool bOutermost;
+};
+
+// Adds the time until the end of the enclosing scope to the named system, and traces it on the Wildfire channel
+#define WF_SCOPE_SIM_TIMING(System) \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR(System, WildfireChannel); \
+	static const FName PREPROCESSOR_JOIN(WfSimTimingName, __LINE__)(System); \
+	FWfScopedSimTiming PREPROCESSOR_JOIN(WfSimTiming, __LINE__)(PREPROCESSOR_JOIN(WfSimTimingName, __LINE__))
+
+// WF_SCOPE_SIM_TIMING, also counted under one of the cycle stats above. Only the outermost scope of a system counts.
+#define WF_SCOPE_CYCLE(Stat, System) \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL_STR(System, WildfireChannel); \
+	static const FName PREPROCESSOR_JOIN(WfCycleName, __LINE__)(System); \
+	const FWfScopedCycle PREPROCESSOR_JOIN(WfCycle, __LINE__)(PREPROCESSOR_JOIN(WfCycleName, __LINE__)); \
+	CONDITIONAL_SCOPE_CYCLE_COUNTER(Stat, PREPROCESSOR_JOIN(WfCycle, __LINE__).IsOutermost()); \
+	FWfScopedSimTiming PREPROCESSOR_JOIN(WfSimTiming, __LINE__)(PREPROCESSOR_JOIN(WfCycleName, __LINE__), PREPROCESSOR_JOIN(WfCycle, __LINE__).IsOutermost())
+
+// Adds to one of the counter stats above, and to the named counter in the dump
+#define WF_COUNT(Stat, Counter, Amount) \
+	do \
+	{ \
+		INC_DWORD_STAT_BY(Stat, Amount); \
+		if (FWfSimTimings::IsEnabled()) \
+		{ \
+			static const FName WfCounterName(Counter); \
+			FWfSimTimings::Get().AddCount(WfCounterName, Amount); \
+		} \
+	} while (0)
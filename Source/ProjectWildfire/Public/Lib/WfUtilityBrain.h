@@ -0,0 +1,189 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Lib/WfDenseIdMap.h"
+#include "UObject/ObjectKey.h"
+
+#include "WfUtilityBrain.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogBrain, Log, All);
+
+
+// What an AI character has decided to do
+UENUM(BlueprintType)
+enum class EWfUtilityAction : uint8
+{
+	Idle = 0,
+	Eat,
+	Drink,
+	Sleep,
+	Train,
+	MaintainApparatus,
+	Respond,
+	Num UMETA(Hidden)
+};
+
+// What decisions are scored from, each normalized to 0..1
+enum class EWfUtilityInput : uint8
+{
+	Hunger = 0,
+	Thirst,
+	Fatigue,
+	Morale,
+	OnDuty,
+	HasIncident,
+	HasApparatus,
+	Interacting,		// Busy with a prop; the current action is held on to harder
+	Num
+};
+
+enum class EWfUtilityCurve : uint8
+{
+	Linear = 0,			// Slope * (x - XShift) + YShift
+	Power,				// Slope * (x - XShift)^Exponent + YShift
+	Logistic			// 1 / (1 + e^(-Slope * (x - XShift))) + YShift
+};
+
+// One input, shaped by a response curve into a 0..1 factor of an action's score
+struct PROJECTWILDFIRE_API FWfConsideration
+{
+	EWfUtilityInput Input = EWfUtilityInput::Hunger;
+	EWfUtilityCurve Curve = EWfUtilityCurve::Linear;
+	float Slope = 1.0f;
+	float Exponent = 1.0f;
+	float XShift = 0.0f;
+	float YShift = 0.0f;
+
+	float Evaluate(const float Value) const;
+
+	// Evaluates Inputs[Indices[i]] into OutFactors[i] for every index, choosing the curve once for all of them
+	void EvaluateMany(const float* Inputs, TConstArrayView<int32> Indices, float* OutFactors) const;
+};
+
+struct PROJECTWILDFIRE_API FWfUtilityActionDef
+{
+	EWfUtilityAction Action = EWfUtilityAction::Idle;
+	float Weight = 1.0f;
+	TArray<FWfConsideration> Considerations;
+};
+
+struct FWfUtilityDecision
+{
+	int32 AgentId;
+	EWfUtilityAction Action;
+	float Score;
+};
+
+
+/**
+ * \brief Utility decisions for every AI character, in flat structure-of-arrays.
+ *  Each action's score is its weight times the product of its considerations, compensated for how many
+ *  there are. Agents are scored in chunks, one consideration at a time across the whole chunk.
+ *  A decision is kept until one of its agent's inputs moves by more than InputTolerance; on top of that,
+ *  agents are revisited in a rolling sweep once every ReevaluateSeconds, spread evenly over the updates.
+ *  Update() evaluates queued agents until its time budget runs out and leaves the rest for the next one,
+ *  so the cost per update stays flat however many agents there are.
+ *  Owned by AGameManager, server only; decisions are handed to the controllers from GetChanges().
+ */
+class PROJECTWILDFIRE_API FWfUtilityBrain
+{
+public:
+
+	FWfUtilityBrain();
+
+	// Adds an agent with every input at zero, queued for a decision. Returns its agent id.
+	int32 AddAgent(AActor* Agent);
+
+	// Swaps the last agent into the removed one's place; ids of other agents stay valid
+	void RemoveAgent(const int32 AgentId);
+
+	bool IsValidAgent(const int32 AgentId) const { return Ids.IsValidId(AgentId); }
+
+	int32 FindAgent(const AActor* Agent) const;
+
+	// Calls Function(AgentId, Agent) for every agent; the agent is nullptr if it was destroyed
+	template <typename FunctionType>
+	void ForEachAgent(FunctionType&& Function) const
+	{
+		for (int32 Index = 0; Index < Agents.Num(); ++Index)
+			Function(Ids.IdOf(Index), Agents[Index].ResolveObjectPtr());
+	}
+
+	AActor* GetAgent(const int32 AgentId) const;
+
+	// Queues the agent for a new decision if the value moved by more than InputTolerance
+	void SetInput(const int32 AgentId, const EWfUtilityInput Input, const float Value);
+
+	float GetInput(const int32 AgentId, const EWfUtilityInput Input) const;
+
+	void RequestEvaluation(const int32 AgentId);
+
+	EWfUtilityAction GetDecision(const int32 AgentId) const;
+
+	/**
+	 * \brief Sweeps agents due for a periodic decision into the queue, then evaluates the queue
+	 * \param DeltaSeconds Seconds since the last update
+	 * \param BudgetSeconds Evaluation stops once this is spent, after at least one chunk
+	 */
+	void Update(const float DeltaSeconds, const double BudgetSeconds);
+
+	// Decisions that changed during the last update
+	TConstArrayView<FWfUtilityDecision> GetChanges() const { return Changes; }
+
+	int32 GetNumAgents() const { return Agents.Num(); }
+	int32 GetNumQueued() const { return Queue.Num() - QueueHead; }
+	int32 GetNumEvaluated() const { return NumEvaluated; }
+
+	// Replaces the action table; every agent is queued for a new decision
+	void SetActions(TArray<FWfUtilityActionDef>&& NewActions);
+
+	static TArray<FWfUtilityActionDef> MakeDefaultActions();
+
+	void Reset();
+
+	// Smallest input change that invalidates a decision
+	float InputTolerance;
+
+	// Seconds between decisions of an agent whose inputs have not changed
+	float ReevaluateSeconds;
+
+	// Added to the current action's score, so close calls do not flip back and forth.
+	// An action its considerations score zero gets none, so an agent drops it once it no longer applies.
+	float Momentum;
+
+	// Further momentum while the agent is busy with a prop
+	float InteractingMomentum;
+
+private:
+
+	static constexpr int32 NumInputs = static_cast<int32>(EWfUtilityInput::Num);
+	static constexpr int32 ChunkSize = 64;
+
+	void Enqueue(const int32 Index);
+
+	void EvaluateChunk(TConstArrayView<int32> Indices);
+
+	TArray<FWfUtilityActionDef> Actions;
+
+	// Structure of arrays, indexed by dense index
+	TArray<float> Inputs[NumInputs];
+	TArray<EWfUtilityAction> Decisions;
+	TArray<bool> bQueued;
+	TArray<TObjectKey<AActor>> Agents;
+
+	// Agent ids, and the dense index of each
+	TWfDenseIdMap<> Ids;
+	TMap<TObjectKey<AActor>, int32> ActorToId;
+
+	// Agent ids waiting for a decision, oldest first from QueueHead
+	TArray<int32> Queue;
+	int32 QueueHead;
+
+	int32 SweepCursor;
+	float SweepCarry;
+
+	TArray<FWfUtilityDecision> Changes;
+	int32 NumEvaluated;
+};
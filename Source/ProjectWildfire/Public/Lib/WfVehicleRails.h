@@ -0,0 +1,207 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Lib/WfDenseIdMap.h"
+#include "UObject/ObjectKey.h"
+
+#include "WfVehicleRails.generated.h"
+
+class FWfRoadGraph;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogRails, Log, All);
+
+
+// How a vehicle following a route is moved
+UENUM(BlueprintType)
+enum class EWfRailMode : uint8
+{
+	None = 0,		// Not following a route; simulated like any vehicle
+	Kinematic,		// No physics; placed along the route by the store
+	Physics,		// Simulated, and steered along the route
+	Num UMETA(Hidden)
+};
+
+struct FWfRailTransition
+{
+	int32 VehicleId;
+	EWfRailMode From;
+	EWfRailMode To;
+};
+
+// Where a simulated vehicle should steer to stay on its route
+struct FWfRailSteering
+{
+	int32 VehicleId;
+	FVector Target;
+	float TargetSpeed;
+};
+
+
+/**
+ * \brief Moves vehicles along road graph routes without physics while nobody can see them.
+ *  A route is a polyline of road nodes with the time each node is reached, from the graph's edge times,
+ *  and is shared by every vehicle driving between the same two nodes until the graph changes. A vehicle
+ *  keeps only its own lead in and lead out (from where it is to the road, and from the road to where it
+ *  is going) and how far along the route it is, in seconds, so a Kinematic vehicle is placed by
+ *  advancing that time and interpolating one segment.
+ *  Vehicles within WakeRadius of an observer, or within RiskRadius of a vehicle that is off the rails or
+ *  near an observer, are handed back to physics and steered along the same route; their progress is then projected from
+ *  where they actually are, so they can drop back to Kinematic wherever they got to.
+ *  Owned by AGameManager, server only; the vehicles apply their own transitions.
+ */
+class PROJECTWILDFIRE_API FWfVehicleRails
+{
+public:
+
+	FWfVehicleRails();
+
+	// Adds a vehicle that is not following a route. Returns its vehicle id.
+	int32 AddVehicle(AActor* Vehicle, const FVector& Location);
+
+	// Swaps the last vehicle into the removed one's place; ids of other vehicles stay valid
+	void RemoveVehicle(const int32 VehicleId);
+
+	bool IsValidVehicle(const int32 VehicleId) const { return Ids.IsValidId(VehicleId); }
+
+	AActor* GetVehicle(const int32 VehicleId) const;
+
+	EWfRailMode GetMode(const int32 VehicleId) const;
+
+	FVector GetLocation(const int32 VehicleId) const;
+	float GetYaw(const int32 VehicleId) const;
+
+	// Velocity along the route; what a Kinematic vehicle is given when it goes back to physics
+	FVector GetVelocity(const int32 VehicleId) const;
+
+	// Where a vehicle that is not Kinematic is; read from the pawn before each update
+	void SetLocation(const int32 VehicleId, const FVector& Location);
+
+	/**
+	 * \brief Routes the vehicle from where it is to the destination, over the road nearest each
+	 * \param OffRoadSpeed Speed between a location and the road, in cm/s
+	 * \return False if there is no open route; the vehicle is left as it was
+	 */
+	bool StartRoute(const int32 VehicleId, const FWfRoadGraph& Graph, const FVector& Destination, const float OffRoadSpeed);
+
+	// The vehicle leaves its route; a Kinematic vehicle goes back to physics on the next update
+	void StopRoute(const int32 VehicleId);
+
+	bool IsOnRoute(const int32 VehicleId) const;
+
+	/**
+	 * \brief The road graph edges the vehicle is driving and will drive next, INDEX_NONE off the road
+	 * \return False if neither is known, as when the graph changed since the route was found
+	 */
+	bool GetRouteEdges(const int32 VehicleId, const FWfRoadGraph& Graph, int32& OutEdge, int32& OutNextEdge) const;
+
+	// Calls Function(VehicleId, Vehicle, Mode) for every vehicle; the vehicle is nullptr if it was destroyed
+	template <typename FunctionType>
+	void ForEachVehicle(FunctionType&& Function) const
+	{
+		for (int32 Index = 0; Index < Vehicles.Num(); ++Index)
+			Function(Ids.IdOf(Index), Vehicles[Index].ResolveObjectPtr(), Modes[Index]);
+	}
+
+	/**
+	 * \brief Advances every vehicle on a route, then picks how each one is moved
+	 * \param Observers Where the players are looking from
+	 * \param DeltaSeconds Seconds since the last update
+	 */
+	void Update(TConstArrayView<FVector> Observers, const float DeltaSeconds);
+
+	// Mode changes made by the last update
+	TConstArrayView<FWfRailTransition> GetTransitions() const { return Transitions; }
+
+	// Vehicles placed by the last update; their pawns are moved to GetLocation() and GetYaw()
+	TConstArrayView<int32> GetMoved() const { return Moved; }
+
+	// Steering for every vehicle simulated along its route
+	TConstArrayView<FWfRailSteering> GetSteering() const { return Steering; }
+
+	// Vehicles that reached their destination during the last update; their route is already stopped
+	TConstArrayView<int32> GetArrivals() const { return Arrivals; }
+
+	int32 GetNumVehicles() const { return Vehicles.Num(); }
+	int32 GetNumInMode(const EWfRailMode Mode) const;
+	int32 GetNumRoutes() const { return Routes.Num(); }
+
+	void Reset();
+
+	// Within this of an observer, vehicles are simulated
+	float WakeRadius;
+
+	// Within this of a vehicle off the rails or near an observer, vehicles are simulated too, so they can collide
+	float RiskRadius;
+
+	// Fraction past a radius a vehicle must be to go back to Kinematic
+	float Hysteresis;
+
+	// How far ahead along the route a simulated vehicle steers to
+	float LookAheadDistance;
+
+	// A simulated vehicle this close to its destination has arrived
+	float ArriveDistance;
+
+private:
+
+	struct FRoute
+	{
+		TArray<FVector> Points;
+		// Seconds from the first point to each point
+		TArray<float> Times;
+		// The road graph node of each point, as of GraphVersion
+		TArray<int32> Nodes;
+		uint32 GraphVersion = 0;
+		uint64 Key = 0;
+		int32 NumUsers = 0;
+	};
+
+	// Per vehicle; the segments are the lead in, the route's segments, then the lead out
+	struct FTrip
+	{
+		int32 RouteIndex = INDEX_NONE;
+		FVector Start = FVector::ZeroVector;
+		FVector End = FVector::ZeroVector;
+		float LeadInTime = 0.0f;
+		float LeadOutTime = 0.0f;
+		int32 Segment = 0;
+		float Time = 0.0f;
+	};
+
+	int32 AcquireRoute(const FWfRoadGraph& Graph, const int32 FromNode, const int32 ToNode);
+	void ReleaseRoute(const int32 RouteIndex);
+
+	int32 GetNumSegments(const FTrip& Trip) const;
+	void GetSegment(const FTrip& Trip, const int32 Segment, FVector& OutFrom, FVector& OutTo, float& OutFromTime, float& OutToTime) const;
+
+	// Advances the trip's time and places the vehicle. Returns true once the end is reached.
+	bool AdvanceKinematic(const int32 Index, const float DeltaSeconds);
+
+	// Projects the vehicle's location on the trip and works out its steering. Returns true once the end is reached.
+	bool TrackPhysics(const int32 Index);
+
+	// Structure of arrays, indexed by dense index
+	TArray<TObjectKey<AActor>> Vehicles;
+	TArray<FVector> Locations;
+	TArray<float> Yaws;
+	TArray<EWfRailMode> Modes;
+	TArray<FTrip> Trips;
+
+	// Vehicle ids, and the dense index of each
+	TWfDenseIdMap<> Ids;
+
+	// Routes by their end nodes; dropped when the last vehicle leaves them or the graph changes
+	TSparseArray<FRoute> Routes;
+	TMap<uint64, int32> RouteCache;
+	uint32 RouteGraphVersion;
+
+	// Vehicles that are a risk to others, and which vehicles are near an observer, for the current update
+	TArray<FVector> SimulatedLocations;
+	TBitArray<> NearObserver;
+	TArray<FWfRailTransition> Transitions;
+	TArray<int32> Moved;
+	TArray<FWfRailSteering> Steering;
+	TArray<int32> Arrivals;
+};
@@ -0,0 +1,26 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+
+#include "WfJournalDecodeCommandlet.generated.h"
+
+
+/**
+ * \brief Decodes an incident journal (see FWfIncidentJournal) to text.
+ *  UnrealEditor-Cmd ProjectWildfire -run=WfJournalDecode <JournalPath> [-Out=<TextPath>]
+ *  Without -Out, the text goes to the log.
+ */
+UCLASS()
+class PROJECTWILDFIRE_API UWfJournalDecodeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UWfJournalDecodeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
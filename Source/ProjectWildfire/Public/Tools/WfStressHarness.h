@@ -0,0 +1,129 @@
+﻿// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Lib/WfIncidentLifecycle.h"
+
+#include "WfStressHarness.generated.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogStress, Log, All);
+
+
+USTRUCT(BlueprintType)
+struct PROJECTWILDFIRE_API FWfStressSettings
+{
+	GENERATED_BODY()
+
+	// How long the run lasts, in world seconds
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) float DurationSeconds = 300.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) float CalloutsPerMinute = 60.0f;
+
+	// Simulated seconds per world second for the run
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) float SimTimeRate = 60.0f;
+
+	// Dispatch, assign, arrive and work every incident like players would; otherwise incidents are left to expire
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) bool bSimulateAssignments = true;
+
+	// World seconds between an incident being dispatched and its units arriving
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) float TravelSeconds = 20.0f;
+
+	// Where the report is written. Defaults to Saved/Stress/Stress-<time>.json
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) FString ReportPath;
+
+	// Quits the process once the report is written, for headless runs
+	UPROPERTY(EditAnywhere, BlueprintReadWrite) bool bExitWhenDone = false;
+};
+
+
+/**
+ * \brief Loads the server with callouts for a fixed time and writes what it cost as JSON.
+ *  Callouts are generated at a steady rate through the callouts manager and, optionally, worked
+ *  through their whole lifecycle. Frame time, memory, GC pauses, replicated bytes and the time
+ *  spent in each simulation system (see FWfSimTimings) are recorded for the report.
+ *  Runs headless on a dedicated server:
+ *  ProjectWildfireServer MapName -nullrhi -ExecCmds="Wf.Stress.Run 300 120 60" -WfStressExit
+ */
+UCLASS(NotBlueprintable)
+class PROJECTWILDFIRE_API AWfStressHarness : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	AWfStressHarness();
+
+	// Spawns a harness and starts a run. Server only; returns nullptr on clients, or if the run could not start.
+	static AWfStressHarness* StartRun(UWorld* World, const FWfStressSettings& Settings);
+
+	virtual void Tick(float DeltaSeconds) override;
+
+protected:
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	bool BeginRun(const FWfStressSettings& NewSettings);
+
+	void GenerateCallout();
+
+	// Moves every active incident one step further along, as a player would
+	void SimulateAssignments();
+
+	void WorkIncident(const int IncidentNumber);
+
+	void FinishRun();
+
+	// Builds the report from everything recorded, and writes it to the report path
+	bool WriteReport(const FString& Path) const;
+
+	UFUNCTION()
+	void OnIncidentStateChanged(const int IncidentNumber, const EWfIncidentState NewState);
+
+	void OnPreGarbageCollect();
+	void OnPostGarbageCollect();
+
+	FWfStressSettings Settings;
+
+	FTimerHandle CalloutTimerHandle;
+	FTimerHandle AssignmentTimerHandle;
+	FTimerHandle FinishTimerHandle;
+
+	// World seconds each active incident was dispatched, the ones already given units, and the ones already being worked
+	TMap<int32, double> DispatchedSeconds;
+	TSet<int32> AssignedIncidents;
+	TSet<int32> WorkedIncidents;
+
+	// Seconds between consecutive ticks, one per frame of the run
+	TArray<float> FrameSeconds;
+	double LastFrameTime = 0.0;
+
+	double RunStartTime = 0.0;
+	FDateTime RunStartUtc;
+	float PreviousSimTimeRate = 1.0f;
+	bool bPreviousStatsEnabled = false;
+
+	uint64 StartUsedMemory = 0;
+	uint64 PeakUsedMemory = 0;
+	uint64 StartOutBytes = 0;
+	uint64 StartOutPackets = 0;
+
+	double GcStartSeconds = 0.0;
+	double GcTotalSeconds = 0.0;
+	double GcMaxSeconds = 0.0;
+	int32 NumGcRuns = 0;
+
+	int32 NumGenerated = 0;
+	int32 NumClosed = 0;
+	int32 NumExpired = 0;
+	int32 PeakActiveIncidents = 0;
+	int32 NumAssignedApparatus = 0;
+
+	FDelegateHandle PreGcHandle;
+	FDelegateHandle PostGcHandle;
+
+	bool bRunning = false;
+};
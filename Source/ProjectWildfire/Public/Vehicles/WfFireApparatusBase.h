@@ -5,6 +5,7 @@
 #include "CoreMinimal.h"
 #include "WfVehicleBase.h"
 #include "Delegates/Delegate.h"
+#include "Lib/WfEquipmentData.h"
 
 #include "WfFireApparatusBase.generated.h"
 
@@ -37,6 +38,19 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetFirefighterAssigned(AWfFfCharacterBase* FireFighter, const bool bAssign = true);
 
+	// The firefighters in the apparatus' seats, in seat order. The seats are the apparatus' crew list.
+	UFUNCTION(BlueprintPure)
+	TArray<AWfFfCharacterBase*> GetSeatedFirefighters() const;
+
+	// Lights and sirens. Civilian traffic pulls over for apparatus running with them.
+	UFUNCTION(BlueprintCallable)
+	void SetEmergencyLights(const bool bEnabled);
+
+	UFUNCTION(BlueprintPure) bool GetEmergencyLights() const { return bEmergencyLights; }
+
+	// Running with lights on, or driving a dispatched route
+	UFUNCTION(BlueprintPure) bool IsResponding() const;
+
 	UFUNCTION(BlueprintPure) FString GetApparatusIdentity() const;
 	UFUNCTION(BlueprintPure) int32 GetApparatusIdentityStation() const { return IdentityStation; }
 	UFUNCTION(BlueprintPure) FString GetApparatusIdentityType() const { return IdentityType; }
@@ -64,6 +78,9 @@ protected:
 	UFUNCTION(Server, Reliable)
 	void Server_SetFirefighterAssigned(AWfFfCharacterBase* FireFighter, const bool bAssign);
 
+	UFUNCTION(Server, Reliable)
+	void Server_SetEmergencyLights(const bool bEnabled);
+
 public: // Public Members
 
 	UPROPERTY(BlueprintAssignable) FOnApparatusIdentityChanged OnApparatusIdentityChanged;
@@ -71,6 +88,21 @@ public: // Public Members
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Settings")
 	FString FireApparatusType = "None";
 
+	// Equipment this apparatus carries, and the most of each it can hold. Spawns fully stocked.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Actor Settings")
+	TMap<TSubclassOf<UEquipmentDataAsset>, float> EquipmentLoadout;
+
+	// Water carried on board, in gallons. Zero for apparatus without a tank.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Actor Settings")
+	float TankGallons = 500.0f;
+
+	// The pump's rated flow (gpm) and pressure (psi). A zero flow means the apparatus has no pump.
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Actor Settings")
+	float PumpRatedGpm = 1500.0f;
+
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category = "Actor Settings")
+	float PumpRatedPsi = 150.0f;
+
 private: // Private Members
 
 	UFUNCTION(NetMulticast, Reliable) void OnRep_IdentityOverride(const FString& OldIdentityValue);
@@ -86,4 +118,6 @@ private: // Private Members
 	UPROPERTY(ReplicatedUsing=OnRep_IdentityUnique)    int32   IdentityUnique;
 
 	UPROPERTY(Replicated) TArray<AWfFfCharacterBase*> AssignedFirefighters;
+
+	UPROPERTY(Replicated) bool bEmergencyLights = false;
 };
@@ -6,9 +6,11 @@
 #include "WfVehicleData.h"
 #include "WheeledVehiclePawn.h"
 #include "Delegates/Delegate.h"
+#include "Lib/WfVehicleRails.h"
 
 #include "WfVehicleBase.generated.h"
 
+class AGameManager;
 class UChaosVehicleWheel;
 class AWfCharacterBase;
 class UInputComponent;
@@ -20,6 +22,7 @@ struct FInputActionValue;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnSeatOccupantChanged,
 	const AWfCharacterBase*, OldOccupant, const AWfCharacterBase*, NewOccupant, const int, SeatNumber);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnVehicleArrived);
 
 
 /**
@@ -41,15 +44,72 @@ public:
 
 	virtual void SetupPlayerInputComponent(UInputComponent* PlayerInputComponent) override;
 
+	// Server only. Seats the character, or empties the seat when the character is null. Fails if the seat is taken.
 	UFUNCTION(BlueprintCallable)
-	void SetSeatOccupant(const int SeatNumber, AWfCharacterBase* SeatCharacter = nullptr);
+	bool SetSeatOccupant(const int SeatNumber, AWfCharacterBase* SeatCharacter = nullptr);
 
 	UFUNCTION(BlueprintPure)
 	AWfCharacterBase* GetSeatOccupant(const int SeatNumber) const;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Settings")
+	// Server only. Empties whichever seat the character is in.
+	UFUNCTION(BlueprintCallable)
+	bool ClearSeatOccupant(const AWfCharacterBase* SeatCharacter);
+
+	// Lowest numbered free seat with the role, or -1 if every one is taken
+	UFUNCTION(BlueprintPure)
+	int FindFreeSeat(const EWfSeatRole Role) const { return VehicleSeats.FindFreeSeat(Role); }
+
+	// Lowest numbered free seat of any role, or -1 if the vehicle is full
+	UFUNCTION(BlueprintPure)
+	int FindAnyFreeSeat() const { return VehicleSeats.FindAnyFreeSeat(); }
+
+	// The seat the character is in, or -1
+	UFUNCTION(BlueprintPure)
+	int FindOccupantSeat(const AWfCharacterBase* SeatCharacter) const { return VehicleSeats.FindSeat(SeatCharacter); }
+
+	// The free seat the character's role should take, or -1 if the vehicle is full. See GetSeatRole().
+	UFUNCTION(BlueprintPure)
+	int FindSeatForCharacter(const AWfCharacterBase* SeatCharacter) const;
+
+	// Engineers drive, captains and chief officers ride as officer, other firefighters as crew, everyone else as a passenger
+	static EWfSeatRole GetSeatRole(const FGameplayTag& CharacterRole);
+
+	UFUNCTION(BlueprintPure)
+	int GetNumFreeSeats() const { return VehicleSeats.GetNumFree(); }
+
+	const FWfVehicleSeats& GetVehicleSeats() const { return VehicleSeats; }
+
+	/**
+	 * \brief Drives to the destination over the road network. Server only.
+	 *  Out of sight the vehicle is moved kinematically along the route; near a player it is simulated and steered.
+	 * \return False if there is no open route
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Driving")
+	bool DriveTo(const FVector& Destination);
+
+	// Leaves the route where the vehicle is, and hands it back to physics
+	UFUNCTION(BlueprintCallable, Category = "Driving")
+	void StopDriving();
+
+	UFUNCTION(BlueprintPure, Category = "Driving")
+	EWfRailMode GetRailMode() const { return RailMode; }
+
+	// The road graph edges of the route being driven, now and next. Only the server knows the route.
+	bool GetRouteEdges(const FWfRoadGraph& Graph, int32& OutEdge, int32& OutNextEdge) const;
+
+	// Called by the game manager as the vehicle rails move the vehicle
+	void SetRailMode(const EWfRailMode NewMode, const FVector& Velocity);
+	void SetRailTransform(const FVector& Location, const float Yaw);
+	void SteerTowards(const FVector& Target, const float TargetSpeed);
+	void FinishRoute();
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Settings", meta = (ClampMin = 1, ClampMax = 64))
 	int NumberOfSeats = 2;
 
+	// Role of each seat by seat number; seats past the end of the list are crew seats
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Settings")
+	TArray<EWfSeatRole> SeatRoles = { EWfSeatRole::Driver, EWfSeatRole::Officer };
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Actor Settings")
 	int VehicleYear;
 
@@ -76,11 +136,23 @@ public:
 
 	UPROPERTY(BlueprintAssignable) FOnSeatOccupantChanged OnSeatOccupantChanged;
 
+	UPROPERTY(BlueprintAssignable) FOnVehicleArrived OnVehicleArrived;
+
+	// Height of the actor above the road while it is moved kinematically
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Driving")
+	float RailHeightOffset = 0.0f;
+
+	// Steering angle, in degrees, that a simulated vehicle following a route treats as full lock
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Driving")
+	float MaxSteeringAngle = 35.0f;
+
 protected:
 
 	virtual void BeginPlay() override;
 
-	virtual void OnConstruction(const FTransform& Transform) override;
+	virtual void PostInitializeComponents() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	virtual void SetupMappingContexts();
 
@@ -110,7 +182,13 @@ private:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Input", meta = (AllowPrivateAccess = "true"))
 	UInputAction* HandbrakeAction;
 
-	UFUNCTION(NetMulticast, Reliable) void OnRep_VehicleSeatsUpdated(const TArray<FVehicleSeat>& OldSeats);
-	UPROPERTY(ReplicatedUsing=OnRep_VehicleSeatsUpdated) TArray<FVehicleSeat> VehicleSeats;
+	// Replicated per seat; OnSeatOccupantChanged fires on both sides as seats change
+	UPROPERTY(Replicated) FWfVehicleSeats VehicleSeats;
+
+	// Replicated so clients can tell which vehicles are driving a route; only the server moves them
+	UPROPERTY(Replicated) EWfRailMode RailMode = EWfRailMode::None;
+
+	TWeakObjectPtr<AGameManager> RailsManager;
+	int32 RailsId = INDEX_NONE;
 
 };
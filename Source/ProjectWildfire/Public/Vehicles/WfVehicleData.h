@@ -4,21 +4,151 @@
 
 #include "CoreMinimal.h"
 #include "Characters/WfCharacterBase.h"
+#include "Net/Serialization/FastArraySerializer.h"
 
 #include "WfVehicleData.generated.h"
 
+class AWfVehicleBase;
+
+
+UENUM(BlueprintType)
+enum class EWfSeatRole : uint8
+{
+	Driver,
+	Officer,
+	Crew,
+	Passenger,
+	Num UMETA(Hidden)
+};
 
 USTRUCT(BlueprintType)
-struct PROJECTWILDFIRE_API FVehicleSeat
+struct PROJECTWILDFIRE_API FVehicleSeat : public FFastArraySerializerItem
 {
 	GENERATED_BODY()
 
 	FVehicleSeat();
-	explicit FVehicleSeat(int NewSeatNumber);
+	explicit FVehicleSeat(int NewSeatNumber, EWfSeatRole NewRole = EWfSeatRole::Crew);
+
+	// Clients only; keep the owner's occupancy bits current and fire its seat delegate
+	void PostReplicatedAdd(const struct FWfVehicleSeats& InArraySerializer);
+	void PostReplicatedChange(const struct FWfVehicleSeats& InArraySerializer);
+	void PreReplicatedRemove(const struct FWfVehicleSeats& InArraySerializer);
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vehicle Seats")
 	int SeatNumber;
 
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vehicle Seats")
+	EWfSeatRole Role;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Vehicle Seats")
 	AWfCharacterBase* SeatOccupant;
+
+	// Not replicated; the occupant the last change was broadcast with
+	TWeakObjectPtr<AWfCharacterBase> LastOccupant;
+};
+
+
+/**
+ * \brief Fixed seats of a vehicle, addressed by seat number, with occupancy kept as a bitmask.
+ *  Each role has a mask of the seats it can use, so the first free seat for a role is one
+ *  count-trailing-zeros of (role mask & ~occupied). Occupants are also mapped back to their seat.
+ *  Replicated as a fast array, so a change sends only the seats that changed; the masks are not
+ *  replicated and are rebuilt from the seats on each side. Limited to MaxSeats seats.
+ *  Clients receive the seats in any order, so Items is never indexed by seat number; SeatItems maps one to the other.
+ */
+USTRUCT()
+struct PROJECTWILDFIRE_API FWfVehicleSeats : public FFastArraySerializer
+{
+	GENERATED_BODY()
+
+	static constexpr int32 MaxSeats = 64;
+
+	FWfVehicleSeats();
+
+	// Server only. Replaces every seat; seats without a role in Roles are crew seats.
+	void Init(AWfVehicleBase* InOwner, const int32 NumSeats, TConstArrayView<EWfSeatRole> Roles);
+
+	// The owner is not replicated, so clients set it before the first seats arrive
+	void SetOwner(AWfVehicleBase* InOwner) { Owner = InOwner; }
+
+	int32 Num() const { return Items.Num(); }
+	bool IsValidSeat(const int32 SeatNumber) const { return FindItem(SeatNumber) != nullptr; }
+	bool IsSeatFree(const int32 SeatNumber) const { return IsValidSeat(SeatNumber) && (OccupiedMask & SeatBit(SeatNumber)) == 0; }
+
+	AWfCharacterBase* GetOccupant(const int32 SeatNumber) const;
+	EWfSeatRole GetRole(const int32 SeatNumber) const;
+
+	// Everyone seated, in seat order
+	void GetOccupants(TArray<AWfCharacterBase*>& OutOccupants) const;
+
+	// The seat the character is in, or INDEX_NONE
+	int32 FindSeat(const AWfCharacterBase* Character) const;
+
+	// Lowest numbered free seat with the role, or INDEX_NONE
+	int32 FindFreeSeat(const EWfSeatRole Role) const { return FirstSeat(RoleMasks[static_cast<int32>(Role)] & ~OccupiedMask); }
+
+	// Lowest numbered free seat of any role, or INDEX_NONE
+	int32 FindAnyFreeSeat() const { return FirstSeat(AllSeatsMask & ~OccupiedMask); }
+
+	/**
+	 * \brief The seat a character of the role should take: a free seat of the role, then a crew seat, then a
+	 *  passenger seat. Driver and officer seats are only given to other roles when nothing else is free.
+	 */
+	int32 FindSeatForRole(const EWfSeatRole Role) const;
+
+	int32 GetNumOccupied() const { return FMath::CountBits(OccupiedMask); }
+	int32 GetNumFree() const { return FMath::CountBits(AllSeatsMask & ~OccupiedMask); }
+	uint64 GetOccupiedMask() const { return OccupiedMask; }
+
+	/**
+	 * \brief Server only. Puts the character in the seat, or empties it when the character is null.
+	 *  Fails if the seat is taken by someone else; a character already in another seat moves.
+	 */
+	bool SetOccupant(const int32 SeatNumber, AWfCharacterBase* Character);
+
+	// Server only. Empties the character's seat, if it has one.
+	bool ClearOccupant(const AWfCharacterBase* Character);
+
+	// Called by the seats as they replicate
+	void OnSeatReplicated(FVehicleSeat& Seat, const bool bRemoved);
+
+	// Seats removed in a replication update shift the items after them
+	void PostReplicatedReceive(const FFastArraySerializer::FPostReplicatedReceiveParameters& Parameters);
+
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+	{
+		return FFastArraySerializer::FastArrayDeltaSerialize<FVehicleSeat, FWfVehicleSeats>(Items, DeltaParms, *this);
+	}
+
+	UPROPERTY()
+	TArray<FVehicleSeat> Items;
+
+private:
+
+	static uint64 SeatBit(const int32 SeatNumber) { return uint64(1) << SeatNumber; }
+	static int32 FirstSeat(const uint64 Mask) { return Mask != 0 ? static_cast<int32>(FMath::CountTrailingZeros64(Mask)) : INDEX_NONE; }
+
+	void SetOccupiedBit(const int32 SeatNumber, AWfCharacterBase* Character);
+
+	const FVehicleSeat* FindItem(const int32 SeatNumber) const;
+
+	void RebuildSeatItems();
+
+	UPROPERTY(NotReplicated)
+	TObjectPtr<AWfVehicleBase> Owner = nullptr;
+
+	uint64 OccupiedMask = 0;
+	uint64 AllSeatsMask = 0;
+	uint64 RoleMasks[static_cast<int32>(EWfSeatRole::Num)] = {};
+
+	TMap<TObjectKey<AWfCharacterBase>, int32> OccupantSeats;
+
+	// Index in Items of each seat number, or INDEX_NONE
+	int8 SeatItems[MaxSeats];
+};
+
+template<>
+struct TStructOpsTypeTraits<FWfVehicleSeats> : public TStructOpsTypeTraitsBase2<FWfVehicleSeats>
+{
+	enum { WithNetDeltaSerializer = true };
 };